@@ -56,6 +56,8 @@ i32 main(i32 argc, char* argv[])
 		.max_num_concurrent_downloads = 1024,
 		.max_num_textures_per_type = 1024,
 		.max_num_kernels = 128,
+		.kernel_cache_dir = "gpu_lib_kernel_cache",
+		.kernel_hot_reload = true,
 		
 		.native_window_handle = window_handle,
 		.allow_tearing = true,
@@ -113,14 +115,14 @@ i32 main(i32 argc, char* argv[])
 		initial_gpu_timestamp = gpuGetDownloadedData<u64>(gpu, ticket);
 	}
 
-	GpuTicket timestamp_tickets[GPU_NUM_CONCURRENT_SUBMITS] = {};
+	GpuTicket timestamp_tickets[GPU_MAX_NUM_CONCURRENT_SUBMITS] = {};
 	auto getCurrTimestampTicket = [&]() -> GpuTicket& {
-		return timestamp_tickets[gpuGetCurrSubmitIdx(gpu) % GPU_NUM_CONCURRENT_SUBMITS];
+		return timestamp_tickets[gpuGetCurrSubmitIdx(gpu) % gpuGetNumConcurrentSubmits(gpu)];
 	};
 
-	GpuTicket big_chunk_tickets[GPU_NUM_CONCURRENT_SUBMITS] = {};
+	GpuTicket big_chunk_tickets[GPU_MAX_NUM_CONCURRENT_SUBMITS] = {};
 	auto getCurrBigChunkTicket = [&]() -> GpuTicket& {
-		return big_chunk_tickets[gpuGetCurrSubmitIdx(gpu) % GPU_NUM_CONCURRENT_SUBMITS];
+		return big_chunk_tickets[gpuGetCurrSubmitIdx(gpu) % gpuGetNumConcurrentSubmits(gpu)];
 	};
 
 	GpuRWTex tex = GPU_NULL_RWTEX;
@@ -203,8 +205,6 @@ i32 main(i32 argc, char* argv[])
 			i32x2 res;
 			GpuPtr color_ptr;
 			GpuRWTex tex_idx;
-			u16 padding;
-			
 		} params;
 		params.res = res;
 		params.color_ptr = color_ptr;
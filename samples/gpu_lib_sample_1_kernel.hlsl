@@ -9,7 +9,6 @@ cbuffer LaunchParams : register(b0) {
 	i32x2 res;
 	GpuPtr color_ptr;
 	GpuRWTex tex_idx;
-	u16 padding;
 }
 
 [numthreads(16, 16, 1)]
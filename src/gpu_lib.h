@@ -7,10 +7,14 @@
 // Constants
 // ------------------------------------------------------------------------------------------------
 
-// This constant defines the number of command lists that can be in-flight at the same time. It's
-// important for synchronization, if you are downloading data from the GPU every frame you should
-// typically have a lag of this many frames before you get the data.
-sfz_constant u32 GPU_NUM_CONCURRENT_SUBMITS = 3;
+// The number of command lists that can be in-flight at the same time, see
+// GpuLibInitCfg::num_concurrent_submits. It's important for synchronization, if you are downloading
+// data from the GPU every frame you should typically have a lag of this many frames before you get
+// the data.
+sfz_constant u32 GPU_DEFAULT_NUM_CONCURRENT_SUBMITS = 3;
+sfz_constant u32 GPU_MIN_NUM_CONCURRENT_SUBMITS = 2;
+sfz_constant u32 GPU_MAX_NUM_CONCURRENT_SUBMITS = 8;
+sfz_constant u32 GPU_WAIT_INFINITE = U32_MAX;
 
 sfz_constant u32 GPU_HEAP_SYSTEM_RESERVED_SIZE = 8 * 1024 * 1024;
 sfz_constant u32 GPU_HEAP_MIN_SIZE = GPU_HEAP_SYSTEM_RESERVED_SIZE;
@@ -18,8 +22,17 @@ sfz_constant u32 GPU_HEAP_MAX_SIZE = U32_MAX;
 sfz_constant u32 GPU_TEXTURES_MIN_NUM = 2;
 sfz_constant u32 GPU_TEXTURES_MAX_NUM = 16384;
 sfz_constant u32 GPU_LAUNCH_PARAMS_MAX_SIZE = sizeof(u32) * 12;
-sfz_constant u32 GPU_KERNEL_MAX_NUM_DEFINES = 8;
-sfz_constant u32 GPU_KERNEL_DEFINE_MAX_LEN = 48;
+sfz_constant u32 GPU_LAUNCH_PARAMS_LARGE_MAX_SIZE = 4096;
+sfz_constant u32 GPU_KERNEL_MAX_NUM_DEFINES = 16;
+sfz_constant u32 GPU_KERNEL_DEFINE_MAX_LEN = 96; // Including null-terminator, longer defines are truncated
+sfz_constant u64 GPU_KERNEL_CACHE_DEFAULT_MAX_SIZE = 256 * 1024 * 1024;
+sfz_constant u32 GPU_KERNEL_MAX_NUM_AXES = 8;
+sfz_constant u32 GPU_KERNEL_MAX_NUM_PERMUTATIONS = 4096;
+sfz_constant u32 GPU_KERNEL_AXIS_NAME_MAX_LEN = GPU_KERNEL_DEFINE_MAX_LEN - 6; // Room for "=<value>"
+sfz_constant u32 GPU_LAUNCH_PARAMS_MAX_NUM_MEMBERS = 32;
+sfz_constant u32 GPU_LAUNCH_PARAM_NAME_MAX_LEN = 32;
+sfz_constant u32 GPU_INDIRECT_ARGS_MAX_NUM_PER_SUBMIT = 4096;
+sfz_constant u32 GPU_CMD_CONTEXTS_MAX_NUM = 64;
 
 
 // Init API
@@ -36,6 +49,22 @@ sfz_struct(GpuLibInitCfg) {
 	u32 max_num_concurrent_downloads;
 	u32 max_num_textures_per_type;
 	u32 max_num_kernels;
+
+	// Number of submits that can be in-flight at the same time, also the number of swapchain
+	// framebuffers. 0 means GPU_DEFAULT_NUM_CONCURRENT_SUBMITS, otherwise clamped to
+	// [GPU_MIN_NUM_CONCURRENT_SUBMITS, GPU_MAX_NUM_CONCURRENT_SUBMITS].
+	u32 num_concurrent_submits;
+
+	// Directory to store compiled kernels in, nullptr disables the kernel cache. Several processes
+	// may share the same directory. A max size of 0 means GPU_KERNEL_CACHE_DEFAULT_MAX_SIZE, the
+	// size includes the pipeline library (driver compiled PSOs) stored in the same directory.
+	const char* kernel_cache_dir;
+	u64 kernel_cache_max_size_bytes;
+
+	// Watch the source files (and includes) of all kernels, recompile them in the background when
+	// changed and swap them in at the next submit. GpuKernel handles stay valid. Requires a
+	// thread-safe cpu_allocator.
+	bool kernel_hot_reload;
 	
 	void* native_window_handle;
 	bool allow_tearing;
@@ -93,10 +122,18 @@ typedef enum {
 	GPU_FORMAT_RG_F32,
 	GPU_FORMAT_RGBA_F32,
 
+	// Block compressed formats, can only be used for read-only textures (not GpuRWTex). See
+	// gpu_lib_bc.h for a CPU encoder.
+	GPU_FORMAT_BC1_UNORM, // RGB, 4 bits per pixel
+	GPU_FORMAT_BC4_UNORM, // R, 4 bits per pixel
+	GPU_FORMAT_BC5_UNORM, // RG, 8 bits per pixel
+	GPU_FORMAT_BC7_UNORM, // RGBA, 8 bits per pixel
+
 	GPU_FORMAT_FORCE_I32 = I32_MAX
 } GpuFormat;
 
 sfz_extern_c const char* gpuFormatToString(GpuFormat format);
+sfz_extern_c u32 gpuFormatGetBytesPerPixel(GpuFormat format); // 0 for block compressed formats
 
 sfz_struct(GpuRWTexDesc) {
 	const char* name;
@@ -166,6 +203,15 @@ sfz_struct(GpuKernelDesc) {
 };
 
 sfz_extern_c GpuKernel gpuKernelInit(GpuLib* gpu, const GpuKernelDesc* desc);
+
+// Initializes several kernels at once. Kernels are compiled (or loaded from the kernel cache) and
+// their pipelines created in parallel on worker threads (OpenMP), returns once all are ready.
+// Kernels that fail get GPU_NULL_KERNEL, returns false if any kernel failed. The time (in ms) it
+// took to build each kernel is written to times_ms_out if it's not nullptr.
+//
+// Note that the cpu_allocator will be called from multiple threads, so it must be thread-safe.
+sfz_extern_c bool gpuKernelInitBatch(
+	GpuLib* gpu, const GpuKernelDesc* descs, u32 num_kernels, GpuKernel* kernels_out, f32* times_ms_out);
 sfz_extern_c void gpuKernelDestroy(GpuLib* gpu, GpuKernel kernel);
 
 sfz_extern_c i32x3 gpuKernelGetGroupDims(const GpuLib* gpu, GpuKernel kernel);
@@ -182,6 +228,184 @@ inline i32 gpuKernelGetGroupDims1(const GpuLib* gpu, GpuKernel kernel)
 	return dims.x;
 }
 
+// A file (typically an include) a kernel depends on, along with the SHA-256 of its contents when
+// the kernel was compiled. The path is owned by the kernel and valid until it's destroyed or
+// reloaded.
+sfz_struct(GpuKernelDepInfo) {
+	const char* path;
+	u8 sha256[32];
+};
+
+// Returns the files the kernel depends on, i.e. all files included when compiling it (excluding
+// the kernel source file itself).
+sfz_extern_c u32 gpuKernelGetNumDeps(const GpuLib* gpu, GpuKernel kernel);
+sfz_extern_c GpuKernelDepInfo gpuKernelGetDep(const GpuLib* gpu, GpuKernel kernel, u32 idx);
+
+// The type of a launch parameter (or of each component if it's a vector).
+typedef enum {
+	GPU_PARAM_TYPE_UNKNOWN = 0,
+	GPU_PARAM_TYPE_BOOL,
+	GPU_PARAM_TYPE_I16,
+	GPU_PARAM_TYPE_U16,
+	GPU_PARAM_TYPE_F16,
+	GPU_PARAM_TYPE_I32,
+	GPU_PARAM_TYPE_U32,
+	GPU_PARAM_TYPE_F32,
+	GPU_PARAM_TYPE_I64,
+	GPU_PARAM_TYPE_U64,
+	GPU_PARAM_TYPE_F64,
+	GPU_PARAM_TYPE_STRUCT,
+
+	GPU_PARAM_TYPE_FORCE_I32 = I32_MAX
+} GpuParamType;
+
+sfz_extern_c const char* gpuParamTypeToString(GpuParamType type);
+
+sfz_struct(GpuLaunchParamMember) {
+	char name[GPU_LAUNCH_PARAM_NAME_MAX_LEN];
+	u32 offset;
+	u32 size;
+	GpuParamType type;
+	u32 num_components; // Rows * columns, e.g. 2 for an int2
+};
+
+// The layout of a kernel's launch parameters (its cbuffer), as reflected by the compiler. Members
+// are sorted by offset. The cbuffer size is padded to 16 bytes, so the params passed to
+// gpuQueueDispatch() may be anything between used_size (end of last member, rounded up to 4 bytes)
+// and size bytes.
+//
+// Launch parameters are passed as root constants when they fit in GPU_LAUNCH_PARAMS_MAX_SIZE bytes.
+// Larger launch parameters (up to GPU_LAUNCH_PARAMS_LARGE_MAX_SIZE bytes) are automatically moved
+// to a root CBV when the kernel is compiled, and copied into the upload heap on dispatch. This is
+// transparent to gpuQueueDispatch(), but costs a memcpy, so prefer root constants when the params
+// fit. The move requires the cbuffer to be declared without an explicit register, e.g.
+// "cbuffer LaunchParams { ... }", or explicitly with "cbuffer LaunchParams : GPU_LARGE_LAUNCH_PARAMS".
+sfz_struct(GpuLaunchParamLayout) {
+	u32 size;
+	u32 used_size;
+	u32 num_members;
+	u32 is_large; // Passed through the upload heap instead of root constants, see above
+	GpuLaunchParamMember members[GPU_LAUNCH_PARAMS_MAX_NUM_MEMBERS];
+};
+
+sfz_extern_c bool gpuKernelGetParamLayout(const GpuLib* gpu, GpuKernel kernel, GpuLaunchParamLayout* layout_out);
+
+// Generates C++ source for a struct called name with the size and member offsets of the layout as
+// constants, each member as "<member>_offset" and "<member>_size" in a nested "members" struct. See
+// GPU_PARAMS_STATIC_ASSERT_SIZE(). Characters in name that aren't valid in an identifier are
+// replaced with '_'. Writes at most out_size chars (including null-terminator), returns the number
+// of chars required (excluding null-terminator), similar to snprintf().
+sfz_extern_c u32 gpuParamLayoutToCppHeader(
+	const GpuLaunchParamLayout* layout, const char* name, char* out, u32 out_size);
+
+#ifdef __cplusplus
+
+#include <stddef.h> // offsetof()
+
+// Compile-time validation of a C++ launch params struct against a layout generated by
+// gpuParamLayoutToCppHeader() (e.g. by gpu_lib_kernelc), catches reordered or mistyped members:
+//
+//     GPU_PARAMS_STATIC_ASSERT_SIZE(MyParams, GpuParamLayout_MyKernel);
+//     GPU_PARAMS_STATIC_ASSERT_MEMBER(MyParams, GpuParamLayout_MyKernel, res);
+#define GPU_PARAMS_STATIC_ASSERT_SIZE(cpp_struct, layout) \
+	static_assert(layout::used_size <= sizeof(cpp_struct) && sizeof(cpp_struct) <= layout::size, \
+		"Size of " #cpp_struct " does not match " #layout)
+#define GPU_PARAMS_STATIC_ASSERT_MEMBER(cpp_struct, layout, member) \
+	static_assert(offsetof(cpp_struct, member) == layout::members::member##_offset && \
+		sizeof(cpp_struct::member) == layout::members::member##_size, \
+		"Offset or size of " #cpp_struct "::" #member " does not match " #layout)
+
+#endif
+
+
+// Kernel permutations API
+// ------------------------------------------------------------------------------------------------
+
+// A kernel with a number of axes, each axis is a define that takes a value in [0, num_values).
+// Boolean axes simply have 2 values. Every combination of axis values is a permutation, identified
+// by a key where the axis values are packed in mixed radix (first axis least significant), meaning
+// keys are dense in [0, num_permutations) and permutations can be looked up in O(1).
+//
+// Permutations are compiled lazily the first time they are requested, or ahead of time (in
+// parallel) using gpuKernelPermutationsPrecompile(). Each compiled permutation is a regular
+// GpuKernel owned by the GpuKernelPermutations, and counts towards max_num_kernels.
+
+// Axis names can be at most GPU_KERNEL_AXIS_NAME_MAX_LEN characters, so that the define with the
+// largest possible value (GPU_KERNEL_MAX_NUM_PERMUTATIONS - 1) fits in GPU_KERNEL_DEFINE_MAX_LEN.
+sfz_struct(GpuKernelAxis) {
+	const char* name; // Name of define, e.g. "USE_FAST_PATH" gives "-DUSE_FAST_PATH=<value>"
+	u32 num_values;
+};
+
+sfz_struct(GpuKernelPermutationsDesc) {
+	const char* name;
+	const char* path;
+	u32 num_defines; // Defines common to all permutations, num_defines + num_axes must fit
+	const char* const* defines;
+	u32 num_axes;
+	const GpuKernelAxis* axes;
+};
+
+sfz_struct(GpuKernelPermutations) {
+	u32 handle;
+
+#ifdef __cplusplus
+	constexpr bool operator== (GpuKernelPermutations o) const { return handle == o.handle; }
+	constexpr bool operator!= (GpuKernelPermutations o) const { return handle != o.handle; }
+#endif
+};
+
+sfz_constant GpuKernelPermutations GPU_NULL_KERNEL_PERMUTATIONS = {};
+
+sfz_extern_c GpuKernelPermutations gpuKernelPermutationsInit(GpuLib* gpu, const GpuKernelPermutationsDesc* desc);
+sfz_extern_c void gpuKernelPermutationsDestroy(GpuLib* gpu, GpuKernelPermutations perms);
+
+// Packs one value per axis into a permutation key, returns U32_MAX if any value is out of range.
+sfz_extern_c u32 gpuKernelPermutationsGetKey(
+	const GpuLib* gpu, GpuKernelPermutations perms, const u32* axis_values);
+sfz_extern_c u32 gpuKernelPermutationsGetNum(const GpuLib* gpu, GpuKernelPermutations perms);
+
+// Returns the kernel for a permutation, compiling it first (blocking) if it hasn't been requested
+// before. Returns GPU_NULL_KERNEL if the permutation failed to compile.
+sfz_extern_c GpuKernel gpuKernelPermutationsGet(GpuLib* gpu, GpuKernelPermutations perms, u32 key);
+
+// Compiles the specified permutations in parallel, see gpuKernelInitBatch(). If keys is nullptr
+// all permutations are compiled. Returns false if any permutation failed.
+sfz_extern_c bool gpuKernelPermutationsPrecompile(
+	GpuLib* gpu, GpuKernelPermutations perms, const u32* keys, u32 num_keys);
+
+
+// Kernel bundle API
+// ------------------------------------------------------------------------------------------------
+
+// A kernel bundle is a single file with precompiled kernels (DXIL and reflection), typically built
+// offline from a manifest using the gpu_lib_kernelc tool. Kernels are created straight from the
+// (memory mapped) bundle, without reading any sources or invoking DXC at runtime. Each kernel is
+// identified by its name and, for permutations, its permutation key (see gpuKernelPermutationsGetKey()).
+
+sfz_constant u32 GPU_KERNEL_BUNDLE_NO_PERMUTATION = U32_MAX;
+
+// Compiles the kernels (in parallel, OpenMP) and writes them to a bundle. Doesn't need a GpuLib,
+// only DXC. permutation_keys may be nullptr if none of the kernels are permutations. Returns false
+// if any kernel fails to compile, or if any (name, permutation key) pair is not unique.
+sfz_extern_c bool gpuKernelBundleWrite(
+	const char* path,
+	const GpuKernelDesc* descs,
+	const u32* permutation_keys,
+	u32 num_kernels,
+	SfzAllocator* allocator);
+
+// Creates a kernel from a bundle. The bundle only has to stay valid during the call. The lookup is
+// a binary search, so creating every kernel in a bundle is O(N log N). Returns GPU_NULL_KERNEL if
+// the kernel isn't in the bundle or the bundle is invalid.
+sfz_extern_c GpuKernel gpuKernelInitFromBundle(
+	GpuLib* gpu, const void* bundle, u64 bundle_size, const char* name, u32 permutation_key);
+
+// Returns the launch parameter layout of a kernel in a bundle, doesn't need a GpuLib. Returns false
+// if the kernel isn't in the bundle.
+sfz_extern_c bool gpuKernelBundleGetParamLayout(
+	const void* bundle, u64 bundle_size, const char* name, u32 permutation_key, GpuLaunchParamLayout* layout_out);
+
 
 // Command API
 // ------------------------------------------------------------------------------------------------
@@ -192,6 +416,10 @@ inline i32 gpuKernelGetGroupDims1(const GpuLib* gpu, GpuKernel kernel)
 // Returns the index of the current command list. Increments every gpuSubmitQueuedWork().
 sfz_extern_c u64 gpuGetCurrSubmitIdx(const GpuLib* gpu);
 
+// Returns the number of submits that can be in-flight at the same time, see
+// GpuLibInitCfg::num_concurrent_submits.
+sfz_extern_c u32 gpuGetNumConcurrentSubmits(const GpuLib* gpu);
+
 // Returns the current resolution of the swapchain (window) being rendered to.
 sfz_extern_c i32x2 gpuSwapchainGetRes(const GpuLib* gpu);
 
@@ -218,35 +446,259 @@ sfz_constant GpuTicket GPU_NULL_TICKET = {};
 // retrieve the data in a later frame when it's ready.
 sfz_extern_c GpuTicket gpuQueueMemcpyDownload(GpuLib* gpu, GpuPtr src, u32 num_bytes);
 
-// Retrieves the data from a previously queued memcpy download.
+// Retrieves the data from a previously queued memcpy (or RWTex) download.
 sfz_extern_c void gpuGetDownloadedData(GpuLib* gpu, GpuTicket ticket, void* dst, u32 num_bytes);
 
-// Queues a kernel dispatch
+// Queues an upload of pixel data to a GpuRWTex. The data must be tightly packed (no padding
+// between rows) and cover the entire texture, i.e. num_bytes == res.x * res.y * bytes per pixel.
+// Instantly copies input to upload heap, no need to keep src around.
+sfz_extern_c void gpuQueueRWTexUpload(GpuLib* gpu, GpuRWTex tex, const void* src, u32 num_bytes);
+
+// Queues a download of the contents of a GpuRWTex. Works the same way as gpuQueueMemcpyDownload(),
+// retrieve the data with gpuGetDownloadedData() in a later frame. The retrieved data is tightly
+// packed, i.e. res.x * res.y * bytes per pixel bytes.
+sfz_extern_c GpuTicket gpuQueueRWTexDownload(GpuLib* gpu, GpuRWTex tex);
+
+// Queues a kernel dispatch. Params are copied, no need to keep them around. See
+// GpuLaunchParamLayout for the allowed sizes.
 sfz_extern_c void gpuQueueDispatch(
 	GpuLib* gpu, GpuKernel kernel, i32x3 num_groups, const void* params, u32 params_size);
 
+// A range of bytes in the gpu heap
+sfz_struct(GpuPtrRange) {
+	GpuPtr ptr;
+	u32 num_bytes;
+};
+
+// Describes which resources a dispatch accesses. If all dispatches declare their accesses gpu_lib
+// automatically inserts barriers when there is a hazard (read-after-write, write-after-write or
+// write-after-read) against an earlier dispatch that hasn't been barriered yet, no manual barriers
+// are necessary.
+//
+// A dispatch without declared access (i.e. gpuQueueDispatch()) is assumed to access everything.
+// Barriers are automatically inserted before it if there are pending declared accesses, but
+// barriers between undeclared dispatches are still the responsibility of the user.
+sfz_struct(GpuDispatchAccess) {
+	const GpuPtrRange* ptr_reads;
+	u32 num_ptr_reads;
+	const GpuPtrRange* ptr_writes;
+	u32 num_ptr_writes;
+	const GpuRWTex* rwtex_reads;
+	u32 num_rwtex_reads;
+	const GpuRWTex* rwtex_writes;
+	u32 num_rwtex_writes;
+};
+
+// Same as gpuQueueDispatch(), but with declared resource accesses.
+sfz_extern_c void gpuQueueDispatchWithAccess(
+	GpuLib* gpu,
+	GpuKernel kernel,
+	i32x3 num_groups,
+	const void* params,
+	u32 params_size,
+	const GpuDispatchAccess* access);
+
+// The arguments of an indirect dispatch, i.e. the number of groups in each dimension. In HLSL
+// this is simply a uint3, e.g. "ptrStore<uint3>(args_ptr, uint3(num_groups, 1, 1))".
+sfz_struct(GpuDispatchArgs) {
+	u32 num_groups_x;
+	u32 num_groups_y;
+	u32 num_groups_z;
+};
+sfz_static_assert(sizeof(GpuDispatchArgs) == 12);
+
+// Queues a kernel dispatch where the number of groups is read from a GpuDispatchArgs in the gpu
+// heap when the dispatch executes, i.e. it can be written by an earlier dispatch in the same
+// submit. The args are copied out of the heap right before the dispatch, so no barrier is needed
+// between the dispatch writing them and this one. A number of groups of 0 is a no-op.
+//
+// At most GPU_INDIRECT_ARGS_MAX_NUM_PER_SUBMIT indirect dispatches may be queued per submit.
+sfz_extern_c void gpuQueueDispatchIndirect(
+	GpuLib* gpu, GpuKernel kernel, GpuPtr args, const void* params, u32 params_size);
+
+// Same as gpuQueueDispatchIndirect(), but with declared resource accesses. The read of args does
+// not need to be declared.
+sfz_extern_c void gpuQueueDispatchIndirectWithAccess(
+	GpuLib* gpu,
+	GpuKernel kernel,
+	GpuPtr args,
+	const void* params,
+	u32 params_size,
+	const GpuDispatchAccess* access);
+
+// A dispatch in a batch, see gpuQueueDispatchBatch().
+sfz_struct(GpuDispatchBatchItem) {
+	GpuKernel kernel;
+	i32x3 num_groups;
+	const void* params;
+	u32 params_size;
+};
+
+// Queues many dispatches at once, equivalent to calling gpuQueueDispatch() for each item in order
+// but with much less CPU overhead. Consecutive items using the same kernel are executed by a single
+// ExecuteIndirect with each dispatch's launch params stored next to its group counts in the upload
+// heap, so the pso is set once per run. Sort items by kernel (where the order doesn't matter) to
+// get longer runs. Kernels with large launch parameters are dispatched one by one.
+//
+// Like gpuQueueDispatch() no barriers are inserted between the dispatches in the batch.
+sfz_extern_c void gpuQueueDispatchBatch(GpuLib* gpu, const GpuDispatchBatchItem* items, u32 num_items);
+
+// Queues a dispatch of a built-in kernel that reads an element count (u32) from count and writes
+// the GpuDispatchArgs for processing that many elements to args_out, i.e.
+// (ceil(count / elements_per_group), 1, 1). The number of groups is clamped to 65535.
+sfz_extern_c void gpuQueueCountToGroups(GpuLib* gpu, GpuPtr count, u32 elements_per_group, GpuPtr args_out);
+
 // Queues the insertion of an unordered access barrier for the gpu heap. Not doing this is
 // undefined behaviour if there are overlapping write-writes or read-writes (but not read-reads)
-// between dispatches. If you are unsure, just insert one after each gpuQueueDispatch().
+// between dispatches. If you are unsure, just insert one after each gpuQueueDispatch(). Not
+// necessary between dispatches with declared access, see GpuDispatchAccess.
 sfz_extern_c void gpuQueueGpuHeapBarrier(GpuLib* gpu);
 
 // Queues the insertion of an unordered access barrier for a specific RWTex (or for all of them).
 // Same rules applies as for gpu heap barriers, necessary for overlapping writes and read-writes,
-// but not for overlapping reads.
+// but not for overlapping reads. gpuQueueRWTexBarriers() only inserts barriers for the textures
+// written to since the last call, which are all of them if a dispatch without declared access
+// has been queued.
 sfz_extern_c void gpuQueueRWTexBarrier(GpuLib* gpu, GpuRWTex tex_idx);
 sfz_extern_c void gpuQueueRWTexBarriers(GpuLib* gpu);
 
-// Submits queued work to GPU and prepares to start recording more.
+// Submits queued work to GPU and prepares to start recording more. Blocks if the CPU is too far
+// ahead, i.e. until the submit from num_concurrent_submits submits ago has finished executing.
 sfz_extern_c void gpuSubmitQueuedWork(GpuLib* gpu);
 
-// Presents the latest swapchain image to the screen. Will block GPU and resize swapchain if
-// resolution has changed.
+// Same as gpuSubmitQueuedWork(), but doesn't block. Returns false without submitting anything if it
+// would have blocked, the queued work is kept and more can be queued before trying again.
+sfz_extern_c bool gpuTrySubmitQueuedWork(GpuLib* gpu);
+
+// Waits until the specified (already submitted) submit has finished executing on the GPU, or until
+// the timeout has passed. Returns whether it finished. A timeout of 0 just checks without blocking,
+// GPU_WAIT_INFINITE never times out.
+sfz_extern_c bool gpuWaitForSubmit(GpuLib* gpu, u64 submit_idx, u32 timeout_ms);
+
+// Presents the latest swapchain image to the screen. If the resolution has changed the swapchain
+// relative GpuRWTex are reallocated without blocking, the old ones are released once in-flight
+// submits are done with them. The actual swapchain framebuffers are only resized (which blocks)
+// once the resolution has stayed the same for a couple of frames.
 sfz_extern_c void gpuSwapchainPresent(GpuLib* gpu, bool vsync);
 
-// Flushes (blocks) until all currently submitted GPU work has finished executing.
+// Flushes (blocks) until all currently submitted GPU work has finished executing, on both queues.
 sfz_extern_c void gpuFlush(GpuLib* gpu);
 
 
+// Command context API
+// ------------------------------------------------------------------------------------------------
+
+// A command context records dispatches into its own command list, so that several threads can
+// record in parallel. Every submit:
+//
+// 1. Main thread: gpuCmdContextBegin() on each context that will be used.
+// 2. Worker threads: gpuCmdContextDispatch(), etc. A context must only be used by one thread at a
+//    time, but different contexts may be used concurrently. The main thread may keep queueing work
+//    meanwhile, but must not create or destroy kernels, textures or contexts.
+// 3. Main thread: once all workers are done, gpuQueueCmdContexts() inserts the recorded commands
+//    at that point of the main thread's queue, in the order given. The order of execution is
+//    thus deterministic, no matter which worker finished first.
+//
+// Contexts can only dispatch. For hazard tracking they count as dispatches without declared access
+// (see GpuDispatchAccess), i.e. barriers between dispatches within a context (or between contexts)
+// are the responsibility of the user, see gpuCmdContextBarrier().
+//
+// Contexts created for GPU_QUEUE_ASYNC_COMPUTE are instead submitted with gpuSubmitAsyncCompute(),
+// see the async compute API below. They are begun once per async submit rather than per submit.
+sfz_struct(GpuCmdContext) {
+	u32 handle;
+
+#ifdef __cplusplus
+	constexpr bool operator== (GpuCmdContext o) const { return handle == o.handle; }
+	constexpr bool operator!= (GpuCmdContext o) const { return handle != o.handle; }
+#endif
+};
+
+sfz_constant GpuCmdContext GPU_NULL_CMD_CONTEXT = {};
+
+typedef enum {
+	GPU_QUEUE_MAIN = 0, // Everything gpuQueue*() records to, submitted by gpuSubmitQueuedWork()
+	GPU_QUEUE_ASYNC_COMPUTE, // Runs in parallel with the main queue, see gpuSubmitAsyncCompute()
+
+	GPU_QUEUE_FORCE_I32 = I32_MAX
+} GpuQueue;
+
+// Creates a command context for the specified queue. Each submit upload_heap_bytes of the upload
+// heap is reserved by gpuCmdContextBegin() for the context's large launch parameters, may be 0 if
+// not needed. Must be 0 for async compute contexts, as the upload heap is reclaimed as main queue
+// submits finish. Async compute contexts thus can't dispatch kernels with large launch parameters
+// (GpuLaunchParamLayout::is_large), such dispatches are skipped with an error.
+sfz_extern_c GpuCmdContext gpuCmdContextInit(GpuLib* gpu, GpuQueue queue, u32 upload_heap_bytes);
+sfz_extern_c void gpuCmdContextDestroy(GpuLib* gpu, GpuCmdContext ctx);
+
+// Begins recording for the current submit, must be called from the main thread. Anything recorded
+// but not queued with gpuQueueCmdContexts() in an earlier submit is discarded.
+sfz_extern_c void gpuCmdContextBegin(GpuLib* gpu, GpuCmdContext ctx);
+
+// Same as gpuQueueDispatch(), but recorded into the context.
+sfz_extern_c void gpuCmdContextDispatch(
+	GpuLib* gpu, GpuCmdContext ctx, GpuKernel kernel, i32x3 num_groups, const void* params, u32 params_size);
+
+// Records an unordered access barrier for the gpu heap and all textures into the context.
+sfz_extern_c void gpuCmdContextBarrier(GpuLib* gpu, GpuCmdContext ctx);
+
+// Inserts the commands recorded into the contexts at this point of the queue, in the given order.
+// Must be called from the main thread once all recording into the contexts is done. The contexts
+// can't be recorded into again until they are begun in the next submit.
+sfz_extern_c void gpuQueueCmdContexts(GpuLib* gpu, const GpuCmdContext* ctxs, u32 num_ctxs);
+
+
+// Async compute API
+// ------------------------------------------------------------------------------------------------
+
+// Long-running work (simulations, BVH refits, etc) can be recorded into GPU_QUEUE_ASYNC_COMPUTE
+// command contexts and submitted to a separate compute queue, where it overlaps with the work of
+// the main queue. Async submits are independent of main queue submits, they are executed straight
+// away and have their own submit index. Async compute contexts can't use large launch parameters,
+// see gpuCmdContextInit().
+//
+// Nothing is synchronized between the queues automatically. Work on one queue that depends on
+// work on the other must wait for a sync point signalled after it, see gpuQueueSignal() and
+// gpuQueueWait(). The gpu heap and RWTex are shared by both queues, the main queue's copies
+// (uploads, downloads and swapchain copies) transition them, so they must not overlap with async
+// work accessing the same resources.
+
+// A point on a queue's timeline, reached once all work queued to the queue before it has finished.
+sfz_struct(GpuSyncPoint) {
+	GpuQueue queue;
+	u64 value;
+};
+
+// Executes the commands recorded into the async compute contexts on the async compute queue, in
+// the given order. Blocks if the async submit from num_concurrent_submits async submits ago is
+// still executing. If that submit is held back (see gpuQueueWait()) this fails with an error
+// instead, as does gpuCmdContextBegin() for async compute contexts.
+sfz_extern_c void gpuSubmitAsyncCompute(GpuLib* gpu, const GpuCmdContext* ctxs, u32 num_ctxs);
+
+// Returns the index of the current async submit. Increments every gpuSubmitAsyncCompute().
+sfz_extern_c u64 gpuGetCurrAsyncSubmitIdx(const GpuLib* gpu);
+
+// Signals a sync point after everything queued to the queue so far. For the main queue that is
+// everything queued in the current submit, the signal is executed by gpuSubmitQueuedWork().
+sfz_extern_c GpuSyncPoint gpuQueueSignal(GpuLib* gpu, GpuQueue queue);
+
+// Makes the queue wait (on the GPU) for a sync point signalled by the other queue before executing
+// anything queued after this. Waiting for a sync point that can't be reached without the waiting
+// queue progressing (e.g. the async queue waiting for the main queue, which waits for async work
+// submitted after that) deadlocks the GPU.
+//
+// The main queue's signals are only executed by gpuSubmitQueuedWork(). Until then, async work
+// queued after a wait for one of them (async submits and signals) is held back on the CPU, and
+// executed by the gpuSubmitQueuedWork() that submits the signal. gpuFlush() doesn't wait for held
+// back work. E.g. the following is valid within a single submit:
+//
+//     const GpuSyncPoint uploaded = gpuQueueSignal(gpu, GPU_QUEUE_MAIN);
+//     gpuQueueWait(gpu, GPU_QUEUE_ASYNC_COMPUTE, uploaded);
+//     gpuSubmitAsyncCompute(gpu, &async_ctx, 1); // Held back
+//     gpuSubmitQueuedWork(gpu); // Submits the signal, then the held back async submit
+sfz_extern_c void gpuQueueWait(GpuLib* gpu, GpuQueue queue, GpuSyncPoint point);
+
+
 // C++ helpers
 // ------------------------------------------------------------------------------------------------
 
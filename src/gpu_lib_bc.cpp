@@ -0,0 +1,782 @@
+#include "gpu_lib_bc.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+sfz_constant i32 BC_BLOCK_DIM = 4;
+sfz_constant u32 BC_BLOCK_NUM_PIXELS = 16;
+
+// An RGBA8 color, indexable by channel
+sfz_struct(BCColor) {
+	u8 v[4];
+	constexpr u8& operator[] (u32 idx) { return v[idx]; }
+	constexpr u8 operator[] (u32 idx) const { return v[idx]; }
+};
+
+// A 4x4 block of RGBA8 pixels, row by row
+sfz_struct(BCBlockRGBA) {
+	BCColor pixels[BC_BLOCK_NUM_PIXELS];
+};
+
+static i32x2 calcNumBlocks(i32x2 res)
+{
+	return i32x2_init((res.x + BC_BLOCK_DIM - 1) / BC_BLOCK_DIM, (res.y + BC_BLOCK_DIM - 1) / BC_BLOCK_DIM);
+}
+
+static bool validateArgs(GpuFormat format, i32x2 res, i32 block_row_begin, i32 block_row_end)
+{
+	if (!gpuFormatIsBlockCompressed(format)) {
+		printf("[gpu_lib]: %s is not a block compressed format\n", gpuFormatToString(format));
+		return false;
+	}
+	if (res.x <= 0 || res.y <= 0) {
+		printf("[gpu_lib]: Invalid resolution for block compression (%ix%i)\n", res.x, res.y);
+		return false;
+	}
+	const i32x2 num_blocks = calcNumBlocks(res);
+	if (block_row_begin < 0 || block_row_end < block_row_begin || num_blocks.y < block_row_end) {
+		printf("[gpu_lib]: Invalid block row range [%i, %i), image has %i block rows\n",
+			block_row_begin, block_row_end, num_blocks.y);
+		return false;
+	}
+	return true;
+}
+
+// Loads a 4x4 block from an image, pixels outside the image are clamped to the edge.
+static BCBlockRGBA loadBlock(const u8* src_rgba8, i32x2 res, i32 block_x, i32 block_y)
+{
+	BCBlockRGBA block = {};
+	for (i32 y = 0; y < BC_BLOCK_DIM; y++) {
+		const i32 src_y = i32_min(block_y * BC_BLOCK_DIM + y, res.y - 1);
+		for (i32 x = 0; x < BC_BLOCK_DIM; x++) {
+			const i32 src_x = i32_min(block_x * BC_BLOCK_DIM + x, res.x - 1);
+			memcpy(&block.pixels[y * BC_BLOCK_DIM + x], src_rgba8 + (u64(src_y) * res.x + src_x) * 4, 4);
+		}
+	}
+	return block;
+}
+
+// Stores a 4x4 block to an image, pixels outside the image are skipped.
+static void storeBlock(const BCBlockRGBA& block, u8* dst_rgba8, i32x2 res, i32 block_x, i32 block_y)
+{
+	for (i32 y = 0; y < BC_BLOCK_DIM; y++) {
+		const i32 dst_y = block_y * BC_BLOCK_DIM + y;
+		if (res.y <= dst_y) break;
+		for (i32 x = 0; x < BC_BLOCK_DIM; x++) {
+			const i32 dst_x = block_x * BC_BLOCK_DIM + x;
+			if (res.x <= dst_x) break;
+			memcpy(dst_rgba8 + (u64(dst_y) * res.x + dst_x) * 4, &block.pixels[y * BC_BLOCK_DIM + x], 4);
+		}
+	}
+}
+
+// The pixels of a block as floats, channel by channel, so that loops over the pixels vectorize
+// (see "#pragma omp simd", enabled by /openmp:experimental).
+sfz_struct(BCBlockF32) {
+	f32 c[4][BC_BLOCK_NUM_PIXELS];
+};
+
+static BCBlockF32 blockToF32(const BCBlockRGBA& block)
+{
+	BCBlockF32 f = {};
+	for (u32 c = 0; c < 4; c++) {
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) f.c[c][i] = f32(block.pixels[i][c]);
+	}
+	return f;
+}
+
+// Finds two endpoints along the principal axis of the first num_channels channels of the block.
+// Uses a few iterations of power iteration on the covariance matrix to find the axis.
+static void fitEndpoints(const BCBlockF32& block, u32 num_channels, f32 e0_out[4], f32 e1_out[4])
+{
+	sfz_assert(num_channels <= 4);
+
+	f32 mean[4] = {};
+	f32 d[4][BC_BLOCK_NUM_PIXELS] = {};
+	for (u32 c = 0; c < num_channels; c++) {
+		f32 sum = 0.0f;
+		#pragma omp simd reduction(+:sum)
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) sum += block.c[c][i];
+		mean[c] = sum / f32(BC_BLOCK_NUM_PIXELS);
+		#pragma omp simd
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) d[c][i] = block.c[c][i] - mean[c];
+	}
+
+	f32 cov[4][4] = {};
+	for (u32 r = 0; r < num_channels; r++) {
+		for (u32 c = r; c < num_channels; c++) {
+			f32 sum = 0.0f;
+			#pragma omp simd reduction(+:sum)
+			for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) sum += d[r][i] * d[c][i];
+			cov[r][c] = sum;
+			cov[c][r] = sum;
+		}
+	}
+
+	f32 axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (u32 iter = 0; iter < 8; iter++) {
+		f32 tmp[4] = {};
+		for (u32 r = 0; r < num_channels; r++) {
+			for (u32 c = 0; c < num_channels; c++) tmp[r] += cov[r][c] * axis[c];
+		}
+		f32 len_sq = 0.0f;
+		for (u32 c = 0; c < num_channels; c++) len_sq += tmp[c] * tmp[c];
+		if (len_sq < 0.0001f) break; // Flat block, keep previous axis
+		const f32 inv_len = 1.0f / sfz_sqrt(len_sq);
+		for (u32 c = 0; c < num_channels; c++) axis[c] = tmp[c] * inv_len;
+	}
+
+	f32 t[BC_BLOCK_NUM_PIXELS] = {};
+	for (u32 c = 0; c < num_channels; c++) {
+		#pragma omp simd
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) t[i] += d[c][i] * axis[c];
+	}
+	f32 t_min = F32_MAX;
+	f32 t_max = -F32_MAX;
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		t_min = f32_min(t_min, t[i]);
+		t_max = f32_max(t_max, t[i]);
+	}
+
+	for (u32 c = 0; c < 4; c++) {
+		e0_out[c] = c < num_channels ? f32_clamp(mean[c] + axis[c] * t_min, 0.0f, 255.0f) : 0.0f;
+		e1_out[c] = c < num_channels ? f32_clamp(mean[c] + axis[c] * t_max, 0.0f, 255.0f) : 0.0f;
+	}
+}
+
+// Finds the endpoints that minimize the squared error of the first num_channels channels when each
+// pixel is reconstructed as lerp(e0, e1, weights[i]). Used to refine endpoints once the indices are
+// known. Returns false if there is no unique solution, i.e. if all weights are the same.
+static bool fitEndpointsLeastSquares(
+	const f32 channels[][BC_BLOCK_NUM_PIXELS], u32 num_channels, const f32 weights[BC_BLOCK_NUM_PIXELS], f32 e0_out[4], f32 e1_out[4])
+{
+	f32 aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	#pragma omp simd reduction(+:aa, ab, bb)
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		const f32 a = 1.0f - weights[i];
+		const f32 b = weights[i];
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+	}
+	const f32 det = aa * bb - ab * ab;
+	if (det < 0.0001f) return false;
+	const f32 inv_det = 1.0f / det;
+
+	for (u32 c = 0; c < 4; c++) {
+		if (num_channels <= c) {
+			e0_out[c] = 0.0f;
+			e1_out[c] = 0.0f;
+			continue;
+		}
+		f32 ax = 0.0f, bx = 0.0f;
+		#pragma omp simd reduction(+:ax, bx)
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+			ax += (1.0f - weights[i]) * channels[c][i];
+			bx += weights[i] * channels[c][i];
+		}
+		e0_out[c] = f32_clamp((ax * bb - bx * ab) * inv_det, 0.0f, 255.0f);
+		e1_out[c] = f32_clamp((bx * aa - ax * ab) * inv_det, 0.0f, 255.0f);
+	}
+	return true;
+}
+
+// Projects each pixel onto the line from p0 to p1 (the first num_channels of the given channels) and
+// picks the closest of num_steps evenly spaced steps along it, 0 at p0 and num_steps - 1 at p1.
+// Returns the squared error of reconstructing the pixels from the steps, where step s is at weight
+// step_weights[s] along the line (or evenly spaced if nullptr). The error ignores the rounding of
+// the hardware palette, which is good enough to compare candidate endpoints.
+static f32 fitSteps(
+	const f32 channels[][BC_BLOCK_NUM_PIXELS], u32 num_channels, const f32 p0[4], const f32 p1[4], u32 num_steps,
+	const f32* step_weights, u32 steps_out[BC_BLOCK_NUM_PIXELS])
+{
+	f32 axis[4] = {};
+	f32 len_sq = 0.0f;
+	for (u32 c = 0; c < num_channels; c++) {
+		axis[c] = p1[c] - p0[c];
+		len_sq += axis[c] * axis[c];
+	}
+	const f32 max_step = f32(num_steps - 1);
+	const f32 scale = len_sq == 0.0f ? 0.0f : max_step / len_sq;
+
+	f32 t[BC_BLOCK_NUM_PIXELS] = {};
+	for (u32 c = 0; c < num_channels; c++) {
+		#pragma omp simd
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) t[i] += (channels[c][i] - p0[c]) * axis[c];
+	}
+	f32 weights[BC_BLOCK_NUM_PIXELS];
+	const f32 inv_max_step = 1.0f / max_step;
+	#pragma omp simd
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		steps_out[i] = u32(f32_clamp(t[i] * scale, 0.0f, max_step) + 0.5f);
+		weights[i] = f32(steps_out[i]) * inv_max_step;
+	}
+	if (step_weights != nullptr) {
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) weights[i] = step_weights[steps_out[i]];
+	}
+
+	f32 err = 0.0f;
+	for (u32 c = 0; c < num_channels; c++) {
+		#pragma omp simd reduction(+:err)
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+			const f32 d = channels[c][i] - (p0[c] + weights[i] * axis[c]);
+			err += d * d;
+		}
+	}
+	return err;
+}
+
+static i32 quantize(f32 v, i32 num_bits)
+{
+	const i32 max_val = (1 << num_bits) - 1;
+	return i32_clamp(i32(v * f32(max_val) / 255.0f + 0.5f), 0, max_val);
+}
+
+// Writes bits into a 128-bit block, LSB first
+sfz_struct(BCBitWriter) {
+	u64 bits[2];
+	u32 offset;
+};
+
+static void writeBits(BCBitWriter& w, u32 val, u32 num_bits)
+{
+	sfz_assert(num_bits <= 32 && (w.offset + num_bits) <= 128);
+	const u64 v = u64(val) & ((u64(1) << num_bits) - 1);
+	const u32 word = w.offset >> 6;
+	const u32 shift = w.offset & 63;
+	w.bits[word] |= v << shift;
+	if (shift + num_bits > 64) w.bits[word + 1] |= v >> (64 - shift);
+	w.offset += num_bits;
+}
+
+static u32 readBits(const u8* src, u32& offset, u32 num_bits)
+{
+	u32 val = 0;
+	for (u32 i = 0; i < num_bits; i++) {
+		const u32 bit = (src[offset >> 3] >> (offset & 7)) & 1u;
+		val |= bit << i;
+		offset += 1;
+	}
+	return val;
+}
+
+// BC1
+// ------------------------------------------------------------------------------------------------
+
+// The palette is ordered c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1, this maps steps along the line
+// from c0 to c1 to indices.
+sfz_constant u32 BC1_STEP_TO_IDX[4] = { 0, 2, 3, 1 };
+
+static BCColor bc1Expand565(u16 c)
+{
+	const u32 r = (c >> 11) & 0x1F;
+	const u32 g = (c >> 5) & 0x3F;
+	const u32 b = c & 0x1F;
+	return BCColor{ { u8((r << 3) | (r >> 2)), u8((g << 2) | (g >> 4)), u8((b << 3) | (b >> 2)), 255 } };
+}
+
+static u16 bc1Quantize565(const f32 e[4])
+{
+	return u16((quantize(e[0], 5) << 11) | (quantize(e[1], 6) << 5) | quantize(e[2], 5));
+}
+
+static void bc1Palette(u16 c0, u16 c1, BCColor palette[4])
+{
+	palette[0] = bc1Expand565(c0);
+	palette[1] = bc1Expand565(c1);
+	for (u32 c = 0; c < 3; c++) {
+		if (c0 > c1) {
+			palette[2][c] = u8((2 * u32(palette[0][c]) + u32(palette[1][c]) + 1) / 3);
+			palette[3][c] = u8((u32(palette[0][c]) + 2 * u32(palette[1][c]) + 1) / 3);
+		}
+		else {
+			palette[2][c] = u8((u32(palette[0][c]) + u32(palette[1][c])) / 2);
+			palette[3][c] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = c0 > c1 ? 255 : 0;
+}
+
+sfz_struct(BC1Block) {
+	u16 c0;
+	u16 c1;
+	u32 indices;
+};
+
+// Quantizes the endpoints (4-color mode) and picks the palette entry of each pixel. Returns the
+// squared error, the weight of each pixel along the line from c0 to c1 is written to weights_out.
+static f32 bc1Evaluate(
+	const BCBlockF32& block, const f32 e0[4], const f32 e1[4], BC1Block& out, f32 weights_out[BC_BLOCK_NUM_PIXELS])
+{
+	out.c0 = bc1Quantize565(e1);
+	out.c1 = bc1Quantize565(e0);
+	if (out.c0 < out.c1) {
+		const u16 tmp = out.c0;
+		out.c0 = out.c1;
+		out.c1 = tmp;
+	}
+
+	// If c0 == c1 the palette is in 3-color mode, but index 0 is still c0. fitSteps() maps all pixels
+	// to step 0 for a zero length line, so this needs no special case.
+	const BCColor c0 = bc1Expand565(out.c0);
+	const BCColor c1 = bc1Expand565(out.c1);
+	const f32 p0[4] = { f32(c0[0]), f32(c0[1]), f32(c0[2]), 0.0f };
+	const f32 p1[4] = { f32(c1[0]), f32(c1[1]), f32(c1[2]), 0.0f };
+	u32 steps[BC_BLOCK_NUM_PIXELS];
+	const f32 err = fitSteps(block.c, 3, p0, p1, 4, nullptr, steps);
+
+	out.indices = 0;
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		out.indices |= BC1_STEP_TO_IDX[steps[i]] << (2 * i);
+		weights_out[i] = f32(steps[i]) * (1.0f / 3.0f);
+	}
+	return err;
+}
+
+static void bc1EncodeBlock(const BCBlockF32& block, u8* dst)
+{
+	f32 e0[4], e1[4];
+	fitEndpoints(block, 3, e0, e1);
+	BC1Block best = {};
+	f32 weights[BC_BLOCK_NUM_PIXELS];
+	f32 best_err = bc1Evaluate(block, e0, e1, best, weights);
+
+	// Refine the endpoints for the chosen indices, keep them as long as the error decreases
+	for (u32 iter = 0; iter < 2 && best_err > 0.0f; iter++) {
+		if (!fitEndpointsLeastSquares(block.c, 3, weights, e0, e1)) break;
+		BC1Block candidate = {};
+		f32 candidate_weights[BC_BLOCK_NUM_PIXELS];
+		const f32 err = bc1Evaluate(block, e0, e1, candidate, candidate_weights);
+		if (best_err <= err) break;
+		best = candidate;
+		best_err = err;
+		memcpy(weights, candidate_weights, sizeof(weights));
+	}
+
+	memcpy(dst + 0, &best.c0, sizeof(u16));
+	memcpy(dst + 2, &best.c1, sizeof(u16));
+	memcpy(dst + 4, &best.indices, sizeof(u32));
+}
+
+static void bc1DecodeBlock(const u8* src, BCBlockRGBA& block)
+{
+	u16 c0 = 0, c1 = 0;
+	u32 indices = 0;
+	memcpy(&c0, src + 0, sizeof(u16));
+	memcpy(&c1, src + 2, sizeof(u16));
+	memcpy(&indices, src + 4, sizeof(u32));
+	BCColor palette[4];
+	bc1Palette(c0, c1, palette);
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		block.pixels[i] = palette[(indices >> (2 * i)) & 0x3];
+	}
+}
+
+// BC4 & BC5
+// ------------------------------------------------------------------------------------------------
+
+static void bc4Palette(u8 r0, u8 r1, u8 palette[8])
+{
+	palette[0] = r0;
+	palette[1] = r1;
+	if (r0 > r1) {
+		for (u32 i = 1; i < 7; i++) palette[i + 1] = u8(((7 - i) * u32(r0) + i * u32(r1) + 3) / 7);
+	}
+	else {
+		for (u32 i = 1; i < 5; i++) palette[i + 1] = u8(((5 - i) * u32(r0) + i * u32(r1) + 2) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static void bc4WriteBlock(u8 r0, u8 r1, const u32 indices[BC_BLOCK_NUM_PIXELS], u8* dst)
+{
+	u64 bits = 0;
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) bits |= u64(indices[i]) << (3 * i);
+	dst[0] = r0;
+	dst[1] = r1;
+	for (u32 i = 0; i < 6; i++) dst[2 + i] = u8(bits >> (8 * i));
+}
+
+// 8 value mode (r0 > r1), the palette is evenly spaced from r0 to r1 so the indices can be found by
+// projection. Returns the squared error, the weight of each pixel along the line from r0 to r1 is
+// written to weights_out.
+static f32 bc4Evaluate8(
+	const f32 values[][BC_BLOCK_NUM_PIXELS], u8 r0, u8 r1,
+	u32 indices_out[BC_BLOCK_NUM_PIXELS], f32 weights_out[BC_BLOCK_NUM_PIXELS])
+{
+	const f32 p0[4] = { f32(r0) };
+	const f32 p1[4] = { f32(r1) };
+	u32 steps[BC_BLOCK_NUM_PIXELS];
+	const f32 err = fitSteps(values, 1, p0, p1, 8, nullptr, steps);
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		indices_out[i] = steps[i] == 0 ? 0 : steps[i] == 7 ? 1 : steps[i] + 1;
+		weights_out[i] = f32(steps[i]) * (1.0f / 7.0f);
+	}
+	return err;
+}
+
+// 6 value mode (r0 <= r1), the palette also contains 0 and 255 so the closest entry of each pixel
+// is found by testing all of them. Returns the squared error.
+static f32 bc4Evaluate6(const f32 values[BC_BLOCK_NUM_PIXELS], u8 r0, u8 r1, u32 indices_out[BC_BLOCK_NUM_PIXELS])
+{
+	u8 palette[8];
+	bc4Palette(r0, r1, palette);
+	f32 best_errs[BC_BLOCK_NUM_PIXELS];
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		best_errs[i] = F32_MAX;
+		indices_out[i] = 0;
+	}
+	for (u32 p = 0; p < 8; p++) {
+		const f32 palette_val = f32(palette[p]);
+		#pragma omp simd
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+			const f32 d = values[i] - palette_val;
+			const f32 err = d * d;
+			const bool better = err < best_errs[i];
+			best_errs[i] = better ? err : best_errs[i];
+			indices_out[i] = better ? p : indices_out[i];
+		}
+	}
+	f32 err = 0.0f;
+	#pragma omp simd reduction(+:err)
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) err += best_errs[i];
+	return err;
+}
+
+// Tries both palette modes and keeps the one with the lowest error. The 8 value mode interpolates
+// between the endpoints (refined with least squares), the 6 value mode has explicit 0 and 255
+// entries, so its endpoints only need to cover the values in between.
+static void bc4EncodeBlock(const BCBlockF32& block, u32 channel, u8* dst)
+{
+	const f32 (*values)[BC_BLOCK_NUM_PIXELS] = block.c + channel;
+	f32 min_val = 255.0f, max_val = 0.0f;
+	f32 min_inner = 255.0f, max_inner = 0.0f;
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		const f32 v = values[0][i];
+		min_val = f32_min(min_val, v);
+		max_val = f32_max(max_val, v);
+		if (v != 0.0f && v != 255.0f) {
+			min_inner = f32_min(min_inner, v);
+			max_inner = f32_max(max_inner, v);
+		}
+	}
+
+	u8 r0 = u8(max_val);
+	u8 r1 = u8(min_val);
+	u32 indices[BC_BLOCK_NUM_PIXELS];
+	f32 weights[BC_BLOCK_NUM_PIXELS];
+	f32 best_err = bc4Evaluate8(values, r0, r1, indices, weights);
+
+	// Refine the endpoints for the chosen indices, keep them as long as the error decreases
+	for (u32 iter = 0; iter < 2 && best_err > 0.0f; iter++) {
+		f32 e0[4], e1[4];
+		if (!fitEndpointsLeastSquares(values, 1, weights, e0, e1)) break;
+		u8 candidate_r0 = u8(e0[0] + 0.5f);
+		u8 candidate_r1 = u8(e1[0] + 0.5f);
+		if (candidate_r0 <= candidate_r1) break; // Would switch to the 6 value mode
+		u32 candidate_indices[BC_BLOCK_NUM_PIXELS];
+		f32 candidate_weights[BC_BLOCK_NUM_PIXELS];
+		const f32 err = bc4Evaluate8(values, candidate_r0, candidate_r1, candidate_indices, candidate_weights);
+		if (best_err <= err) break;
+		best_err = err;
+		r0 = candidate_r0;
+		r1 = candidate_r1;
+		memcpy(indices, candidate_indices, sizeof(indices));
+		memcpy(weights, candidate_weights, sizeof(weights));
+	}
+
+	// 6 value mode, only worth trying if the block has values at the ends of the range
+	if (best_err > 0.0f && (min_val == 0.0f || max_val == 255.0f)) {
+		if (max_inner < min_inner) min_inner = max_inner = 0.0f; // Only 0 and 255 in block
+		u32 candidate_indices[BC_BLOCK_NUM_PIXELS];
+		const f32 err = bc4Evaluate6(values[0], u8(min_inner), u8(max_inner), candidate_indices);
+		if (err < best_err) {
+			r0 = u8(min_inner);
+			r1 = u8(max_inner);
+			memcpy(indices, candidate_indices, sizeof(indices));
+		}
+	}
+
+	bc4WriteBlock(r0, r1, indices, dst);
+}
+
+static void bc4DecodeBlock(const u8* src, u32 channel, BCBlockRGBA& block)
+{
+	u8 palette[8];
+	bc4Palette(src[0], src[1], palette);
+	u64 indices = 0;
+	for (u32 i = 0; i < 6; i++) indices |= u64(src[2 + i]) << (8 * i);
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		block.pixels[i][channel] = palette[(indices >> (3 * i)) & 0x7];
+	}
+}
+
+// BC7 (mode 6)
+// ------------------------------------------------------------------------------------------------
+
+sfz_constant u32 BC7_WEIGHTS_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+sfz_constant f32 BC7_STEP_WEIGHTS[16] = {
+	0.0f / 64.0f, 4.0f / 64.0f, 9.0f / 64.0f, 13.0f / 64.0f, 17.0f / 64.0f, 21.0f / 64.0f, 26.0f / 64.0f, 30.0f / 64.0f,
+	34.0f / 64.0f, 38.0f / 64.0f, 43.0f / 64.0f, 47.0f / 64.0f, 51.0f / 64.0f, 55.0f / 64.0f, 60.0f / 64.0f, 64.0f / 64.0f
+};
+
+static void bc7Palette(const BCColor& e0, const BCColor& e1, BCColor palette[16])
+{
+	for (u32 i = 0; i < 16; i++) {
+		const u32 w = BC7_WEIGHTS_4[i];
+		for (u32 c = 0; c < 4; c++) {
+			palette[i][c] = u8(((64 - w) * u32(e0[c]) + w * u32(e1[c]) + 32) >> 6);
+		}
+	}
+}
+
+static BCColor bc7QuantizeEndpoint(const f32 e[4], u32 pbit)
+{
+	BCColor q = {};
+	for (u32 c = 0; c < 4; c++) {
+		const i32 v = i32_clamp(i32((e[c] - f32(pbit)) * 0.5f + 0.5f), 0, 127);
+		q[c] = u8((v << 1) | i32(pbit));
+	}
+	return q;
+}
+
+sfz_struct(BC7Block) {
+	BCColor q0;
+	BCColor q1;
+	u8 indices[BC_BLOCK_NUM_PIXELS];
+};
+
+// Quantizes the endpoints with all p-bit combinations, picks the palette entry of each pixel by
+// projecting it onto the quantized endpoints, and keeps the combination with the lowest error.
+static f32 bc7Evaluate(const BCBlockF32& block, const f32 e0[4], const f32 e1[4], BC7Block& out)
+{
+	f32 best_err = F32_MAX;
+	for (u32 p = 0; p < 4; p++) {
+		const BCColor q0 = bc7QuantizeEndpoint(e0, p & 1u);
+		const BCColor q1 = bc7QuantizeEndpoint(e1, p >> 1);
+		const f32 p0[4] = { f32(q0[0]), f32(q0[1]), f32(q0[2]), f32(q0[3]) };
+		const f32 p1[4] = { f32(q1[0]), f32(q1[1]), f32(q1[2]), f32(q1[3]) };
+		u32 steps[BC_BLOCK_NUM_PIXELS];
+		const f32 err = fitSteps(block.c, 4, p0, p1, 16, BC7_STEP_WEIGHTS, steps);
+		if (err < best_err) {
+			best_err = err;
+			out.q0 = q0;
+			out.q1 = q1;
+			for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) out.indices[i] = u8(steps[i]);
+		}
+	}
+	return best_err;
+}
+
+static void bc7EncodeBlock(const BCBlockF32& block, u8* dst)
+{
+	f32 e0[4], e1[4];
+	fitEndpoints(block, 4, e0, e1);
+	BC7Block best = {};
+	f32 best_err = bc7Evaluate(block, e0, e1, best);
+
+	// Refine the endpoints for the chosen indices, keep them as long as the error decreases
+	for (u32 iter = 0; iter < 2 && best_err > 0.0f; iter++) {
+		f32 weights[BC_BLOCK_NUM_PIXELS];
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) weights[i] = BC7_STEP_WEIGHTS[best.indices[i]];
+		if (!fitEndpointsLeastSquares(block.c, 4, weights, e0, e1)) break;
+		BC7Block candidate = {};
+		const f32 err = bc7Evaluate(block, e0, e1, candidate);
+		if (best_err <= err) break;
+		best = candidate;
+		best_err = err;
+	}
+
+	// The projection assumes evenly spaced palette entries, check the neighbouring entries of the
+	// exact palette to fix pixels close to the middle between two entries.
+	BCColor palette[16];
+	bc7Palette(best.q0, best.q1, palette);
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		const u32 idx = best.indices[i];
+		f32 best_pixel_err = F32_MAX;
+		for (u32 n = idx == 0 ? 0 : idx - 1; n <= u32_min(idx + 1, 15); n++) {
+			f32 err = 0.0f;
+			for (u32 c = 0; c < 4; c++) {
+				const f32 d = block.c[c][i] - f32(palette[n][c]);
+				err += d * d;
+			}
+			if (err < best_pixel_err) {
+				best_pixel_err = err;
+				best.indices[i] = u8(n);
+			}
+		}
+	}
+
+	// The MSB of the first index is implicitly 0, swap endpoints if necessary
+	if (best.indices[0] >= 8) {
+		const BCColor tmp = best.q0;
+		best.q0 = best.q1;
+		best.q1 = tmp;
+		for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) best.indices[i] = u8(15 - best.indices[i]);
+	}
+
+	BCBitWriter w = {};
+	writeBits(w, 1u << 6, 7); // Mode 6
+	for (u32 c = 0; c < 4; c++) {
+		writeBits(w, best.q0[c] >> 1, 7);
+		writeBits(w, best.q1[c] >> 1, 7);
+	}
+	writeBits(w, best.q0[0] & 1u, 1);
+	writeBits(w, best.q1[0] & 1u, 1);
+	writeBits(w, best.indices[0], 3);
+	for (u32 i = 1; i < BC_BLOCK_NUM_PIXELS; i++) writeBits(w, best.indices[i], 4);
+	sfz_assert(w.offset == 128);
+	memcpy(dst, w.bits, 16);
+}
+
+static void bc7DecodeBlock(const u8* src, BCBlockRGBA& block)
+{
+	// Only mode 6 is supported
+	if ((src[0] & 0x7F) != (1u << 6)) {
+		block = {};
+		return;
+	}
+
+	u32 offset = 7;
+	BCColor e0 = {}, e1 = {};
+	for (u32 c = 0; c < 4; c++) {
+		e0[c] = u8(readBits(src, offset, 7) << 1);
+		e1[c] = u8(readBits(src, offset, 7) << 1);
+	}
+	const u32 p0 = readBits(src, offset, 1);
+	const u32 p1 = readBits(src, offset, 1);
+	for (u32 c = 0; c < 4; c++) {
+		e0[c] |= u8(p0);
+		e1[c] |= u8(p1);
+	}
+
+	BCColor palette[16];
+	bc7Palette(e0, e1, palette);
+	for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) {
+		block.pixels[i] = palette[readBits(src, offset, i == 0 ? 3 : 4)];
+	}
+}
+
+// Block compression API
+// ------------------------------------------------------------------------------------------------
+
+sfz_extern_c bool gpuFormatIsBlockCompressed(GpuFormat format)
+{
+	return gpuBCBytesPerBlock(format) != 0;
+}
+
+sfz_extern_c u32 gpuBCBytesPerBlock(GpuFormat format)
+{
+	switch (format) {
+	case GPU_FORMAT_BC1_UNORM: return 8;
+	case GPU_FORMAT_BC4_UNORM: return 8;
+	case GPU_FORMAT_BC5_UNORM: return 16;
+	case GPU_FORMAT_BC7_UNORM: return 16;
+	default: break;
+	}
+	return 0;
+}
+
+sfz_extern_c u32 gpuBCCalcSizeBytes(GpuFormat format, i32x2 res)
+{
+	const i32x2 num_blocks = calcNumBlocks(res);
+	return u32(num_blocks.x) * u32(num_blocks.y) * gpuBCBytesPerBlock(format);
+}
+
+sfz_extern_c bool gpuBCEncodeBlockRows(
+	GpuFormat format, const u8* src_rgba8, i32x2 res, u8* dst, i32 block_row_begin, i32 block_row_end)
+{
+	if (!validateArgs(format, res, block_row_begin, block_row_end)) return false;
+	const i32x2 num_blocks = calcNumBlocks(res);
+	const u32 block_size = gpuBCBytesPerBlock(format);
+
+	for (i32 block_y = block_row_begin; block_y < block_row_end; block_y++) {
+		for (i32 block_x = 0; block_x < num_blocks.x; block_x++) {
+			const BCBlockF32 block = blockToF32(loadBlock(src_rgba8, res, block_x, block_y));
+			u8* block_dst = dst + (u64(block_y) * num_blocks.x + block_x) * block_size;
+			switch (format) {
+			case GPU_FORMAT_BC1_UNORM: bc1EncodeBlock(block, block_dst); break;
+			case GPU_FORMAT_BC4_UNORM: bc4EncodeBlock(block, 0, block_dst); break;
+			case GPU_FORMAT_BC5_UNORM:
+				bc4EncodeBlock(block, 0, block_dst);
+				bc4EncodeBlock(block, 1, block_dst + 8);
+				break;
+			case GPU_FORMAT_BC7_UNORM: bc7EncodeBlock(block, block_dst); break;
+			default: sfz_assert(false); break;
+			}
+		}
+	}
+	return true;
+}
+
+sfz_extern_c bool gpuBCDecodeBlockRows(
+	GpuFormat format, const u8* src, i32x2 res, u8* dst_rgba8, i32 block_row_begin, i32 block_row_end)
+{
+	if (!validateArgs(format, res, block_row_begin, block_row_end)) return false;
+	const i32x2 num_blocks = calcNumBlocks(res);
+	const u32 block_size = gpuBCBytesPerBlock(format);
+
+	for (i32 block_y = block_row_begin; block_y < block_row_end; block_y++) {
+		for (i32 block_x = 0; block_x < num_blocks.x; block_x++) {
+			const u8* block_src = src + (u64(block_y) * num_blocks.x + block_x) * block_size;
+			BCBlockRGBA block = {};
+			for (u32 i = 0; i < BC_BLOCK_NUM_PIXELS; i++) block.pixels[i][3] = 255;
+			switch (format) {
+			case GPU_FORMAT_BC1_UNORM: bc1DecodeBlock(block_src, block); break;
+			case GPU_FORMAT_BC4_UNORM: bc4DecodeBlock(block_src, 0, block); break;
+			case GPU_FORMAT_BC5_UNORM:
+				bc4DecodeBlock(block_src, 0, block);
+				bc4DecodeBlock(block_src + 8, 1, block);
+				break;
+			case GPU_FORMAT_BC7_UNORM: bc7DecodeBlock(block_src, block); break;
+			default: sfz_assert(false); break;
+			}
+			storeBlock(block, dst_rgba8, res, block_x, block_y);
+		}
+	}
+	return true;
+}
+
+sfz_extern_c bool gpuBCEncode(GpuFormat format, const u8* src_rgba8, i32x2 res, u8* dst)
+{
+	if (!validateArgs(format, res, 0, 0)) return false;
+	const i32 num_block_rows = calcNumBlocks(res).y;
+#pragma omp parallel for schedule(dynamic)
+	for (i32 block_y = 0; block_y < num_block_rows; block_y++) {
+		gpuBCEncodeBlockRows(format, src_rgba8, res, dst, block_y, block_y + 1);
+	}
+	return true;
+}
+
+sfz_extern_c bool gpuBCDecode(GpuFormat format, const u8* src, i32x2 res, u8* dst_rgba8)
+{
+	if (!validateArgs(format, res, 0, 0)) return false;
+	const i32 num_block_rows = calcNumBlocks(res).y;
+#pragma omp parallel for schedule(dynamic)
+	for (i32 block_y = 0; block_y < num_block_rows; block_y++) {
+		gpuBCDecodeBlockRows(format, src, res, dst_rgba8, block_y, block_y + 1);
+	}
+	return true;
+}
+
+sfz_extern_c f32 gpuBCCalcPSNR(const u8* a_rgba8, const u8* b_rgba8, i32x2 res, u32 num_channels)
+{
+	sfz_assert(0 < num_channels && num_channels <= 4);
+	const u64 num_pixels = u64(res.x) * u64(res.y);
+	f64 sum_sq_err = 0.0;
+	for (u64 i = 0; i < num_pixels; i++) {
+		for (u32 c = 0; c < num_channels; c++) {
+			const f64 d = f64(a_rgba8[i * 4 + c]) - f64(b_rgba8[i * 4 + c]);
+			sum_sq_err += d * d;
+		}
+	}
+	if (sum_sq_err == 0.0) return F32_MAX;
+	const f64 mse = sum_sq_err / f64(num_pixels * num_channels);
+	return f32(10.0 * log10((255.0 * 255.0) / mse));
+}
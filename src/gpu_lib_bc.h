@@ -0,0 +1,61 @@
+#pragma once
+#ifndef GPU_LIB_BC_H
+#define GPU_LIB_BC_H
+
+#include <gpu_lib.h>
+
+// Block compression
+// ------------------------------------------------------------------------------------------------
+
+// A small CPU encoder (and decoder) for the block compressed formats in GpuFormat. Intended to be
+// used at asset-build time, it does not depend on D3D12 and can be used without a GpuLib.
+//
+// Input to the encoder (and output from the decoder) is always tightly packed RGBA8 pixels. BC4
+// only uses the R channel and BC5 only the R and G channels, the decoder sets the unused channels
+// to 0 (and alpha to 255). Textures whose resolution isn't divisible by 4 are padded by clamping
+// to the edge.
+//
+// Each block is encoded by finding the principal axis of its colors, projecting the pixels onto
+// the quantized endpoints to pick indices and then refining the endpoints with least squares for
+// those indices. The per pixel loops work on one channel at a time so they vectorize, and
+// gpuBCEncode() encodes block rows in parallel (OpenMP). The tests in tests/gpu_lib_bc_tests.cpp
+// check quality (PSNR) and print throughput (MPix/s) for each format.
+//
+// Supported formats:
+// * BC1: RGB, 8 bytes per block. Always uses 4-color mode, alpha is ignored.
+// * BC4: R, 8 bytes per block. Both the 8 value mode and the 6 value mode (with explicit 0 and
+//        255) are tried, the one with the lowest error is kept.
+// * BC5: RG, 16 bytes per block.
+// * BC7: RGBA, 16 bytes per block. Only mode 6 is used when encoding, and only mode 6 is
+//        understood by the decoder (other modes decode to 0). The decoder exists to validate the
+//        encoder, not to decode arbitrary BC7 data.
+
+// Returns whether the format is block compressed or not.
+sfz_extern_c bool gpuFormatIsBlockCompressed(GpuFormat format);
+
+// Returns the number of bytes per 4x4 block for a block compressed format, 0 otherwise.
+sfz_extern_c u32 gpuBCBytesPerBlock(GpuFormat format);
+
+// Returns the number of bytes required to store a block compressed texture of the given resolution.
+sfz_extern_c u32 gpuBCCalcSizeBytes(GpuFormat format, i32x2 res);
+
+// Encodes the block rows [block_row_begin, block_row_end) of the image. A block row is 4 pixel
+// rows. The entire dst image must be allocated (gpuBCCalcSizeBytes()), but only the specified
+// block rows are written. Different ranges can safely be encoded on different threads at the same
+// time. Returns false if the input is invalid.
+sfz_extern_c bool gpuBCEncodeBlockRows(
+	GpuFormat format, const u8* src_rgba8, i32x2 res, u8* dst, i32 block_row_begin, i32 block_row_end);
+
+// Decodes the block rows [block_row_begin, block_row_end) of the image, see gpuBCEncodeBlockRows().
+sfz_extern_c bool gpuBCDecodeBlockRows(
+	GpuFormat format, const u8* src, i32x2 res, u8* dst_rgba8, i32 block_row_begin, i32 block_row_end);
+
+// Encodes/decodes an entire image, block rows are distributed over all available cores (OpenMP).
+sfz_extern_c bool gpuBCEncode(GpuFormat format, const u8* src_rgba8, i32x2 res, u8* dst);
+sfz_extern_c bool gpuBCDecode(GpuFormat format, const u8* src, i32x2 res, u8* dst_rgba8);
+
+// Calculates the PSNR (in dB) between two RGBA8 images over the first num_channels channels. Useful
+// to validate the quality of the encoder. Returns F32_MAX if the images are identical.
+sfz_extern_c f32 gpuBCCalcPSNR(const u8* a_rgba8, const u8* b_rgba8, i32x2 res, u32 num_channels);
+
+#endif // GPU_LIB_BC_H
@@ -0,0 +1,476 @@
+#include "gpu_lib_cmd_stream.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+const char* gpuResStateToString(GpuResState state)
+{
+	switch (state) {
+	case GPU_RES_STATE_COMMON: return "COMMON";
+	case GPU_RES_STATE_UNORDERED_ACCESS: return "UNORDERED_ACCESS";
+	case GPU_RES_STATE_COPY_SOURCE: return "COPY_SOURCE";
+	case GPU_RES_STATE_COPY_DEST: return "COPY_DEST";
+	case GPU_RES_STATE_INDIRECT_ARGUMENT: return "INDIRECT_ARGUMENT";
+	case GPU_RES_STATE_GENERIC_READ: return "GENERIC_READ";
+	case GPU_RES_STATE_PRESENT: return "PRESENT";
+	default: break;
+	}
+	return "INVALID";
+}
+
+const char* gpuCmdTypeToString(GpuCmdType type)
+{
+	switch (type) {
+	case GPU_CMD_NOP: return "NOP";
+	case GPU_CMD_BARRIER: return "BARRIER";
+	case GPU_CMD_COPY_BUFFER: return "COPY_BUFFER";
+	case GPU_CMD_COPY_BUFFER_TO_TEX: return "COPY_BUFFER_TO_TEX";
+	case GPU_CMD_COPY_TEX_TO_BUFFER: return "COPY_TEX_TO_BUFFER";
+	case GPU_CMD_COPY_TEX: return "COPY_TEX";
+	case GPU_CMD_TIMESTAMP: return "TIMESTAMP";
+	case GPU_CMD_SET_KERNEL: return "SET_KERNEL";
+	case GPU_CMD_SET_PARAMS: return "SET_PARAMS";
+	case GPU_CMD_SET_LARGE_PARAMS: return "SET_LARGE_PARAMS";
+	case GPU_CMD_DISPATCH: return "DISPATCH";
+	case GPU_CMD_DISPATCH_INDIRECT: return "DISPATCH_INDIRECT";
+	case GPU_CMD_SEGMENT_END: return "SEGMENT_END";
+	default: break;
+	}
+	return "INVALID";
+}
+
+static const char* cmdObjTypeToString(GpuCmdObjType type)
+{
+	switch (type) {
+	case GPU_CMD_OBJ_BUFFER: return "buffer";
+	case GPU_CMD_OBJ_TEXTURE: return "texture";
+	case GPU_CMD_OBJ_KERNEL: return "kernel";
+	case GPU_CMD_OBJ_QUERY_HEAP: return "query heap";
+	case GPU_CMD_OBJ_CMD_SIG: return "command signature";
+	default: break;
+	}
+	return "invalid object";
+}
+
+// Shrinks the stream to its first num_cmds commands, the arena memory after them is reused.
+static void cmdStreamTruncate(GpuCmdStream* stream, u32 num_cmds)
+{
+	sfz_assert(num_cmds <= stream->num_cmds);
+	stream->num_cmds = num_cmds;
+	stream->arena.getState()->currentOffsetBytes = u64(num_cmds) * sizeof(GpuCmd);
+}
+
+// Stream
+// ------------------------------------------------------------------------------------------------
+
+void cmdStreamInit(GpuCmdStream* stream, u32 max_num_cmds, SfzAllocator* allocator)
+{
+	stream->arena.init(allocator, u64(max_num_cmds) * sizeof(GpuCmd), sfz_dbg("GpuCmdStream::arena"));
+	stream->cmds = reinterpret_cast<GpuCmd*>(stream->arena.getState()->memory);
+	stream->num_cmds = 0;
+	stream->objs.init(256, allocator, sfz_dbg("GpuCmdStream::objs"));
+	stream->validate_kernel_set = false;
+	stream->tmp_last_barrier.init(256, allocator, sfz_dbg("GpuCmdStream::tmp_last_barrier"));
+}
+
+void cmdStreamReset(GpuCmdStream* stream)
+{
+	cmdStreamClearCmds(stream);
+	stream->objs.clear();
+	stream->validate_kernel_set = false;
+}
+
+void cmdStreamClearCmds(GpuCmdStream* stream)
+{
+	stream->arena.resetArena();
+	stream->num_cmds = 0;
+}
+
+u32 cmdStreamAddObj(GpuCmdStream* stream, const GpuCmdObj& obj)
+{
+	stream->objs.add(obj);
+	stream->tmp_last_barrier.add(U32_MAX);
+	return stream->objs.size() - 1;
+}
+
+bool cmdStreamRecord(GpuCmdStream* stream, const GpuCmd& cmd)
+{
+	void* mem = stream->arena.getArena()->alloc(sfz_dbg("GpuCmd"), sizeof(GpuCmd), alignof(GpuCmd));
+	if (mem == nullptr) return false;
+	GpuCmd* dst = static_cast<GpuCmd*>(mem);
+	sfz_assert(dst == stream->cmds + stream->num_cmds);
+	*dst = cmd;
+	stream->num_cmds += 1;
+	return true;
+}
+
+// Passes
+// ------------------------------------------------------------------------------------------------
+
+// Merges the barrier into an earlier barrier on the same resource in the same run, returns false
+// if they can't be merged and both are needed.
+static bool mergeBarrier(GpuCmdBarrier& other, const GpuCmdBarrier& barrier)
+{
+	// Any earlier barrier on the resource already synchronizes all earlier accesses to it, and a
+	// transition synchronizes the same accesses as an earlier UAV barrier.
+	if (barrier.uav) return true;
+	if (other.uav) {
+		other = barrier;
+		return true;
+	}
+
+	// Consecutive transitions (A -> B, B -> C) are folded into one (A -> C). A round trip back to
+	// UNORDERED_ACCESS still needs to synchronize, so it becomes a UAV barrier. Other round trips
+	// are kept as is.
+	if (other.after != barrier.before) return false;
+	if (other.before != barrier.after) {
+		other.after = barrier.after;
+		return true;
+	}
+	if (barrier.after == GPU_RES_STATE_UNORDERED_ACCESS) {
+		other.uav = true;
+		other.before = GPU_RES_STATE_COMMON;
+		other.after = GPU_RES_STATE_COMMON;
+		return true;
+	}
+	return false;
+}
+
+static void clearLastBarriers(GpuCmdStream* stream, u32 run_begin, u32 run_end)
+{
+	for (u32 i = run_begin; i < run_end; i++) {
+		const u32 obj = stream->cmds[i].barrier.obj;
+		if (obj < stream->objs.size()) stream->tmp_last_barrier[obj] = U32_MAX;
+	}
+}
+
+void cmdStreamMergeBarriers(GpuCmdStream* stream)
+{
+	// Index of the last kept barrier on each object in the current run, U32_MAX outside of runs
+	GpuCmd* cmds = stream->cmds;
+	u32* last_barrier = stream->tmp_last_barrier.data();
+	u32 num_kept = 0;
+	u32 run_begin = U32_MAX;
+	for (u32 i = 0; i < stream->num_cmds; i++) {
+		const GpuCmd cmd = cmds[i];
+		if (cmd.type == GPU_CMD_NOP) continue;
+
+		// End of run
+		if (cmd.type != GPU_CMD_BARRIER) {
+			if (run_begin != U32_MAX) {
+				clearLastBarriers(stream, run_begin, num_kept);
+				run_begin = U32_MAX;
+			}
+			cmds[num_kept] = cmd;
+			num_kept += 1;
+			continue;
+		}
+
+		if (run_begin == U32_MAX) run_begin = num_kept;
+		const u32 obj = cmd.barrier.obj;
+		if (obj < stream->objs.size()) { // Invalid barriers are kept as is, caught by validation
+			if (last_barrier[obj] != U32_MAX && mergeBarrier(cmds[last_barrier[obj]].barrier, cmd.barrier)) continue;
+			last_barrier[obj] = num_kept;
+		}
+		cmds[num_kept] = cmd;
+		num_kept += 1;
+	}
+	if (run_begin != U32_MAX) {
+		clearLastBarriers(stream, run_begin, num_kept);
+	}
+	cmdStreamTruncate(stream, num_kept);
+}
+
+void cmdStreamCoalesceCopies(GpuCmdStream* stream)
+{
+	GpuCmd* cmds = stream->cmds;
+	u32 num_kept = 0;
+	for (u32 i = 0; i < stream->num_cmds; i++) {
+		const GpuCmd cmd = cmds[i];
+		if (cmd.type == GPU_CMD_NOP) continue;
+		if (cmd.type == GPU_CMD_COPY_BUFFER && num_kept != 0 && cmds[num_kept - 1].type == GPU_CMD_COPY_BUFFER) {
+			GpuCmdCopyBuffer& prev = cmds[num_kept - 1].copy_buffer;
+			const GpuCmdCopyBuffer& copy = cmd.copy_buffer;
+			if (prev.dst == copy.dst && prev.src == copy.src &&
+				(prev.dst_offset + prev.num_bytes) == copy.dst_offset &&
+				(prev.src_offset + prev.num_bytes) == copy.src_offset) {
+				prev.num_bytes += copy.num_bytes;
+				continue;
+			}
+		}
+		cmds[num_kept] = cmd;
+		num_kept += 1;
+	}
+	cmdStreamTruncate(stream, num_kept);
+}
+
+// Validation
+// ------------------------------------------------------------------------------------------------
+
+sfz_struct(CmdValidator) {
+	GpuCmdStream* stream;
+	u32 cmd_idx;
+	GpuCmdType cmd_type;
+	bool valid;
+	u32 num_bound_not_ua; // Bound objects not in the UNORDERED_ACCESS state
+};
+
+static void validatorError(CmdValidator* v, const char* fmt, ...)
+{
+	v->valid = false;
+	char msg[256] = {};
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	va_end(args);
+	printf("[gpu_lib]: Invalid command %u (%s) in command stream: %s\n",
+		v->cmd_idx, gpuCmdTypeToString(v->cmd_type), msg);
+}
+
+// Returns the object if the index is valid and the object is of the given type, nullptr otherwise.
+static GpuCmdObj* validatorObj(CmdValidator* v, u32 obj_idx, GpuCmdObjType type)
+{
+	if (obj_idx >= v->stream->objs.size()) {
+		validatorError(v, "object %u doesn't exist (%u objects).", obj_idx, v->stream->objs.size());
+		return nullptr;
+	}
+	GpuCmdObj& obj = v->stream->objs[obj_idx];
+	if (obj.type != type) {
+		validatorError(v, "object %u is a %s, expected a %s.",
+			obj_idx, cmdObjTypeToString(obj.type), cmdObjTypeToString(type));
+		return nullptr;
+	}
+	return &obj;
+}
+
+static void validatorState(CmdValidator* v, u32 obj_idx, const GpuCmdObj& obj, GpuResState state, GpuResState alt)
+{
+	if (obj.state == state || obj.state == alt) return;
+	validatorError(v, "object %u is in state %s, expected %s.",
+		obj_idx, gpuResStateToString(obj.state), gpuResStateToString(state));
+}
+
+static void validatorSetState(CmdValidator* v, GpuCmdObj& obj, GpuResState state)
+{
+	if (obj.bound) {
+		if (obj.state != GPU_RES_STATE_UNORDERED_ACCESS) v->num_bound_not_ua -= 1;
+		if (state != GPU_RES_STATE_UNORDERED_ACCESS) v->num_bound_not_ua += 1;
+	}
+	obj.state = state;
+}
+
+static void validatorRange(CmdValidator* v, u32 obj_idx, const GpuCmdObj& obj, u64 offset, u64 num_bytes)
+{
+	if (offset <= obj.size && num_bytes <= (obj.size - offset)) return;
+	validatorError(v, "range [%llu, %llu) is outside of object %u (%llu bytes).",
+		offset, offset + num_bytes, obj_idx, obj.size);
+}
+
+static void validateBarrier(CmdValidator* v, const GpuCmdBarrier& barrier)
+{
+	if (barrier.obj >= v->stream->objs.size()) {
+		validatorError(v, "object %u doesn't exist (%u objects).", barrier.obj, v->stream->objs.size());
+		return;
+	}
+	GpuCmdObj& obj = v->stream->objs[barrier.obj];
+	if (obj.type != GPU_CMD_OBJ_BUFFER && obj.type != GPU_CMD_OBJ_TEXTURE) {
+		validatorError(v, "object %u is a %s, expected a buffer or texture.",
+			barrier.obj, cmdObjTypeToString(obj.type));
+		return;
+	}
+	if (barrier.uav) {
+		validatorState(v, barrier.obj, obj, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_UNORDERED_ACCESS);
+		return;
+	}
+	if (barrier.before >= GPU_RES_STATE_NUM || barrier.after >= GPU_RES_STATE_NUM) {
+		validatorError(v, "invalid resource state.");
+		return;
+	}
+	if (barrier.before == barrier.after) {
+		validatorError(v, "transition of object %u from %s to the same state.",
+			barrier.obj, gpuResStateToString(barrier.before));
+	}
+	if (obj.state != barrier.before) {
+		validatorError(v, "transition of object %u from %s, but it is in state %s.",
+			barrier.obj, gpuResStateToString(barrier.before), gpuResStateToString(obj.state));
+	}
+	validatorSetState(v, obj, barrier.after);
+}
+
+static void validateCopyBufferTex(CmdValidator* v, const GpuCmdCopyBufferTex& copy, bool to_tex)
+{
+	const GpuCmdObj* tex = validatorObj(v, copy.tex, GPU_CMD_OBJ_TEXTURE);
+	const GpuCmdObj* buffer = validatorObj(v, copy.buffer, GPU_CMD_OBJ_BUFFER);
+	if (tex == nullptr || buffer == nullptr) return;
+	if (to_tex) {
+		validatorState(v, copy.tex, *tex, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COPY_DEST);
+		validatorState(v, copy.buffer, *buffer, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_GENERIC_READ);
+	}
+	else {
+		validatorState(v, copy.tex, *tex, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_COPY_SOURCE);
+		validatorState(v, copy.buffer, *buffer, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COPY_DEST);
+	}
+	const u32 row_size = tex->width * gpuFormatGetBytesPerPixel(tex->format);
+	if (row_size == 0 || tex->height == 0) {
+		validatorError(v, "texture %u has no rows that can be copied.", copy.tex);
+		return;
+	}
+	if (copy.row_pitch < row_size) {
+		validatorError(v, "row pitch (%u) is smaller than a row (%u bytes).", copy.row_pitch, row_size);
+		return;
+	}
+	validatorRange(v, copy.buffer, *buffer, copy.buffer_offset, u64(copy.row_pitch) * (tex->height - 1) + row_size);
+}
+
+static void validateCopyTex(CmdValidator* v, const GpuCmdCopyTex& copy)
+{
+	const GpuCmdObj* dst = validatorObj(v, copy.dst, GPU_CMD_OBJ_TEXTURE);
+	const GpuCmdObj* src = validatorObj(v, copy.src, GPU_CMD_OBJ_TEXTURE);
+	if (dst == nullptr || src == nullptr) return;
+	if (copy.dst == copy.src) validatorError(v, "copy from texture %u to itself.", copy.dst);
+	validatorState(v, copy.dst, *dst, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COPY_DEST);
+	validatorState(v, copy.src, *src, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_COPY_SOURCE);
+	if (copy.width == 0 && copy.height == 0) {
+		if (dst->width != src->width || dst->height != src->height) {
+			validatorError(v, "whole texture copy between textures of different sizes (%ux%u and %ux%u).",
+				dst->width, dst->height, src->width, src->height);
+		}
+	}
+	else if (copy.width == 0 || copy.height == 0 ||
+		dst->width < copy.width || dst->height < copy.height || src->width < copy.width || src->height < copy.height) {
+		validatorError(v, "invalid region (%ux%u) for textures of size %ux%u and %ux%u.",
+			copy.width, copy.height, dst->width, dst->height, src->width, src->height);
+	}
+}
+
+static void validateDispatchState(CmdValidator* v)
+{
+	if (!v->stream->validate_kernel_set) validatorError(v, "no kernel set.");
+	if (v->num_bound_not_ua == 0) return;
+	for (u32 i = 0; i < v->stream->objs.size(); i++) {
+		const GpuCmdObj& obj = v->stream->objs[i];
+		if (!obj.bound || obj.state == GPU_RES_STATE_UNORDERED_ACCESS) continue;
+		validatorError(v, "bound object %u is in state %s, expected UNORDERED_ACCESS.",
+			i, gpuResStateToString(obj.state));
+	}
+}
+
+bool cmdStreamValidate(GpuCmdStream* stream)
+{
+	CmdValidator v = {};
+	v.stream = stream;
+	v.valid = true;
+	for (const GpuCmdObj& obj : stream->objs) {
+		if (obj.bound && obj.state != GPU_RES_STATE_UNORDERED_ACCESS) v.num_bound_not_ua += 1;
+	}
+
+	for (u32 i = 0; i < stream->num_cmds; i++) {
+		const GpuCmd& cmd = stream->cmds[i];
+		v.cmd_idx = i;
+		v.cmd_type = cmd.type;
+		switch (cmd.type) {
+		case GPU_CMD_NOP:
+			break;
+
+		case GPU_CMD_BARRIER:
+			validateBarrier(&v, cmd.barrier);
+			break;
+
+		case GPU_CMD_COPY_BUFFER: {
+			const GpuCmdCopyBuffer& copy = cmd.copy_buffer;
+			const GpuCmdObj* dst = validatorObj(&v, copy.dst, GPU_CMD_OBJ_BUFFER);
+			const GpuCmdObj* src = validatorObj(&v, copy.src, GPU_CMD_OBJ_BUFFER);
+			if (dst == nullptr || src == nullptr) break;
+			if (copy.dst == copy.src) validatorError(&v, "copy from buffer %u to itself.", copy.dst);
+			if (copy.num_bytes == 0) validatorError(&v, "copy of 0 bytes.");
+			validatorState(&v, copy.dst, *dst, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COPY_DEST);
+			validatorState(&v, copy.src, *src, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_GENERIC_READ);
+			validatorRange(&v, copy.dst, *dst, copy.dst_offset, copy.num_bytes);
+			validatorRange(&v, copy.src, *src, copy.src_offset, copy.num_bytes);
+		} break;
+
+		case GPU_CMD_COPY_BUFFER_TO_TEX:
+			validateCopyBufferTex(&v, cmd.copy_buffer_tex, true);
+			break;
+
+		case GPU_CMD_COPY_TEX_TO_BUFFER:
+			validateCopyBufferTex(&v, cmd.copy_buffer_tex, false);
+			break;
+
+		case GPU_CMD_COPY_TEX:
+			validateCopyTex(&v, cmd.copy_tex);
+			break;
+
+		case GPU_CMD_TIMESTAMP: {
+			const GpuCmdTimestamp& ts = cmd.timestamp;
+			const GpuCmdObj* query_heap = validatorObj(&v, ts.query_heap, GPU_CMD_OBJ_QUERY_HEAP);
+			const GpuCmdObj* dst = validatorObj(&v, ts.dst, GPU_CMD_OBJ_BUFFER);
+			if (query_heap == nullptr || dst == nullptr) break;
+			if (query_heap->size <= ts.query_idx) {
+				validatorError(&v, "query %u is outside of the query heap (%llu queries).", ts.query_idx, query_heap->size);
+			}
+			if ((ts.dst_offset % 8) != 0) validatorError(&v, "timestamp destination is not 8 byte aligned.");
+			validatorState(&v, ts.dst, *dst, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COPY_DEST);
+			validatorRange(&v, ts.dst, *dst, ts.dst_offset, sizeof(u64));
+		} break;
+
+		case GPU_CMD_SET_KERNEL:
+			if (validatorObj(&v, cmd.set_kernel.kernel, GPU_CMD_OBJ_KERNEL) != nullptr) {
+				stream->validate_kernel_set = true;
+			}
+			break;
+
+		case GPU_CMD_SET_PARAMS:
+			if (GPU_LAUNCH_PARAMS_MAX_SIZE < cmd.set_params.size || (cmd.set_params.size % 4) != 0) {
+				validatorError(&v, "invalid launch params size (%u bytes).", cmd.set_params.size);
+			}
+			break;
+
+		case GPU_CMD_SET_LARGE_PARAMS: {
+			const GpuCmdSetLargeParams& params = cmd.set_large_params;
+			const GpuCmdObj* buffer = validatorObj(&v, params.buffer, GPU_CMD_OBJ_BUFFER);
+			if (buffer == nullptr) break;
+			if ((params.offset % GPU_CMD_LARGE_PARAMS_ALIGN) != 0) {
+				validatorError(&v, "large launch params offset (%llu) is not %u byte aligned.",
+					params.offset, GPU_CMD_LARGE_PARAMS_ALIGN);
+			}
+			validatorState(&v, params.buffer, *buffer, GPU_RES_STATE_GENERIC_READ, GPU_RES_STATE_GENERIC_READ);
+			validatorRange(&v, params.buffer, *buffer, params.offset, params.size);
+		} break;
+
+		case GPU_CMD_DISPATCH: {
+			const GpuCmdDispatch& dispatch = cmd.dispatch;
+			validateDispatchState(&v);
+			const u32 groups[3] = { dispatch.num_groups_x, dispatch.num_groups_y, dispatch.num_groups_z };
+			for (u32 d = 0; d < 3; d++) {
+				if (groups[d] != 0 && groups[d] <= GPU_CMD_DISPATCH_MAX_NUM_GROUPS) continue;
+				validatorError(&v, "invalid number of groups (%u, %u, %u).", groups[0], groups[1], groups[2]);
+				break;
+			}
+		} break;
+
+		case GPU_CMD_DISPATCH_INDIRECT: {
+			const GpuCmdDispatchIndirect& dispatch = cmd.dispatch_indirect;
+			validateDispatchState(&v);
+			const GpuCmdObj* cmd_sig = validatorObj(&v, dispatch.cmd_sig, GPU_CMD_OBJ_CMD_SIG);
+			const GpuCmdObj* args = validatorObj(&v, dispatch.args, GPU_CMD_OBJ_BUFFER);
+			if (cmd_sig == nullptr || args == nullptr) break;
+			if (dispatch.count == 0) validatorError(&v, "indirect dispatch of 0 commands.");
+			validatorState(&v, dispatch.args, *args, GPU_RES_STATE_INDIRECT_ARGUMENT, GPU_RES_STATE_GENERIC_READ);
+			validatorRange(&v, dispatch.args, *args, dispatch.args_offset, cmd_sig->size * dispatch.count);
+		} break;
+
+		case GPU_CMD_SEGMENT_END:
+			stream->validate_kernel_set = false;
+			break;
+
+		default:
+			validatorError(&v, "unknown command type (%u).", u32(cmd.type));
+			break;
+		}
+	}
+	return v.valid;
+}
@@ -0,0 +1,464 @@
+#pragma once
+#ifndef GPU_LIB_CMD_STREAM_HPP
+#define GPU_LIB_CMD_STREAM_HPP
+
+#include <gpu_lib.h>
+
+#include <string.h>
+
+#include <sfz_cpp.hpp>
+#include <skipifzero_allocators.hpp>
+#include <skipifzero_arrays.hpp>
+
+// Command stream
+// ------------------------------------------------------------------------------------------------
+
+// The main queue's commands are recorded into a command stream instead of straight into a D3D12
+// command list. The stream is backend independent: commands are fixed size POD structs, allocated
+// back to back from an arena, and refer to resources, kernels etc. by index into the stream's
+// object table. The backend translates the stream to native commands when the work is submitted
+// (or earlier, if the arena fills up).
+//
+// Before translation the stream is optimized by passes over it:
+//
+// * cmdStreamMergeBarriers(): redundant UAV barriers are dropped and consecutive transitions of a
+//   resource are folded into one, within each run of back to back barriers. The backend records
+//   each run as a single batch.
+// * cmdStreamCoalesceCopies(): back to back buffer copies between the same buffers, where both the
+//   source and destination ranges directly follow each other, become a single copy.
+//
+// cmdStreamValidate() checks a stream against the object table: indices, bounds, group counts and
+// that every command sees its resources in the states it needs. It's run by the backend in debug
+// mode, and by the tests (tests/gpu_lib_cmd_stream_tests.cpp).
+
+// The resource states used by gpu_lib, a subset of D3D12_RESOURCE_STATES.
+enum GpuResState : u8 {
+	GPU_RES_STATE_COMMON = 0,
+	GPU_RES_STATE_UNORDERED_ACCESS,
+	GPU_RES_STATE_COPY_SOURCE,
+	GPU_RES_STATE_COPY_DEST,
+	GPU_RES_STATE_INDIRECT_ARGUMENT,
+	GPU_RES_STATE_GENERIC_READ, // Upload heaps, includes INDIRECT_ARGUMENT and constant buffer reads
+	GPU_RES_STATE_PRESENT,
+	GPU_RES_STATE_NUM
+};
+
+const char* gpuResStateToString(GpuResState state);
+
+// Objects
+// ------------------------------------------------------------------------------------------------
+
+enum GpuCmdObjType : u8 {
+	GPU_CMD_OBJ_BUFFER = 0,
+	GPU_CMD_OBJ_TEXTURE,
+	GPU_CMD_OBJ_KERNEL,
+	GPU_CMD_OBJ_QUERY_HEAP, // Timestamp queries
+	GPU_CMD_OBJ_CMD_SIG, // Indirect dispatch command signature
+	GPU_CMD_OBJ_NUM
+};
+
+// An object referenced by commands. The native object must stay alive until the stream has been
+// translated and the submit has finished executing, the table itself only lives until the stream
+// is reset.
+sfz_struct(GpuCmdObj) {
+	void* native; // Backend object, opaque to the stream
+	GpuCmdObjType type;
+
+	// Buffers and textures. The state the resource is in before the stream, advanced to the state
+	// after the validated commands by cmdStreamValidate(). Resources that are bound to dispatches
+	// must be in the UNORDERED_ACCESS state when dispatching.
+	GpuResState state;
+	bool bound;
+
+	u32 width; // Textures, in texels
+	u32 height;
+	GpuFormat format;
+	u64 size; // Buffers: bytes, query heaps: num queries, command signatures: args stride in bytes
+	bool sets_params; // Command signatures, launch params are undefined after an indirect dispatch
+};
+
+inline GpuCmdObj cmdObjBuffer(void* native, u64 size, GpuResState state, bool bound)
+{
+	GpuCmdObj obj = {};
+	obj.native = native;
+	obj.type = GPU_CMD_OBJ_BUFFER;
+	obj.state = state;
+	obj.bound = bound;
+	obj.size = size;
+	return obj;
+}
+
+inline GpuCmdObj cmdObjTexture(void* native, u32 width, u32 height, GpuFormat format, GpuResState state, bool bound)
+{
+	GpuCmdObj obj = {};
+	obj.native = native;
+	obj.type = GPU_CMD_OBJ_TEXTURE;
+	obj.state = state;
+	obj.bound = bound;
+	obj.width = width;
+	obj.height = height;
+	obj.format = format;
+	return obj;
+}
+
+inline GpuCmdObj cmdObjKernel(void* native)
+{
+	GpuCmdObj obj = {};
+	obj.native = native;
+	obj.type = GPU_CMD_OBJ_KERNEL;
+	return obj;
+}
+
+inline GpuCmdObj cmdObjQueryHeap(void* native, u32 num_queries)
+{
+	GpuCmdObj obj = {};
+	obj.native = native;
+	obj.type = GPU_CMD_OBJ_QUERY_HEAP;
+	obj.size = num_queries;
+	return obj;
+}
+
+inline GpuCmdObj cmdObjCmdSig(void* native, u32 args_stride, bool sets_params)
+{
+	GpuCmdObj obj = {};
+	obj.native = native;
+	obj.type = GPU_CMD_OBJ_CMD_SIG;
+	obj.size = args_stride;
+	obj.sets_params = sets_params;
+	return obj;
+}
+
+// Commands
+// ------------------------------------------------------------------------------------------------
+
+enum GpuCmdType : u8 {
+	GPU_CMD_NOP = 0,
+	GPU_CMD_BARRIER, // Transition (whole resource) or UAV barrier
+	GPU_CMD_COPY_BUFFER,
+	GPU_CMD_COPY_BUFFER_TO_TEX, // Whole texture from rows in a buffer
+	GPU_CMD_COPY_TEX_TO_BUFFER, // Whole texture to rows in a buffer
+	GPU_CMD_COPY_TEX, // Whole texture, or the top left width x height texels if non-zero
+	GPU_CMD_TIMESTAMP, // Takes a timestamp and writes it (u64) to a buffer
+	GPU_CMD_SET_KERNEL,
+	GPU_CMD_SET_PARAMS, // Root constants
+	GPU_CMD_SET_LARGE_PARAMS, // Constant buffer in a GENERIC_READ buffer
+	GPU_CMD_DISPATCH,
+	GPU_CMD_DISPATCH_INDIRECT,
+	GPU_CMD_SEGMENT_END, // Ends the current native command list, see GpuCmdSegmentEnd
+	GPU_CMD_NUM
+};
+
+const char* gpuCmdTypeToString(GpuCmdType type);
+
+sfz_struct(GpuCmdBarrier) {
+	u32 obj;
+	bool uav; // UAV barrier if set, otherwise a transition from before to after
+	GpuResState before;
+	GpuResState after;
+};
+
+sfz_struct(GpuCmdCopyBuffer) {
+	u32 dst;
+	u32 src;
+	u64 dst_offset;
+	u64 src_offset;
+	u64 num_bytes;
+};
+
+// The rows of the texture are row_pitch bytes apart in the buffer, starting at buffer_offset.
+sfz_struct(GpuCmdCopyBufferTex) {
+	u32 tex;
+	u32 buffer;
+	u64 buffer_offset;
+	u32 row_pitch;
+};
+
+sfz_struct(GpuCmdCopyTex) {
+	u32 dst;
+	u32 src;
+	u32 width; // 0 to copy the whole texture, both must be the same size
+	u32 height;
+};
+
+sfz_struct(GpuCmdTimestamp) {
+	u32 query_heap;
+	u32 query_idx;
+	u32 dst;
+	u64 dst_offset;
+};
+
+sfz_struct(GpuCmdSetKernel) {
+	u32 kernel;
+};
+
+sfz_struct(GpuCmdSetParams) {
+	u32 size;
+	u32 params[GPU_LAUNCH_PARAMS_MAX_SIZE / 4];
+};
+
+sfz_struct(GpuCmdSetLargeParams) {
+	u32 buffer;
+	u32 size;
+	u64 offset;
+};
+
+sfz_struct(GpuCmdDispatch) {
+	u32 num_groups_x;
+	u32 num_groups_y;
+	u32 num_groups_z;
+};
+
+sfz_struct(GpuCmdDispatchIndirect) {
+	u32 cmd_sig;
+	u32 args;
+	u64 args_offset;
+	u32 count;
+};
+
+// The native command list is closed and stored in slot exec_list_idx of the backend's list of
+// command lists to execute, so that other work can be executed between it and the next segment.
+// All state set by commands (kernel and launch params) is reset.
+sfz_struct(GpuCmdSegmentEnd) {
+	u32 exec_list_idx;
+};
+
+sfz_struct(GpuCmd) {
+	GpuCmdType type;
+	union {
+		GpuCmdBarrier barrier;
+		GpuCmdCopyBuffer copy_buffer;
+		GpuCmdCopyBufferTex copy_buffer_tex; // COPY_BUFFER_TO_TEX and COPY_TEX_TO_BUFFER
+		GpuCmdCopyTex copy_tex;
+		GpuCmdTimestamp timestamp;
+		GpuCmdSetKernel set_kernel;
+		GpuCmdSetParams set_params;
+		GpuCmdSetLargeParams set_large_params;
+		GpuCmdDispatch dispatch;
+		GpuCmdDispatchIndirect dispatch_indirect;
+		GpuCmdSegmentEnd segment_end;
+	};
+};
+sfz_static_assert(sizeof(GpuCmd) == 64);
+
+inline GpuCmd cmdTransition(u32 obj, GpuResState before, GpuResState after)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_BARRIER;
+	cmd.barrier.obj = obj;
+	cmd.barrier.before = before;
+	cmd.barrier.after = after;
+	return cmd;
+}
+
+inline GpuCmd cmdUavBarrier(u32 obj)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_BARRIER;
+	cmd.barrier.obj = obj;
+	cmd.barrier.uav = true;
+	return cmd;
+}
+
+inline GpuCmd cmdCopyBuffer(u32 dst, u64 dst_offset, u32 src, u64 src_offset, u64 num_bytes)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_COPY_BUFFER;
+	cmd.copy_buffer.dst = dst;
+	cmd.copy_buffer.src = src;
+	cmd.copy_buffer.dst_offset = dst_offset;
+	cmd.copy_buffer.src_offset = src_offset;
+	cmd.copy_buffer.num_bytes = num_bytes;
+	return cmd;
+}
+
+inline GpuCmd cmdCopyBufferToTex(u32 tex, u32 buffer, u64 buffer_offset, u32 row_pitch)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_COPY_BUFFER_TO_TEX;
+	cmd.copy_buffer_tex.tex = tex;
+	cmd.copy_buffer_tex.buffer = buffer;
+	cmd.copy_buffer_tex.buffer_offset = buffer_offset;
+	cmd.copy_buffer_tex.row_pitch = row_pitch;
+	return cmd;
+}
+
+inline GpuCmd cmdCopyTexToBuffer(u32 buffer, u64 buffer_offset, u32 row_pitch, u32 tex)
+{
+	GpuCmd cmd = cmdCopyBufferToTex(tex, buffer, buffer_offset, row_pitch);
+	cmd.type = GPU_CMD_COPY_TEX_TO_BUFFER;
+	return cmd;
+}
+
+inline GpuCmd cmdCopyTex(u32 dst, u32 src, u32 width = 0, u32 height = 0)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_COPY_TEX;
+	cmd.copy_tex.dst = dst;
+	cmd.copy_tex.src = src;
+	cmd.copy_tex.width = width;
+	cmd.copy_tex.height = height;
+	return cmd;
+}
+
+inline GpuCmd cmdTimestamp(u32 query_heap, u32 query_idx, u32 dst, u64 dst_offset)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_TIMESTAMP;
+	cmd.timestamp.query_heap = query_heap;
+	cmd.timestamp.query_idx = query_idx;
+	cmd.timestamp.dst = dst;
+	cmd.timestamp.dst_offset = dst_offset;
+	return cmd;
+}
+
+inline GpuCmd cmdSetKernel(u32 kernel)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_SET_KERNEL;
+	cmd.set_kernel.kernel = kernel;
+	return cmd;
+}
+
+// params_size must be at most GPU_LAUNCH_PARAMS_MAX_SIZE.
+inline GpuCmd cmdSetParams(const void* params, u32 params_size)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_SET_PARAMS;
+	cmd.set_params.size = params_size;
+	if (params_size != 0 && params_size <= GPU_LAUNCH_PARAMS_MAX_SIZE) memcpy(cmd.set_params.params, params, params_size);
+	return cmd;
+}
+
+inline GpuCmd cmdSetLargeParams(u32 buffer, u64 offset, u32 size)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_SET_LARGE_PARAMS;
+	cmd.set_large_params.buffer = buffer;
+	cmd.set_large_params.size = size;
+	cmd.set_large_params.offset = offset;
+	return cmd;
+}
+
+inline GpuCmd cmdDispatch(u32 num_groups_x, u32 num_groups_y, u32 num_groups_z)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_DISPATCH;
+	cmd.dispatch.num_groups_x = num_groups_x;
+	cmd.dispatch.num_groups_y = num_groups_y;
+	cmd.dispatch.num_groups_z = num_groups_z;
+	return cmd;
+}
+
+inline GpuCmd cmdDispatchIndirect(u32 cmd_sig, u32 args, u64 args_offset, u32 count)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_DISPATCH_INDIRECT;
+	cmd.dispatch_indirect.cmd_sig = cmd_sig;
+	cmd.dispatch_indirect.args = args;
+	cmd.dispatch_indirect.args_offset = args_offset;
+	cmd.dispatch_indirect.count = count;
+	return cmd;
+}
+
+inline GpuCmd cmdSegmentEnd(u32 exec_list_idx)
+{
+	GpuCmd cmd = {};
+	cmd.type = GPU_CMD_SEGMENT_END;
+	cmd.segment_end.exec_list_idx = exec_list_idx;
+	return cmd;
+}
+
+// Stream
+// ------------------------------------------------------------------------------------------------
+
+sfz_constant u32 GPU_CMD_DISPATCH_MAX_NUM_GROUPS = 65535; // Per dimension
+sfz_constant u32 GPU_CMD_LARGE_PARAMS_ALIGN = 256;
+
+sfz_struct(GpuCmdStream) {
+	// Commands are allocated back to back from the arena, so they form a contiguous array starting
+	// at the beginning of it (cmds). Cleared by cmdStreamClearCmds() once they have been translated.
+	sfz::ArenaHeap arena;
+	GpuCmd* cmds;
+	u32 num_cmds;
+
+	// Objects are kept until cmdStreamReset(), so they can be used by commands recorded after the
+	// commands before them have been translated.
+	SfzArray<GpuCmdObj> objs;
+
+	// Validation state carried between cmdStreamValidate() calls
+	bool validate_kernel_set;
+
+	// Scratch memory for cmdStreamMergeBarriers(), one entry per object
+	SfzArray<u32> tmp_last_barrier;
+};
+
+// The arena holds up to max_num_cmds commands, recording fails once it's full.
+void cmdStreamInit(GpuCmdStream* stream, u32 max_num_cmds, SfzAllocator* allocator);
+
+// Clears both commands and objects.
+void cmdStreamReset(GpuCmdStream* stream);
+
+// Clears the commands, the objects are kept.
+void cmdStreamClearCmds(GpuCmdStream* stream);
+
+// Returns the index of the object, used to refer to it in commands.
+u32 cmdStreamAddObj(GpuCmdStream* stream, const GpuCmdObj& obj);
+
+// Appends a command to the stream, returns false if the arena is full. The caller is then expected
+// to translate the stream and clear its commands before trying again.
+bool cmdStreamRecord(GpuCmdStream* stream, const GpuCmd& cmd);
+
+// Passes, see the top of this file. Both compact the stream in place.
+void cmdStreamMergeBarriers(GpuCmdStream* stream);
+void cmdStreamCoalesceCopies(GpuCmdStream* stream);
+
+// Validates the commands against the objects, prints every error found. The object states are
+// advanced to the state after the commands, so a stream translated in several parts can be
+// validated one part at a time.
+bool cmdStreamValidate(GpuCmdStream* stream);
+
+// Translation
+// ------------------------------------------------------------------------------------------------
+
+// The state the backend binds while translating a stream into a command list, used to skip
+// redundant state changes. The root signature and global descriptors are bound once when the
+// command list is reset, which also resets this. Root constants are kept when the pso changes, so
+// consecutive dispatches with the same params (or a prefix of them) only set them once, even if the
+// kernel differs.
+sfz_struct(GpuBoundState) {
+	void* pso; // Native kernel object
+	u32 params[GPU_LAUNCH_PARAMS_MAX_SIZE / 4];
+	u32 params_size; // 0 if unknown
+};
+
+// Returns whether the pso needs to be set, i.e. a different one is bound. Marks it as bound.
+inline bool boundStateSetKernel(GpuBoundState* bound, void* pso)
+{
+	if (bound->pso == pso) return false;
+	bound->pso = pso;
+	return true;
+}
+
+// Returns whether the launch params root constants need to be set, i.e. they aren't the params
+// already bound or a prefix of them. Marks them as bound. params_size must be at most
+// GPU_LAUNCH_PARAMS_MAX_SIZE.
+inline bool boundStateSetParams(GpuBoundState* bound, const void* params, u32 params_size)
+{
+	if (params_size == 0) return false;
+
+	// Constants past params_size are left as they were, so the bound params are still known
+	const bool already_bound = params_size <= bound->params_size && memcmp(bound->params, params, params_size) == 0;
+	if (already_bound) return false;
+	memcpy(bound->params, params, params_size);
+	bound->params_size = u32_max(bound->params_size, params_size);
+	return true;
+}
+
+// Called after commands that leave the root constants undefined, e.g. an indirect dispatch whose
+// command signature sets them.
+inline void boundStateInvalidateParams(GpuBoundState* bound)
+{
+	bound->params_size = 0;
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "gpu_lib_internal.hpp"
+#include "gpu_lib_kernel_bundle.hpp"
 
 // D3D12 Agility SDK exports
 // ------------------------------------------------------------------------------------------------
@@ -42,17 +43,467 @@ static void logDebugMessages(ID3D12InfoQueue* info_queue)
 	info_queue->ClearStoredMessages();
 }
 
+// Pending releases
+// ------------------------------------------------------------------------------------------------
+
+// Keeps the object alive until all submits that could potentially be using it have finished.
+static void retireObject(GpuLib* gpu, ComPtr<IUnknown> object)
+{
+	if (object == nullptr) return;
+	GpuPendingRelease& release = gpu->pending_releases.add();
+	release.object = sfz_move(object);
+	release.submit_idx = gpu->curr_submit_idx;
+	release.async_fence_value = gpu->async_fence_value;
+}
+
+static void releaseCompletedObjects(GpuLib* gpu)
+{
+	const u64 async_completed_value = gpu->async_fence->GetCompletedValue();
+	for (u32 i = 0; i < gpu->pending_releases.size();) {
+		const GpuPendingRelease& release = gpu->pending_releases[i];
+		if (release.submit_idx <= gpu->known_completed_submit_idx &&
+			release.async_fence_value <= async_completed_value) {
+			gpu->pending_releases.removeQuickSwap(i);
+		}
+		else {
+			i += 1;
+		}
+	}
+}
+
+// Command lists
+// ------------------------------------------------------------------------------------------------
+
+// Binds the state shared by all dispatches: the texture descriptor heap, the global root signature,
+// the gpu heap and the queue's current range of the texture descriptor heap. Must be called every
+// time a command list (main segment or context) is reset, dispatches then only need to set their
+// pso and launch parameters.
+static void bindGlobalState(
+	GpuLib* gpu, ID3D12GraphicsCommandList* cmd_list, GpuBoundState& bound, GpuQueue queue = GPU_QUEUE_MAIN)
+{
+	ID3D12DescriptorHeap* heaps[] = { gpu->tex_descriptor_heap.Get() };
+	cmd_list->SetDescriptorHeaps(1, heaps);
+	cmd_list->SetComputeRootSignature(gpu->root_sig.Get());
+	cmd_list->SetComputeRootUnorderedAccessView(
+		GPU_ROOT_PARAM_GLOBAL_HEAP_IDX, gpu->gpu_heap->GetGPUVirtualAddress());
+	cmd_list->SetComputeRootDescriptorTable(
+		GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX, gpu->getCurrTexDescriptorsGpu(queue));
+	bound = {};
+}
+
+// Starts the next segment after a segment end has been translated, shares the allocator with the
+// previous ones.
+static void cmdListBeginSegment(GpuLib* gpu)
+{
+	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
+	if (cmd_list_info.num_segments_used == cmd_list_info.segments.size()) {
+		ComPtr<ID3D12GraphicsCommandList> segment;
+		if (!CHECK_D3D12(gpu->device->CreateCommandList(
+			0, D3D12_COMMAND_LIST_TYPE_DIRECT, cmd_list_info.cmd_allocator.Get(), nullptr, IID_PPV_ARGS(&segment)))) {
+			printf("[gpu_lib]: Could not create command list.\n");
+			return;
+		}
+		cmd_list_info.segments.add(segment);
+	}
+	else {
+		ID3D12GraphicsCommandList* segment = cmd_list_info.segments[cmd_list_info.num_segments_used].Get();
+		if (!CHECK_D3D12(segment->Reset(cmd_list_info.cmd_allocator.Get(), nullptr))) {
+			printf("[gpu_lib]: Couldn't reset command list\n");
+			return;
+		}
+	}
+	cmd_list_info.cmd_list = cmd_list_info.segments[cmd_list_info.num_segments_used];
+	cmd_list_info.num_segments_used += 1;
+	bindGlobalState(gpu, cmd_list_info.cmd_list.Get(), cmd_list_info.bound);
+}
+
+static void cmdListSetPso(ID3D12GraphicsCommandList* cmd_list, GpuBoundState& bound, ID3D12PipelineState* pso)
+{
+	if (boundStateSetKernel(&bound, pso)) cmd_list->SetPipelineState(pso);
+}
+
+// Sets the launch params root constants, params_size must be at most GPU_LAUNCH_PARAMS_MAX_SIZE.
+static void cmdListSetRootParams(
+	ID3D12GraphicsCommandList* cmd_list, GpuBoundState& bound, const void* params, u32 params_size)
+{
+	if (boundStateSetParams(&bound, params, params_size)) {
+		cmd_list->SetComputeRoot32BitConstants(GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX, params_size / 4, params, 0);
+	}
+}
+
+// Registers the objects used by every submit in the command stream, in the order of the
+// GPU_CMD_STREAM_OBJ_* indices. Textures and kernels are registered on first use, see cmdStreamObj().
+static void cmdListResetStream(GpuLib* gpu)
+{
+	GpuCmdStream& stream = gpu->cmd_stream;
+	sfz_assert(stream.num_cmds == 0);
+	cmdStreamReset(&stream);
+	cmdStreamAddObj(&stream, cmdObjBuffer(
+		gpu->gpu_heap.Get(), gpu->cfg.gpu_heap_size_bytes, gpu->gpu_heap_state, true));
+	cmdStreamAddObj(&stream, cmdObjBuffer(
+		gpu->upload_heap.Get(), gpu->cfg.upload_heap_size_bytes, GPU_RES_STATE_GENERIC_READ, false));
+	cmdStreamAddObj(&stream, cmdObjBuffer(
+		gpu->download_heap.Get(), gpu->cfg.download_heap_size_bytes, GPU_RES_STATE_COPY_DEST, false));
+	cmdStreamAddObj(&stream, cmdObjQueryHeap(gpu->timestamp_query_heap.Get(), 1));
+	cmdStreamAddObj(&stream, cmdObjBuffer(gpu->indirect_args.Get(),
+		u64(gpu->cfg.num_concurrent_submits) * GPU_INDIRECT_ARGS_MAX_NUM_PER_SUBMIT * sizeof(GpuDispatchArgs),
+		gpu->indirect_args_state, false));
+	cmdStreamAddObj(&stream, cmdObjCmdSig(gpu->dispatch_cmd_sig.Get(), sizeof(GpuDispatchArgs), false));
+	cmdStreamAddObj(&stream, cmdObjCmdSig(gpu->batch_cmd_sig.Get(), sizeof(GpuBatchDispatchArgs), true));
+	sfz_assert(stream.objs.size() == GPU_CMD_STREAM_NUM_FIXED_OBJS);
+}
+
+// Binds global state for the first segment of a submit's command list, also resets the per
+// submit state.
+static void cmdListBindGlobalState(GpuLib* gpu, GpuCmdListInfo& cmd_list_info)
+{
+	bindGlobalState(gpu, cmd_list_info.cmd_list.Get(), cmd_list_info.bound);
+	gpu->indirect_args_state = GPU_RES_STATE_COMMON;
+	gpu->indirect_args_num_used = 0;
+	cmdListResetStream(gpu);
+}
+
+// Returns the command stream object of a texture or kernel, registered the first time it's used
+// in the current submit (or after its native object changed, e.g. on rebuild or hot reload).
+static u32 cmdStreamObj(GpuLib* gpu, GpuCmdObjCache& cache, const GpuCmdObj& obj)
+{
+	const u64 stamp = gpu->curr_submit_idx + 1;
+	if (cache.stamp == stamp && cache.native == obj.native) return cache.obj;
+	cache.obj = cmdStreamAddObj(&gpu->cmd_stream, obj);
+	cache.stamp = stamp;
+	cache.native = obj.native;
+	return cache.obj;
+}
+
+static D3D12_RESOURCE_STATES resStateToD3D12(GpuResState state)
+{
+	switch (state) {
+	case GPU_RES_STATE_COMMON: return D3D12_RESOURCE_STATE_COMMON;
+	case GPU_RES_STATE_UNORDERED_ACCESS: return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+	case GPU_RES_STATE_COPY_SOURCE: return D3D12_RESOURCE_STATE_COPY_SOURCE;
+	case GPU_RES_STATE_COPY_DEST: return D3D12_RESOURCE_STATE_COPY_DEST;
+	case GPU_RES_STATE_INDIRECT_ARGUMENT: return D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+	case GPU_RES_STATE_GENERIC_READ: return D3D12_RESOURCE_STATE_GENERIC_READ;
+	case GPU_RES_STATE_PRESENT: return D3D12_RESOURCE_STATE_PRESENT;
+	default: break;
+	}
+	sfz_assert(false);
+	return D3D12_RESOURCE_STATE_COMMON;
+}
+
+static ID3D12Resource* cmdObjResource(const GpuCmdStream& stream, u32 obj)
+{
+	return static_cast<ID3D12Resource*>(stream.objs[obj].native);
+}
+
+// The texture's rows in a buffer, row_pitch bytes apart starting at offset.
+static D3D12_TEXTURE_COPY_LOCATION cmdObjFootprint(const GpuCmdStream& stream, const GpuCmdCopyBufferTex& copy)
+{
+	const GpuCmdObj& tex = stream.objs[copy.tex];
+	D3D12_TEXTURE_COPY_LOCATION loc = {};
+	loc.pResource = cmdObjResource(stream, copy.buffer);
+	loc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	loc.PlacedFootprint.Offset = copy.buffer_offset;
+	loc.PlacedFootprint.Footprint.Format = formatToD3D12(tex.format);
+	loc.PlacedFootprint.Footprint.Width = tex.width;
+	loc.PlacedFootprint.Footprint.Height = tex.height;
+	loc.PlacedFootprint.Footprint.Depth = 1;
+	loc.PlacedFootprint.Footprint.RowPitch = copy.row_pitch;
+	return loc;
+}
+
+static D3D12_TEXTURE_COPY_LOCATION cmdObjSubresource(const GpuCmdStream& stream, u32 obj)
+{
+	D3D12_TEXTURE_COPY_LOCATION loc = {};
+	loc.pResource = cmdObjResource(stream, obj);
+	loc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	loc.SubresourceIndex = 0;
+	return loc;
+}
+
+static void cmdListFlushBarriers(GpuLib* gpu, ID3D12GraphicsCommandList* cmd_list)
+{
+	if (gpu->tmp_barriers.isEmpty()) return;
+	cmd_list->ResourceBarrier(gpu->tmp_barriers.size(), gpu->tmp_barriers.data());
+	gpu->tmp_barriers.clear();
+}
+
+// Translates the commands recorded in the stream to the current command list, after running the
+// passes over them (and validating them in debug mode), then clears them. Called at submit, and
+// whenever the stream is full.
+static void cmdListTranslate(GpuLib* gpu)
+{
+	GpuCmdStream& stream = gpu->cmd_stream;
+	if (gpu->cfg.debug_mode) cmdStreamValidate(&stream);
+	cmdStreamMergeBarriers(&stream);
+	cmdStreamCoalesceCopies(&stream);
+
+	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
+	gpu->tmp_barriers.clear();
+	for (u32 i = 0; i < stream.num_cmds; i++) {
+		const GpuCmd& cmd = stream.cmds[i];
+		ID3D12GraphicsCommandList* cmd_list = cmd_list_info.cmd_list.Get();
+
+		// Each run of back to back barriers is recorded as a single batch
+		if (cmd.type == GPU_CMD_BARRIER) {
+			D3D12_RESOURCE_BARRIER& barrier = gpu->tmp_barriers.add();
+			barrier = {};
+			barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+			if (cmd.barrier.uav) {
+				barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+				barrier.UAV.pResource = cmdObjResource(stream, cmd.barrier.obj);
+			}
+			else {
+				barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+				barrier.Transition.pResource = cmdObjResource(stream, cmd.barrier.obj);
+				barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+				barrier.Transition.StateBefore = resStateToD3D12(cmd.barrier.before);
+				barrier.Transition.StateAfter = resStateToD3D12(cmd.barrier.after);
+			}
+			continue;
+		}
+		cmdListFlushBarriers(gpu, cmd_list);
+
+		switch (cmd.type) {
+		case GPU_CMD_COPY_BUFFER: {
+			const GpuCmdCopyBuffer& copy = cmd.copy_buffer;
+			cmd_list->CopyBufferRegion(cmdObjResource(stream, copy.dst), copy.dst_offset,
+				cmdObjResource(stream, copy.src), copy.src_offset, copy.num_bytes);
+		} break;
+
+		case GPU_CMD_COPY_BUFFER_TO_TEX: {
+			const D3D12_TEXTURE_COPY_LOCATION dst = cmdObjSubresource(stream, cmd.copy_buffer_tex.tex);
+			const D3D12_TEXTURE_COPY_LOCATION src = cmdObjFootprint(stream, cmd.copy_buffer_tex);
+			cmd_list->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		} break;
+
+		case GPU_CMD_COPY_TEX_TO_BUFFER: {
+			const D3D12_TEXTURE_COPY_LOCATION dst = cmdObjFootprint(stream, cmd.copy_buffer_tex);
+			const D3D12_TEXTURE_COPY_LOCATION src = cmdObjSubresource(stream, cmd.copy_buffer_tex.tex);
+			cmd_list->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		} break;
+
+		case GPU_CMD_COPY_TEX: {
+			const GpuCmdCopyTex& copy = cmd.copy_tex;
+			if (copy.width == 0) {
+				cmd_list->CopyResource(cmdObjResource(stream, copy.dst), cmdObjResource(stream, copy.src));
+				break;
+			}
+			const D3D12_TEXTURE_COPY_LOCATION dst = cmdObjSubresource(stream, copy.dst);
+			const D3D12_TEXTURE_COPY_LOCATION src = cmdObjSubresource(stream, copy.src);
+			D3D12_BOX src_box = {};
+			src_box.right = copy.width;
+			src_box.bottom = copy.height;
+			src_box.back = 1;
+			cmd_list->CopyTextureRegion(&dst, 0, 0, 0, &src, &src_box);
+		} break;
+
+		case GPU_CMD_TIMESTAMP: {
+			const GpuCmdTimestamp& ts = cmd.timestamp;
+			ID3D12QueryHeap* query_heap = static_cast<ID3D12QueryHeap*>(stream.objs[ts.query_heap].native);
+			cmd_list->EndQuery(query_heap, D3D12_QUERY_TYPE_TIMESTAMP, ts.query_idx);
+			cmd_list->ResolveQueryData(query_heap, D3D12_QUERY_TYPE_TIMESTAMP, ts.query_idx, 1,
+				cmdObjResource(stream, ts.dst), ts.dst_offset);
+		} break;
+
+		case GPU_CMD_SET_KERNEL:
+			cmdListSetPso(cmd_list, cmd_list_info.bound,
+				static_cast<ID3D12PipelineState*>(stream.objs[cmd.set_kernel.kernel].native));
+			break;
+
+		case GPU_CMD_SET_PARAMS:
+			cmdListSetRootParams(cmd_list, cmd_list_info.bound, cmd.set_params.params, cmd.set_params.size);
+			break;
+
+		case GPU_CMD_SET_LARGE_PARAMS:
+			cmd_list->SetComputeRootConstantBufferView(GPU_ROOT_PARAM_LARGE_LAUNCH_PARAMS_IDX,
+				cmdObjResource(stream, cmd.set_large_params.buffer)->GetGPUVirtualAddress() + cmd.set_large_params.offset);
+			break;
+
+		case GPU_CMD_DISPATCH:
+			cmd_list->Dispatch(cmd.dispatch.num_groups_x, cmd.dispatch.num_groups_y, cmd.dispatch.num_groups_z);
+			break;
+
+		case GPU_CMD_DISPATCH_INDIRECT: {
+			const GpuCmdDispatchIndirect& dispatch = cmd.dispatch_indirect;
+			const GpuCmdObj& cmd_sig = stream.objs[dispatch.cmd_sig];
+			cmd_list->ExecuteIndirect(static_cast<ID3D12CommandSignature*>(cmd_sig.native), dispatch.count,
+				cmdObjResource(stream, dispatch.args), dispatch.args_offset, nullptr, 0);
+			if (cmd_sig.sets_params) boundStateInvalidateParams(&cmd_list_info.bound);
+		} break;
+
+		case GPU_CMD_SEGMENT_END:
+			if (!CHECK_D3D12(cmd_list->Close())) {
+				printf("[gpu_lib]: Could not close command list.\n");
+			}
+			cmd_list_info.exec_lists[cmd.segment_end.exec_list_idx] = cmd_list;
+			cmdListBeginSegment(gpu);
+			break;
+
+		default:
+			break;
+		}
+	}
+	cmdListFlushBarriers(gpu, cmd_list_info.cmd_list.Get());
+	cmdStreamClearCmds(&stream);
+}
+
+// Records a command in the command stream, the commands recorded so far are translated first if
+// the stream is full.
+static void cmdListRecord(GpuLib* gpu, const GpuCmd& cmd)
+{
+	if (cmdStreamRecord(&gpu->cmd_stream, cmd)) return;
+	cmdListTranslate(gpu);
+	const bool recorded = cmdStreamRecord(&gpu->cmd_stream, cmd);
+	sfz_assert(recorded);
+	(void)recorded;
+}
+
+static void cmdListHeapTransition(GpuLib* gpu, GpuResState after)
+{
+	if (gpu->gpu_heap_state == after) return;
+	cmdListRecord(gpu, cmdTransition(GPU_CMD_STREAM_OBJ_GPU_HEAP, gpu->gpu_heap_state, after));
+	gpu->gpu_heap_state = after;
+}
+
+// Ends the currently recording segment of the current submit's command list, so that other command
+// lists (or cross-queue signals and waits) can be executed between it and the next segment. The
+// segment is closed when the stream is translated, its slot in exec_lists is reserved until then.
+static void cmdListEndSegment(GpuLib* gpu)
+{
+	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
+	cmdListRecord(gpu, cmdSegmentEnd(cmd_list_info.exec_lists.size()));
+	cmd_list_info.exec_lists.add(nullptr);
+}
+
+// DXC
+// ------------------------------------------------------------------------------------------------
+
+static bool dxcInit(GpuDxc* dxc)
+{
+	if (!CHECK_D3D12(DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&dxc->utils)))) {
+		printf("[gpu_lib]: Could not initialize DXC utils.");
+		return false;
+	}
+
+	if (!CHECK_D3D12(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&dxc->compiler)))) {
+		printf("[gpu_lib]: Could not initialize DXC compiler.");
+		return false;
+	}
+	return true;
+}
+
+// Pipeline library
+// ------------------------------------------------------------------------------------------------
+
+// Name of a kernel's PSO in the pipeline library. The root signature is shared by all kernels, so
+// the DXIL is the only thing that differs between pipeline state descs.
+static WideStr pipelineLibraryName(const GpuHash& dxil_hash)
+{
+	return expandUtf8(hashToString(dxil_hash).str);
+}
+
+// Creates the pipeline library, from the serialized library in the kernel cache directory if it
+// exists and matches the current adapter and driver. Only used if the kernel cache is enabled.
+static void pipelineLibraryInit(GpuLib* gpu)
+{
+	gpu->pipeline_library_blob.init(0, gpu->cfg.cpu_allocator, sfz_dbg("GpuLib::pipeline_library_blob"));
+	gpu->pipeline_library_num_in_file = 0;
+	gpu->pipeline_library_num_stored = 0;
+	if (!gpu->kernel_cache.enabled) return;
+
+	// Serialized libraries are only valid for the adapter and driver they were created with
+	GpuPipelineLibraryKey& key = gpu->pipeline_library_key;
+	key = {};
+	{
+		DXGI_ADAPTER_DESC1 dxgi_desc = {};
+		CHECK_D3D12(gpu->dxgi->GetDesc1(&dxgi_desc));
+		key.vendor_id = dxgi_desc.VendorId;
+		key.device_id = dxgi_desc.DeviceId;
+		key.subsys_id = dxgi_desc.SubSysId;
+		key.revision = dxgi_desc.Revision;
+		LARGE_INTEGER driver_version = {};
+		CHECK_D3D12(gpu->dxgi->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driver_version));
+		key.driver_version = u64(driver_version.QuadPart);
+		key.d3d12_sdk_version = D3D12SDKVersion;
+	}
+
+	ComPtr<ID3D12Device1> device1;
+	if (!CHECK_D3D12(gpu->device->QueryInterface(IID_PPV_ARGS(&device1)))) return;
+
+	const bool file_loaded = pipelineLibraryFileLoad(
+		&gpu->kernel_cache, key, gpu->cfg.cpu_allocator, gpu->pipeline_library_blob, &gpu->pipeline_library_num_in_file);
+	if (file_loaded) {
+		// The driver can still reject the blob, in that case we fall back to an empty library
+		const HRESULT res = device1->CreatePipelineLibrary(
+			gpu->pipeline_library_blob.data(), gpu->pipeline_library_blob.size(), IID_PPV_ARGS(&gpu->pipeline_library));
+		if (SUCCEEDED(res)) return;
+		printf("[gpu_lib]: Serialized pipeline library rejected by driver, creating new one.\n");
+		gpu->pipeline_library_blob.destroy();
+		gpu->pipeline_library_num_in_file = 0;
+	}
+
+	if (!CHECK_D3D12(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&gpu->pipeline_library)))) {
+		printf("[gpu_lib]: Failed to create pipeline library.\n");
+		gpu->pipeline_library = nullptr;
+	}
+}
+
+// Serializes a pipeline library with the PSOs of all live kernels to the kernel cache directory.
+// A new library is built instead of serializing the one PSOs were loaded from, which prunes PSOs
+// of kernels that are no longer used (e.g. old versions of hot reloaded kernels). Does nothing if
+// no new PSOs were stored and the file contains exactly the live PSOs.
+static void pipelineLibraryStore(GpuLib* gpu)
+{
+	if (gpu->pipeline_library == nullptr) return;
+
+	ComPtr<ID3D12Device1> device1;
+	if (!CHECK_D3D12(gpu->device->QueryInterface(IID_PPV_ARGS(&device1)))) return;
+	ComPtr<ID3D12PipelineLibrary> live_library;
+	if (!CHECK_D3D12(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&live_library)))) return;
+
+	// Kernels with identical DXIL share a name, storing it again fails which is fine
+	u32 num_pipelines = 0;
+	const GpuKernelInfo* kernels = gpu->kernels.data();
+	const sfz::PoolSlot* slots = gpu->kernels.slots();
+	const u32 array_size = gpu->kernels.arraySize();
+	for (u32 idx = 0; idx < array_size; idx++) {
+		if (!slots[idx].active() || kernels[idx].pso == nullptr) continue;
+		const WideStr library_name = pipelineLibraryName(kernels[idx].dxil_hash);
+		if (SUCCEEDED(live_library->StorePipeline(library_name.str, kernels[idx].pso.Get()))) num_pipelines += 1;
+	}
+
+	const bool needs_store = pipelineLibraryNeedsStore(
+		gpu->pipeline_library_num_stored, num_pipelines, gpu->pipeline_library_num_in_file);
+	if (!needs_store) return;
+
+	const u64 size = live_library->GetSerializedSize();
+	SfzArray<u8> blob;
+	blob.init(u32(size), gpu->cfg.cpu_allocator, sfz_dbg("pipelineLibraryStore"));
+	blob.hackSetSize(u32(size));
+	if (!CHECK_D3D12(live_library->Serialize(blob.data(), size))) {
+		printf("[gpu_lib]: Failed to serialize pipeline library.\n");
+		return;
+	}
+	pipelineLibraryFileStore(&gpu->kernel_cache, gpu->pipeline_library_key, blob.data(), size, num_pipelines);
+}
+
 // Init API
 // ------------------------------------------------------------------------------------------------
 
+static GpuKernel kernelInitBuiltin(GpuLib* gpu, const char* name, const char* src_no_prolog);
+
 sfz_extern_c GpuLib* gpuLibInit(const GpuLibInitCfg* cfgIn)
 {
 	// Copy config so that we can make changes to it before finally storing it in the context
 	GpuLibInitCfg cfg = *cfgIn;
 	cfg.gpu_heap_size_bytes = u32_clamp(cfg.gpu_heap_size_bytes, GPU_HEAP_MIN_SIZE, GPU_HEAP_MAX_SIZE);
 	cfg.max_num_textures_per_type = u32_clamp(cfg.max_num_textures_per_type, GPU_TEXTURES_MIN_NUM, GPU_TEXTURES_MAX_NUM);
-	cfg.upload_heap_size_bytes = sfzRoundUpAlignedU32(cfg.upload_heap_size_bytes, GPU_UPLOAD_HEAP_ALIGN);
-	cfg.download_heap_size_bytes = sfzRoundUpAlignedU32(cfg.download_heap_size_bytes, GPU_DOWNLOAD_HEAP_ALIGN);
+	cfg.upload_heap_size_bytes = sfzRoundUpAlignedU32(cfg.upload_heap_size_bytes, GPU_TEXTURE_PLACEMENT_ALIGN);
+	cfg.download_heap_size_bytes = sfzRoundUpAlignedU32(cfg.download_heap_size_bytes, GPU_TEXTURE_PLACEMENT_ALIGN);
+	if (cfg.num_concurrent_submits == 0) cfg.num_concurrent_submits = GPU_DEFAULT_NUM_CONCURRENT_SUBMITS;
+	cfg.num_concurrent_submits = u32_clamp(
+		cfg.num_concurrent_submits, GPU_MIN_NUM_CONCURRENT_SUBMITS, GPU_MAX_NUM_CONCURRENT_SUBMITS);
 
 	// Enable debug layers in debug mode
 	if (cfg.debug_mode) {
@@ -132,9 +583,34 @@ sfz_extern_c GpuLib* gpuLibInit(const GpuLibInitCfg* cfgIn)
 		cmd_queue_fence_event = CreateEventA(NULL, false, false, "gpu_lib_cmd_queue_fence_event");
 	}
 
+	// Create async compute queue and the fences used to synchronize with it
+	ComPtr<ID3D12CommandQueue> async_queue;
+	ComPtr<ID3D12Fence> async_fence;
+	HANDLE async_fence_event = nullptr;
+	ComPtr<ID3D12Fence> main_sync_fence;
+	{
+		D3D12_COMMAND_QUEUE_DESC queue_desc = {};
+		queue_desc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+		queue_desc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
+		queue_desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+		queue_desc.NodeMask = 0;
+		if (!CHECK_D3D12(device->CreateCommandQueue(&queue_desc, IID_PPV_ARGS(&async_queue)))) {
+			printf("[gpu_lib]: Could not create async compute queue.\n");
+			return nullptr;
+		}
+
+		if (!CHECK_D3D12(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&async_fence))) ||
+			!CHECK_D3D12(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&main_sync_fence)))) {
+			printf("[gpu_lib]: Could not create async compute queue fences.\n");
+			return nullptr;
+		}
+
+		async_fence_event = CreateEventA(NULL, false, false, "gpu_lib_async_fence_event");
+	}
+
 	// Create command lists
-	GpuCmdListInfo cmd_lists[GPU_NUM_CONCURRENT_SUBMITS];
-	for (u32 i = 0; i < GPU_NUM_CONCURRENT_SUBMITS; i++) {
+	GpuCmdListInfo cmd_lists[GPU_MAX_NUM_CONCURRENT_SUBMITS];
+	for (u32 i = 0; i < cfg.num_concurrent_submits; i++) {
 		GpuCmdListInfo& info = cmd_lists[i];
 
 		if (!CHECK_D3D12(device->CreateCommandAllocator(
@@ -162,12 +638,91 @@ sfz_extern_c GpuLib* gpuLibInit(const GpuLibInitCfg* cfgIn)
 			}
 		}
 
-		info.fence_value = 0;
-		info.submit_idx = 0;
-		info.upload_heap_offset = 0;
-		info.download_heap_offset = 0;
+		info.slot = {};
+		info.bound = {};
+		info.num_segments_used = 1;
+	}
+
+	// Create global root signature, shared by all kernels. Only the launch parameters differ between
+	// kernels, so the max amount of root constants are always reserved. Large launch parameters are
+	// a root CBV pointing into the upload heap, see GPU_LARGE_LAUNCH_PARAMS in the prolog.
+	ComPtr<ID3D12RootSignature> root_sig;
+	{
+		constexpr u32 NUM_ROOT_PARAMS = 4;
+		D3D12_ROOT_PARAMETER1 root_params[NUM_ROOT_PARAMS] = {};
+
+		root_params[GPU_ROOT_PARAM_GLOBAL_HEAP_IDX].ParameterType = D3D12_ROOT_PARAMETER_TYPE_UAV;
+		root_params[GPU_ROOT_PARAM_GLOBAL_HEAP_IDX].Descriptor.ShaderRegister = 0;
+		root_params[GPU_ROOT_PARAM_GLOBAL_HEAP_IDX].Descriptor.RegisterSpace = 0;
+		// Note: UAV is written to during command list execution, thus it MUST be volatile.
+		root_params[GPU_ROOT_PARAM_GLOBAL_HEAP_IDX].Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE;
+		root_params[GPU_ROOT_PARAM_GLOBAL_HEAP_IDX].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+		// The same descriptors are exposed once per typed view of the rwtex array (float4, uint4, int4,
+		// uint, int), each in its own register space. They all alias the start of the table.
+		D3D12_DESCRIPTOR_RANGE1 desc_ranges[GPU_RWTEX_ARRAY_NUM_TYPED_VIEWS] = {};
+		for (u32 i = 0; i < GPU_RWTEX_ARRAY_NUM_TYPED_VIEWS; i++) {
+			D3D12_DESCRIPTOR_RANGE1& desc_range = desc_ranges[i];
+			desc_range.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+			desc_range.NumDescriptors = UINT_MAX; // Unbounded
+			desc_range.BaseShaderRegister = 1;
+			desc_range.RegisterSpace = i;
+			desc_range.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE;
+			desc_range.OffsetInDescriptorsFromTableStart = 0;
+		}
+		root_params[GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+		root_params[GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX].DescriptorTable.NumDescriptorRanges = GPU_RWTEX_ARRAY_NUM_TYPED_VIEWS;
+		root_params[GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX].DescriptorTable.pDescriptorRanges = desc_ranges;
+		root_params[GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+		root_params[GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+		root_params[GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX].Constants.ShaderRegister = 0;
+		root_params[GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX].Constants.RegisterSpace = 0;
+		root_params[GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX].Constants.Num32BitValues = GPU_LAUNCH_PARAMS_MAX_SIZE / 4;
+		root_params[GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+		root_params[GPU_ROOT_PARAM_LARGE_LAUNCH_PARAMS_IDX].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+		root_params[GPU_ROOT_PARAM_LARGE_LAUNCH_PARAMS_IDX].Descriptor.ShaderRegister = 1;
+		root_params[GPU_ROOT_PARAM_LARGE_LAUNCH_PARAMS_IDX].Descriptor.RegisterSpace = 0;
+		// Note: Written by the cpu before the command list is submitted, never changed after that.
+		root_params[GPU_ROOT_PARAM_LARGE_LAUNCH_PARAMS_IDX].Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_STATIC;
+		root_params[GPU_ROOT_PARAM_LARGE_LAUNCH_PARAMS_IDX].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+
+		D3D12_VERSIONED_ROOT_SIGNATURE_DESC root_sig_desc = {};
+		root_sig_desc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+		root_sig_desc.Desc_1_1.NumParameters = NUM_ROOT_PARAMS;
+		root_sig_desc.Desc_1_1.pParameters = root_params;
+		root_sig_desc.Desc_1_1.NumStaticSamplers = 0;
+		root_sig_desc.Desc_1_1.pStaticSamplers = nullptr;
+		root_sig_desc.Desc_1_1.Flags =
+			D3D12_ROOT_SIGNATURE_FLAG_DENY_VERTEX_SHADER_ROOT_ACCESS |
+			D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
+			D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
+			D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS |
+			D3D12_ROOT_SIGNATURE_FLAG_DENY_PIXEL_SHADER_ROOT_ACCESS |
+			D3D12_ROOT_SIGNATURE_FLAG_DENY_AMPLIFICATION_SHADER_ROOT_ACCESS |
+			D3D12_ROOT_SIGNATURE_FLAG_DENY_MESH_SHADER_ROOT_ACCESS;
+
+		ComPtr<ID3DBlob> blob;
+		ComPtr<ID3DBlob> error_blob;
+		const bool serialize_success = CHECK_D3D12(D3D12SerializeVersionedRootSignature(
+			&root_sig_desc, &blob, &error_blob));
+		if (!serialize_success) {
+			printf("[gpu_lib]: Failed to serialize root signature: %s\n",
+				(const char*)error_blob->GetBufferPointer());
+			return nullptr;
+		}
+
+		const bool create_success = CHECK_D3D12(device->CreateRootSignature(
+			0, blob->GetBufferPointer(), blob->GetBufferSize(), IID_PPV_ARGS(&root_sig)));
+		if (!create_success) {
+			printf("[gpu_lib]: Failed to create root signature\n");
+			return nullptr;
+		}
+		setDebugNameLazy(root_sig);
 	}
 
+
 	// Create timestamp stuff
 	ComPtr<ID3D12QueryHeap> timestamp_query_heap;
 	{
@@ -219,6 +774,79 @@ sfz_extern_c GpuLib* gpuLibInit(const GpuLibInitCfg* cfgIn)
 		setDebugNameLazy(gpu_heap);
 	}
 
+	// Allocate indirect arguments buffer, one range per concurrent submit
+	ComPtr<ID3D12Resource> indirect_args;
+	{
+		D3D12_HEAP_PROPERTIES heap_props = {};
+		heap_props.Type = D3D12_HEAP_TYPE_DEFAULT;
+		heap_props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+		heap_props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+		heap_props.CreationNodeMask = 0;
+		heap_props.VisibleNodeMask = 0;
+
+		D3D12_RESOURCE_DESC desc = {};
+		desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		desc.Alignment = 0;
+		desc.Width = u64(cfg.num_concurrent_submits) * GPU_INDIRECT_ARGS_MAX_NUM_PER_SUBMIT * sizeof(GpuDispatchArgs);
+		desc.Height = 1;
+		desc.DepthOrArraySize = 1;
+		desc.MipLevels = 1;
+		desc.Format = DXGI_FORMAT_UNKNOWN;
+		desc.SampleDesc.Count = 1;
+		desc.SampleDesc.Quality = 0;
+		desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+		if (!CHECK_D3D12(device->CreateCommittedResource(
+			&heap_props, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&indirect_args)))) {
+			printf("[gpu_lib]: Could not allocate indirect arguments buffer.\n");
+			return nullptr;
+		}
+		setDebugNameLazy(indirect_args);
+	}
+
+	// Create command signature for indirect dispatches. It doesn't change any root arguments, so
+	// it doesn't need the root signature and can be shared by all kernels.
+	ComPtr<ID3D12CommandSignature> dispatch_cmd_sig;
+	{
+		D3D12_INDIRECT_ARGUMENT_DESC arg_desc = {};
+		arg_desc.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH;
+
+		D3D12_COMMAND_SIGNATURE_DESC cmd_sig_desc = {};
+		cmd_sig_desc.ByteStride = sizeof(GpuDispatchArgs);
+		cmd_sig_desc.NumArgumentDescs = 1;
+		cmd_sig_desc.pArgumentDescs = &arg_desc;
+		cmd_sig_desc.NodeMask = 0;
+
+		if (!CHECK_D3D12(device->CreateCommandSignature(&cmd_sig_desc, nullptr, IID_PPV_ARGS(&dispatch_cmd_sig)))) {
+			printf("[gpu_lib]: Could not create command signature for indirect dispatches.\n");
+			return nullptr;
+		}
+	}
+
+	// Create command signature for batched dispatches, sets the launch params root constants so it
+	// needs the root signature. Still shared by all kernels since they share the root signature.
+	ComPtr<ID3D12CommandSignature> batch_cmd_sig;
+	{
+		D3D12_INDIRECT_ARGUMENT_DESC arg_descs[2] = {};
+		arg_descs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+		arg_descs[0].Constant.RootParameterIndex = GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX;
+		arg_descs[0].Constant.DestOffsetIn32BitValues = 0;
+		arg_descs[0].Constant.Num32BitValuesToSet = GPU_LAUNCH_PARAMS_MAX_SIZE / 4;
+		arg_descs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH;
+
+		D3D12_COMMAND_SIGNATURE_DESC cmd_sig_desc = {};
+		cmd_sig_desc.ByteStride = sizeof(GpuBatchDispatchArgs);
+		cmd_sig_desc.NumArgumentDescs = 2;
+		cmd_sig_desc.pArgumentDescs = arg_descs;
+		cmd_sig_desc.NodeMask = 0;
+
+		if (!CHECK_D3D12(device->CreateCommandSignature(&cmd_sig_desc, root_sig.Get(), IID_PPV_ARGS(&batch_cmd_sig)))) {
+			printf("[gpu_lib]: Could not create command signature for batched dispatches.\n");
+			return nullptr;
+		}
+	}
+
 	// Allocate upload heap
 	ComPtr<ID3D12Resource> upload_heap;
 	u8* upload_heap_mapped_ptr = nullptr; // Persistently mapped, never unmapped
@@ -311,33 +939,47 @@ sfz_extern_c GpuLib* gpuLibInit(const GpuLibInitCfg* cfgIn)
 		download_heap_mapped_ptr = static_cast<u8*>(mapped_ptr);
 	}
 
-	// Create tex descriptor heap
+	// Create tex descriptor heaps
+	ComPtr<ID3D12DescriptorHeap> tex_descriptor_heap_cpu;
 	ComPtr<ID3D12DescriptorHeap> tex_descriptor_heap;
 	u32 num_tex_descriptors = 0;
 	u32 tex_descriptor_size = 0;
 	D3D12_CPU_DESCRIPTOR_HANDLE tex_descriptor_heap_start_cpu = {};
-	D3D12_GPU_DESCRIPTOR_HANDLE tex_descriptor_heap_start_gpu = {};
+	D3D12_CPU_DESCRIPTOR_HANDLE tex_descriptor_heap_visible_start_cpu = {};
+	D3D12_GPU_DESCRIPTOR_HANDLE tex_descriptor_heap_visible_start_gpu = {};
 	{
 		num_tex_descriptors = cfg.max_num_textures_per_type;
+
+		// CPU heap, only ever written to from CPU
 		D3D12_DESCRIPTOR_HEAP_DESC heap_desc = {};
 		heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
 		heap_desc.NumDescriptors = num_tex_descriptors;
-		heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+		heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 		heap_desc.NodeMask = 0;
-
-		if (!CHECK_D3D12(device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&tex_descriptor_heap)))) {
+		if (!CHECK_D3D12(device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&tex_descriptor_heap_cpu)))) {
 			printf("[gpu_lib]: Could not allocate %u descriptors for texture arrays, exiting.\n",
 				num_tex_descriptors);
 			return nullptr;
 		}
+		setDebugNameLazy(tex_descriptor_heap_cpu);
+
+		// Shader-visible heap, one range of descriptors per concurrent submit (main and async)
+		heap_desc.NumDescriptors = num_tex_descriptors * cfg.num_concurrent_submits * 2;
+		heap_desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+		if (!CHECK_D3D12(device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&tex_descriptor_heap)))) {
+			printf("[gpu_lib]: Could not allocate %u shader-visible descriptors for texture arrays, exiting.\n",
+				heap_desc.NumDescriptors);
+			return nullptr;
+		}
 		setDebugNameLazy(tex_descriptor_heap);
 
 		tex_descriptor_size = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-		tex_descriptor_heap_start_cpu = tex_descriptor_heap->GetCPUDescriptorHandleForHeapStart();
-		tex_descriptor_heap_start_gpu = tex_descriptor_heap->GetGPUDescriptorHandleForHeapStart();
+		tex_descriptor_heap_start_cpu = tex_descriptor_heap_cpu->GetCPUDescriptorHandleForHeapStart();
+		tex_descriptor_heap_visible_start_cpu = tex_descriptor_heap->GetCPUDescriptorHandleForHeapStart();
+		tex_descriptor_heap_visible_start_gpu = tex_descriptor_heap->GetGPUDescriptorHandleForHeapStart();
 
-		// Set null descriptors for all potential slots in the heap
-		for (u32 i = 0; i < cfg.max_num_textures_per_type; i++) {
+		// Set null descriptors for all potential slots in the CPU heap
+		for (u32 i = 0; i < num_tex_descriptors; i++) {
 			D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
 			uav_desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
 			uav_desc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
@@ -348,6 +990,14 @@ sfz_extern_c GpuLib* gpuLibInit(const GpuLibInitCfg* cfgIn)
 			cpu_descriptor.ptr = tex_descriptor_heap_start_cpu.ptr + tex_descriptor_size * i;
 			device->CreateUnorderedAccessView(nullptr, nullptr, &uav_desc, cpu_descriptor);
 		}
+
+		// Copy the null descriptors to all ranges of the shader-visible heap
+		for (u32 i = 0; i < cfg.num_concurrent_submits * 2; i++) {
+			D3D12_CPU_DESCRIPTOR_HANDLE dst = {};
+			dst.ptr = tex_descriptor_heap_visible_start_cpu.ptr + u64(i) * num_tex_descriptors * tex_descriptor_size;
+			device->CopyDescriptorsSimple(
+				num_tex_descriptors, dst, tex_descriptor_heap_start_cpu, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		}
 	}
 
 	// Initialize RWTex pool
@@ -361,25 +1011,8 @@ sfz_extern_c GpuLib* gpuLibInit(const GpuLibInitCfg* cfgIn)
 	}
 
 	// Load DXC compiler
-	ComPtr<IDxcUtils> dxc_utils;
-	ComPtr<IDxcCompiler3> dxc_compiler;
-	ComPtr<IDxcIncludeHandler> dxc_include_handler;
-	{
-		if (!CHECK_D3D12(DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&dxc_utils)))) {
-			printf("[gpu_lib]: Could not initialize DXC utils.");
-			return nullptr;
-		}
-
-		if (!CHECK_D3D12(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&dxc_compiler)))) {
-			printf("[gpu_lib]: Could not initialize DXC compiler.");
-			return nullptr;
-		}
-
-		if (!CHECK_D3D12(dxc_utils->CreateDefaultIncludeHandler(&dxc_include_handler))) {
-			printf("[gpu_lib]: Could not create DXC include handler.");
-			return nullptr;
-		}
-	}
+	GpuDxc dxc = {};
+	if (!dxcInit(&dxc)) return nullptr;
 
 	// If we have a window handle specified create swapchain and such
 	ComPtr<IDXGISwapChain4> swapchain;
@@ -404,7 +1037,7 @@ sfz_extern_c GpuLib* gpuLibInit(const GpuLibInitCfg* cfgIn)
 			desc.Stereo = FALSE;
 			desc.SampleDesc = { 1, 0 }; // No MSAA
 			desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT; // DXGI_USAGE_UNORDERED_ACCESS
-			desc.BufferCount = GPU_NUM_CONCURRENT_SUBMITS;
+			desc.BufferCount = cfg.num_concurrent_submits;
 			desc.Scaling = DXGI_SCALING_STRETCH;
 			desc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
 			desc.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
@@ -439,56 +1072,112 @@ sfz_extern_c GpuLib* gpuLibInit(const GpuLibInitCfg* cfgIn)
 	gpu->device = device;
 	gpu->info_queue = info_queue;
 
+	gpu->root_sig = root_sig;
+
 	gpu->curr_submit_idx = 0;
 	gpu->known_completed_submit_idx = 0;
 	gpu->cmd_queue = cmd_queue;
 	gpu->cmd_queue_fence = cmd_queue_fence;
 	gpu->cmd_queue_fence_event = cmd_queue_fence_event;
 	gpu->cmd_queue_fence_value = 0;
-	for (u32 i = 0; i < GPU_NUM_CONCURRENT_SUBMITS; i++) gpu->cmd_lists[i] = cmd_lists[i];
+	for (u32 i = 0; i < cfg.num_concurrent_submits; i++) {
+		GpuCmdListInfo& info = gpu->cmd_lists[i];
+		info = sfz_move(cmd_lists[i]);
+		info.segments.init(4, cfg.cpu_allocator, sfz_dbg("GpuCmdListInfo::segments"));
+		info.segments.add(info.cmd_list);
+		info.exec_lists.init(4 + GPU_CMD_CONTEXTS_MAX_NUM, cfg.cpu_allocator, sfz_dbg("GpuCmdListInfo::exec_lists"));
+		info.sync_ops.init(16, cfg.cpu_allocator, sfz_dbg("GpuCmdListInfo::sync_ops"));
+	}
+
+	gpu->async_queue = async_queue;
+	gpu->async_fence = async_fence;
+	gpu->async_fence_event = async_fence_event;
+	gpu->async_fence_value = 0;
+	gpu->async_fence_issued_value = 0;
+	gpu->async_curr_submit_idx = 0;
+	for (u32 i = 0; i < GPU_MAX_NUM_CONCURRENT_SUBMITS; i++) gpu->async_submit_fence_values[i] = 0;
+	gpu->async_exec_lists.init(GPU_CMD_CONTEXTS_MAX_NUM, cfg.cpu_allocator, sfz_dbg("GpuLib::async_exec_lists"));
+	gpu->async_sync_ops.init(16, cfg.cpu_allocator, sfz_dbg("GpuLib::async_sync_ops"));
+	gpu->main_sync_fence = main_sync_fence;
+	gpu->main_sync_fence_value = 0;
+	gpu->main_sync_fence_submitted_value = 0;
 
 	gpu->timestamp_query_heap = timestamp_query_heap;
 
 	gpu->gpu_heap = gpu_heap;
-	gpu->gpu_heap_state = D3D12_RESOURCE_STATE_COMMON;
+	gpu->gpu_heap_state = GPU_RES_STATE_COMMON;
 	gpu->gpu_heap_next_free = GPU_HEAP_SYSTEM_RESERVED_SIZE;
 
 	gpu->upload_heap = upload_heap;
 	gpu->upload_heap_mapped_ptr = upload_heap_mapped_ptr;
-	gpu->upload_heap_offset = 0;
-	gpu->upload_heap_safe_offset = 0;
+	gpu->upload_heap_ring = heapRingInit(cfg.upload_heap_size_bytes);
 
 	gpu->download_heap = download_heap;
 	gpu->download_heap_mapped_ptr = download_heap_mapped_ptr;
-	gpu->download_heap_offset = 0;
-	gpu->download_heap_safe_offset = 0;
+	gpu->download_heap_ring = heapRingInit(cfg.download_heap_size_bytes);
 	gpu->downloads.init(cfg.max_num_concurrent_downloads, cfg.cpu_allocator, sfz_dbg("GpuLib::downloads"));
 
+	gpu->pending_releases.init(64, cfg.cpu_allocator, sfz_dbg("GpuLib::pending_releases"));
+
+	gpu->tex_descriptor_heap_cpu = tex_descriptor_heap_cpu;
 	gpu->tex_descriptor_heap = tex_descriptor_heap;
 	gpu->num_tex_descriptors = num_tex_descriptors;
 	gpu->tex_descriptor_size = tex_descriptor_size;
 	gpu->tex_descriptor_heap_start_cpu = tex_descriptor_heap_start_cpu;
-	gpu->tex_descriptor_heap_start_gpu = tex_descriptor_heap_start_gpu;
+	gpu->tex_descriptor_heap_visible_start_cpu = tex_descriptor_heap_visible_start_cpu;
+	gpu->tex_descriptor_heap_visible_start_gpu = tex_descriptor_heap_visible_start_gpu;
 
 	gpu->rw_textures = sfz_move(rw_textures);
 
-	gpu->dxc_utils = dxc_utils;
-	gpu->dxc_compiler = dxc_compiler;
-	gpu->dxc_include_handler = dxc_include_handler;
+	gpu->dxc = dxc;
+	gpu->dxc_workers.init(0, cfg.cpu_allocator, sfz_dbg("GpuLib::dxc_workers"));
+
+	InitializeSRWLock(&gpu->kernel_cache_lock);
+	includeCacheInit(&gpu->include_cache, cfg.cpu_allocator);
+	if (cfg.kernel_cache_dir != nullptr) {
+		kernelCacheInit(&gpu->kernel_cache, cfg.kernel_cache_dir, cfg.kernel_cache_max_size_bytes, cfg.cpu_allocator);
+	}
+	pipelineLibraryInit(gpu);
 
 	gpu->kernels.init(cfg.max_num_kernels, cfg.cpu_allocator, sfz_dbg("GpuLib::kernels"));
+	gpu->kernel_permutations.init(cfg.max_num_kernels, cfg.cpu_allocator, sfz_dbg("GpuLib::kernel_permutations"));
+	gpu->kernel_reload_jobs.init(64, cfg.cpu_allocator, sfz_dbg("GpuLib::kernel_reload_jobs"));
+
+	gpu->cmd_contexts.init(GPU_CMD_CONTEXTS_MAX_NUM, cfg.cpu_allocator, sfz_dbg("GpuLib::cmd_contexts"));
 
 	gpu->swapchain_res = i32x2_splat(0);
+	gpu->swapchain_fb_res = i32x2_splat(0);
+	gpu->swapchain_num_stable_presents = 0;
 	gpu->swapchain = swapchain;
 
+	gpu->heap_hazards.init(cfg.cpu_allocator);
+	gpu->rwtex_hazards.init(cfg.max_num_textures_per_type, cfg.cpu_allocator);
+	gpu->rwtex_hazards.setExists(GPU_NULL_RWTEX, true);
+	gpu->rwtex_hazards.setExists(GpuRWTex(RWTEX_SWAPCHAIN_IDX), true);
+	cmdStreamInit(&gpu->cmd_stream, GPU_CMD_STREAM_MAX_NUM_CMDS, cfg.cpu_allocator);
 	gpu->tmp_barriers.init(cfg.max_num_textures_per_type, cfg.cpu_allocator, sfz_dbg("GpuLib::tmp_barriers"));
 
+	gpu->indirect_args = indirect_args;
+	gpu->indirect_args_state = GPU_RES_STATE_COMMON;
+	gpu->indirect_args_num_used = 0;
+	gpu->dispatch_cmd_sig = dispatch_cmd_sig;
+	gpu->batch_cmd_sig = batch_cmd_sig;
+
+	// Built-in kernels, not fatal if they fail to compile, only the functions using them break
+	gpu->count_to_groups_kernel = kernelInitBuiltin(gpu, "gpu_lib_count_to_groups", GPU_COUNT_TO_GROUPS_KERNEL_SRC);
+	if (gpu->count_to_groups_kernel == GPU_NULL_KERNEL) {
+		printf("[gpu_lib]: Failed to build built-in kernel, gpuQueueCountToGroups() is unavailable.\n");
+	}
+
+	// Bind global state for the first command list, subsequent ones are bound when they are reset
+	cmdListBindGlobalState(gpu, gpu->getCurrCmdList());
+
 	// Do a quick present after initialization has finished, used to set up framebuffers
 	gpuSubmitQueuedWork(gpu);
 	gpuSwapchainPresent(gpu, false);
 	sfz_assert(gpu->curr_submit_idx == 1);
-	sfz_assert(gpu->upload_heap_safe_offset == gpu->cfg.upload_heap_size_bytes);
-	sfz_assert(gpu->download_heap_safe_offset == gpu->cfg.download_heap_size_bytes);
+	sfz_assert(gpu->upload_heap_ring.safe_offset == gpu->cfg.upload_heap_size_bytes);
+	sfz_assert(gpu->download_heap_ring.safe_offset == gpu->cfg.download_heap_size_bytes);
 
 	return gpu;
 }
@@ -499,9 +1188,24 @@ sfz_extern_c void gpuLibDestroy(GpuLib* gpu)
 	
 	// Flush all in-flight commands
 	gpuFlush(gpu);
+
+	// Wait for kernels being reloaded in the background
+	for (GpuKernelReloadJob* job : gpu->kernel_reload_jobs) {
+		WaitForSingleObject(job->thread, INFINITE);
+		CloseHandle(job->thread);
+		sfz_delete(gpu->cfg.cpu_allocator, job);
+	}
+	gpu->kernel_reload_jobs.clear();
+
+	// Write pipeline library to disk, then release all PSOs before the library and its blob
+	pipelineLibraryStore(gpu);
+	gpu->kernels.destroy();
+	gpu->pending_releases.clear();
+	gpu->pipeline_library.Reset();
 	
-	// Destroy command queue's fence event
+	// Destroy command queues' fence events
 	CloseHandle(gpu->cmd_queue_fence_event);
+	CloseHandle(gpu->async_fence_event);
 
 	SfzAllocator* allocator = gpu->cfg.cpu_allocator;
 	sfz_delete(allocator, gpu);
@@ -538,17 +1242,17 @@ sfz_extern_c void gpuFree(GpuLib* gpu, GpuPtr ptr)
 // Textures API
 // ------------------------------------------------------------------------------------------------
 
-sfz_extern_c const char* gpuFormatToString(GpuFormat format)
-{
-	return formatToString(format);
-}
-
 static GpuRWTex gpuRWTexInitInternal(GpuLib* gpu, const GpuRWTexDesc* desc, const SfzHandle* existing_handle = nullptr)
 {
 	if (desc->format == GPU_FORMAT_UNDEFINED) {
 		printf("[gpu_lib]: Must specify a valid texture format when creating an RWTex\n");
 		return GPU_NULL_RWTEX;
 	}
+	if (gpuFormatGetBytesPerPixel(desc->format) == 0) {
+		printf("[gpu_lib]: Block compressed formats (%s) can't be used for RWTex\n",
+			gpuFormatToString(desc->format));
+		return GPU_NULL_RWTEX;
+	}
 	if (desc->swapchain_relative && desc->relative_fixed_height != 0 && desc->relative_scale != 0.0f) {
 		printf("[gpu_lib]: For swapchain relative textures either fixed height or scale MUST be 0.\n");
 		return GPU_NULL_RWTEX;
@@ -587,7 +1291,7 @@ static GpuRWTex gpuRWTexInitInternal(GpuLib* gpu, const GpuRWTexDesc* desc, cons
 			IID_PPV_ARGS(&tex)));
 		if (!success) {
 			printf("[gpu_lib]: Could not allocate GpuRWTex of size %ix%i and format %s\n",
-				tex_res.x, tex_res.y, formatToString(desc->format));
+				tex_res.x, tex_res.y, gpuFormatToString(desc->format));
 			return GPU_NULL_RWTEX;
 		}
 		setDebugName(tex.Get(), desc->name);
@@ -605,9 +1309,11 @@ static GpuRWTex gpuRWTexInitInternal(GpuLib* gpu, const GpuRWTexDesc* desc, cons
 		printf("[gpu_lib]: Could not allocate slot in GpuRWTex array, out of slots.\n");
 		return GPU_NULL_RWTEX;
 	}
+	gpu->rwtex_hazards.setExists(GpuRWTex(handle.idx()), true);
 
-	// Store info about texture
+	// Store info about texture, old texture (if rebuilding) is kept alive until it is safe to release
 	GpuRWTexInfo& info = *gpu->rw_textures.get(handle);
+	retireObject(gpu, info.tex);
 	info.tex = tex;
 	info.tex_res = tex_res;
 	info.desc = *desc;
@@ -632,9 +1338,29 @@ static GpuRWTex gpuRWTexInitInternal(GpuLib* gpu, const GpuRWTexDesc* desc, cons
 	return tex_idx;
 }
 
-sfz_extern_c GpuRWTex gpuRWTexInit(GpuLib* gpu, const GpuRWTexDesc* desc)
+static void rwTexUpdateDesc(GpuLib* gpu, SfzHandle handle, const GpuRWTexDesc* new_desc)
 {
-	return gpuRWTexInitInternal(gpu, desc);
+	GpuRWTexInfo& tex_info = *gpu->rw_textures.get(handle);
+
+	// Keep texture (and its descriptor) if resolution didn't change, only need to update desc
+	const i32x2 new_res = calcRWTexTargetRes(gpu->swapchain_res, new_desc);
+	if (new_res == tex_info.tex_res) {
+		tex_info.desc = *new_desc;
+		tex_info.desc.name = tex_info.name.str;
+		return;
+	}
+
+	// Rebuild texture
+	// Need to copy desc to avoid potential aliasing issues
+	SfzStr96 name = tex_info.name;
+	GpuRWTexDesc desc = *new_desc;
+	desc.name = name.str;
+	gpuRWTexInitInternal(gpu, &desc, &handle);
+}
+
+sfz_extern_c GpuRWTex gpuRWTexInit(GpuLib* gpu, const GpuRWTexDesc* desc)
+{
+	return gpuRWTexInitInternal(gpu, desc);
 }
 
 sfz_extern_c void gpuRWTexDestroy(GpuLib* gpu, GpuRWTex tex)
@@ -659,7 +1385,9 @@ sfz_extern_c void gpuRWTexDestroy(GpuLib* gpu, GpuRWTex tex)
 		gpu->device->CreateUnorderedAccessView(nullptr, nullptr, &uav_desc, cpu_descriptor);
 	}
 
+	retireObject(gpu, tex_info->tex);
 	gpu->rw_textures.deallocate(handle);
+	gpu->rwtex_hazards.setExists(tex, false);
 }
 
 sfz_extern_c const GpuRWTexDesc* gpuRWTexGetDesc(const GpuLib* gpu, GpuRWTex tex)
@@ -696,14 +1424,10 @@ sfz_extern_c void gpuRWTexSetSwapchainRelativeScale(GpuLib* gpu, GpuRWTex tex, f
 	// Just return if we already have the correct scale
 	if (tex_info->desc.relative_scale == scale) return;
 
-	// Rebuild texture
-	// Need to copy desc to avoid potential aliasing issues
-	SfzStr96 name = tex_info->name;
 	GpuRWTexDesc desc = tex_info->desc;
 	desc.relative_fixed_height = 0;
 	desc.relative_scale = scale;
-	desc.name = name.str;
-	gpuRWTexInitInternal(gpu, &desc, &handle);
+	rwTexUpdateDesc(gpu, handle, &desc);
 }
 
 sfz_extern_c void gpuRWTexSetSwapchainRelativeFixedHeight(GpuLib* gpu, GpuRWTex tex, i32 height)
@@ -724,260 +1448,748 @@ sfz_extern_c void gpuRWTexSetSwapchainRelativeFixedHeight(GpuLib* gpu, GpuRWTex
 	// Just return if we already have the correct fixed height
 	if (tex_info->desc.relative_fixed_height == height) return;
 
-	// Rebuild texture
-	// Need to copy desc to avoid potential aliasing issues
-	SfzStr96 name = tex_info->name;
 	GpuRWTexDesc desc = tex_info->desc;
 	desc.relative_fixed_height = height;
 	desc.relative_scale = 0.0f;
-	desc.name = name.str;
-	gpuRWTexInitInternal(gpu, &desc, &handle);
+	rwTexUpdateDesc(gpu, handle, &desc);
 }
 
 // Kernel API
 // ------------------------------------------------------------------------------------------------
 
-sfz_extern_c GpuKernel gpuKernelInit(GpuLib* gpu, const GpuKernelDesc* desc)
+// Compiler arguments for a kernel, base arguments followed by its defines.
+sfz_struct(GpuKernelArgs) {
+	wchar_t defines_wide[GPU_KERNEL_MAX_NUM_DEFINES][GPU_KERNEL_DEFINE_MAX_LEN + 3];
+	LPCWSTR args[GPU_KERNEL_DXC_NUM_BASE_ARGS + GPU_KERNEL_MAX_NUM_DEFINES];
+	u32 num_args;
+};
+
+static void kernelArgsInit(GpuKernelArgs* out, const GpuKernelDesc* desc)
 {
-	// Read shader file from disk
-	u32 src_size = 0;
-	char* src = nullptr;
-	{
-		// Map shader file
-		FileMapData src_map = fileMap(desc->path, true);
-		if (src_map.ptr == nullptr) {
-			printf("[gpulib]: Failed to map kernel source file \"%s\".\n", desc->path);
-			return GPU_NULL_KERNEL;
-		}
-		sfz_defer[=]() { fileUnmap(src_map); };
-
-		// Allocate memory for src + prolog
-		src_size = u32(src_map.size_bytes + GPU_KERNEL_PROLOG_SIZE);
-		src = static_cast<char*>(gpu->cfg.cpu_allocator->alloc(sfz_dbg(""), src_size + 1));
-		
-		// Copy prolog and then src file into buffer
-		memcpy(src, GPU_KERNEL_PROLOG, GPU_KERNEL_PROLOG_SIZE);
-		memcpy(src + GPU_KERNEL_PROLOG_SIZE, src_map.ptr, src_map.size_bytes);
-		src[src_size] = '\0'; // Guarantee null-termination, safe because we allocated 1 byte extra.
+	*out = {};
+	for (u32 i = 0; i < GPU_KERNEL_DXC_NUM_BASE_ARGS; i++) {
+		out->args[i] = GPU_KERNEL_DXC_BASE_ARGS[i];
 	}
-	sfz_defer[=]() { gpu->cfg.cpu_allocator->dealloc(src); };
+	const u32 num_defines = u32_min(desc->num_defines, GPU_KERNEL_MAX_NUM_DEFINES);
+	for (u32 i = 0; i < num_defines; i++) {
+		out->defines_wide[i][0] = L'-';
+		out->defines_wide[i][1] = L'D';
+		utf8ToWide(out->defines_wide[i] + 2, GPU_KERNEL_DEFINE_MAX_LEN, desc->defines[i]);
+		out->defines_wide[i][GPU_KERNEL_DEFINE_MAX_LEN + 2] = '\0';
+		out->args[GPU_KERNEL_DXC_NUM_BASE_ARGS + i] = out->defines_wide[i];
+	}
+	out->num_args = GPU_KERNEL_DXC_NUM_BASE_ARGS + num_defines;
+}
 
-	// Compile shader
-	ComPtr<IDxcBlob> dxil_blob;
-	i32x3 group_dims = i32x3_splat(0);
-	u32 launch_params_size = 0;
-	{
-		// Create source blob
-		ComPtr<IDxcBlobEncoding> source_blob;
-		if (!CHECK_D3D12(gpu->dxc_utils->CreateBlob(src, src_size, CP_UTF8, &source_blob))) {
-			printf("[gpulib]: Failed to create source blob\n");
-			return GPU_NULL_KERNEL;
-		}
-		DxcBuffer src_buffer = {};
-		src_buffer.Ptr = source_blob->GetBufferPointer();
-		src_buffer.Size = source_blob->GetBufferSize();
-		src_buffer.Encoding = 0;
-
-		// Defines
-		const u32 num_defines = u32_min(desc->num_defines, GPU_KERNEL_MAX_NUM_DEFINES);
-		wchar_t defines_wide[GPU_KERNEL_DEFINE_MAX_LEN + 3][GPU_KERNEL_MAX_NUM_DEFINES] = {};
-		for (u32 i = 0; i < num_defines; i++) {
-			defines_wide[i][0] = L'-';
-			defines_wide[i][1] = L'D';
-			utf8ToWide(defines_wide[i] + 2, GPU_KERNEL_DEFINE_MAX_LEN, desc->defines[i]);
-			defines_wide[i][GPU_KERNEL_DEFINE_MAX_LEN + 2] = '\0';
-		}
-
-		// Compiler arguments
-		constexpr u32 NUM_ARGS_BASE = 11;
-		constexpr u32 MAX_NUM_ARGS = NUM_ARGS_BASE + GPU_KERNEL_MAX_NUM_DEFINES;
-		const u32 num_args = NUM_ARGS_BASE + num_defines;
-		LPCWSTR args[MAX_NUM_ARGS] = {
-			L"-E",
-			L"CSMain",
-			L"-T",
-			L"cs_6_6",
-			L"-HV 2021",
-			L"-enable-16bit-types",
-			L"-O3",
-			L"-Zi",
-			L"-Qembed_debug",
-			DXC_ARG_PACK_MATRIX_ROW_MAJOR,
-			L"-DGPU_LIB_HLSL"
-		};
-		for (u32 i = 0; i < num_defines; i++) {
-			args[NUM_ARGS_BASE + i] = defines_wide[i];
-		}
-
-		// Compile shader
-		ComPtr<IDxcResult> compile_res;
-		CHECK_D3D12(gpu->dxc_compiler->Compile(
-			&src_buffer, args, num_args, gpu->dxc_include_handler.Get(), IID_PPV_ARGS(&compile_res)));
-		{
-			ComPtr<IDxcBlobUtf8> error_msgs;
-			CHECK_D3D12(compile_res->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&error_msgs), nullptr));
-			if (error_msgs && error_msgs->GetStringLength() > 0) {
-				printf("[gpu_lib]: %s\n", (const char*)error_msgs->GetBufferPointer());
-			}
+// Reads the kernel source file and prepends the prolog. Returned buffer is null-terminated and
+// must be deallocated with the cpu allocator.
+static char* kernelReadSource(SfzAllocator* allocator, const char* path, u32* src_size_out)
+{
+	// Map shader file
+	FileMapData src_map = fileMap(path, true);
+	if (src_map.ptr == nullptr) {
+		printf("[gpulib]: Failed to map kernel source file \"%s\".\n", path);
+		return nullptr;
+	}
+	sfz_defer[=]() { fileUnmap(src_map); };
+
+	// Allocate memory for src + prolog
+	const u32 src_size = u32(src_map.size_bytes + GPU_KERNEL_PROLOG_SIZE);
+	char* src = static_cast<char*>(allocator->alloc(sfz_dbg(""), src_size + 1));
+
+	// Copy prolog and then src file into buffer
+	memcpy(src, GPU_KERNEL_PROLOG, GPU_KERNEL_PROLOG_SIZE);
+	memcpy(src + GPU_KERNEL_PROLOG_SIZE, src_map.ptr, src_map.size_bytes);
+	src[src_size] = '\0'; // Guarantee null-termination, safe because we allocated 1 byte extra.
+	*src_size_out = src_size;
+	return src;
+}
 
-			ComPtr<IDxcBlobUtf8> remarks;
-			CHECK_D3D12(compile_res->GetOutput(DXC_OUT_REMARKS, IID_PPV_ARGS(&remarks), nullptr));
-			if (remarks && remarks->GetStringLength() > 0) {
-				printf("[gpu_lib]: %s\n", (const char*)remarks->GetBufferPointer());
+// The kernel cache key, a hash of everything (except includes) that determines the output of the
+// compiler. Includes are stored and validated per cache entry, see GpuKernelCache.
+static GpuHash kernelCacheKey(
+	IDxcCompiler3* compiler, const char* src, u32 src_size, const GpuKernelArgs& args)
+{
+	GpuSha256 sha = sha256Init();
+	const u32 cache_version = GPU_KERNEL_CACHE_VERSION;
+	sha256Update(&sha, &cache_version, sizeof(u32));
+
+	// Compiler version
+	ComPtr<IDxcVersionInfo> version_info;
+	if (SUCCEEDED(compiler->QueryInterface(IID_PPV_ARGS(&version_info)))) {
+		u32 major = 0, minor = 0;
+		version_info->GetVersion(&major, &minor);
+		sha256Update(&sha, &major, sizeof(u32));
+		sha256Update(&sha, &minor, sizeof(u32));
+	}
+	ComPtr<IDxcVersionInfo2> version_info2;
+	if (SUCCEEDED(compiler->QueryInterface(IID_PPV_ARGS(&version_info2)))) {
+		u32 commit_count = 0;
+		char* commit_hash = nullptr;
+		if (SUCCEEDED(version_info2->GetCommitInfo(&commit_count, &commit_hash))) {
+			sha256Update(&sha, &commit_count, sizeof(u32));
+			if (commit_hash != nullptr) {
+				sha256Update(&sha, commit_hash, strlen(commit_hash));
+				CoTaskMemFree(commit_hash);
 			}
+		}
+	}
 
-			HRESULT hr = {};
-			CHECK_D3D12(compile_res->GetStatus(&hr));
-			const bool compile_success = CHECK_D3D12(hr);
-			if (!compile_success) {
-				printf("[gpu_lib]: Failed to compile kernel\n");
-				return GPU_NULL_KERNEL;
-			}
+	// Arguments (including defines), null-terminators included to separate them
+	for (u32 i = 0; i < args.num_args; i++) {
+		sha256Update(&sha, args.args[i], (wcslen(args.args[i]) + 1) * sizeof(wchar_t));
+	}
+
+	// Prolog + source
+	sha256Update(&sha, src, src_size);
+	return sha256Final(&sha);
+}
+
+// DXC passes include paths as found by its search, e.g. ".\common.hlsl" or "./dir/common.hlsl".
+// Use forward slashes and strip leading "./" so the same file always gets the same path.
+static SfzStr320 includePathNormalize(LPCWSTR filename)
+{
+	SfzStr320 path = {};
+	WideCharToMultiByte(CP_UTF8, 0, filename, -1, path.str, sizeof(path.str) - 1, nullptr, nullptr);
+	for (char* c = path.str; *c != '\0'; c++) {
+		if (*c == '\\') *c = '/';
+	}
+	u32 offset = 0;
+	while (path.str[offset] == '.' && path.str[offset + 1] == '/') offset += 2;
+	if (offset != 0) memmove(path.str, path.str + offset, strlen(path.str + offset) + 1);
+	return path;
+}
+
+// Include handler that serves files from the include cache and records each loaded file along with
+// a hash of its contents. Owned by the stack of the compile, so reference counting is a no-op.
+struct GpuIncludeHandler final : public IDxcIncludeHandler {
+	IDxcUtils* utils = nullptr;
+	GpuIncludeCache* include_cache = nullptr;
+	SfzArray<GpuKernelDep>* deps = nullptr;
+
+	HRESULT STDMETHODCALLTYPE LoadSource(LPCWSTR filename, IDxcBlob** include_source) override
+	{
+		*include_source = nullptr;
+		const SfzStr320 path = includePathNormalize(filename);
+		const u8* contents = nullptr;
+		u32 size = 0;
+		GpuHash hash = {};
+		if (!includeCacheGet(include_cache, path.str, &contents, &size, &hash)) {
+			return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
 		}
 
-		// Get compiled DXIL
-		CHECK_D3D12(compile_res->GetOutput(DXC_OUT_OBJECT, IID_PPV_ARGS(&dxil_blob), nullptr));
-		ComPtr<IDxcBlob> reflection_data;
-
-		// Get reflection data
-		ComPtr<ID3D12ShaderReflection> reflection;
-		CHECK_D3D12(compile_res->GetOutput(DXC_OUT_REFLECTION, IID_PPV_ARGS(&reflection_data), nullptr));
-		DxcBuffer reflection_buffer = {};
-		reflection_buffer.Ptr = reflection_data->GetBufferPointer();
-		reflection_buffer.Size = reflection_data->GetBufferSize();
-		reflection_buffer.Encoding = 0;
-		CHECK_D3D12(gpu->dxc_utils->CreateReflection(&reflection_buffer, IID_PPV_ARGS(&reflection)));
-
-		// Get group dimensions from reflection
-		u32 group_dim_x = 0, group_dim_y = 0, group_dim_z = 0;
-		reflection->GetThreadGroupSize(&group_dim_x, &group_dim_y, &group_dim_z);
-		group_dims = i32x3_init((i32)group_dim_x, (i32)group_dim_y, (i32)group_dim_z);
-
-		// Get launch parameters info from reflection
-		D3D12_SHADER_DESC shader_desc = {};
-		CHECK_D3D12(reflection->GetDesc(&shader_desc));
-		if (shader_desc.ConstantBuffers > 1) {
-			printf("[gpu_lib]: More than 1 constant buffer bound, not allowed.\n");
-			return GPU_NULL_KERNEL;
-		}
-		if (shader_desc.ConstantBuffers == 1) {
-			ID3D12ShaderReflectionConstantBuffer* cbuffer_reflection =
-				reflection->GetConstantBufferByIndex(0);
-			D3D12_SHADER_BUFFER_DESC cbuffer = {};
-			CHECK_D3D12(cbuffer_reflection->GetDesc(&cbuffer));
-			launch_params_size = cbuffer.Size;
-			if (launch_params_size > GPU_LAUNCH_PARAMS_MAX_SIZE) {
-				printf("[gpu_lib]: Launch parameters too big, %u bytes, max %u bytes allowed\n",
-					launch_params_size, GPU_LAUNCH_PARAMS_MAX_SIZE);
-				return GPU_NULL_KERNEL;
+		// Contents live as long as the include cache, no need for DXC to copy them
+		ComPtr<IDxcBlobEncoding> blob;
+		const HRESULT res = utils->CreateBlobFromPinned(contents, size, CP_UTF8, &blob);
+		if (FAILED(res)) return res;
+
+		// Record each file once, even if it's included several times
+		bool recorded = false;
+		for (const GpuKernelDep& dep : *deps) {
+			if (strcmp(dep.path.str, path.str) == 0) {
+				recorded = true;
+				break;
 			}
 		}
+		if (!recorded) {
+			GpuKernelDep& dep = deps->add();
+			dep.path = path;
+			dep.hash = hash;
+		}
+
+		*include_source = blob.Detach();
+		return S_OK;
 	}
 
-	// Create root signature
-	ComPtr<ID3D12RootSignature> root_sig;
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object) override
 	{
-		constexpr u32 MAX_NUM_ROOT_PARAMS = 3;
-		const u32 num_root_params =
-			launch_params_size != 0 ? MAX_NUM_ROOT_PARAMS : (MAX_NUM_ROOT_PARAMS - 1);
-		D3D12_ROOT_PARAMETER1 root_params[MAX_NUM_ROOT_PARAMS] = {};
+		if (riid == __uuidof(IDxcIncludeHandler) || riid == __uuidof(IUnknown)) {
+			*object = static_cast<IDxcIncludeHandler*>(this);
+			return S_OK;
+		}
+		*object = nullptr;
+		return E_NOINTERFACE;
+	}
+	ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+	ULONG STDMETHODCALLTYPE Release() override { return 1; }
+};
 
-		root_params[GPU_ROOT_PARAM_GLOBAL_HEAP_IDX].ParameterType = D3D12_ROOT_PARAMETER_TYPE_UAV;
-		root_params[GPU_ROOT_PARAM_GLOBAL_HEAP_IDX].Descriptor.ShaderRegister = 0;
-		root_params[GPU_ROOT_PARAM_GLOBAL_HEAP_IDX].Descriptor.RegisterSpace = 0;
-		// Note: UAV is written to during command list execution, thus it MUST be volatile.
-		root_params[GPU_ROOT_PARAM_GLOBAL_HEAP_IDX].Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE;
-		root_params[GPU_ROOT_PARAM_GLOBAL_HEAP_IDX].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+static GpuParamType paramTypeFromD3D12(const D3D12_SHADER_TYPE_DESC& type_desc)
+{
+	if (type_desc.Class == D3D_SVC_STRUCT) return GPU_PARAM_TYPE_STRUCT;
+	switch (type_desc.Type) {
+	case D3D_SVT_BOOL: return GPU_PARAM_TYPE_BOOL;
+	case D3D_SVT_INT16: return GPU_PARAM_TYPE_I16;
+	case D3D_SVT_UINT16: return GPU_PARAM_TYPE_U16;
+	case D3D_SVT_FLOAT16: return GPU_PARAM_TYPE_F16;
+	case D3D_SVT_INT: return GPU_PARAM_TYPE_I32;
+	case D3D_SVT_UINT: return GPU_PARAM_TYPE_U32;
+	case D3D_SVT_FLOAT: return GPU_PARAM_TYPE_F32;
+	case D3D_SVT_INT64: return GPU_PARAM_TYPE_I64;
+	case D3D_SVT_UINT64: return GPU_PARAM_TYPE_U64;
+	case D3D_SVT_DOUBLE: return GPU_PARAM_TYPE_F64;
+	default: break;
+	}
+	return GPU_PARAM_TYPE_UNKNOWN;
+}
 
-		D3D12_DESCRIPTOR_RANGE1 desc_range = {};
-		desc_range.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
-		desc_range.NumDescriptors = UINT_MAX; // Unbounded
-		desc_range.BaseShaderRegister = 1;
-		desc_range.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE;
-		desc_range.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-		root_params[GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-		root_params[GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX].DescriptorTable.NumDescriptorRanges = 1;
-		root_params[GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX].DescriptorTable.pDescriptorRanges = &desc_range;
-		root_params[GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+// Reflects the members of the launch parameters cbuffer. Variables are reported in declaration
+// order, which for cbuffers is also offset order.
+static bool reflectParamLayout(
+	ID3D12ShaderReflectionConstantBuffer* cbuffer_reflection,
+	const D3D12_SHADER_BUFFER_DESC& cbuffer,
+	GpuLaunchParamLayout* layout_out)
+{
+	GpuLaunchParamLayout& layout = *layout_out;
+	layout = {};
+	layout.size = cbuffer.Size;
+	if (cbuffer.Variables > GPU_LAUNCH_PARAMS_MAX_NUM_MEMBERS) {
+		printf("[gpu_lib]: Too many launch parameters, %u, max %u allowed\n",
+			cbuffer.Variables, GPU_LAUNCH_PARAMS_MAX_NUM_MEMBERS);
+		return false;
+	}
 
-		if (launch_params_size != 0) {
-			root_params[GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
-			root_params[GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX].Constants.ShaderRegister = 0;
-			root_params[GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX].Constants.RegisterSpace = 0;
-			root_params[GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX].Constants.Num32BitValues = launch_params_size / 4;
-			root_params[GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-		}
+	u32 used_end = 0;
+	for (u32 i = 0; i < cbuffer.Variables; i++) {
+		ID3D12ShaderReflectionVariable* var = cbuffer_reflection->GetVariableByIndex(i);
+		D3D12_SHADER_VARIABLE_DESC var_desc = {};
+		CHECK_D3D12(var->GetDesc(&var_desc));
+		D3D12_SHADER_TYPE_DESC type_desc = {};
+		CHECK_D3D12(var->GetType()->GetDesc(&type_desc));
+
+		GpuLaunchParamMember& member = layout.members[layout.num_members];
+		layout.num_members += 1;
+		strncpy(member.name, var_desc.Name, GPU_LAUNCH_PARAM_NAME_MAX_LEN - 1);
+		member.offset = var_desc.StartOffset;
+		member.size = var_desc.Size;
+		member.type = paramTypeFromD3D12(type_desc);
+		member.num_components = type_desc.Rows * type_desc.Columns;
+		used_end = u32_max(used_end, member.offset + member.size);
+	}
 
-		D3D12_VERSIONED_ROOT_SIGNATURE_DESC root_sig_desc = {};
-		root_sig_desc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
-		root_sig_desc.Desc_1_1.NumParameters = num_root_params;
-		root_sig_desc.Desc_1_1.pParameters = root_params;
-		root_sig_desc.Desc_1_1.NumStaticSamplers = 0;
-		root_sig_desc.Desc_1_1.pStaticSamplers = nullptr;
-		root_sig_desc.Desc_1_1.Flags =
-			D3D12_ROOT_SIGNATURE_FLAG_DENY_VERTEX_SHADER_ROOT_ACCESS |
-			D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
-			D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
-			D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS |
-			D3D12_ROOT_SIGNATURE_FLAG_DENY_PIXEL_SHADER_ROOT_ACCESS |
-			D3D12_ROOT_SIGNATURE_FLAG_DENY_AMPLIFICATION_SHADER_ROOT_ACCESS |
-			D3D12_ROOT_SIGNATURE_FLAG_DENY_MESH_SHADER_ROOT_ACCESS;
+	// Root constants are set 32 bits at a time
+	layout.used_size = (used_end + 3) & ~3u;
+	return true;
+}
 
-		ComPtr<ID3DBlob> blob;
-		ComPtr<ID3DBlob> error_blob;
-		const bool serialize_success = CHECK_D3D12(D3D12SerializeVersionedRootSignature(
-			&root_sig_desc, &blob, &error_blob));
-		if (!serialize_success) {
-			printf("[gpu_lib]: Failed to serialize root signature: %s\n",
-				(const char*)error_blob->GetBufferPointer());
-			return GPU_NULL_KERNEL;
+// Compiles the source with DXC and prints any errors. Includes are recorded in deps_out.
+static bool dxcCompile(
+	GpuDxc& dxc,
+	GpuIncludeCache* include_cache,
+	const DxcBuffer& src_buffer,
+	const LPCWSTR* args,
+	u32 num_args,
+	SfzArray<GpuKernelDep>& deps_out,
+	ComPtr<IDxcResult>& result_out)
+{
+	GpuIncludeHandler include_handler;
+	include_handler.utils = dxc.utils.Get();
+	include_handler.include_cache = include_cache;
+	include_handler.deps = &deps_out;
+
+	CHECK_D3D12(dxc.compiler->Compile(
+		&src_buffer, args, num_args, &include_handler, IID_PPV_ARGS(&result_out)));
+
+	ComPtr<IDxcBlobUtf8> error_msgs;
+	CHECK_D3D12(result_out->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&error_msgs), nullptr));
+	if (error_msgs && error_msgs->GetStringLength() > 0) {
+		printf("[gpu_lib]: %s\n", (const char*)error_msgs->GetBufferPointer());
+	}
+
+	ComPtr<IDxcBlobUtf8> remarks;
+	CHECK_D3D12(result_out->GetOutput(DXC_OUT_REMARKS, IID_PPV_ARGS(&remarks), nullptr));
+	if (remarks && remarks->GetStringLength() > 0) {
+		printf("[gpu_lib]: %s\n", (const char*)remarks->GetBufferPointer());
+	}
+
+	HRESULT hr = {};
+	CHECK_D3D12(result_out->GetStatus(&hr));
+	const bool compile_success = CHECK_D3D12(hr);
+	if (!compile_success) {
+		printf("[gpu_lib]: Failed to compile kernel\n");
+		return false;
+	}
+	return true;
+}
+
+static ComPtr<ID3D12ShaderReflection> dxcGetReflection(GpuDxc& dxc, IDxcResult* result)
+{
+	ComPtr<IDxcBlob> reflection_data;
+	ComPtr<ID3D12ShaderReflection> reflection;
+	CHECK_D3D12(result->GetOutput(DXC_OUT_REFLECTION, IID_PPV_ARGS(&reflection_data), nullptr));
+	DxcBuffer reflection_buffer = {};
+	reflection_buffer.Ptr = reflection_data->GetBufferPointer();
+	reflection_buffer.Size = reflection_data->GetBufferSize();
+	reflection_buffer.Encoding = 0;
+	CHECK_D3D12(dxc.utils->CreateReflection(&reflection_buffer, IID_PPV_ARGS(&reflection)));
+	return reflection;
+}
+
+// Compiles a kernel and reflects its group dimensions and launch parameters layout.
+//
+// Launch parameters at b0 that don't fit in the root constants are moved to b1 (the root CBV, see
+// GPU_LARGE_LAUNCH_PARAMS) by compiling again with the cbuffer's name defined as
+// "<name> : register(b1)". This only works if the cbuffer has no explicit register, which is the
+// normal way to declare launch parameters. An explicit register(b0) either fails the second compile
+// or keeps the cbuffer at b0, the reflection of the second compile is checked to catch the latter.
+static bool kernelCompile(
+	GpuDxc& dxc,
+	GpuIncludeCache* include_cache,
+	SfzAllocator* allocator,
+	const char* src,
+	u32 src_size,
+	const GpuKernelArgs& args,
+	GpuKernelBinary* out)
+{
+	// Create source blob
+	ComPtr<IDxcBlobEncoding> source_blob;
+	if (!CHECK_D3D12(dxc.utils->CreateBlob(src, src_size, CP_UTF8, &source_blob))) {
+		printf("[gpulib]: Failed to create source blob\n");
+		return false;
+	}
+	DxcBuffer src_buffer = {};
+	src_buffer.Ptr = source_blob->GetBufferPointer();
+	src_buffer.Size = source_blob->GetBufferSize();
+	src_buffer.Encoding = 0;
+
+	// Compile shader, record includes so that cache entries can be invalidated when they change
+	out->deps.init(16, allocator, sfz_dbg("GpuKernelBinary::deps"));
+	ComPtr<IDxcResult> compile_res;
+	if (!dxcCompile(dxc, include_cache, src_buffer, args.args, args.num_args, out->deps, compile_res)) return false;
+	ComPtr<ID3D12ShaderReflection> reflection = dxcGetReflection(dxc, compile_res.Get());
+
+	D3D12_SHADER_DESC shader_desc = {};
+	CHECK_D3D12(reflection->GetDesc(&shader_desc));
+	if (shader_desc.ConstantBuffers > 1) {
+		printf("[gpu_lib]: More than 1 constant buffer bound, not allowed.\n");
+		return false;
+	}
+
+	// Move launch parameters too large for root constants to b1, see above
+	if (shader_desc.ConstantBuffers == 1) {
+		D3D12_SHADER_BUFFER_DESC cbuffer = {};
+		CHECK_D3D12(reflection->GetConstantBufferByIndex(0)->GetDesc(&cbuffer));
+		D3D12_SHADER_INPUT_BIND_DESC bind_desc = {};
+		CHECK_D3D12(reflection->GetResourceBindingDescByName(cbuffer.Name, &bind_desc));
+		if (bind_desc.Space == 0 && bind_desc.BindPoint == 0 && cbuffer.Size > GPU_LAUNCH_PARAMS_MAX_SIZE) {
+			// Copied, the name is owned by the reflection which is replaced below
+			SfzStr96 cbuffer_name = {};
+			sfzStr96Appendf(&cbuffer_name, "%s", cbuffer.Name);
+			SfzStr320 define = {};
+			sfzStr320Appendf(&define, "-D%s=%s : register(b1)", cbuffer_name.str, cbuffer_name.str);
+			wchar_t define_wide[sizeof(define.str)] = {};
+			utf8ToWide(define_wide, sizeof(define.str), define.str);
+			LPCWSTR large_args[GPU_KERNEL_DXC_NUM_BASE_ARGS + GPU_KERNEL_MAX_NUM_DEFINES + 1] = {};
+			memcpy(large_args, args.args, args.num_args * sizeof(LPCWSTR));
+			large_args[args.num_args] = define_wide;
+
+			out->deps.clear();
+			compile_res.Reset();
+			if (!dxcCompile(dxc, include_cache, src_buffer, large_args, args.num_args + 1, out->deps, compile_res)) {
+				printf("[gpu_lib]: Could not move %u bytes of launch parameters to b1, declare \"%s\" without an explicit register or with GPU_LARGE_LAUNCH_PARAMS.\n",
+					cbuffer.Size, cbuffer_name.str);
+				return false;
+			}
+			reflection = dxcGetReflection(dxc, compile_res.Get());
+			CHECK_D3D12(reflection->GetDesc(&shader_desc));
+			D3D12_SHADER_INPUT_BIND_DESC moved_bind_desc = {};
+			if (shader_desc.ConstantBuffers != 1 ||
+				FAILED(reflection->GetResourceBindingDescByName(cbuffer_name.str, &moved_bind_desc)) ||
+				moved_bind_desc.Space != 0 || moved_bind_desc.BindPoint != 1) {
+				printf("[gpu_lib]: Launch parameters \"%s\" (%u bytes) are declared with an explicit register, only %u bytes fit at b0. Remove the register or use GPU_LARGE_LAUNCH_PARAMS.\n",
+					cbuffer_name.str, cbuffer.Size, GPU_LAUNCH_PARAMS_MAX_SIZE);
+				return false;
+			}
 		}
+	}
 
-		const bool create_success = CHECK_D3D12(gpu->device->CreateRootSignature(
-			0, blob->GetBufferPointer(), blob->GetBufferSize(), IID_PPV_ARGS(&root_sig)));
-		if (!create_success) {
-			printf("[gpu_lib]: Failed to create root signature\n");
-			return GPU_NULL_KERNEL;
-		} 
-		setDebugName(root_sig.Get(), desc->name);
+	// Get compiled DXIL
+	ComPtr<IDxcBlob> dxil_blob;
+	CHECK_D3D12(compile_res->GetOutput(DXC_OUT_OBJECT, IID_PPV_ARGS(&dxil_blob), nullptr));
+	const u32 dxil_size = u32(dxil_blob->GetBufferSize());
+	out->dxil.init(dxil_size, allocator, sfz_dbg("GpuKernelBinary::dxil"));
+	out->dxil.add(static_cast<const u8*>(dxil_blob->GetBufferPointer()), dxil_size);
+
+	// Get group dimensions from reflection
+	u32 group_dim_x = 0, group_dim_y = 0, group_dim_z = 0;
+	reflection->GetThreadGroupSize(&group_dim_x, &group_dim_y, &group_dim_z);
+	out->group_dims = i32x3_init((i32)group_dim_x, (i32)group_dim_y, (i32)group_dim_z);
+
+	// Get launch parameters info from reflection
+	out->param_layout = {};
+	if (shader_desc.ConstantBuffers == 1) {
+		ID3D12ShaderReflectionConstantBuffer* cbuffer_reflection =
+			reflection->GetConstantBufferByIndex(0);
+		D3D12_SHADER_BUFFER_DESC cbuffer = {};
+		CHECK_D3D12(cbuffer_reflection->GetDesc(&cbuffer));
+
+		// Root constants (b0) or large launch parameters (b1)
+		D3D12_SHADER_INPUT_BIND_DESC bind_desc = {};
+		CHECK_D3D12(reflection->GetResourceBindingDescByName(cbuffer.Name, &bind_desc));
+		if (bind_desc.Space != 0 || bind_desc.BindPoint > 1) {
+			printf("[gpu_lib]: Launch parameters must be bound to b0 or GPU_LARGE_LAUNCH_PARAMS, got b%u (space %u)\n",
+				bind_desc.BindPoint, bind_desc.Space);
+			return false;
+		}
+		const bool is_large = bind_desc.BindPoint == 1;
+		const u32 max_size = is_large ? GPU_LAUNCH_PARAMS_LARGE_MAX_SIZE : GPU_LAUNCH_PARAMS_MAX_SIZE;
+		if (cbuffer.Size > max_size) {
+			printf("[gpu_lib]: Launch parameters too big, %u bytes, max %u bytes allowed\n", cbuffer.Size, max_size);
+			return false;
+		}
+		if (!reflectParamLayout(cbuffer_reflection, cbuffer, &out->param_layout)) return false;
+		out->param_layout.is_large = is_large ? 1 : 0;
 	}
+	return true;
+}
+
+// Creates the pipeline state for a compiled kernel. Thread-safe, both the device and the pipeline
+// library are free-threaded.
+static bool kernelCreatePipeline(
+	GpuLib* gpu,
+	const char* name,
+	const u8* dxil,
+	u32 dxil_size,
+	const GpuHash& dxil_hash,
+	ComPtr<ID3D12PipelineState>& pso_out)
+{
+	ID3D12Device3* device = gpu->device.Get();
 
 	// Create PSO (Pipeline State Object)
-	ComPtr<ID3D12PipelineState> pso;
 	{
 		D3D12_COMPUTE_PIPELINE_STATE_DESC pso_desc = {};
-		pso_desc.pRootSignature = root_sig.Get();
-		pso_desc.CS.pShaderBytecode = dxil_blob->GetBufferPointer();
-		pso_desc.CS.BytecodeLength = dxil_blob->GetBufferSize();
+		pso_desc.pRootSignature = gpu->root_sig.Get();
+		pso_desc.CS.pShaderBytecode = dxil;
+		pso_desc.CS.BytecodeLength = dxil_size;
 		pso_desc.NodeMask = 0;
 		pso_desc.CachedPSO = {};
 		pso_desc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
 
-		const bool pso_success = CHECK_D3D12(gpu->device->CreateComputePipelineState(
-			&pso_desc, IID_PPV_ARGS(&pso)));
+		// Try loading the PSO from the pipeline library first, skips the driver compile
+		ID3D12PipelineLibrary* library = gpu->pipeline_library.Get();
+		const WideStr library_name = pipelineLibraryName(dxil_hash);
+		if (library != nullptr &&
+			SUCCEEDED(library->LoadComputePipeline(library_name.str, &pso_desc, IID_PPV_ARGS(&pso_out)))) {
+			setDebugName(pso_out.Get(), name);
+			return true;
+		}
+
+		const bool pso_success = CHECK_D3D12(device->CreateComputePipelineState(
+			&pso_desc, IID_PPV_ARGS(&pso_out)));
 		if (!pso_success) {
 			printf("[gpu_lib]: Failed to create pso\n");
-			return GPU_NULL_KERNEL;
+			return false;
 		}
-		setDebugName(pso.Get(), desc->name);
+		setDebugName(pso_out.Get(), name);
+
+		// Store PSO in library. Fails if another thread stored the same PSO first, that's fine.
+		if (library != nullptr && SUCCEEDED(library->StorePipeline(library_name.str, pso_out.Get()))) {
+			InterlockedIncrement(&gpu->pipeline_library_num_stored);
+		}
+	}
+	return true;
+}
+
+// Compiles (or loads from the kernel cache) and creates the pipeline for a kernel, src must include
+// the prolog. Safe to call from multiple threads as long as each thread uses its own DXC instance.
+static bool kernelBuildFromSource(
+	GpuLib* gpu,
+	GpuDxc& dxc,
+	const char* name,
+	const char* src,
+	u32 src_size,
+	const GpuKernelArgs& args,
+	GpuKernelBinary* binary_out,
+	ComPtr<ID3D12PipelineState>& pso_out)
+{
+	// Check kernel cache, compile shader on miss
+	const GpuHash cache_key = kernelCacheKey(dxc.compiler.Get(), src, src_size, args);
+	const bool cache_hit = kernelCacheLoad(
+		&gpu->kernel_cache, cache_key, &gpu->include_cache, gpu->cfg.cpu_allocator, binary_out);
+	if (!cache_hit) {
+		const bool compile_success = kernelCompile(
+			dxc, &gpu->include_cache, gpu->cfg.cpu_allocator, src, src_size, args, binary_out);
+		if (!compile_success) return false;
+		AcquireSRWLockExclusive(&gpu->kernel_cache_lock);
+		kernelCacheStore(&gpu->kernel_cache, cache_key, *binary_out);
+		ReleaseSRWLockExclusive(&gpu->kernel_cache_lock);
+	}
+
+	binary_out->dxil_hash = sha256(binary_out->dxil.data(), binary_out->dxil.size());
+	return kernelCreatePipeline(
+		gpu, name, binary_out->dxil.data(), binary_out->dxil.size(), binary_out->dxil_hash, pso_out);
+}
+
+// Reads, compiles (or loads from the kernel cache) and creates the pipeline for a kernel. Safe to
+// call from multiple threads as long as each thread uses its own DXC instance.
+static bool kernelBuild(
+	GpuLib* gpu,
+	GpuDxc& dxc,
+	const GpuKernelDesc* desc,
+	GpuKernelBinary* binary_out,
+	ComPtr<ID3D12PipelineState>& pso_out)
+{
+	// Read shader file from disk
+	u32 src_size = 0;
+	char* src = kernelReadSource(gpu->cfg.cpu_allocator, desc->path, &src_size);
+	if (src == nullptr) return false;
+	sfz_defer[=]() { gpu->cfg.cpu_allocator->dealloc(src); };
+
+	// Compiler arguments
+	GpuKernelArgs args = {};
+	kernelArgsInit(&args, desc);
+
+	return kernelBuildFromSource(gpu, dxc, desc->name, src, src_size, args, binary_out, pso_out);
+}
+
+static GpuKernelSource kernelSourceInit(const GpuKernelDesc* desc)
+{
+	GpuKernelSource source = {};
+	if (desc->name != nullptr) sfzStr96Appendf(&source.name, "%s", desc->name);
+	sfzStr320Appendf(&source.path, "%s", desc->path);
+	source.num_defines = u32_min(desc->num_defines, GPU_KERNEL_MAX_NUM_DEFINES);
+	for (u32 i = 0; i < source.num_defines; i++) {
+		sfzStr96Appendf(&source.defines[i], "%s", desc->defines[i]);
 	}
+	return source;
+}
+
+// Returns a desc pointing into the source, defines_out must have room for GPU_KERNEL_MAX_NUM_DEFINES.
+static GpuKernelDesc kernelSourceToDesc(const GpuKernelSource& source, const char** defines_out)
+{
+	for (u32 i = 0; i < source.num_defines; i++) defines_out[i] = source.defines[i].str;
+	GpuKernelDesc desc = {};
+	desc.name = source.name.str;
+	desc.path = source.path.str;
+	desc.num_defines = source.num_defines;
+	desc.defines = defines_out;
+	return desc;
+}
+
+static void kernelSetDeps(GpuLib* gpu, GpuKernelInfo& info, const GpuKernelBinary& binary)
+{
+	info.deps.init(binary.deps.size(), gpu->cfg.cpu_allocator, sfz_dbg("GpuKernelInfo::deps"));
+	info.deps.add(binary.deps.data(), binary.deps.size());
+}
+
+// Starts watching the kernel's source file and all its includes for changes.
+static void kernelWatchFiles(GpuLib* gpu, GpuKernelInfo& info)
+{
+	watchedFilesInit(
+		info.watched_files, info.source.path.str, info.deps.data(), info.deps.size(), gpu->cfg.cpu_allocator);
+}
+
+static GpuKernel kernelStore(
+	GpuLib* gpu,
+	const GpuKernelDesc* desc,
+	const GpuKernelBinary& binary,
+	ComPtr<ID3D12PipelineState> pso)
+{
+	const SfzHandle handle = gpu->kernels.allocate();
+	if (handle == SFZ_NULL_HANDLE) return GPU_NULL_KERNEL;
+	GpuKernelInfo& kernel_info = *gpu->kernels.get(handle);
+	kernel_info.pso = pso;
+	kernel_info.dxil_hash = binary.dxil_hash;
+	kernel_info.group_dims = binary.group_dims;
+	kernel_info.param_layout = binary.param_layout;
+	kernel_info.source = kernelSourceInit(desc);
+	kernelSetDeps(gpu, kernel_info, binary);
+	if (gpu->cfg.kernel_hot_reload) kernelWatchFiles(gpu, kernel_info);
+	return GpuKernel{ handle.bits };
+}
+
+sfz_extern_c GpuKernel gpuKernelInit(GpuLib* gpu, const GpuKernelDesc* desc)
+{
+	GpuKernelBinary binary = {};
+	ComPtr<ID3D12PipelineState> pso;
+	if (!kernelBuild(gpu, gpu->dxc, desc, &binary, pso)) return GPU_NULL_KERNEL;
+	return kernelStore(gpu, desc, binary, pso);
+}
+
+// Builds a kernel from source embedded in gpu_lib (see GPU_COUNT_TO_GROUPS_KERNEL_SRC). Built-in
+// kernels have no source file, so they are never hot reloaded.
+static GpuKernel kernelInitBuiltin(GpuLib* gpu, const char* name, const char* src_no_prolog)
+{
+	const u32 src_size = u32(GPU_KERNEL_PROLOG_SIZE + strlen(src_no_prolog));
+	char* src = static_cast<char*>(gpu->cfg.cpu_allocator->alloc(sfz_dbg(""), src_size + 1));
+	sfz_defer[=]() { gpu->cfg.cpu_allocator->dealloc(src); };
+	memcpy(src, GPU_KERNEL_PROLOG, GPU_KERNEL_PROLOG_SIZE);
+	memcpy(src + GPU_KERNEL_PROLOG_SIZE, src_no_prolog, src_size - GPU_KERNEL_PROLOG_SIZE);
+	src[src_size] = '\0';
+
+	GpuKernelDesc desc = {};
+	desc.name = name;
+	GpuKernelArgs args = {};
+	kernelArgsInit(&args, &desc);
+
+	GpuKernelBinary binary = {};
+	ComPtr<ID3D12PipelineState> pso;
+	if (!kernelBuildFromSource(gpu, gpu->dxc, name, src, src_size, args, &binary, pso)) return GPU_NULL_KERNEL;
 
-	// Store kernel data and return handle
 	const SfzHandle handle = gpu->kernels.allocate();
 	if (handle == SFZ_NULL_HANDLE) return GPU_NULL_KERNEL;
 	GpuKernelInfo& kernel_info = *gpu->kernels.get(handle);
 	kernel_info.pso = pso;
-	kernel_info.root_sig = root_sig;
-	kernel_info.group_dims = group_dims;
-	kernel_info.launch_params_size = launch_params_size;
+	kernel_info.dxil_hash = binary.dxil_hash;
+	kernel_info.group_dims = binary.group_dims;
+	kernel_info.param_layout = binary.param_layout;
+	sfzStr96Appendf(&kernel_info.source.name, "%s", name);
 	return GpuKernel{ handle.bits };
 }
 
+// Per kernel state used by gpuKernelInitBatch().
+sfz_struct(GpuKernelBatchItem) {
+	GpuKernelBinary binary;
+	ComPtr<ID3D12PipelineState> pso;
+};
+
+sfz_struct(GpuKernelBatch) {
+	GpuLib* gpu;
+	const GpuKernelDesc* descs;
+	GpuKernelBatchItem* items;
+};
+
+// Compiles a kernel and creates its pipeline on a worker thread, see jobsRunBatch().
+static bool kernelBatchJob(void* user, u32 item_idx, u32 worker_idx)
+{
+	GpuKernelBatch& batch = *static_cast<GpuKernelBatch*>(user);
+	GpuKernelBatchItem& item = batch.items[item_idx];
+	GpuDxc& dxc = batch.gpu->dxc_workers[worker_idx];
+	return kernelBuild(batch.gpu, dxc, &batch.descs[item_idx], &item.binary, item.pso);
+}
+
+sfz_extern_c bool gpuKernelInitBatch(
+	GpuLib* gpu, const GpuKernelDesc* descs, u32 num_kernels, GpuKernel* kernels_out, f32* times_ms_out)
+{
+	for (u32 i = 0; i < num_kernels; i++) kernels_out[i] = GPU_NULL_KERNEL;
+	if (num_kernels == 0) return true;
+
+	// DXC instances are not thread-safe, make sure we have one per worker thread
+	const u32 num_workers = jobsNumWorkers();
+	while (gpu->dxc_workers.size() < num_workers) {
+		GpuDxc dxc = {};
+		if (!dxcInit(&dxc)) return false;
+		gpu->dxc_workers.add(sfz_move(dxc));
+	}
+
+	// Compile kernels and create pipelines on worker threads
+	SfzArray<GpuKernelBatchItem> items;
+	items.init(num_kernels, gpu->cfg.cpu_allocator, sfz_dbg("gpuKernelInitBatch"));
+	for (u32 i = 0; i < num_kernels; i++) items.add(GpuKernelBatchItem{});
+	SfzArray<bool> successes;
+	successes.init(num_kernels, gpu->cfg.cpu_allocator, sfz_dbg("gpuKernelInitBatch"));
+	successes.add(false, num_kernels);
+	GpuKernelBatch batch = {};
+	batch.gpu = gpu;
+	batch.descs = descs;
+	batch.items = items.data();
+	jobsRunBatch(num_kernels, kernelBatchJob, &batch, successes.data(), times_ms_out);
+
+	// Store kernels, the pool is not thread-safe so this is done on the calling thread
+	bool all_success = true;
+	for (u32 i = 0; i < num_kernels; i++) {
+		GpuKernelBatchItem& item = items[i];
+		if (!successes[i]) {
+			printf("[gpu_lib]: Failed to build kernel \"%s\" in batch.\n", descs[i].name);
+			all_success = false;
+			continue;
+		}
+		kernels_out[i] = kernelStore(gpu, &descs[i], item.binary, item.pso);
+		if (kernels_out[i] == GPU_NULL_KERNEL) all_success = false;
+	}
+	return all_success;
+}
+
+// Kernel hot reload
+// ------------------------------------------------------------------------------------------------
+
+static DWORD WINAPI kernelReloadThread(void* param)
+{
+	GpuKernelReloadJob* job = static_cast<GpuKernelReloadJob*>(param);
+	GpuDxc dxc = {};
+	if (!dxcInit(&dxc)) return 0;
+	const char* defines[GPU_KERNEL_MAX_NUM_DEFINES] = {};
+	const GpuKernelDesc desc = kernelSourceToDesc(job->source, defines);
+	job->success = kernelBuild(job->gpu, dxc, &desc, &job->binary, job->pso);
+	return 0;
+}
+
+static void kernelReloadStart(GpuLib* gpu, SfzHandle handle, GpuKernelInfo& info)
+{
+	GpuKernelReloadJob* job = sfz_new<GpuKernelReloadJob>(gpu->cfg.cpu_allocator, sfz_dbg("GpuKernelReloadJob"));
+	job->gpu = gpu;
+	job->kernel = handle;
+	job->source = info.source;
+	job->thread = CreateThread(nullptr, 0, kernelReloadThread, job, 0, nullptr);
+	if (job->thread == nullptr) {
+		printf("[gpu_lib]: Failed to create thread for reloading kernel \"%s\"\n", info.source.name.str);
+		sfz_delete(gpu->cfg.cpu_allocator, job);
+		return;
+	}
+	info.reload_in_flight = true;
+	gpu->kernel_reload_jobs.add(job);
+}
+
+// Swaps in kernels that have finished reloading and starts reloading kernels whose files have
+// changed. Called at the end of gpuSubmitQueuedWork(), the old pipelines are retired because they
+// can still be used by in-flight submits.
+static void kernelHotReloadUpdate(GpuLib* gpu)
+{
+	// Swap in finished kernels
+	for (u32 i = 0; i < gpu->kernel_reload_jobs.size();) {
+		GpuKernelReloadJob* job = gpu->kernel_reload_jobs[i];
+		if (WaitForSingleObject(job->thread, 0) != WAIT_OBJECT_0) {
+			i += 1;
+			continue;
+		}
+		CloseHandle(job->thread);
+
+		// Kernel might have been destroyed while it was being reloaded
+		GpuKernelInfo* info = gpu->kernels.get(job->kernel);
+		if (info != nullptr) {
+			info->reload_in_flight = false;
+			if (job->success) {
+				retireObject(gpu, info->pso);
+				info->pso = job->pso;
+				info->dxil_hash = job->binary.dxil_hash;
+				info->group_dims = job->binary.group_dims;
+				info->param_layout = job->binary.param_layout;
+				kernelSetDeps(gpu, *info, job->binary);
+				kernelWatchFiles(gpu, *info);
+				printf("[gpu_lib]: Reloaded kernel \"%s\"\n", info->source.name.str);
+			}
+			else {
+				printf("[gpu_lib]: Failed to reload kernel \"%s\", keeping old version\n", info->source.name.str);
+			}
+		}
+
+		sfz_delete(gpu->cfg.cpu_allocator, job);
+		gpu->kernel_reload_jobs.removeQuickSwap(i);
+	}
+
+	// Check if any watched files have changed
+	if (!hotReloadShouldPoll(&gpu->kernel_hot_reload_last_poll_ms, timeNowMs())) return;
+
+	GpuKernelInfo* kernels = gpu->kernels.data();
+	const sfz::PoolSlot* slots = gpu->kernels.slots();
+	const u32 array_size = gpu->kernels.arraySize();
+	for (u32 idx = 0; idx < array_size; idx++) {
+		const sfz::PoolSlot slot = slots[idx];
+		if (!slot.active()) continue;
+		GpuKernelInfo& info = kernels[idx];
+		if (info.reload_in_flight) continue;
+
+		// If the reload fails we wait for the next change
+		if (watchedFilesChanged(info.watched_files)) kernelReloadStart(gpu, gpu->kernels.getHandle(idx), info);
+	}
+}
+
 sfz_extern_c void gpuKernelDestroy(GpuLib* gpu, GpuKernel kernel)
 {
 	const SfzHandle handle = SfzHandle{ kernel.handle };
 	GpuKernelInfo* info = gpu->kernels.get(handle);
 	if (info == nullptr) return;
+	retireObject(gpu, info->pso); // Might be used by commands in the stream
 	gpu->kernels.deallocate(handle);
 }
 
@@ -989,6 +2201,293 @@ sfz_extern_c i32x3 gpuKernelGetGroupDims(const GpuLib* gpu, GpuKernel kernel)
 	return info->group_dims;
 }
 
+sfz_extern_c bool gpuKernelGetParamLayout(const GpuLib* gpu, GpuKernel kernel, GpuLaunchParamLayout* layout_out)
+{
+	const SfzHandle handle = SfzHandle{ kernel.handle };
+	const GpuKernelInfo* info = gpu->kernels.get(handle);
+	if (info == nullptr) return false;
+	*layout_out = info->param_layout;
+	return true;
+}
+
+sfz_extern_c u32 gpuKernelGetNumDeps(const GpuLib* gpu, GpuKernel kernel)
+{
+	const SfzHandle handle = SfzHandle{ kernel.handle };
+	const GpuKernelInfo* info = gpu->kernels.get(handle);
+	if (info == nullptr) return 0;
+	return info->deps.size();
+}
+
+sfz_extern_c GpuKernelDepInfo gpuKernelGetDep(const GpuLib* gpu, GpuKernel kernel, u32 idx)
+{
+	GpuKernelDepInfo dep_info = {};
+	const SfzHandle handle = SfzHandle{ kernel.handle };
+	const GpuKernelInfo* info = gpu->kernels.get(handle);
+	if (info == nullptr || idx >= info->deps.size()) return dep_info;
+	const GpuKernelDep& dep = info->deps[idx];
+	dep_info.path = dep.path.str;
+	memcpy(dep_info.sha256, dep.hash.bytes, sizeof(dep_info.sha256));
+	return dep_info;
+}
+
+// Kernel permutations API
+// ------------------------------------------------------------------------------------------------
+
+// The desc of a single permutation, along with storage for the strings it points to.
+sfz_struct(GpuKernelPermutationDesc) {
+	SfzStr96 name;
+	SfzStr96 defines[GPU_KERNEL_MAX_NUM_DEFINES];
+	const char* define_ptrs[GPU_KERNEL_MAX_NUM_DEFINES];
+	GpuKernelDesc desc;
+};
+
+static void permutationDescInit(const GpuKernelPermutationsInfo& info, u32 key, GpuKernelPermutationDesc* out)
+{
+	*out = {};
+	sfzStr96Appendf(&out->name, "%s[%u]", info.source.name.str, key);
+
+	u32 num_defines = 0;
+	for (u32 i = 0; i < info.source.num_defines; i++) {
+		out->defines[num_defines++] = info.source.defines[i];
+	}
+	u32 axis_values[GPU_KERNEL_MAX_NUM_AXES] = {};
+	permutationKeyUnpack(info.axis_num_values, info.num_axes, key, axis_values);
+	for (u32 i = 0; i < info.num_axes; i++) {
+		sfzStr96Appendf(&out->defines[num_defines++], "%s=%u", info.axis_names[i].str, axis_values[i]);
+	}
+	for (u32 i = 0; i < num_defines; i++) out->define_ptrs[i] = out->defines[i].str;
+
+	out->desc.name = out->name.str;
+	out->desc.path = info.source.path.str;
+	out->desc.num_defines = num_defines;
+	out->desc.defines = out->define_ptrs;
+}
+
+sfz_extern_c GpuKernelPermutations gpuKernelPermutationsInit(GpuLib* gpu, const GpuKernelPermutationsDesc* desc)
+{
+	u32 num_permutations = 0;
+	if (!permutationAxesValidate(desc->axes, desc->num_axes, desc->num_defines, &num_permutations)) {
+		return GPU_NULL_KERNEL_PERMUTATIONS;
+	}
+
+	const SfzHandle handle = gpu->kernel_permutations.allocate();
+	if (handle == SFZ_NULL_HANDLE) return GPU_NULL_KERNEL_PERMUTATIONS;
+	GpuKernelPermutationsInfo& info = *gpu->kernel_permutations.get(handle);
+	const GpuKernelDesc source_desc = { desc->name, desc->path, desc->num_defines, desc->defines };
+	info.source = kernelSourceInit(&source_desc);
+	info.num_axes = desc->num_axes;
+	for (u32 i = 0; i < desc->num_axes; i++) {
+		info.axis_names[i] = {};
+		sfzStr96Appendf(&info.axis_names[i], "%s", desc->axes[i].name);
+		info.axis_num_values[i] = desc->axes[i].num_values;
+	}
+	info.num_permutations = num_permutations;
+	info.kernels.init(info.num_permutations, gpu->cfg.cpu_allocator, sfz_dbg("GpuKernelPermutationsInfo::kernels"));
+	info.kernels.add(GPU_NULL_KERNEL, info.num_permutations);
+	info.failed.init(info.num_permutations, gpu->cfg.cpu_allocator, sfz_dbg("GpuKernelPermutationsInfo::failed"));
+	info.failed.add(false, info.num_permutations);
+	return GpuKernelPermutations{ handle.bits };
+}
+
+sfz_extern_c void gpuKernelPermutationsDestroy(GpuLib* gpu, GpuKernelPermutations perms)
+{
+	const SfzHandle handle = SfzHandle{ perms.handle };
+	GpuKernelPermutationsInfo* info = gpu->kernel_permutations.get(handle);
+	if (info == nullptr) return;
+	for (GpuKernel kernel : info->kernels) {
+		if (kernel != GPU_NULL_KERNEL) gpuKernelDestroy(gpu, kernel);
+	}
+	gpu->kernel_permutations.deallocate(handle);
+}
+
+sfz_extern_c u32 gpuKernelPermutationsGetKey(
+	const GpuLib* gpu, GpuKernelPermutations perms, const u32* axis_values)
+{
+	const GpuKernelPermutationsInfo* info = gpu->kernel_permutations.get(SfzHandle{ perms.handle });
+	if (info == nullptr) return U32_MAX;
+	return permutationKeyPack(info->axis_num_values, info->num_axes, axis_values);
+}
+
+sfz_extern_c u32 gpuKernelPermutationsGetNum(const GpuLib* gpu, GpuKernelPermutations perms)
+{
+	const GpuKernelPermutationsInfo* info = gpu->kernel_permutations.get(SfzHandle{ perms.handle });
+	if (info == nullptr) return 0;
+	return info->num_permutations;
+}
+
+sfz_extern_c GpuKernel gpuKernelPermutationsGet(GpuLib* gpu, GpuKernelPermutations perms, u32 key)
+{
+	GpuKernelPermutationsInfo* info = gpu->kernel_permutations.get(SfzHandle{ perms.handle });
+	if (info == nullptr || key >= info->num_permutations) return GPU_NULL_KERNEL;
+	GpuKernel& kernel = info->kernels[key];
+	if (kernel == GPU_NULL_KERNEL && !info->failed[key]) {
+		GpuKernelPermutationDesc perm_desc = {};
+		permutationDescInit(*info, key, &perm_desc);
+		kernel = gpuKernelInit(gpu, &perm_desc.desc);
+		info->failed[key] = kernel == GPU_NULL_KERNEL;
+	}
+	return kernel;
+}
+
+sfz_extern_c bool gpuKernelPermutationsPrecompile(
+	GpuLib* gpu, GpuKernelPermutations perms, const u32* keys, u32 num_keys)
+{
+	GpuKernelPermutationsInfo* info = gpu->kernel_permutations.get(SfzHandle{ perms.handle });
+	if (info == nullptr) return false;
+	if (keys == nullptr) num_keys = info->num_permutations;
+
+	// Gather permutations that haven't been compiled yet. Descs point into themselves, so capacity
+	// is reserved up front to make sure they are never moved.
+	SfzArray<u32> batch_keys;
+	batch_keys.init(num_keys, gpu->cfg.cpu_allocator, sfz_dbg("gpuKernelPermutationsPrecompile"));
+	SfzArray<GpuKernelPermutationDesc> perm_descs;
+	perm_descs.init(num_keys, gpu->cfg.cpu_allocator, sfz_dbg("gpuKernelPermutationsPrecompile"));
+	SfzArray<GpuKernelDesc> descs;
+	descs.init(num_keys, gpu->cfg.cpu_allocator, sfz_dbg("gpuKernelPermutationsPrecompile"));
+	for (u32 i = 0; i < num_keys; i++) {
+		const u32 key = keys != nullptr ? keys[i] : i;
+		if (key >= info->num_permutations) return false;
+		if (info->kernels[key] != GPU_NULL_KERNEL) continue;
+		batch_keys.add(key);
+		GpuKernelPermutationDesc& perm_desc = perm_descs.add();
+		permutationDescInit(*info, key, &perm_desc);
+		descs.add(perm_desc.desc);
+	}
+	if (descs.isEmpty()) return true;
+
+	SfzArray<GpuKernel> kernels;
+	kernels.init(descs.size(), gpu->cfg.cpu_allocator, sfz_dbg("gpuKernelPermutationsPrecompile"));
+	kernels.add(GPU_NULL_KERNEL, descs.size());
+	const bool success = gpuKernelInitBatch(gpu, descs.data(), descs.size(), kernels.data(), nullptr);
+	for (u32 i = 0; i < batch_keys.size(); i++) {
+		const u32 key = batch_keys[i];
+		if (info->kernels[key] != GPU_NULL_KERNEL) {
+			// Key was specified more than once
+			gpuKernelDestroy(gpu, kernels[i]);
+			continue;
+		}
+		info->kernels[key] = kernels[i];
+		info->failed[key] = kernels[i] == GPU_NULL_KERNEL;
+	}
+	return success;
+}
+
+// Kernel bundle API
+// ------------------------------------------------------------------------------------------------
+
+sfz_struct(GpuKernelBundleBatch) {
+	GpuDxc* dxc_workers;
+	GpuIncludeCache* include_cache;
+	SfzAllocator* allocator;
+	const GpuKernelDesc* descs;
+	GpuKernelBinary* binaries;
+};
+
+// Compiles a kernel for a bundle on a worker thread, see jobsRunBatch().
+static bool kernelBundleJob(void* user, u32 item_idx, u32 worker_idx)
+{
+	GpuKernelBundleBatch& batch = *static_cast<GpuKernelBundleBatch*>(user);
+	const GpuKernelDesc& desc = batch.descs[item_idx];
+	u32 src_size = 0;
+	char* src = kernelReadSource(batch.allocator, desc.path, &src_size);
+	if (src == nullptr) return false;
+	GpuKernelArgs args = {};
+	kernelArgsInit(&args, &desc);
+	const bool success = kernelCompile(batch.dxc_workers[worker_idx], batch.include_cache, batch.allocator,
+		src, src_size, args, &batch.binaries[item_idx]);
+	batch.allocator->dealloc(src);
+	return success;
+}
+
+sfz_extern_c bool gpuKernelBundleWrite(
+	const char* path,
+	const GpuKernelDesc* descs,
+	const u32* permutation_keys,
+	u32 num_kernels,
+	SfzAllocator* allocator)
+{
+	// DXC instances are not thread-safe, one per worker thread
+	const u32 num_workers = jobsNumWorkers();
+	SfzArray<GpuDxc> dxc_workers;
+	dxc_workers.init(num_workers, allocator, sfz_dbg("gpuKernelBundleWrite"));
+	for (u32 i = 0; i < num_workers; i++) {
+		GpuDxc dxc = {};
+		if (!dxcInit(&dxc)) return false;
+		dxc_workers.add(sfz_move(dxc));
+	}
+	GpuIncludeCache include_cache = {};
+	includeCacheInit(&include_cache, allocator);
+
+	// Compile kernels on worker threads, no device is needed since no pipelines are created
+	SfzArray<GpuKernelBinary> binaries;
+	binaries.init(num_kernels, allocator, sfz_dbg("gpuKernelBundleWrite"));
+	for (u32 i = 0; i < num_kernels; i++) binaries.add(GpuKernelBinary{});
+	SfzArray<bool> successes;
+	successes.init(num_kernels, allocator, sfz_dbg("gpuKernelBundleWrite"));
+	successes.add(false, num_kernels);
+	GpuKernelBundleBatch batch = {};
+	batch.dxc_workers = dxc_workers.data();
+	batch.include_cache = &include_cache;
+	batch.allocator = allocator;
+	batch.descs = descs;
+	batch.binaries = binaries.data();
+	jobsRunBatch(num_kernels, kernelBundleJob, &batch, successes.data(), nullptr);
+
+	SfzArray<GpuKernelBundleInput> inputs;
+	inputs.init(num_kernels, allocator, sfz_dbg("gpuKernelBundleWrite"));
+	for (u32 i = 0; i < num_kernels; i++) {
+		if (!successes[i]) {
+			printf("[gpu_lib]: Failed to compile kernel \"%s\" for bundle.\n", descs[i].name);
+			return false;
+		}
+		const GpuKernelBinary& binary = binaries[i];
+		GpuKernelBundleInput& input = inputs.add();
+		input.name = descs[i].name;
+		input.permutation_key = permutation_keys != nullptr ? permutation_keys[i] : GPU_KERNEL_BUNDLE_NO_PERMUTATION;
+		input.dxil = binary.dxil.data();
+		input.dxil_size = binary.dxil.size();
+		input.group_dims = binary.group_dims;
+		input.param_layout = &binary.param_layout;
+	}
+
+	SfzArray<u8> bundle;
+	if (!kernelBundleBuild(inputs.data(), inputs.size(), allocator, bundle)) return false;
+	const void* parts[1] = { bundle.data() };
+	const u64 part_sizes[1] = { bundle.size() };
+	if (!writeFileAtomic(path, parts, part_sizes, 1)) {
+		printf("[gpu_lib]: Failed to write kernel bundle \"%s\".\n", path);
+		return false;
+	}
+	return true;
+}
+
+sfz_extern_c GpuKernel gpuKernelInitFromBundle(
+	GpuLib* gpu, const void* bundle, u64 bundle_size, const char* name, u32 permutation_key)
+{
+	const GpuKernelBundleEntry* entry = kernelBundleFind(bundle, bundle_size, name, permutation_key);
+	if (entry == nullptr) {
+		printf("[gpu_lib]: Kernel \"%s\" (permutation %u) not found in bundle.\n", name, permutation_key);
+		return GPU_NULL_KERNEL;
+	}
+
+	// DXIL is passed straight from the bundle to the driver (or pipeline library)
+	const u8* dxil = static_cast<const u8*>(bundle) + entry->dxil_offset;
+	ComPtr<ID3D12PipelineState> pso;
+	if (!kernelCreatePipeline(gpu, name, dxil, entry->dxil_size, entry->dxil_hash, pso)) return GPU_NULL_KERNEL;
+
+	// Kernels from bundles have no source, so they are never hot reloaded
+	const SfzHandle handle = gpu->kernels.allocate();
+	if (handle == SFZ_NULL_HANDLE) return GPU_NULL_KERNEL;
+	GpuKernelInfo& kernel_info = *gpu->kernels.get(handle);
+	kernel_info.pso = pso;
+	kernel_info.dxil_hash = entry->dxil_hash;
+	kernel_info.group_dims = entry->group_dims;
+	memcpy(&kernel_info.param_layout, static_cast<const u8*>(bundle) + entry->param_layout_offset,
+		sizeof(GpuLaunchParamLayout));
+	sfzStr96Appendf(&kernel_info.source.name, "%s", name);
+	return GpuKernel{ handle.bits };
+}
+
 // Command API
 // ------------------------------------------------------------------------------------------------
 
@@ -997,6 +2496,11 @@ sfz_extern_c u64 gpuGetCurrSubmitIdx(const GpuLib* gpu)
 	return gpu->curr_submit_idx;
 }
 
+sfz_extern_c u32 gpuGetNumConcurrentSubmits(const GpuLib* gpu)
+{
+	return gpu->cfg.num_concurrent_submits;
+}
+
 sfz_extern_c i32x2 gpuSwapchainGetRes(const GpuLib* gpu)
 {
 	return gpu->swapchain_res;
@@ -1014,37 +2518,31 @@ sfz_extern_c u64 gpuTimestampGetFreq(const GpuLib* gpu)
 
 sfz_extern_c void gpuQueueTakeTimestamp(GpuLib* gpu, GpuPtr dst)
 {
-	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
-
 	// Note: This isn't necessarily the fastest/least blocking path. We could query the result
 	//       directly to the download heap, and in that case there would be no need to insert a
 	//       barrier on the global heap. OTOH, we already need this barrier for memcpy uploads, so
 	//       might not matter much.
 
 	// Ensure heap is in COPY_DEST state
-	if (gpu->gpu_heap_state != D3D12_RESOURCE_STATE_COPY_DEST) {
-		D3D12_RESOURCE_BARRIER barrier = {};
-		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		barrier.Transition.pResource = gpu->gpu_heap.Get();
-		barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-		barrier.Transition.StateBefore = gpu->gpu_heap_state;
-		barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
-		cmd_list_info.cmd_list->ResourceBarrier(1, &barrier);
-		gpu->gpu_heap_state = D3D12_RESOURCE_STATE_COPY_DEST;
-	}
+	cmdListHeapTransition(gpu, GPU_RES_STATE_COPY_DEST);
 
 	// Get timestamp and store it in u64 pointed to by gpu pointer
 	const u32 timestamp_idx = 0; // We only need one slot because we immediately copy out the data
-	cmd_list_info.cmd_list->EndQuery(
-		gpu->timestamp_query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestamp_idx);
-	cmd_list_info.cmd_list->ResolveQueryData(
-		gpu->timestamp_query_heap.Get(),
-		D3D12_QUERY_TYPE_TIMESTAMP,
-		timestamp_idx,
-		1,
-		gpu->gpu_heap.Get(),
-		dst);
+	cmdListRecord(gpu, cmdTimestamp(GPU_CMD_STREAM_OBJ_TIMESTAMP_QUERIES, timestamp_idx, GPU_CMD_STREAM_OBJ_GPU_HEAP, dst));
+}
+
+// Allocates a range in the upload heap ring buffer, returns offset into the mapped heap.
+static bool uploadHeapAlloc(GpuLib* gpu, u32 num_bytes, u32 align, u64* begin_mapped_out)
+{
+	return heapRingAlloc(&gpu->upload_heap_ring, "Upload",
+		sfzRoundUpAlignedU32(num_bytes, GPU_UPLOAD_HEAP_ALIGN), align, begin_mapped_out);
+}
+
+// Allocates a range in the download heap ring buffer, returns offset into the mapped heap.
+static bool downloadHeapAlloc(GpuLib* gpu, u32 num_bytes, u32 align, u64* begin_mapped_out)
+{
+	return heapRingAlloc(&gpu->download_heap_ring, "Download",
+		sfzRoundUpAlignedU32(num_bytes, GPU_DOWNLOAD_HEAP_ALIGN), align, begin_mapped_out);
 }
 
 sfz_extern_c void gpuQueueMemcpyUpload(GpuLib* gpu, GpuPtr dst, const void* src, u32 num_bytes_original)
@@ -1054,46 +2552,20 @@ sfz_extern_c void gpuQueueMemcpyUpload(GpuLib* gpu, GpuPtr dst, const void* src,
 		printf("[gpu_lib]: Trying to memcpy upload to an invalid pointer (%u)\n", dst);
 		return;
 	}
-	const u32 num_bytes = sfzRoundUpAlignedU32(num_bytes_original, GPU_UPLOAD_HEAP_ALIGN);
 
 	// Try to allocate a range
-	u64 begin = gpu->upload_heap_offset;
-	u64 begin_mapped = begin % gpu->cfg.upload_heap_size_bytes;
-	if (gpu->cfg.upload_heap_size_bytes < (begin_mapped + num_bytes)) {
-		// Wrap around, try in beginning of heap instead.
-		begin = sfzRoundUpAlignedU64(gpu->upload_heap_offset, gpu->cfg.upload_heap_size_bytes);
-		begin_mapped = 0;
-	}
-	const u64 end = begin + num_bytes;
-	
-	// Check for heap overflow
-	if (gpu->upload_heap_safe_offset <= end) {
-		printf("[gpu_lib]: Upload heap overflow by %u bytes\n",
-			u32(end - gpu->upload_heap_safe_offset));
-		return;
-	}
+	u64 begin_mapped = 0;
+	if (!uploadHeapAlloc(gpu, num_bytes_original, GPU_UPLOAD_HEAP_ALIGN, &begin_mapped)) return;
 
-	// Memcpy data to upload heap and commit change
+	// Memcpy data to upload heap
 	memcpy(gpu->upload_heap_mapped_ptr + begin_mapped, src, num_bytes_original);
-	gpu->upload_heap_offset = end;
 
 	// Ensure heap is in COPY_DEST state
-	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
-	if (gpu->gpu_heap_state != D3D12_RESOURCE_STATE_COPY_DEST) {
-		D3D12_RESOURCE_BARRIER barrier = {};
-		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		barrier.Transition.pResource = gpu->gpu_heap.Get();
-		barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-		barrier.Transition.StateBefore = gpu->gpu_heap_state;
-		barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
-		cmd_list_info.cmd_list->ResourceBarrier(1, &barrier);
-		gpu->gpu_heap_state = D3D12_RESOURCE_STATE_COPY_DEST;
-	}
+	cmdListHeapTransition(gpu, GPU_RES_STATE_COPY_DEST);
 
-	// Copy to heap
-	cmd_list_info.cmd_list->CopyBufferRegion(
-		gpu->gpu_heap.Get(), dst, gpu->upload_heap.Get(), begin_mapped, num_bytes_original);
+	// Copy to heap, coalesced with adjacent uploads by cmdStreamCoalesceCopies() if contiguous
+	cmdListRecord(gpu, cmdCopyBuffer(
+		GPU_CMD_STREAM_OBJ_GPU_HEAP, dst, GPU_CMD_STREAM_OBJ_UPLOAD_HEAP, begin_mapped, num_bytes_original));
 }
 
 sfz_extern_c GpuTicket gpuQueueMemcpyDownload(GpuLib* gpu, GpuPtr src, u32 num_bytes_original)
@@ -1103,45 +2575,129 @@ sfz_extern_c GpuTicket gpuQueueMemcpyDownload(GpuLib* gpu, GpuPtr src, u32 num_b
 		printf("[gpu_lib]: Trying to memcpy download from an invalid pointer (%u)\n", src);
 		return GPU_NULL_TICKET;
 	}
-	const u32 num_bytes = sfzRoundUpAlignedU32(num_bytes_original, GPU_DOWNLOAD_HEAP_ALIGN);
 
-	// Try to allocate a range
-	u64 begin = gpu->download_heap_offset;
-	u64 begin_mapped = begin % gpu->cfg.download_heap_size_bytes;
-	if (gpu->cfg.download_heap_size_bytes < (begin_mapped + num_bytes)) {
-		// Wrap around, try in beginning of heap instead.
-		begin = sfzRoundUpAlignedU64(gpu->download_heap_offset, gpu->cfg.download_heap_size_bytes);
-		begin_mapped = 0;
-	}
-	const u64 end = begin + num_bytes;
-
-	// Check for heap overflow
-	if (gpu->download_heap_safe_offset <= end) {
-		printf("[gpu_lib]: Download heap overflow by %u bytes\n",
-			u32(end - gpu->download_heap_safe_offset));
+	// Allocate a pending download slot
+	const SfzHandle download_handle = gpu->downloads.allocate();
+	if (download_handle == SFZ_NULL_HANDLE) {
+		printf("[gpu_lib]: Out of room for more concurrent downloads (max %u)\n",
+			gpu->cfg.max_num_concurrent_downloads);
 		return GPU_NULL_TICKET;
 	}
 
-	// Commit change
-	gpu->download_heap_offset = end;
+	// Try to allocate a range
+	u64 begin_mapped = 0;
+	if (!downloadHeapAlloc(gpu, num_bytes_original, GPU_DOWNLOAD_HEAP_ALIGN, &begin_mapped)) {
+		gpu->downloads.deallocate(download_handle);
+		return GPU_NULL_TICKET;
+	}
 
 	// Ensure heap is in COPY_SOURCE state
-	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
-	if (gpu->gpu_heap_state != D3D12_RESOURCE_STATE_COPY_SOURCE) {
-		D3D12_RESOURCE_BARRIER barrier = {};
-		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		barrier.Transition.pResource = gpu->gpu_heap.Get();
-		barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-		barrier.Transition.StateBefore = gpu->gpu_heap_state;
-		barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
-		cmd_list_info.cmd_list->ResourceBarrier(1, &barrier);
-		gpu->gpu_heap_state = D3D12_RESOURCE_STATE_COPY_SOURCE;
-	}
+	cmdListHeapTransition(gpu, GPU_RES_STATE_COPY_SOURCE);
 
 	// Copy to download heap
-	cmd_list_info.cmd_list->CopyBufferRegion(
-		gpu->download_heap.Get(), begin_mapped, gpu->gpu_heap.Get(), src, num_bytes_original);
+	cmdListRecord(gpu, cmdCopyBuffer(
+		GPU_CMD_STREAM_OBJ_DOWNLOAD_HEAP, begin_mapped, GPU_CMD_STREAM_OBJ_GPU_HEAP, src, num_bytes_original));
+
+	// Store data for the pending download
+	GpuPendingDownload& pending = *gpu->downloads.get(download_handle);
+	pending = {};
+	pending.heap_offset = u32(begin_mapped);
+	pending.num_bytes = num_bytes_original;
+	pending.submit_idx = gpu->curr_submit_idx;
+
+	const GpuTicket ticket = { download_handle.bits };
+	return ticket;
+}
+
+sfz_extern_c void gpuGetDownloadedData(GpuLib* gpu, GpuTicket ticket, void* dst, u32 num_bytes)
+{
+	const SfzHandle handle = SfzHandle{ ticket.handle };
+	GpuPendingDownload* pending = gpu->downloads.get(handle);
+	if (pending == nullptr) {
+		printf("[gpu_lib]: Invalid ticket.\n");
+		return;
+	}
+	if (pending->num_bytes != num_bytes) {
+		printf("[gpu_lib]: Memcpy download size mismatch, requested %u bytes, but %u was downloaded\n",
+			num_bytes, pending->num_bytes);
+		return;
+	}
+	if (gpu->known_completed_submit_idx < pending->submit_idx) {
+		printf("[gpu_lib]: Memcpy download is not yet done.\n");
+		return;
+	}
+	const u8* src = gpu->download_heap_mapped_ptr + pending->heap_offset;
+	if (pending->row_pitch != 0) {
+		copyRows((u8*)dst, pending->row_size, src, pending->row_pitch, pending->row_size, pending->num_rows);
+	}
+	else {
+		memcpy(dst, src, num_bytes);
+	}
+	gpu->downloads.deallocate(handle);
+}
+
+// The swapchain slot doesn't own its texture, it's stored separately in GpuLib.
+static ID3D12Resource* getRWTexResource(GpuLib* gpu, GpuRWTex tex_idx, GpuRWTexInfo& info)
+{
+	if (tex_idx == RWTEX_SWAPCHAIN_IDX) return gpu->swapchain_rwtex.Get();
+	return info.tex.Get();
+}
+
+// Returns the texture's command stream object, the texture must exist. RWTex are in the
+// UNORDERED_ACCESS state outside of the commands recorded by a single API call.
+static u32 rwTexCmdObj(GpuLib* gpu, GpuRWTex tex_idx, GpuRWTexInfo& info)
+{
+	ID3D12Resource* tex = getRWTexResource(gpu, tex_idx, info);
+	sfz_assert(tex != nullptr);
+	const i32x2 res = tex_idx == RWTEX_SWAPCHAIN_IDX ? gpu->swapchain_res : info.tex_res;
+	return cmdStreamObj(gpu, info.cmd_obj, cmdObjTexture(
+		tex, u32(res.x), u32(res.y), info.desc.format, GPU_RES_STATE_UNORDERED_ACCESS, true));
+}
+
+sfz_extern_c void gpuQueueRWTexUpload(GpuLib* gpu, GpuRWTex tex, const void* src, u32 num_bytes)
+{
+	const SfzHandle handle = gpu->rw_textures.getHandle(tex);
+	GpuRWTexInfo* tex_info = gpu->rw_textures.get(handle);
+	if (tex_info == nullptr || tex_info->tex == nullptr) {
+		printf("[gpu_lib]: Trying to upload to a GpuRWTex that doesn't exist (%u).\n", u32(tex));
+		return;
+	}
+	const GpuTexRows rows = texRows(tex_info->desc.format, tex_info->tex_res);
+	const u32 row_size = rows.row_size;
+	const u32 row_pitch = rows.row_pitch;
+	const u32 num_rows = rows.num_rows;
+	if (num_bytes != row_size * num_rows) {
+		printf("[gpu_lib]: RWTex upload size mismatch, got %u bytes, but texture \"%s\" is %u bytes\n",
+			num_bytes, tex_info->name.str, row_size * num_rows);
+		return;
+	}
+
+	// Try to allocate a range
+	u64 begin_mapped = 0;
+	if (!uploadHeapAlloc(gpu, row_pitch * num_rows, GPU_TEXTURE_PLACEMENT_ALIGN, &begin_mapped)) return;
+
+	// Copy rows to upload heap, adding padding so each row starts on an aligned pitch
+	copyRows(gpu->upload_heap_mapped_ptr + begin_mapped, row_pitch, (const u8*)src, row_size, row_size, num_rows);
+
+	// Copy to texture
+	const u32 tex_obj = rwTexCmdObj(gpu, tex, *tex_info);
+	cmdListRecord(gpu, cmdTransition(tex_obj, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST));
+	cmdListRecord(gpu, cmdCopyBufferToTex(tex_obj, GPU_CMD_STREAM_OBJ_UPLOAD_HEAP, begin_mapped, row_pitch));
+	cmdListRecord(gpu, cmdTransition(tex_obj, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_UNORDERED_ACCESS));
+}
+
+sfz_extern_c GpuTicket gpuQueueRWTexDownload(GpuLib* gpu, GpuRWTex tex)
+{
+	const SfzHandle handle = gpu->rw_textures.getHandle(tex);
+	GpuRWTexInfo* tex_info = gpu->rw_textures.get(handle);
+	if (tex_info == nullptr || tex_info->tex == nullptr) {
+		printf("[gpu_lib]: Trying to download a GpuRWTex that doesn't exist (%u).\n", u32(tex));
+		return GPU_NULL_TICKET;
+	}
+	const GpuTexRows rows = texRows(tex_info->desc.format, tex_info->tex_res);
+	const u32 row_size = rows.row_size;
+	const u32 row_pitch = rows.row_pitch;
+	const u32 num_rows = rows.num_rows;
 
 	// Allocate a pending download slot
 	const SfzHandle download_handle = gpu->downloads.allocate();
@@ -1151,224 +2707,460 @@ sfz_extern_c GpuTicket gpuQueueMemcpyDownload(GpuLib* gpu, GpuPtr src, u32 num_b
 		return GPU_NULL_TICKET;
 	}
 
-	// Store data for the pending download
-	GpuPendingDownload& pending = *gpu->downloads.get(download_handle);
-	pending.heap_offset = u32(begin_mapped);
-	pending.num_bytes = num_bytes_original;
-	pending.submit_idx = gpu->curr_submit_idx;
+	// Try to allocate a range
+	u64 begin_mapped = 0;
+	if (!downloadHeapAlloc(gpu, row_pitch * num_rows, GPU_TEXTURE_PLACEMENT_ALIGN, &begin_mapped)) {
+		gpu->downloads.deallocate(download_handle);
+		return GPU_NULL_TICKET;
+	}
+
+	// Copy to download heap
+	const u32 tex_obj = rwTexCmdObj(gpu, tex, *tex_info);
+	cmdListRecord(gpu, cmdTransition(tex_obj, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE));
+	cmdListRecord(gpu, cmdCopyTexToBuffer(GPU_CMD_STREAM_OBJ_DOWNLOAD_HEAP, begin_mapped, row_pitch, tex_obj));
+	cmdListRecord(gpu, cmdTransition(tex_obj, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_UNORDERED_ACCESS));
+
+	// Store data for the pending download
+	GpuPendingDownload& pending = *gpu->downloads.get(download_handle);
+	pending = {};
+	pending.heap_offset = u32(begin_mapped);
+	pending.num_bytes = row_size * num_rows;
+	pending.submit_idx = gpu->curr_submit_idx;
+	pending.row_pitch = row_pitch;
+	pending.row_size = row_size;
+	pending.num_rows = num_rows;
+
+	const GpuTicket ticket = { download_handle.bits };
+	return ticket;
+}
+
+sfz_extern_c void gpuQueueDispatch(
+	GpuLib* gpu, GpuKernel kernel, i32x3 num_groups, const void* params, u32 params_size)
+{
+	gpuQueueDispatchWithAccess(gpu, kernel, num_groups, params, params_size, nullptr);
+}
+
+static void queueRWTexBarrier(GpuLib* gpu, GpuRWTex tex_idx, GpuRWTexInfo& info)
+{
+	if (getRWTexResource(gpu, tex_idx, info) == nullptr) return;
+	cmdListRecord(gpu, cmdUavBarrier(rwTexCmdObj(gpu, tex_idx, info)));
+}
+
+// Records the barriers output by the last query of the rwtex hazard tracker.
+static void queueTrackerRWTexBarriers(GpuLib* gpu)
+{
+	for (GpuRWTex tex : gpu->rwtex_hazards.barriers) {
+		GpuRWTexInfo* tex_info = gpu->rw_textures.get(gpu->rw_textures.getHandle(tex));
+		if (tex_info == nullptr) continue;
+		queueRWTexBarrier(gpu, tex, *tex_info);
+	}
+	gpu->rwtex_hazards.barriers.clear();
+}
+
+static void queueHeapBarrier(GpuLib* gpu)
+{
+	cmdListRecord(gpu, cmdUavBarrier(GPU_CMD_STREAM_OBJ_GPU_HEAP));
+	gpu->heap_hazards.clear();
+}
+
+static void resolveHazards(GpuLib* gpu, const GpuDispatchAccess* access)
+{
+	// Undeclared dispatch, synchronize against all declared accesses. Barriers between undeclared
+	// dispatches are the responsibility of the user.
+	if (access == nullptr) {
+		if (gpu->heap_hazards.hasDeclaredAccesses()) queueHeapBarrier(gpu);
+	}
+	else if (gpu->heap_hazards.hasHazard(*access)) {
+		queueHeapBarrier(gpu);
+	}
+
+	gpu->rwtex_hazards.resolve(access);
+	queueTrackerRWTexBarriers(gpu);
+}
+
+static void trackAccesses(GpuLib* gpu, const GpuDispatchAccess* access)
+{
+	if (access == nullptr) {
+		gpu->heap_hazards.clear();
+		gpu->heap_hazards.unknown = true;
+	}
+	else {
+		gpu->heap_hazards.add(*access);
+	}
+	gpu->rwtex_hazards.add(access);
+}
+
+// Transitions the heap to the UNORDERED_ACCESS state if it's in any other state.
+static void heapEnsureUnorderedAccess(GpuLib* gpu)
+{
+	if (gpu->gpu_heap_state == GPU_RES_STATE_UNORDERED_ACCESS) return;
+	cmdListHeapTransition(gpu, GPU_RES_STATE_UNORDERED_ACCESS);
+
+	// Transition barrier synchronizes all earlier accesses to the heap
+	gpu->heap_hazards.clear();
+}
+
+// Prepares the command list for a dispatch of the kernel: transitions the heap, resolves hazards
+// and sets the pso. Returns nullptr (and prints why) if the kernel is invalid.
+static const GpuKernelInfo* dispatchBegin(GpuLib* gpu, GpuKernel kernel, const GpuDispatchAccess* access)
+{
+	heapEnsureUnorderedAccess(gpu);
+
+	// Set kernel
+	GpuKernelInfo* kernel_info = gpu->kernels.get(SfzHandle{ kernel.handle });
+	if (kernel_info == nullptr) {
+		printf("[gpu_lib]: Invalid kernel handle.\n");
+		return nullptr;
+	}
+
+	// Insert barriers for hazards against earlier dispatches
+	resolveHazards(gpu, access);
+	// Root signature and global descriptors are bound once per command list, see
+	// cmdListBindGlobalState(). Only the pso needs to be set, and only if it changed (checked when
+	// the stream is translated).
+	const u32 kernel_obj = cmdStreamObj(gpu, kernel_info->cmd_obj, cmdObjKernel(kernel_info->pso.Get()));
+	cmdListRecord(gpu, cmdSetKernel(kernel_obj));
+	return kernel_info;
+}
+
+// Sets the launch params of a dispatch, must be called after dispatchBegin().
+static bool dispatchSetParams(GpuLib* gpu, const GpuKernelInfo& kernel_info, const void* params, u32 params_size)
+{
+	const GpuLaunchParamLayout& param_layout = kernel_info.param_layout;
+	if (!paramsSizeValid(param_layout, params_size)) return false;
+	if (param_layout.is_large) {
+		// Placed in the upload heap ring buffer, which is reclaimed once this submit has finished
+		// executing. The cbuffer is read straight from the upload heap, so no copy or barrier needed.
+		u64 begin_mapped = 0;
+		if (!uploadHeapAlloc(gpu, params_size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, &begin_mapped)) {
+			return false;
+		}
+		memcpy(gpu->upload_heap_mapped_ptr + begin_mapped, params, params_size);
+		cmdListRecord(gpu, cmdSetLargeParams(GPU_CMD_STREAM_OBJ_UPLOAD_HEAP, begin_mapped, params_size));
+	}
+	else if (params_size != 0) {
+		cmdListRecord(gpu, cmdSetParams(params, params_size));
+	}
+	return true;
+}
+
+sfz_extern_c void gpuQueueDispatchWithAccess(
+	GpuLib* gpu,
+	GpuKernel kernel,
+	i32x3 num_groups,
+	const void* params,
+	u32 params_size,
+	const GpuDispatchAccess* access)
+{
+	const GpuKernelInfo* kernel_info = dispatchBegin(gpu, kernel, access);
+	if (kernel_info == nullptr) return;
+	if (!dispatchSetParams(gpu, *kernel_info, params, params_size)) return;
 
-	const GpuTicket ticket = { download_handle.bits };
-	return ticket;
+	// Dispatch
+	sfz_assert(0 < num_groups.x && 0 < num_groups.y && 0 < num_groups.z);
+	cmdListRecord(gpu, cmdDispatch(u32(num_groups.x), u32(num_groups.y), u32(num_groups.z)));
+	trackAccesses(gpu, access);
 }
 
-sfz_extern_c void gpuGetDownloadedData(GpuLib* gpu, GpuTicket ticket, void* dst, u32 num_bytes)
+sfz_extern_c void gpuQueueDispatchIndirect(
+	GpuLib* gpu, GpuKernel kernel, GpuPtr args, const void* params, u32 params_size)
 {
-	const SfzHandle handle = SfzHandle{ ticket.handle };
-	GpuPendingDownload* pending = gpu->downloads.get(handle);
-	if (pending == nullptr) {
-		printf("[gpu_lib]: Invalid ticket.\n");
+	gpuQueueDispatchIndirectWithAccess(gpu, kernel, args, params, params_size, nullptr);
+}
+
+sfz_extern_c void gpuQueueDispatchIndirectWithAccess(
+	GpuLib* gpu,
+	GpuKernel kernel,
+	GpuPtr args,
+	const void* params,
+	u32 params_size,
+	const GpuDispatchAccess* access)
+{
+	if (args < GPU_HEAP_SYSTEM_RESERVED_SIZE || gpu->cfg.gpu_heap_size_bytes < (u64(args) + sizeof(GpuDispatchArgs)) ||
+		(args % 4) != 0) {
+		printf("[gpu_lib]: Invalid indirect dispatch args pointer (%u)\n", args);
 		return;
 	}
-	if (pending->num_bytes != num_bytes) {
-		printf("[gpu_lib]: Memcpy download size mismatch, requested %u bytes, but %u was downloaded\n",
-			num_bytes, pending->num_bytes);
+	if (gpu->indirect_args_num_used >= GPU_INDIRECT_ARGS_MAX_NUM_PER_SUBMIT) {
+		printf("[gpu_lib]: Too many indirect dispatches in one submit (max %u)\n", GPU_INDIRECT_ARGS_MAX_NUM_PER_SUBMIT);
 		return;
 	}
-	if (gpu->known_completed_submit_idx < pending->submit_idx) {
-		printf("[gpu_lib]: Memcpy download is not yet done.\n");
-		return;
+
+	// Ensure heap is in COPY_SOURCE state and indirect args buffer in COPY_DEST state
+	cmdListHeapTransition(gpu, GPU_RES_STATE_COPY_SOURCE);
+	if (gpu->indirect_args_state != GPU_RES_STATE_COPY_DEST) {
+		cmdListRecord(gpu, cmdTransition(
+			GPU_CMD_STREAM_OBJ_INDIRECT_ARGS, gpu->indirect_args_state, GPU_RES_STATE_COPY_DEST));
+		gpu->indirect_args_state = GPU_RES_STATE_COPY_DEST;
 	}
-	memcpy(dst, gpu->download_heap_mapped_ptr + pending->heap_offset, num_bytes);
-	gpu->downloads.deallocate(handle);
+
+	// Copy args to this submit's range of the indirect args buffer
+	const u64 args_offset = gpu->getCurrIndirectArgsOffset();
+	gpu->indirect_args_num_used += 1;
+	cmdListRecord(gpu, cmdCopyBuffer(
+		GPU_CMD_STREAM_OBJ_INDIRECT_ARGS, args_offset, GPU_CMD_STREAM_OBJ_GPU_HEAP, args, sizeof(GpuDispatchArgs)));
+	cmdListRecord(gpu, cmdTransition(
+		GPU_CMD_STREAM_OBJ_INDIRECT_ARGS, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_INDIRECT_ARGUMENT));
+	gpu->indirect_args_state = GPU_RES_STATE_INDIRECT_ARGUMENT;
+
+	// Dispatch, transitions the heap back to UNORDERED_ACCESS
+	const GpuKernelInfo* kernel_info = dispatchBegin(gpu, kernel, access);
+	if (kernel_info == nullptr) return;
+	if (!dispatchSetParams(gpu, *kernel_info, params, params_size)) return;
+	cmdListRecord(gpu, cmdDispatchIndirect(
+		GPU_CMD_STREAM_OBJ_DISPATCH_CMD_SIG, GPU_CMD_STREAM_OBJ_INDIRECT_ARGS, args_offset, 1));
+	trackAccesses(gpu, access);
 }
 
-sfz_extern_c void gpuQueueDispatch(
-	GpuLib* gpu, GpuKernel kernel, i32x3 num_groups, const void* params, u32 params_size)
+sfz_extern_c void gpuQueueDispatchBatch(GpuLib* gpu, const GpuDispatchBatchItem* items, u32 num_items)
 {
-	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
+	for (u32 run_begin = 0, run_end = 0; run_begin < num_items; run_begin = run_end) {
+		run_end = dispatchBatchRunEnd(items, num_items, run_begin);
+		const GpuKernel kernel = items[run_begin].kernel;
+		const GpuKernelInfo* kernel_info = gpu->kernels.get(SfzHandle{ kernel.handle });
+		if (kernel_info == nullptr) {
+			printf("[gpu_lib]: Invalid kernel handle.\n");
+			continue;
+		}
+		if (dispatchBatchRunIsDirect(run_end - run_begin, kernel_info->param_layout)) {
+			for (u32 i = run_begin; i < run_end; i++) {
+				gpuQueueDispatch(gpu, items[i].kernel, items[i].num_groups, items[i].params, items[i].params_size);
+			}
+			continue;
+		}
 
-	// Ensure heap is in UNORDERED_ACCESS state
-	if (gpu->gpu_heap_state != D3D12_RESOURCE_STATE_UNORDERED_ACCESS) {
-		D3D12_RESOURCE_BARRIER barrier = {};
-		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		barrier.Transition.pResource = gpu->gpu_heap.Get();
-		barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-		barrier.Transition.StateBefore = gpu->gpu_heap_state;
-		barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-		cmd_list_info.cmd_list->ResourceBarrier(1, &barrier);
-		gpu->gpu_heap_state = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+		// Write args to the upload heap, skipping invalid items. Done before anything is recorded, so
+		// a run without valid items doesn't cause hazard tracking or barriers.
+		const u32 max_num_args = run_end - run_begin;
+		u64 begin_mapped = 0;
+		if (!uploadHeapAlloc(gpu, max_num_args * sizeof(GpuBatchDispatchArgs), GPU_UPLOAD_HEAP_ALIGN, &begin_mapped)) {
+			continue;
+		}
+		GpuBatchDispatchArgs* args =
+			reinterpret_cast<GpuBatchDispatchArgs*>(gpu->upload_heap_mapped_ptr + begin_mapped);
+		const u32 num_args = dispatchBatchPackArgs(kernel_info->param_layout, items + run_begin, max_num_args, args);
+		if (num_args == 0) continue;
+
+		// The upload heap is always in the GENERIC_READ state, which includes INDIRECT_ARGUMENT. The
+		// root constants set by the command signature are undefined afterwards.
+		if (dispatchBegin(gpu, kernel, nullptr) == nullptr) continue;
+		cmdListRecord(gpu, cmdDispatchIndirect(
+			GPU_CMD_STREAM_OBJ_BATCH_CMD_SIG, GPU_CMD_STREAM_OBJ_UPLOAD_HEAP, begin_mapped, num_args));
+		trackAccesses(gpu, nullptr);
 	}
+}
 
-	// Set kernel
-	const GpuKernelInfo* kernel_info = gpu->kernels.get(SfzHandle{ kernel.handle });
-	if (kernel_info == nullptr) {
-		printf("[gpu_lib]: Invalid kernel handle.\n");
+sfz_extern_c void gpuQueueCountToGroups(GpuLib* gpu, GpuPtr count, u32 elements_per_group, GpuPtr args_out)
+{
+	if (gpu->count_to_groups_kernel == GPU_NULL_KERNEL) {
+		printf("[gpu_lib]: gpuQueueCountToGroups() is unavailable, built-in kernel failed to build.\n");
 		return;
 	}
-	cmd_list_info.cmd_list->SetPipelineState(kernel_info->pso.Get());
-	cmd_list_info.cmd_list->SetComputeRootSignature(kernel_info->root_sig.Get());
-
-	// Set inline descriptors
-	// TODO: This could probably be done only once somehow
-	cmd_list_info.cmd_list->SetComputeRootUnorderedAccessView(
-		GPU_ROOT_PARAM_GLOBAL_HEAP_IDX, gpu->gpu_heap->GetGPUVirtualAddress());
-	cmd_list_info.cmd_list->SetComputeRootDescriptorTable(
-		GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX, gpu->tex_descriptor_heap_start_gpu);
-
-	// Set launch params
-	if (kernel_info->launch_params_size != params_size) {
-		printf("[gpu_lib]: Invalid size of launch parameters, got %u bytes, expected %u bytes.\n",
-			params_size, kernel_info->launch_params_size);
+	if (elements_per_group == 0) {
+		printf("[gpu_lib]: gpuQueueCountToGroups() requires at least 1 element per group.\n");
 		return;
 	}
-	if (params_size != 0) {
-		cmd_list_info.cmd_list->SetComputeRoot32BitConstants(
-			GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX, params_size / 4, params, 0);
-	}
 
-	// Dispatch
-	sfz_assert(0 < num_groups.x && 0 < num_groups.y && 0 < num_groups.z);
-	cmd_list_info.cmd_list->Dispatch(u32(num_groups.x), u32(num_groups.y), u32(num_groups.z));
+	struct {
+		GpuPtr count_ptr;
+		GpuPtr args_ptr;
+		u32 elements_per_group;
+	} params;
+	params.count_ptr = count;
+	params.args_ptr = args_out;
+	params.elements_per_group = elements_per_group;
+
+	const GpuPtrRange reads[1] = { GpuPtrRange{ count, sizeof(u32) } };
+	const GpuPtrRange writes[1] = { GpuPtrRange{ args_out, sizeof(GpuDispatchArgs) } };
+	GpuDispatchAccess access = {};
+	access.ptr_reads = reads;
+	access.num_ptr_reads = 1;
+	access.ptr_writes = writes;
+	access.num_ptr_writes = 1;
+	gpuQueueDispatchWithAccess(
+		gpu, gpu->count_to_groups_kernel, i32x3_splat(1), &params, sizeof(params), &access);
 }
 
 sfz_extern_c void gpuQueueGpuHeapBarrier(GpuLib* gpu)
 {
-	if (gpu->gpu_heap_state != D3D12_RESOURCE_STATE_UNORDERED_ACCESS) {
+	if (gpu->gpu_heap_state != GPU_RES_STATE_UNORDERED_ACCESS) {
 		printf("[gpu_lib]: Can't insert a gpu heap barrier, heap is in the wrong internal state.\n");
 		return;
 	}
-	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
-	D3D12_RESOURCE_BARRIER barrier = {};
-	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	barrier.UAV.pResource = gpu->gpu_heap.Get();
-	cmd_list_info.cmd_list->ResourceBarrier(1, &barrier);
+	queueHeapBarrier(gpu);
 }
 
 sfz_extern_c void gpuQueueRWTexBarrier(GpuLib* gpu, GpuRWTex tex_idx)
 {
 	const SfzHandle handle = gpu->rw_textures.getHandle(tex_idx);
-	const GpuRWTexInfo* tex_info = gpu->rw_textures.get(handle);
+	GpuRWTexInfo* tex_info = gpu->rw_textures.get(handle);
 	if (tex_info == nullptr) {
 		printf("[gpu_lib]: Trying to insert a GpuRWTex barrier for idx %u, which doesn't exist.\n",
 			u32(tex_idx));
 		return;
 	}
-	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
-	D3D12_RESOURCE_BARRIER barrier = {};
-	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	barrier.UAV.pResource = tex_info->tex.Get();
-	cmd_list_info.cmd_list->ResourceBarrier(1, &barrier);
+	queueRWTexBarrier(gpu, tex_idx, *tex_info);
+	gpu->rwtex_hazards.onBarrier(tex_idx);
 }
 
 sfz_extern_c void gpuQueueRWTexBarriers(GpuLib* gpu)
 {
-	// Prepare barriers for all GpuRWTex
-	gpu->tmp_barriers.clear();
-	GpuRWTexInfo* tex_infos = gpu->rw_textures.data();
-	const sfz::PoolSlot* slots = gpu->rw_textures.slots();
-	const u32 array_size = gpu->rw_textures.arraySize();
-	for (u32 idx = RWTEX_SWAPCHAIN_IDX; idx < array_size; idx++) {
-		const sfz::PoolSlot slot = slots[idx];
-		if (!slot.active()) continue;
-		GpuRWTexInfo& info = tex_infos[idx];		
-		D3D12_RESOURCE_BARRIER& barrier = gpu->tmp_barriers.add();
-		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		barrier.UAV.pResource = info.tex.Get();
+	// Barriers for all written GpuRWTex
+	gpu->rwtex_hazards.barrierWritten();
+	queueTrackerRWTexBarriers(gpu);
+}
+
+// Waits until the fence reaches the value, returns false on timeout. Loops since the (auto-reset)
+// event might still be signalled from an earlier wait that timed out.
+static bool fenceWait(ID3D12Fence* fence, HANDLE event, u64 fence_value, u32 timeout_ms)
+{
+	const u64 start_ms = GetTickCount64();
+	while (fence->GetCompletedValue() < fence_value) {
+		const u64 elapsed_ms = GetTickCount64() - start_ms;
+		if (timeout_ms != GPU_WAIT_INFINITE && elapsed_ms >= timeout_ms) return false;
+		CHECK_D3D12(fence->SetEventOnCompletion(fence_value, event));
+		const u32 wait_ms = timeout_ms == GPU_WAIT_INFINITE ? INFINITE : u32(timeout_ms - elapsed_ms);
+		WaitForSingleObject(event, wait_ms);
 	}
+	return true;
+}
 
-	// Set barriers
-	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
-	cmd_list_info.cmd_list->ResourceBarrier(gpu->tmp_barriers.size(), gpu->tmp_barriers.data());
+static bool cmdQueueFenceWait(GpuLib* gpu, u64 fence_value, u32 timeout_ms)
+{
+	return fenceWait(gpu->cmd_queue_fence.Get(), gpu->cmd_queue_fence_event, fence_value, timeout_ms);
+}
+
+// Issues the steps of syncOpsIssue() to a command queue.
+sfz_struct(QueueSyncIssuer) {
+	ID3D12CommandQueue* queue;
+	ID3D12CommandList* const* lists;
+	ID3D12Fence* wait_fence;
+	ID3D12Fence* signal_fence;
+};
+
+static void queueSyncIssueStep(void* user, const GpuSyncStep& step)
+{
+	const QueueSyncIssuer& issuer = *static_cast<const QueueSyncIssuer*>(user);
+	switch (step.type) {
+	case GPU_SYNC_STEP_EXECUTE:
+		issuer.queue->ExecuteCommandLists(step.num_lists, issuer.lists + step.first_list);
+		break;
+	case GPU_SYNC_STEP_WAIT:
+		CHECK_D3D12(issuer.queue->Wait(issuer.wait_fence, step.fence_value));
+		break;
+	case GPU_SYNC_STEP_SIGNAL:
+		CHECK_D3D12(issuer.queue->Signal(issuer.signal_fence, step.fence_value));
+		break;
+	}
+}
+
+// Issues the held back async work to the async queue, up until the first wait for a main queue
+// signal that hasn't been submitted yet.
+static void asyncQueueIssue(GpuLib* gpu)
+{
+	QueueSyncIssuer issuer = {};
+	issuer.queue = gpu->async_queue.Get();
+	issuer.lists = gpu->async_exec_lists.data();
+	issuer.wait_fence = gpu->main_sync_fence.Get();
+	issuer.signal_fence = gpu->async_fence.Get();
+	const GpuSyncOpsIssued issued = syncOpsIssue(gpu->async_sync_ops.data(), gpu->async_sync_ops.size(),
+		gpu->async_exec_lists.size(), gpu->main_sync_fence_submitted_value, queueSyncIssueStep, &issuer);
+	if (issued.last_signal_value != 0) gpu->async_fence_issued_value = issued.last_signal_value;
+
+	// Remove what was issued
+	if (issued.num_lists != 0) gpu->async_exec_lists.remove(0, issued.num_lists);
+	syncOpsRemoveIssued(gpu->async_sync_ops, issued);
+}
+
+// Waits until the async submit that last used the current async submit's slot (descriptor range
+// and the contexts' allocators) is done. Returns false instead if it is still held back, it can't
+// finish before the main queue signal it waits for has been submitted.
+static bool asyncSlotWait(GpuLib* gpu)
+{
+	const u64 slot_fence_value =
+		gpu->async_submit_fence_values[gpu->async_curr_submit_idx % gpu->cfg.num_concurrent_submits];
+	if (gpu->async_fence_issued_value < slot_fence_value) return false;
+	return fenceWait(gpu->async_fence.Get(), gpu->async_fence_event, slot_fence_value, GPU_WAIT_INFINITE);
 }
 
 sfz_extern_c void gpuSubmitQueuedWork(GpuLib* gpu)
 {
 	// Copy contents from swapchain RT to actual swapchain
+	ComPtr<ID3D12Resource> render_target; // Must outlive the translation of the stream below
 	if (gpu->swapchain != nullptr && gpu->swapchain_rwtex != nullptr) {
-		GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
-
-		// Grab current swapchain render target and descriptor heap
+		// Grab current swapchain render target
 		const u32 curr_swapchain_fb_idx = gpu->swapchain->GetCurrentBackBufferIndex();
-		sfz_assert(curr_swapchain_fb_idx < GPU_NUM_CONCURRENT_SUBMITS);
-		ComPtr<ID3D12Resource> render_target;
+		sfz_assert(curr_swapchain_fb_idx < gpu->cfg.num_concurrent_submits);
 		CHECK_D3D12(gpu->swapchain->GetBuffer(curr_swapchain_fb_idx, IID_PPV_ARGS(&render_target)));
-
-		// Barriers to transition swapchain rwtex to COPY_SOURCE and swapchain backing to COPY_DEST.
-		{
-			D3D12_RESOURCE_BARRIER barriers[2] = {};
-
-			barriers[0].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-			barriers[0].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-			barriers[0].Transition.pResource = gpu->swapchain_rwtex.Get();
-			barriers[0].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-			barriers[0].Transition.StateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-			barriers[0].Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
-
-			barriers[1].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-			barriers[1].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-			barriers[1].Transition.pResource = render_target.Get();
-			barriers[1].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-			barriers[1].Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-			barriers[1].Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
-
-			cmd_list_info.cmd_list->ResourceBarrier(2, barriers);
+		const u32 rwtex_obj = rwTexCmdObj(gpu, RWTEX_SWAPCHAIN_IDX, gpu->rw_textures.data()[RWTEX_SWAPCHAIN_IDX]);
+		const u32 rt_obj = cmdStreamAddObj(&gpu->cmd_stream, cmdObjTexture(render_target.Get(),
+			u32(gpu->swapchain_fb_res.x), u32(gpu->swapchain_fb_res.y), GPU_FORMAT_UNDEFINED, GPU_RES_STATE_PRESENT, false));
+
+		// Transition swapchain rwtex to COPY_SOURCE and swapchain backing to COPY_DEST
+		cmdListRecord(gpu, cmdTransition(rwtex_obj, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE));
+		cmdListRecord(gpu, cmdTransition(rt_obj, GPU_RES_STATE_PRESENT, GPU_RES_STATE_COPY_DEST));
+
+		// Copy contents of swapchain rt to actual backbuffer. If the framebuffers have not been
+		// resized yet (window is likely being dragged), only copy the region that overlaps.
+		if (gpu->swapchain_res == gpu->swapchain_fb_res) {
+			cmdListRecord(gpu, cmdCopyTex(rt_obj, rwtex_obj));
 		}
-
-		// Copy contents of swapchain rt to actual backbuffer
-		cmd_list_info.cmd_list->CopyResource(render_target.Get(), gpu->swapchain_rwtex.Get());
-
-		// Barriers to transition swapchain rwtex to UNORDERED_ACCESS and swapchain backing to PRESENT.
-		{
-			D3D12_RESOURCE_BARRIER barriers[2] = {};
-
-			barriers[0].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-			barriers[0].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-			barriers[0].Transition.pResource = gpu->swapchain_rwtex.Get();
-			barriers[0].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-			barriers[0].Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_SOURCE;
-			barriers[0].Transition.StateAfter = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
-
-			barriers[1].Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-			barriers[1].Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-			barriers[1].Transition.pResource = render_target.Get();
-			barriers[1].Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-			barriers[1].Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-			barriers[1].Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
-
-			cmd_list_info.cmd_list->ResourceBarrier(2, barriers);
+		else {
+			const i32x2 copy_res = i32x2_min(gpu->swapchain_res, gpu->swapchain_fb_res);
+			cmdListRecord(gpu, cmdCopyTex(rt_obj, rwtex_obj, u32(copy_res.x), u32(copy_res.y)));
 		}
+
+		// Transition swapchain rwtex to UNORDERED_ACCESS and swapchain backing to PRESENT
+		cmdListRecord(gpu, cmdTransition(rwtex_obj, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_UNORDERED_ACCESS));
+		cmdListRecord(gpu, cmdTransition(rt_obj, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_PRESENT));
 	}
 
 	// Execute current command list
 	{
 		GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
 
-		// Store current upload and download heap offsets
-		cmd_list_info.upload_heap_offset = gpu->upload_heap_offset;
-		cmd_list_info.download_heap_offset = gpu->download_heap_offset;
-
-		// Close command list
+		// Translate the command stream and close command list
+		cmdListTranslate(gpu);
 		if (!CHECK_D3D12(cmd_list_info.cmd_list->Close())) {
 			printf("[gpu_lib]: Could not close command list.\n");
 			return;
 		}
 
-		// Execute command list
-		ID3D12CommandList* cmd_lists[1] = {};
-		cmd_lists[0] = cmd_list_info.cmd_list.Get();
-		gpu->cmd_queue->ExecuteCommandLists(1, cmd_lists);
+		// Copy RWTex descriptors to this submit's range of the shader-visible descriptor heap
+		D3D12_CPU_DESCRIPTOR_HANDLE dst_descriptors = {};
+		dst_descriptors.ptr =
+			gpu->tex_descriptor_heap_visible_start_cpu.ptr + gpu->getCurrTexDescriptorsOffset();
+		gpu->device->CopyDescriptorsSimple(
+			gpu->rw_textures.arraySize(),
+			dst_descriptors,
+			gpu->tex_descriptor_heap_start_cpu,
+			D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+		// Execute command list, i.e. all segments and command contexts queued in between them. Cross
+		// queue signals and waits are executed at the points they were queued.
+		cmd_list_info.exec_lists.add(cmd_list_info.cmd_list.Get());
+		QueueSyncIssuer issuer = {};
+		issuer.queue = gpu->cmd_queue.Get();
+		issuer.lists = cmd_list_info.exec_lists.data();
+		issuer.wait_fence = gpu->async_fence.Get();
+		issuer.signal_fence = gpu->main_sync_fence.Get();
+		const GpuSyncOpsIssued issued = syncOpsIssue(cmd_list_info.sync_ops.data(), cmd_list_info.sync_ops.size(),
+			cmd_list_info.exec_lists.size(), U64_MAX, queueSyncIssueStep, &issuer);
+		if (issued.last_signal_value != 0) gpu->main_sync_fence_submitted_value = issued.last_signal_value;
+		cmd_list_info.exec_lists.clear();
+		cmd_list_info.sync_ops.clear();
+
+		// Async work waiting for the signals just submitted can now be issued
+		asyncQueueIssue(gpu);
 
 		// Fence signalling
 		if (!CHECK_D3D12(gpu->cmd_queue->Signal(gpu->cmd_queue_fence.Get(), gpu->cmd_queue_fence_value))) {
 			printf("[gpu_lib]: Could not signal from command queue\n");
 			return;
 		}
-		// This command list is done once the value above is signalled
-		cmd_list_info.fence_value = gpu->cmd_queue_fence_value;
+		// This command list is done once the value above is signalled, store it along with the
+		// current upload and download heap offsets
+		submitSlotEnd(&cmd_list_info.slot, gpu->cmd_queue_fence_value, gpu->upload_heap_ring, gpu->download_heap_ring);
 		// Increment value we will signal next time
 		gpu->cmd_queue_fence_value += 1;
 	}
@@ -1386,40 +3178,63 @@ sfz_extern_c void gpuSubmitQueuedWork(GpuLib* gpu)
 		GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
 
 		// Wait until command list is done
-		if (gpu->cmd_queue_fence->GetCompletedValue() < cmd_list_info.fence_value) {
-			CHECK_D3D12(gpu->cmd_queue_fence->SetEventOnCompletion(
-				cmd_list_info.fence_value, gpu->cmd_queue_fence_event));
-			WaitForSingleObject(gpu->cmd_queue_fence_event, INFINITE);
-		}
+		cmdQueueFenceWait(gpu, cmd_list_info.slot.fence_value, GPU_WAIT_INFINITE);
 
 		// Now we know that the command list we just got has finished executing, thus we can set
 		// our known completed submit idx to the idx of the submit it was from.
 		gpu->known_completed_submit_idx =
-			u64_max(gpu->known_completed_submit_idx, cmd_list_info.submit_idx);
+			u64_max(gpu->known_completed_submit_idx, cmd_list_info.slot.submit_idx);
 
-		// Same applies to upload and download heap safe offsets. The safe offset is always + size
-		// of the heap in question to handle wrap around in logic.
-		gpu->upload_heap_safe_offset = u64_max(gpu->upload_heap_safe_offset, 
-			cmd_list_info.upload_heap_offset + gpu->cfg.upload_heap_size_bytes);
-		gpu->download_heap_safe_offset = u64_max(gpu->download_heap_safe_offset,
-			cmd_list_info.download_heap_offset + gpu->cfg.download_heap_size_bytes);
+		// Same applies to the upload and download heap ranges it used. Marks the new command list
+		// with the index of the current submit.
+		submitSlotBegin(&cmd_list_info.slot, gpu->curr_submit_idx, &gpu->upload_heap_ring, &gpu->download_heap_ring);
 
-		// Mark the new command list with the index of the current submit
-		cmd_list_info.submit_idx = gpu->curr_submit_idx;
+		// Release objects which are no longer in use
+		releaseCompletedObjects(gpu);
 
 		if (!CHECK_D3D12(cmd_list_info.cmd_allocator->Reset())) {
 			printf("[gpu_lib]: Couldn't reset command allocator\n");
 			return;
 		}
+		cmd_list_info.cmd_list = cmd_list_info.segments[0];
+		cmd_list_info.num_segments_used = 1;
 		if (!CHECK_D3D12(cmd_list_info.cmd_list->Reset(cmd_list_info.cmd_allocator.Get(), nullptr))) {
 			printf("[gpu_lib]: Couldn't reset command list\n");
 			return;
 		}
 
-		// Set texture descriptor heap
-		ID3D12DescriptorHeap* heaps[] = { gpu->tex_descriptor_heap.Get() };
-		cmd_list_info.cmd_list->SetDescriptorHeaps(1, heaps);
+		// Bind descriptor heap, root signature and global descriptors
+		cmdListBindGlobalState(gpu, cmd_list_info);
+	}
+
+	// Swap in hot reloaded kernels
+	if (gpu->cfg.kernel_hot_reload) kernelHotReloadUpdate(gpu);
+}
+
+sfz_extern_c bool gpuTrySubmitQueuedWork(GpuLib* gpu)
+{
+	// Submitting blocks until the command list of the next submit is done, check it up front
+	const GpuCmdListInfo& next_cmd_list_info =
+		gpu->cmd_lists[submitSlotIdx(gpu->curr_submit_idx + 1, gpu->cfg.num_concurrent_submits)];
+	if (submitSlotInFlight(next_cmd_list_info.slot, gpu->cmd_queue_fence->GetCompletedValue())) return false;
+	gpuSubmitQueuedWork(gpu);
+	return true;
+}
+
+sfz_extern_c bool gpuWaitForSubmit(GpuLib* gpu, u64 submit_idx, u32 timeout_ms)
+{
+	if (submit_idx >= gpu->curr_submit_idx) {
+		printf("[gpu_lib]: Can't wait for submit %llu, it has not been submitted yet.\n", submit_idx);
+		return false;
 	}
+
+	// The command list has been reused by a later submit, so this submit must have finished
+	const GpuCmdListInfo& cmd_list_info = gpu->cmd_lists[submitSlotIdx(submit_idx, gpu->cfg.num_concurrent_submits)];
+	if (submitSlotReused(cmd_list_info.slot, submit_idx)) return true;
+
+	if (!cmdQueueFenceWait(gpu, cmd_list_info.slot.fence_value, timeout_ms)) return false;
+	gpu->known_completed_submit_idx = u64_max(gpu->known_completed_submit_idx, submit_idx);
+	return true;
 }
 
 sfz_extern_c void gpuSwapchainPresent(GpuLib* gpu, bool vsync)
@@ -1449,38 +3264,20 @@ sfz_extern_c void gpuSwapchainPresent(GpuLib* gpu, bool vsync)
 		sfz_assert(false);
 		return;
 	}
-	gpu->swapchain_res = window_res;
 
-	// Grab old swapchain resolution
+	// Grab swapchain desc
 	DXGI_SWAP_CHAIN_DESC swapchain_desc = {};
 	CHECK_D3D12(gpu->swapchain->GetDesc(&swapchain_desc));
-	sfz_assert(swapchain_desc.BufferCount == GPU_NUM_CONCURRENT_SUBMITS);
-	const i32x2 old_swapchain_res =
-		i32x2_init(swapchain_desc.BufferDesc.Width, swapchain_desc.BufferDesc.Height);
-	
-	// Resize swapchain if window resolution has changed
-	if (old_swapchain_res != window_res) {
-		printf("[gpu_lib]: Resizing swapchain framebuffers from %ix%i to %ix%i\n",
-			old_swapchain_res.x, old_swapchain_res.y, window_res.x, window_res.y);
-
-		// Flush current work in-progress
-		gpuFlush(gpu);
+	sfz_assert(swapchain_desc.BufferCount == gpu->cfg.num_concurrent_submits);
 
-		// Release old swapchain RT
-		gpu->swapchain_rwtex.Reset();
-
-		// Resize swapchain
-		if (!CHECK_D3D12(gpu->swapchain->ResizeBuffers(
-			GPU_NUM_CONCURRENT_SUBMITS,
-			u32(window_res.x),
-			u32(window_res.y),
-			swapchain_desc.BufferDesc.Format,
-			swapchain_desc.Flags))) {
-			printf("[gpu_lib]: Failed to resize swapchain framebuffers\n");
-			return;
-		}
+	// Reallocate swapchain RWTex and swapchain relative GpuRWTex if window resolution has changed.
+	// Does not block, the old textures are kept alive until in-flight submits are done with them.
+	const bool res_changed =
+		swapchainResUpdate(&gpu->swapchain_res, &gpu->swapchain_num_stable_presents, window_res);
+	if (res_changed || gpu->swapchain_rwtex == nullptr) {
 
 		// Allocate swapchain RT
+		ComPtr<ID3D12Resource> swapchain_rwtex;
 		{
 			D3D12_HEAP_PROPERTIES heap_props = {};
 			heap_props.Type = D3D12_HEAP_TYPE_DEFAULT;
@@ -1509,14 +3306,16 @@ sfz_extern_c void gpuSwapchainPresent(GpuLib* gpu, bool vsync)
 				&desc,
 				D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
 				nullptr,
-				IID_PPV_ARGS(&gpu->swapchain_rwtex)));
+				IID_PPV_ARGS(&swapchain_rwtex)));
 			if (!rt_success) {
 				printf("[gpu_lib]: Could not allocate swapchain render target of size %ix%i.\n",
 					window_res.x, window_res.y);
 				return;
 			}
-			setDebugName(gpu->swapchain_rwtex.Get(), "swapchain_rwtex");
+			setDebugName(swapchain_rwtex.Get(), "swapchain_rwtex");
 		}
+		retireObject(gpu, gpu->swapchain_rwtex);
+		gpu->swapchain_rwtex = swapchain_rwtex;
 
 		// Set swapchain RT descriptor in tex descriptor heap
 		{
@@ -1532,7 +3331,7 @@ sfz_extern_c void gpuSwapchainPresent(GpuLib* gpu, bool vsync)
 			gpu->device->CreateUnorderedAccessView(gpu->swapchain_rwtex.Get(), nullptr, &uav_desc, cpu_descriptor);
 		}
 
-		// Rebuild all swapchain relative GpuRWTex
+		// Rebuild swapchain relative GpuRWTex whose resolution changed
 		GpuRWTexInfo* tex_infos = gpu->rw_textures.data();
 		const sfz::PoolSlot* tex_slots = gpu->rw_textures.slots();
 		const u32 tex_array_size = gpu->rw_textures.arraySize();
@@ -1543,35 +3342,367 @@ sfz_extern_c void gpuSwapchainPresent(GpuLib* gpu, bool vsync)
 			if (!tex_info.desc.swapchain_relative) continue;
 			const SfzHandle tex_handle = gpu->rw_textures.getHandle(idx);
 			sfz_assert(tex_handle != SFZ_NULL_HANDLE);
+			const GpuRWTexDesc desc = tex_info.desc;
+			rwTexUpdateDesc(gpu, tex_handle, &desc);
+		}
+	}
 
-			// Rebuild texture
-			// Need to copy desc to avoid potential aliasing issues
-			SfzStr96 name = tex_info.name;
-			GpuRWTexDesc desc = tex_info.desc;
-			desc.name = name.str;
-			gpuRWTexInitInternal(gpu, &desc, &tex_handle);
+	// Resize swapchain framebuffers once the window resolution has stabilized (or immediately if
+	// it's the first time). This requires a flush, so we want to do it as rarely as possible.
+	if (swapchainFbResizeDue(gpu->swapchain_fb_res, gpu->swapchain_res, gpu->swapchain_num_stable_presents)) {
+		printf("[gpu_lib]: Resizing swapchain framebuffers from %ix%i to %ix%i\n",
+			swapchain_desc.BufferDesc.Width, swapchain_desc.BufferDesc.Height, window_res.x, window_res.y);
+
+		// Flush current work in-progress, framebuffers may not be referenced when resizing
+		gpuFlush(gpu);
+
+		// Resize swapchain
+		if (!CHECK_D3D12(gpu->swapchain->ResizeBuffers(
+			gpu->cfg.num_concurrent_submits,
+			u32(window_res.x),
+			u32(window_res.y),
+			swapchain_desc.BufferDesc.Format,
+			swapchain_desc.Flags))) {
+			printf("[gpu_lib]: Failed to resize swapchain framebuffers\n");
+			return;
 		}
+		gpu->swapchain_fb_res = window_res;
 	}
 }
 
 sfz_extern_c void gpuFlush(GpuLib* gpu)
 {
 	CHECK_D3D12(gpu->cmd_queue->Signal(gpu->cmd_queue_fence.Get(), gpu->cmd_queue_fence_value));
-	if (gpu->cmd_queue_fence->GetCompletedValue() < gpu->cmd_queue_fence_value) {
-		CHECK_D3D12(gpu->cmd_queue_fence->SetEventOnCompletion(
-			gpu->cmd_queue_fence_value, gpu->cmd_queue_fence_event));
-		WaitForSingleObject(gpu->cmd_queue_fence_event, INFINITE);
-	}
+	cmdQueueFenceWait(gpu, gpu->cmd_queue_fence_value, GPU_WAIT_INFINITE);
 	gpu->cmd_queue_fence_value += 1;
 
+	// Flush async compute queue, work held back for main queue signals that haven't been submitted
+	// can't finish, so only what has been issued is waited for.
+	if (gpu->async_sync_ops.isEmpty() && gpu->async_exec_lists.isEmpty()) {
+		gpu->async_fence_value += 1;
+		gpu->async_fence_issued_value = gpu->async_fence_value;
+		CHECK_D3D12(gpu->async_queue->Signal(gpu->async_fence.Get(), gpu->async_fence_value));
+	}
+	fenceWait(gpu->async_fence.Get(), gpu->async_fence_event, gpu->async_fence_issued_value, GPU_WAIT_INFINITE);
+
 	// Since we have flushed all submitted work, it stands to reason that it must have completed.
 	// Update known completed submit idx accordingly
 	gpu->known_completed_submit_idx = gpu->curr_submit_idx > 0 ? gpu->curr_submit_idx - 1 : 0;
 
 	// Same applies to upload and download heap safe offset. The safe offset is always + size of
 	// the heap in question to handle wrap around in logic.
-	gpu->upload_heap_safe_offset = u64_max(gpu->upload_heap_safe_offset,
-		gpu->getPrevCmdList().upload_heap_offset + gpu->cfg.upload_heap_size_bytes);
-	gpu->download_heap_safe_offset = u64_max(gpu->download_heap_safe_offset,
-		gpu->getPrevCmdList().download_heap_offset + gpu->cfg.download_heap_size_bytes);
+	heapRingRetire(&gpu->upload_heap_ring, gpu->getPrevCmdList().slot.upload_heap_offset);
+	heapRingRetire(&gpu->download_heap_ring, gpu->getPrevCmdList().slot.download_heap_offset);
+
+	// Release objects which are no longer in use
+	releaseCompletedObjects(gpu);
+}
+
+// Command context API
+// ------------------------------------------------------------------------------------------------
+
+sfz_extern_c GpuCmdContext gpuCmdContextInit(GpuLib* gpu, GpuQueue queue, u32 upload_heap_bytes)
+{
+	if (queue != GPU_QUEUE_MAIN && queue != GPU_QUEUE_ASYNC_COMPUTE) {
+		printf("[gpu_lib]: Invalid queue for command context.\n");
+		return GPU_NULL_CMD_CONTEXT;
+	}
+	if (queue == GPU_QUEUE_ASYNC_COMPUTE && upload_heap_bytes != 0) {
+		printf("[gpu_lib]: Async compute command contexts can't reserve upload heap memory.\n");
+		return GPU_NULL_CMD_CONTEXT;
+	}
+	const D3D12_COMMAND_LIST_TYPE list_type =
+		queue == GPU_QUEUE_MAIN ? D3D12_COMMAND_LIST_TYPE_DIRECT : D3D12_COMMAND_LIST_TYPE_COMPUTE;
+
+	const SfzHandle handle = gpu->cmd_contexts.allocate();
+	if (handle == SFZ_NULL_HANDLE) {
+		printf("[gpu_lib]: Out of command contexts (max %u).\n", GPU_CMD_CONTEXTS_MAX_NUM);
+		return GPU_NULL_CMD_CONTEXT;
+	}
+	GpuCmdContextInfo& info = *gpu->cmd_contexts.get(handle);
+	info = {};
+
+	// One allocator per concurrent submit, so recording can start before earlier submits are done
+	for (u32 i = 0; i < gpu->cfg.num_concurrent_submits; i++) {
+		if (!CHECK_D3D12(gpu->device->CreateCommandAllocator(
+			list_type, IID_PPV_ARGS(&info.cmd_allocators[i])))) {
+			printf("[gpu_lib]: Could not create command allocator for command context.\n");
+			gpu->cmd_contexts.deallocate(handle);
+			return GPU_NULL_CMD_CONTEXT;
+		}
+	}
+	if (!CHECK_D3D12(gpu->device->CreateCommandList(
+		0, list_type, info.cmd_allocators[0].Get(), nullptr, IID_PPV_ARGS(&info.cmd_list))) ||
+		!CHECK_D3D12(info.cmd_list->Close())) {
+		printf("[gpu_lib]: Could not create command list for command context.\n");
+		gpu->cmd_contexts.deallocate(handle);
+		return GPU_NULL_CMD_CONTEXT;
+	}
+
+	info.queue = queue;
+	info.recording = false;
+	info.begin_submit_idx = U64_MAX;
+	info.upload_heap_bytes = sfzRoundUpAlignedU32(upload_heap_bytes, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+	return GpuCmdContext{ handle.bits };
+}
+
+sfz_extern_c void gpuCmdContextDestroy(GpuLib* gpu, GpuCmdContext ctx)
+{
+	const SfzHandle handle = SfzHandle{ ctx.handle };
+	GpuCmdContextInfo* info = gpu->cmd_contexts.get(handle);
+	if (info == nullptr) return;
+	if (info->recording) CHECK_D3D12(info->cmd_list->Close());
+
+	// Might still be used by in-flight submits
+	retireObject(gpu, info->cmd_list);
+	for (u32 i = 0; i < gpu->cfg.num_concurrent_submits; i++) retireObject(gpu, info->cmd_allocators[i]);
+	gpu->cmd_contexts.deallocate(handle);
+}
+
+sfz_extern_c void gpuCmdContextBegin(GpuLib* gpu, GpuCmdContext ctx)
+{
+	GpuCmdContextInfo* info = gpu->cmd_contexts.get(SfzHandle{ ctx.handle });
+	if (info == nullptr) {
+		printf("[gpu_lib]: Invalid command context handle.\n");
+		return;
+	}
+
+	// The allocator might be in use by a context queued earlier in this submit
+	const u64 submit_idx = info->queue == GPU_QUEUE_MAIN ? gpu->curr_submit_idx : gpu->async_curr_submit_idx;
+	if (info->begin_submit_idx == submit_idx) {
+		printf("[gpu_lib]: Command context can only be begun once per submit.\n");
+		return;
+	}
+	if (info->queue == GPU_QUEUE_ASYNC_COMPUTE && !asyncSlotWait(gpu)) {
+		printf("[gpu_lib]: Async submit %llu is still held back by a wait for the main queue, call "
+			"gpuSubmitQueuedWork() before beginning async command contexts.\n",
+			gpu->async_curr_submit_idx - gpu->cfg.num_concurrent_submits);
+		return;
+	}
+
+	// Discard anything recorded but never queued
+	if (info->recording) CHECK_D3D12(info->cmd_list->Close());
+	info->recording = false;
+
+	// The allocator was last used num_concurrent_submits submits (of the context's queue) ago, which
+	// we know has finished since the current submit was started.
+	ID3D12CommandAllocator* cmd_allocator =
+		info->cmd_allocators[submit_idx % gpu->cfg.num_concurrent_submits].Get();
+	if (!CHECK_D3D12(cmd_allocator->Reset()) || !CHECK_D3D12(info->cmd_list->Reset(cmd_allocator, nullptr))) {
+		printf("[gpu_lib]: Couldn't reset command context.\n");
+		return;
+	}
+	bindGlobalState(gpu, info->cmd_list.Get(), info->bound, info->queue);
+
+	// Reserve upload heap range for large launch params, reclaimed with the rest of this submit
+	info->upload_num_reserved = 0;
+	info->upload_num_used = 0;
+	if (info->upload_heap_bytes != 0) {
+		u64 begin_mapped = 0;
+		if (uploadHeapAlloc(gpu, info->upload_heap_bytes, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, &begin_mapped)) {
+			info->upload_begin_mapped = begin_mapped;
+			info->upload_num_reserved = info->upload_heap_bytes;
+		}
+	}
+
+	info->recording = true;
+	info->begin_submit_idx = submit_idx;
+}
+
+sfz_extern_c void gpuCmdContextDispatch(
+	GpuLib* gpu, GpuCmdContext ctx, GpuKernel kernel, i32x3 num_groups, const void* params, u32 params_size)
+{
+	GpuCmdContextInfo* info = gpu->cmd_contexts.get(SfzHandle{ ctx.handle });
+	if (info == nullptr || !info->recording) {
+		printf("[gpu_lib]: Command context is invalid or not recording.\n");
+		return;
+	}
+	const GpuKernelInfo* kernel_info = gpu->kernels.get(SfzHandle{ kernel.handle });
+	if (kernel_info == nullptr) {
+		printf("[gpu_lib]: Invalid kernel handle.\n");
+		return;
+	}
+	if (!paramsSizeValid(kernel_info->param_layout, params_size)) return;
+	if (kernel_info->param_layout.is_large && info->queue == GPU_QUEUE_ASYNC_COMPUTE) {
+		printf("[gpu_lib]: Kernels with large launch params can't be dispatched from async compute command contexts.\n");
+		return;
+	}
+
+	ID3D12GraphicsCommandList* cmd_list = info->cmd_list.Get();
+	cmdListSetPso(cmd_list, info->bound, kernel_info->pso.Get());
+	if (kernel_info->param_layout.is_large) {
+		const u32 num_bytes = sfzRoundUpAlignedU32(params_size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+		if (info->upload_num_reserved < info->upload_num_used + num_bytes) {
+			printf("[gpu_lib]: Command context out of reserved upload heap memory (%u bytes).\n",
+				info->upload_num_reserved);
+			return;
+		}
+		const u64 begin_mapped = info->upload_begin_mapped + info->upload_num_used;
+		info->upload_num_used += num_bytes;
+		memcpy(gpu->upload_heap_mapped_ptr + begin_mapped, params, params_size);
+		cmd_list->SetComputeRootConstantBufferView(
+			GPU_ROOT_PARAM_LARGE_LAUNCH_PARAMS_IDX, gpu->upload_heap->GetGPUVirtualAddress() + begin_mapped);
+	}
+	else {
+		cmdListSetRootParams(cmd_list, info->bound, params, params_size);
+	}
+
+	sfz_assert(0 < num_groups.x && 0 < num_groups.y && 0 < num_groups.z);
+	cmd_list->Dispatch(u32(num_groups.x), u32(num_groups.y), u32(num_groups.z));
+}
+
+sfz_extern_c void gpuCmdContextBarrier(GpuLib* gpu, GpuCmdContext ctx)
+{
+	GpuCmdContextInfo* info = gpu->cmd_contexts.get(SfzHandle{ ctx.handle });
+	if (info == nullptr || !info->recording) {
+		printf("[gpu_lib]: Command context is invalid or not recording.\n");
+		return;
+	}
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+	barrier.UAV.pResource = nullptr; // All UAV accesses
+	info->cmd_list->ResourceBarrier(1, &barrier);
+}
+
+sfz_extern_c void gpuQueueCmdContexts(GpuLib* gpu, const GpuCmdContext* ctxs, u32 num_ctxs)
+{
+	if (num_ctxs == 0) return;
+	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
+
+	// Contexts assume the heap is in UNORDERED_ACCESS state
+	heapEnsureUnorderedAccess(gpu);
+	resolveHazards(gpu, nullptr);
+
+	// End the current segment, the contexts are executed after it
+	cmdListEndSegment(gpu);
+	for (u32 i = 0; i < num_ctxs; i++) {
+		GpuCmdContextInfo* info = gpu->cmd_contexts.get(SfzHandle{ ctxs[i].handle });
+		if (info == nullptr || info->queue != GPU_QUEUE_MAIN ||
+			!info->recording || info->begin_submit_idx != gpu->curr_submit_idx) {
+			printf("[gpu_lib]: Command context %u is invalid or not begun this submit, skipping.\n", i);
+			continue;
+		}
+		info->recording = false;
+		if (!CHECK_D3D12(info->cmd_list->Close())) {
+			printf("[gpu_lib]: Could not close command context %u, skipping.\n", i);
+			continue;
+		}
+		cmd_list_info.exec_lists.add(info->cmd_list.Get());
+	}
+
+	// Contexts are treated like dispatches without declared access
+	trackAccesses(gpu, nullptr);
+}
+
+// Async compute API
+// ------------------------------------------------------------------------------------------------
+
+sfz_extern_c void gpuSubmitAsyncCompute(GpuLib* gpu, const GpuCmdContext* ctxs, u32 num_ctxs)
+{
+	// The slot is normally waited for at the end of the previous async submit, but not if that
+	// submit was held back
+	if (!asyncSlotWait(gpu)) {
+		printf("[gpu_lib]: Async submit %llu is still held back by a wait for the main queue, call "
+			"gpuSubmitQueuedWork() first. Skipping async submit.\n",
+			gpu->async_curr_submit_idx - gpu->cfg.num_concurrent_submits);
+		return;
+	}
+
+	// Copy RWTex descriptors to this async submit's range of the shader-visible descriptor heap
+	D3D12_CPU_DESCRIPTOR_HANDLE dst_descriptors = {};
+	dst_descriptors.ptr =
+		gpu->tex_descriptor_heap_visible_start_cpu.ptr + gpu->getCurrTexDescriptorsOffset(GPU_QUEUE_ASYNC_COMPUTE);
+	gpu->device->CopyDescriptorsSimple(
+		gpu->rw_textures.arraySize(),
+		dst_descriptors,
+		gpu->tex_descriptor_heap_start_cpu,
+		D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	// Queue contexts
+	for (u32 i = 0; i < num_ctxs; i++) {
+		GpuCmdContextInfo* info = gpu->cmd_contexts.get(SfzHandle{ ctxs[i].handle });
+		if (info == nullptr || info->queue != GPU_QUEUE_ASYNC_COMPUTE ||
+			!info->recording || info->begin_submit_idx != gpu->async_curr_submit_idx) {
+			printf("[gpu_lib]: Command context %u is invalid or not begun this async submit, skipping.\n", i);
+			continue;
+		}
+		info->recording = false;
+		if (!CHECK_D3D12(info->cmd_list->Close())) {
+			printf("[gpu_lib]: Could not close command context %u, skipping.\n", i);
+			continue;
+		}
+		gpu->async_exec_lists.add(info->cmd_list.Get());
+	}
+
+	// This submit is done once the value is signalled
+	gpu->async_fence_value += 1;
+	syncOpsAdd(gpu->async_sync_ops, gpu->async_exec_lists.size(), false, gpu->async_fence_value);
+	gpu->async_submit_fence_values[gpu->async_curr_submit_idx % gpu->cfg.num_concurrent_submits] =
+		gpu->async_fence_value;
+	gpu->async_curr_submit_idx += 1;
+
+	// Execute straight away, unless held back by a wait for the main queue
+	asyncQueueIssue(gpu);
+
+	// Wait until the async submit that last used the next descriptor range (and the contexts'
+	// allocators for it) is done. If it's held back, the next async submit fails instead.
+	asyncSlotWait(gpu);
+}
+
+sfz_extern_c u64 gpuGetCurrAsyncSubmitIdx(const GpuLib* gpu)
+{
+	return gpu->async_curr_submit_idx;
+}
+
+sfz_extern_c GpuSyncPoint gpuQueueSignal(GpuLib* gpu, GpuQueue queue)
+{
+	GpuSyncPoint point = {};
+	point.queue = queue;
+
+	// Async work is executed straight away, so can signal straight away (unless held back)
+	if (queue == GPU_QUEUE_ASYNC_COMPUTE) {
+		gpu->async_fence_value += 1;
+		syncOpsAdd(gpu->async_sync_ops, gpu->async_exec_lists.size(), false, gpu->async_fence_value);
+		asyncQueueIssue(gpu);
+		point.value = gpu->async_fence_value;
+		return point;
+	}
+	sfz_assert(queue == GPU_QUEUE_MAIN);
+
+	// Async work waiting for this expects the heap to be in UNORDERED_ACCESS state
+	heapEnsureUnorderedAccess(gpu);
+
+	// Split the command list, signal is executed between the segments at submit
+	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
+	cmdListEndSegment(gpu);
+	gpu->main_sync_fence_value += 1;
+	syncOpsAdd(cmd_list_info.sync_ops, cmd_list_info.exec_lists.size(), false, gpu->main_sync_fence_value);
+
+	point.value = gpu->main_sync_fence_value;
+	return point;
+}
+
+sfz_extern_c void gpuQueueWait(GpuLib* gpu, GpuQueue queue, GpuSyncPoint point)
+{
+	if (point.queue == queue) return; // Queues execute in order, nothing to wait for
+	const u64 max_value = point.queue == GPU_QUEUE_MAIN ? gpu->main_sync_fence_value : gpu->async_fence_value;
+	if (point.value == 0 || max_value < point.value) {
+		printf("[gpu_lib]: Invalid sync point, can't wait for it.\n");
+		return;
+	}
+
+	// Affects everything submitted to the async queue after this. Issued straight away if the
+	// signal has been submitted, otherwise async work is held back until it is.
+	if (queue == GPU_QUEUE_ASYNC_COMPUTE) {
+		syncOpsAdd(gpu->async_sync_ops, gpu->async_exec_lists.size(), true, point.value);
+		asyncQueueIssue(gpu);
+		return;
+	}
+	sfz_assert(queue == GPU_QUEUE_MAIN);
+
+	// Split the command list, wait is executed between the segments at submit
+	GpuCmdListInfo& cmd_list_info = gpu->getCurrCmdList();
+	cmdListEndSegment(gpu);
+	syncOpsAdd(cmd_list_info.sync_ops, cmd_list_info.exec_lists.size(), true, point.value);
 }
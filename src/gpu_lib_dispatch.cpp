@@ -0,0 +1,50 @@
+#include "gpu_lib_dispatch.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+// Dispatch helpers
+// ------------------------------------------------------------------------------------------------
+
+bool paramsSizeValid(const GpuLaunchParamLayout& param_layout, u32 params_size)
+{
+	if (params_size < param_layout.used_size || param_layout.size < params_size || (params_size % 4) != 0) {
+		printf("[gpu_lib]: Invalid size of launch parameters, got %u bytes, expected %u to %u bytes.\n",
+			params_size, param_layout.used_size, param_layout.size);
+		return false;
+	}
+	return true;
+}
+
+// Dispatch batches
+// ------------------------------------------------------------------------------------------------
+
+u32 dispatchBatchRunEnd(const GpuDispatchBatchItem* items, u32 num_items, u32 run_begin)
+{
+	const GpuKernel kernel = items[run_begin].kernel;
+	u32 run_end = run_begin + 1;
+	while (run_end < num_items && items[run_end].kernel == kernel) run_end += 1;
+	return run_end;
+}
+
+u32 dispatchBatchPackArgs(
+	const GpuLaunchParamLayout& param_layout,
+	const GpuDispatchBatchItem* items,
+	u32 num_items,
+	GpuBatchDispatchArgs* args_out)
+{
+	u32 num_args = 0;
+	for (u32 i = 0; i < num_items; i++) {
+		const GpuDispatchBatchItem& item = items[i];
+		if (!paramsSizeValid(param_layout, item.params_size)) continue;
+		sfz_assert(0 < item.num_groups.x && 0 < item.num_groups.y && 0 < item.num_groups.z);
+		GpuBatchDispatchArgs tmp = {};
+		if (item.params_size != 0) memcpy(tmp.params, item.params, item.params_size);
+		tmp.dispatch.num_groups_x = u32(item.num_groups.x);
+		tmp.dispatch.num_groups_y = u32(item.num_groups.y);
+		tmp.dispatch.num_groups_z = u32(item.num_groups.z);
+		memcpy(&args_out[num_args], &tmp, sizeof(GpuBatchDispatchArgs)); // Write-combined memory, write once
+		num_args += 1;
+	}
+	return num_args;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef GPU_LIB_DISPATCH_HPP
+#define GPU_LIB_DISPATCH_HPP
+
+#include <gpu_lib.h>
+
+#include <sfz_cpp.hpp>
+
+#include "gpu_lib_cmd_stream.hpp"
+
+// Dispatch helpers
+// ------------------------------------------------------------------------------------------------
+
+// Backend independent parts of queueing dispatches: launch param validation, the group counts
+// written by gpuQueueCountToGroups() and the grouping and packing of gpuQueueDispatchBatch(). Tested (and the batch packing benchmarked) in
+// tests/gpu_lib_dispatch_tests.cpp.
+
+// Checks the size of the launch params passed to a dispatch against the kernel's layout, prints
+// why and returns false if it's invalid.
+bool paramsSizeValid(const GpuLaunchParamLayout& param_layout, u32 params_size);
+
+// The number of groups gpuQueueCountToGroups() writes for count elements, i.e. the CPU reference of
+// GPU_COUNT_TO_GROUPS_KERNEL_SRC (gpu_lib_internal.hpp), keep the two in sync. Rounds up without
+// overflowing for counts close to U32_MAX. elements_per_group must not be 0.
+inline u32 dispatchCountToGroups(u32 count, u32 elements_per_group)
+{
+	sfz_assert(elements_per_group != 0);
+	const u32 num_groups = count / elements_per_group + (count % elements_per_group != 0 ? 1 : 0);
+	return u32_min(num_groups, GPU_CMD_DISPATCH_MAX_NUM_GROUPS);
+}
+
+// Dispatch batches
+// ------------------------------------------------------------------------------------------------
+
+// The indirect arguments of one dispatch in a batch, see gpuQueueDispatchBatch(). Matches the
+// layout of the backend's batch command signature, the launch params are always padded to the max
+// size.
+sfz_struct(GpuBatchDispatchArgs) {
+	u32 params[GPU_LAUNCH_PARAMS_MAX_SIZE / 4];
+	GpuDispatchArgs dispatch;
+};
+sfz_static_assert(sizeof(GpuBatchDispatchArgs) == 60);
+
+// Returns the end of the run of consecutive items using the same kernel as items[run_begin].
+u32 dispatchBatchRunEnd(const GpuDispatchBatchItem* items, u32 num_items, u32 run_begin);
+
+// Whether a run should be dispatched item by item instead of by a single ExecuteIndirect. Not worth
+// the indirection for single dispatches, and large launch params can't be set as root constants.
+inline bool dispatchBatchRunIsDirect(u32 run_size, const GpuLaunchParamLayout& param_layout)
+{
+	return run_size == 1 || param_layout.is_large;
+}
+
+// Writes the indirect arguments of a run of items to args_out, which must have room for one per
+// item. Items with invalid launch params are skipped (with an error message). Each element of
+// args_out is written exactly once, in order, so it can point to write-combined memory. Returns the
+// number of arguments written.
+u32 dispatchBatchPackArgs(
+	const GpuLaunchParamLayout& param_layout,
+	const GpuDispatchBatchItem* items,
+	u32 num_items,
+	GpuBatchDispatchArgs* args_out);
+
+#endif
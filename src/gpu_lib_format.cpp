@@ -0,0 +1,86 @@
+#include <gpu_lib.h>
+
+// Format API
+// ------------------------------------------------------------------------------------------------
+
+// Kept separate from the backend so backend independent parts (e.g. the block compression encoder)
+// can use them.
+
+sfz_extern_c const char* gpuFormatToString(GpuFormat fmt)
+{
+	switch (fmt) {
+	case GPU_FORMAT_UNDEFINED: return "GPU_FORMAT_UNDEFINED";
+
+	case GPU_FORMAT_R_U8_UNORM: return "GPU_FORMAT_R_U8_UNORM";
+	case GPU_FORMAT_RG_U8_UNORM: return "GPU_FORMAT_RG_U8_UNORM";
+	case GPU_FORMAT_RGBA_U8_UNORM: return "GPU_FORMAT_RGBA_U8_UNORM";
+
+	case GPU_FORMAT_R_U8: return "GPU_FORMAT_R_U8";
+	case GPU_FORMAT_RG_U8: return "GPU_FORMAT_RG_U8";
+	case GPU_FORMAT_RGBA_U8: return "GPU_FORMAT_RGBA_U8";
+
+	case GPU_FORMAT_R_U16: return "GPU_FORMAT_R_U16";
+	case GPU_FORMAT_RG_U16: return "GPU_FORMAT_RG_U16";
+	case GPU_FORMAT_RGBA_U16: return "GPU_FORMAT_RGBA_U16";
+
+	case GPU_FORMAT_R_I32: return "GPU_FORMAT_R_I32";
+	case GPU_FORMAT_RG_I32: return "GPU_FORMAT_RG_I32";
+	case GPU_FORMAT_RGBA_I32: return "GPU_FORMAT_RGBA_I32";
+
+	case GPU_FORMAT_R_F16: return "GPU_FORMAT_R_F16";
+	case GPU_FORMAT_RG_F16: return "GPU_FORMAT_RG_F16";
+	case GPU_FORMAT_RGBA_F16: return "GPU_FORMAT_RGBA_F16";
+
+	case GPU_FORMAT_R_F32: return "GPU_FORMAT_R_F32";
+	case GPU_FORMAT_RG_F32: return "GPU_FORMAT_RG_F32";
+	case GPU_FORMAT_RGBA_F32: return "GPU_FORMAT_RGBA_F32";
+
+	case GPU_FORMAT_BC1_UNORM: return "GPU_FORMAT_BC1_UNORM";
+	case GPU_FORMAT_BC4_UNORM: return "GPU_FORMAT_BC4_UNORM";
+	case GPU_FORMAT_BC5_UNORM: return "GPU_FORMAT_BC5_UNORM";
+	case GPU_FORMAT_BC7_UNORM: return "GPU_FORMAT_BC7_UNORM";
+
+	default: break;
+	}
+	sfz_assert(false);
+	return "UNKNOWN";
+}
+
+sfz_extern_c u32 gpuFormatGetBytesPerPixel(GpuFormat fmt)
+{
+	switch (fmt) {
+	case GPU_FORMAT_R_U8_UNORM: return 1;
+	case GPU_FORMAT_RG_U8_UNORM: return 2;
+	case GPU_FORMAT_RGBA_U8_UNORM: return 4;
+
+	case GPU_FORMAT_R_U8: return 1;
+	case GPU_FORMAT_RG_U8: return 2;
+	case GPU_FORMAT_RGBA_U8: return 4;
+
+	case GPU_FORMAT_R_U16: return 2;
+	case GPU_FORMAT_RG_U16: return 4;
+	case GPU_FORMAT_RGBA_U16: return 8;
+
+	case GPU_FORMAT_R_I32: return 4;
+	case GPU_FORMAT_RG_I32: return 8;
+	case GPU_FORMAT_RGBA_I32: return 16;
+
+	case GPU_FORMAT_R_F16: return 2;
+	case GPU_FORMAT_RG_F16: return 4;
+	case GPU_FORMAT_RGBA_F16: return 8;
+
+	case GPU_FORMAT_R_F32: return 4;
+	case GPU_FORMAT_RG_F32: return 8;
+	case GPU_FORMAT_RGBA_F32: return 16;
+
+	// Block compressed formats don't have a per pixel size
+	case GPU_FORMAT_BC1_UNORM: return 0;
+	case GPU_FORMAT_BC4_UNORM: return 0;
+	case GPU_FORMAT_BC5_UNORM: return 0;
+	case GPU_FORMAT_BC7_UNORM: return 0;
+
+	default: break;
+	}
+	sfz_assert(false);
+	return 0;
+}
@@ -0,0 +1,558 @@
+#include "gpu_lib_frame_graph.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sfz_cpp.hpp>
+#include <skipifzero_arrays.hpp>
+
+// Frame graph state
+// ------------------------------------------------------------------------------------------------
+
+sfz_constant u32 FG_NONE = U32_MAX;
+
+typedef enum {
+	FG_RES_TYPE_IMPORTED_PTR = 0,
+	FG_RES_TYPE_IMPORTED_RWTEX,
+	FG_RES_TYPE_TRANSIENT,
+} FgResType;
+
+sfz_struct(FgResource) {
+	FgResType type;
+	GpuPtr ptr; // Assigned by compile for transients
+	u32 num_bytes;
+	GpuRWTex tex;
+
+	// Compile state
+	bool needed; // Read by a used pass declared after the current one (when walking backwards)
+	u32 last_write_level; // FG_NONE if not written yet
+	u32 last_read_level; // Since the last write, FG_NONE if not read
+	u32 first_level;
+	u32 last_level;
+	bool rwtex_pending_read;
+	bool rwtex_pending_write;
+};
+
+sfz_struct(FgAccess) {
+	u32 res_idx;
+	bool write;
+};
+
+sfz_struct(FgPass) {
+	const char* name;
+	GpuFgPassFunc* func;
+	void* user_data;
+	bool side_effects;
+	u32 accesses_begin;
+	u32 num_accesses;
+
+	// Compile state
+	bool used;
+	u32 level;
+};
+
+// A pass in compiled order, the barriers are queued before it.
+sfz_struct(FgStep) {
+	u32 pass_idx;
+	bool heap_barrier;
+	u32 rwtex_barriers_begin;
+	u32 num_rwtex_barriers;
+};
+
+// A heap range, [begin, end).
+sfz_struct(FgRange) {
+	u64 begin;
+	u64 end;
+};
+
+// A set of heap ranges, kept sorted and merged so overlap queries are a binary search.
+sfz_struct(FgRangeSet) {
+	SfzArray<FgRange> ranges;
+
+	// Index of the first range that ends at or after ptr.
+	u32 lowerBound(u64 ptr) const
+	{
+		u32 begin = 0;
+		u32 end = ranges.size();
+		while (begin < end) {
+			const u32 mid = begin + (end - begin) / 2;
+			if (ranges[mid].end < ptr) begin = mid + 1;
+			else end = mid;
+		}
+		return begin;
+	}
+
+	bool overlaps(FgRange range) const
+	{
+		if (range.begin == range.end) return false;
+		u32 idx = lowerBound(range.begin);
+		// lowerBound() includes a range ending exactly at begin (for merging), it doesn't overlap
+		if (idx < ranges.size() && ranges[idx].end == range.begin) idx += 1;
+		return idx < ranges.size() && ranges[idx].begin < range.end;
+	}
+
+	// Returns the merged range that now contains range.
+	FgRange add(FgRange range)
+	{
+		if (range.begin == range.end) return range;
+		const u32 first = lowerBound(range.begin);
+		u32 last = first;
+		while (last < ranges.size() && ranges[last].begin <= range.end) {
+			range.begin = u64_min(range.begin, ranges[last].begin);
+			range.end = u64_max(range.end, ranges[last].end);
+			last += 1;
+		}
+		if (first == last) {
+			ranges.insert(first, range);
+		}
+		else {
+			ranges[first] = range;
+			if ((first + 1) < last) ranges.remove(first + 1, last - first - 1);
+		}
+		return range;
+	}
+};
+
+sfz_struct(GpuFrameGraph) {
+	SfzAllocator* allocator;
+	SfzArray<FgResource> resources; // Index 0 is the null resource
+	SfzArray<FgPass> passes;
+	SfzArray<FgAccess> accesses;
+
+	// Compiled
+	bool compiled;
+	SfzArray<FgStep> steps;
+	SfzArray<GpuRWTex> rwtex_barriers;
+	GpuFrameGraphStats stats;
+
+	// Temp arrays used while compiling, kept to avoid reallocating every frame
+	SfzArray<u32> tmp_transients; // Sorted by first level
+	SfzArray<u32> tmp_releases; // Sorted by last level
+	FgRangeSet tmp_free; // Free ranges of the transient heap while placing
+	FgRangeSet tmp_pending_reads; // Accessed since the last heap barrier
+	FgRangeSet tmp_pending_writes;
+};
+
+static FgResource* getResource(GpuFrameGraph* fg, GpuFgRes res)
+{
+	if (res == GPU_NULL_FG_RES || fg->resources.size() <= res) return nullptr;
+	return &fg->resources[res];
+}
+
+static const FgResource* getResource(const GpuFrameGraph* fg, GpuFgRes res)
+{
+	if (res == GPU_NULL_FG_RES || fg->resources.size() <= res) return nullptr;
+	return &fg->resources[res];
+}
+
+static GpuFgRes addResource(GpuFrameGraph* fg, const FgResource& res)
+{
+	fg->compiled = false;
+	fg->resources.add(res);
+	return fg->resources.size() - 1;
+}
+
+// Compile steps
+// ------------------------------------------------------------------------------------------------
+
+// Walks the passes backwards, a pass is used if it has side effects or writes something needed.
+// Imported resources are always needed, transients once read by a used pass.
+static void cullPasses(GpuFrameGraph* fg)
+{
+	for (u32 i = 1; i < fg->resources.size(); i++) {
+		FgResource& res = fg->resources[i];
+		res.needed = res.type != FG_RES_TYPE_TRANSIENT;
+	}
+
+	for (u32 pass_idx = fg->passes.size(); pass_idx > 0; pass_idx--) {
+		FgPass& pass = fg->passes[pass_idx - 1];
+		pass.used = pass.side_effects;
+		for (u32 i = 0; i < pass.num_accesses && !pass.used; i++) {
+			const FgAccess& access = fg->accesses[pass.accesses_begin + i];
+			if (access.write && fg->resources[access.res_idx].needed) pass.used = true;
+		}
+		if (!pass.used) continue;
+		for (u32 i = 0; i < pass.num_accesses; i++) {
+			const FgAccess& access = fg->accesses[pass.accesses_begin + i];
+			if (!access.write) fg->resources[access.res_idx].needed = true;
+		}
+	}
+}
+
+// Assigns each used pass the lowest level after all passes it depends on, i.e. the last writer of
+// everything it accesses (read-after-write, write-after-write) and the readers since the last write
+// of everything it writes (write-after-read). Returns the number of levels.
+static u32 assignLevels(GpuFrameGraph* fg)
+{
+	for (u32 i = 1; i < fg->resources.size(); i++) {
+		FgResource& res = fg->resources[i];
+		res.last_write_level = FG_NONE;
+		res.last_read_level = FG_NONE;
+		res.first_level = FG_NONE;
+		res.last_level = FG_NONE;
+	}
+
+	u32 num_levels = 0;
+	for (FgPass& pass : fg->passes) {
+		if (!pass.used) continue;
+		u32 level = 0;
+		for (u32 i = 0; i < pass.num_accesses; i++) {
+			const FgAccess& access = fg->accesses[pass.accesses_begin + i];
+			const FgResource& res = fg->resources[access.res_idx];
+			if (res.last_write_level != FG_NONE) level = u32_max(level, res.last_write_level + 1);
+			if (access.write && res.last_read_level != FG_NONE) level = u32_max(level, res.last_read_level + 1);
+		}
+		pass.level = level;
+		num_levels = u32_max(num_levels, level + 1);
+
+		// Writes first, so the reads of a read-write access count as reads of the new version
+		for (u32 i = 0; i < pass.num_accesses; i++) {
+			const FgAccess& access = fg->accesses[pass.accesses_begin + i];
+			FgResource& res = fg->resources[access.res_idx];
+			if (access.write) {
+				res.last_write_level = level;
+				res.last_read_level = FG_NONE;
+			}
+			res.first_level = u32_min(res.first_level, level);
+			res.last_level = res.last_level == FG_NONE ? level : u32_max(res.last_level, level);
+		}
+		for (u32 i = 0; i < pass.num_accesses; i++) {
+			const FgAccess& access = fg->accesses[pass.accesses_begin + i];
+			FgResource& res = fg->resources[access.res_idx];
+			if (!access.write) {
+				res.last_read_level = res.last_read_level == FG_NONE ? level : u32_max(res.last_read_level, level);
+			}
+		}
+	}
+	return num_levels;
+}
+
+// Places transients by sweeping over the levels. Transients whose lifetime (first to last level
+// accessed) has ended are released, then the ones starting at the level are placed largest first,
+// each in the smallest free range that fits, or at the top of the used memory. Transients can thus
+// only share memory if their lifetimes don't overlap. Returns the total size required.
+//
+// O(T log T + T * F) for T transients and F free ranges, where F is at most the number of
+// transients alive at the same time (and usually much smaller).
+static u32 placeTransients(GpuFrameGraph* fg, GpuPtr transient_heap)
+{
+	fg->tmp_transients.clear();
+	fg->tmp_releases.clear();
+	for (u32 i = 1; i < fg->resources.size(); i++) {
+		FgResource& res = fg->resources[i];
+		if (res.type != FG_RES_TYPE_TRANSIENT) continue;
+		res.ptr = GPU_NULLPTR;
+		if (res.first_level == FG_NONE) continue; // Only accessed by culled passes
+		fg->tmp_transients.add(i);
+		fg->tmp_releases.add(i);
+		fg->stats.transient_size_unaliased_bytes += sfzRoundUpAlignedU32(res.num_bytes, GPU_FG_TRANSIENT_ALIGN);
+	}
+	const SfzArray<FgResource>& resources = fg->resources;
+	fg->tmp_transients.sort([&](u32 lhs, u32 rhs) {
+		const FgResource& l = resources[lhs];
+		const FgResource& r = resources[rhs];
+		if (l.first_level != r.first_level) return l.first_level < r.first_level;
+		if (l.num_bytes != r.num_bytes) return l.num_bytes > r.num_bytes;
+		return lhs < rhs;
+	});
+	fg->tmp_releases.sort([&](u32 lhs, u32 rhs) {
+		if (resources[lhs].last_level != resources[rhs].last_level) {
+			return resources[lhs].last_level < resources[rhs].last_level;
+		}
+		return lhs < rhs;
+	});
+
+	// Offsets are relative to the transient heap while placing, ptr is used to store them
+	SfzArray<FgRange>& free_ranges = fg->tmp_free.ranges;
+	free_ranges.clear();
+	u32 top = 0; // Everything above is free
+	u32 total_size = 0;
+	u32 num_released = 0;
+	for (u32 res_idx : fg->tmp_transients) {
+		FgResource& res = fg->resources[res_idx];
+		const u32 num_bytes = sfzRoundUpAlignedU32(res.num_bytes, GPU_FG_TRANSIENT_ALIGN);
+
+		// Release transients no longer alive, free ranges reaching the top lower it instead
+		while (num_released < fg->tmp_releases.size()) {
+			const FgResource& released = fg->resources[fg->tmp_releases[num_released]];
+			if (res.first_level <= released.last_level) break;
+			num_released += 1;
+			const u64 released_end = u64(released.ptr) + sfzRoundUpAlignedU32(released.num_bytes, GPU_FG_TRANSIENT_ALIGN);
+			const FgRange merged = fg->tmp_free.add(FgRange{ released.ptr, released_end });
+			if (merged.end == top) {
+				top = u32(merged.begin);
+				free_ranges.remove(free_ranges.size() - 1);
+			}
+		}
+
+		// Smallest free range that fits
+		u32 best_idx = U32_MAX;
+		for (u32 i = 0; i < free_ranges.size(); i++) {
+			const u64 size = free_ranges[i].end - free_ranges[i].begin;
+			if (size < num_bytes) continue;
+			if (best_idx == U32_MAX || size < (free_ranges[best_idx].end - free_ranges[best_idx].begin)) best_idx = i;
+		}
+		if (best_idx != U32_MAX) {
+			FgRange& range = free_ranges[best_idx];
+			res.ptr = u32(range.begin);
+			range.begin += num_bytes;
+			if (range.begin == range.end) free_ranges.remove(best_idx);
+		}
+		else {
+			res.ptr = top;
+			top += num_bytes;
+			total_size = u32_max(total_size, top);
+		}
+	}
+
+	for (u32 res_idx : fg->tmp_transients) fg->resources[res_idx].ptr += transient_heap;
+	return total_size;
+}
+
+// Checks the level's accesses against the accesses since the last barriers, then adds them. Must
+// be called for each level in order.
+static void computeLevelBarriers(GpuFrameGraph* fg, u32 level_steps_begin, u32 level_steps_end)
+{
+	FgStep& first_step = fg->steps[level_steps_begin];
+	first_step.rwtex_barriers_begin = fg->rwtex_barriers.size();
+
+	// Find hazards
+	for (u32 step_idx = level_steps_begin; step_idx < level_steps_end; step_idx++) {
+		const FgPass& pass = fg->passes[fg->steps[step_idx].pass_idx];
+		for (u32 i = 0; i < pass.num_accesses; i++) {
+			const FgAccess& access = fg->accesses[pass.accesses_begin + i];
+			FgResource& res = fg->resources[access.res_idx];
+			if (res.type == FG_RES_TYPE_IMPORTED_RWTEX) {
+				const bool hazard = res.rwtex_pending_write || (access.write && res.rwtex_pending_read);
+				if (!hazard) continue;
+				fg->rwtex_barriers.add(res.tex);
+				res.rwtex_pending_read = false;
+				res.rwtex_pending_write = false;
+				continue;
+			}
+			if (first_step.heap_barrier) continue;
+			const FgRange range = FgRange{ res.ptr, u64(res.ptr) + res.num_bytes };
+			if (fg->tmp_pending_writes.overlaps(range) || (access.write && fg->tmp_pending_reads.overlaps(range))) {
+				first_step.heap_barrier = true;
+			}
+		}
+	}
+	first_step.num_rwtex_barriers = fg->rwtex_barriers.size() - first_step.rwtex_barriers_begin;
+	if (first_step.heap_barrier) {
+		fg->tmp_pending_reads.ranges.clear();
+		fg->tmp_pending_writes.ranges.clear();
+		fg->stats.num_heap_barriers += 1;
+	}
+	fg->stats.num_rwtex_barriers += first_step.num_rwtex_barriers;
+
+	// Track the level's accesses
+	for (u32 step_idx = level_steps_begin; step_idx < level_steps_end; step_idx++) {
+		const FgPass& pass = fg->passes[fg->steps[step_idx].pass_idx];
+		for (u32 i = 0; i < pass.num_accesses; i++) {
+			const FgAccess& access = fg->accesses[pass.accesses_begin + i];
+			FgResource& res = fg->resources[access.res_idx];
+			if (res.type == FG_RES_TYPE_IMPORTED_RWTEX) {
+				if (access.write) res.rwtex_pending_write = true;
+				else res.rwtex_pending_read = true;
+				continue;
+			}
+			const FgRange range = FgRange{ res.ptr, u64(res.ptr) + res.num_bytes };
+			if (access.write) fg->tmp_pending_writes.add(range);
+			else fg->tmp_pending_reads.add(range);
+		}
+	}
+}
+
+// Frame graph API
+// ------------------------------------------------------------------------------------------------
+
+sfz_extern_c GpuFrameGraph* gpuFrameGraphInit(SfzAllocator* allocator)
+{
+	GpuFrameGraph* fg = sfz_new<GpuFrameGraph>(allocator, sfz_dbg("GpuFrameGraph"));
+	fg->allocator = allocator;
+	fg->resources.init(256, allocator, sfz_dbg("GpuFrameGraph::resources"));
+	fg->passes.init(256, allocator, sfz_dbg("GpuFrameGraph::passes"));
+	fg->accesses.init(1024, allocator, sfz_dbg("GpuFrameGraph::accesses"));
+	fg->steps.init(256, allocator, sfz_dbg("GpuFrameGraph::steps"));
+	fg->rwtex_barriers.init(64, allocator, sfz_dbg("GpuFrameGraph::rwtex_barriers"));
+	fg->tmp_transients.init(64, allocator, sfz_dbg("GpuFrameGraph::tmp_transients"));
+	fg->tmp_releases.init(64, allocator, sfz_dbg("GpuFrameGraph::tmp_releases"));
+	fg->tmp_free.ranges.init(64, allocator, sfz_dbg("GpuFrameGraph::tmp_free"));
+	fg->tmp_pending_reads.ranges.init(256, allocator, sfz_dbg("GpuFrameGraph::tmp_pending_reads"));
+	fg->tmp_pending_writes.ranges.init(256, allocator, sfz_dbg("GpuFrameGraph::tmp_pending_writes"));
+	gpuFrameGraphReset(fg);
+	return fg;
+}
+
+sfz_extern_c void gpuFrameGraphDestroy(GpuFrameGraph* fg)
+{
+	if (fg == nullptr) return;
+	SfzAllocator* allocator = fg->allocator;
+	sfz_delete(allocator, fg);
+}
+
+sfz_extern_c void gpuFrameGraphReset(GpuFrameGraph* fg)
+{
+	fg->resources.clear();
+	fg->resources.add(); // Null resource
+	fg->passes.clear();
+	fg->accesses.clear();
+	fg->compiled = false;
+	fg->steps.clear();
+	fg->rwtex_barriers.clear();
+	fg->stats = {};
+}
+
+sfz_extern_c GpuFgRes gpuFgImportPtr(GpuFrameGraph* fg, GpuPtr ptr, u32 num_bytes)
+{
+	FgResource res = {};
+	res.type = FG_RES_TYPE_IMPORTED_PTR;
+	res.ptr = ptr;
+	res.num_bytes = num_bytes;
+	return addResource(fg, res);
+}
+
+sfz_extern_c GpuFgRes gpuFgImportRWTex(GpuFrameGraph* fg, GpuRWTex tex)
+{
+	for (u32 i = 1; i < fg->resources.size(); i++) {
+		const FgResource& res = fg->resources[i];
+		if (res.type == FG_RES_TYPE_IMPORTED_RWTEX && res.tex == tex) return i;
+	}
+	FgResource res = {};
+	res.type = FG_RES_TYPE_IMPORTED_RWTEX;
+	res.tex = tex;
+	return addResource(fg, res);
+}
+
+sfz_extern_c GpuFgRes gpuFgCreateTransient(GpuFrameGraph* fg, u32 num_bytes)
+{
+	FgResource res = {};
+	res.type = FG_RES_TYPE_TRANSIENT;
+	res.num_bytes = num_bytes;
+	return addResource(fg, res);
+}
+
+sfz_extern_c void gpuFgAddPass(GpuFrameGraph* fg, const GpuFgPassDesc* desc)
+{
+	fg->compiled = false;
+	FgPass& pass = fg->passes.add();
+	pass.name = desc->name != nullptr ? desc->name : "<unnamed>";
+	pass.func = desc->func;
+	pass.user_data = desc->user_data;
+	pass.side_effects = desc->side_effects;
+	pass.accesses_begin = fg->accesses.size();
+	for (u32 i = 0; i < desc->num_reads; i++) fg->accesses.add(FgAccess{ desc->reads[i], false });
+	for (u32 i = 0; i < desc->num_writes; i++) fg->accesses.add(FgAccess{ desc->writes[i], true });
+	pass.num_accesses = desc->num_reads + desc->num_writes;
+}
+
+sfz_extern_c bool gpuFrameGraphCompile(GpuFrameGraph* fg, GpuPtr transient_heap, u32 transient_heap_size)
+{
+	fg->compiled = false;
+	fg->steps.clear();
+	fg->rwtex_barriers.clear();
+	fg->stats = {};
+	fg->stats.num_passes = fg->passes.size();
+
+	// Validate accesses
+	for (const FgPass& pass : fg->passes) {
+		for (u32 i = 0; i < pass.num_accesses; i++) {
+			const FgAccess& access = fg->accesses[pass.accesses_begin + i];
+			if (getResource(fg, access.res_idx) == nullptr) {
+				printf("[gpu_lib]: Frame graph pass \"%s\" accesses invalid resource %u.\n", pass.name, access.res_idx);
+				return false;
+			}
+		}
+		if (pass.func == nullptr) {
+			printf("[gpu_lib]: Frame graph pass \"%s\" has no function.\n", pass.name);
+			return false;
+		}
+	}
+
+	cullPasses(fg);
+	fg->stats.num_levels = assignLevels(fg);
+
+	// Allocate transients
+	fg->stats.transient_size_bytes = placeTransients(fg, transient_heap);
+	if (transient_heap_size < fg->stats.transient_size_bytes) {
+		printf("[gpu_lib]: Frame graph needs %u bytes of transient memory, only %u available.\n",
+			fg->stats.transient_size_bytes, transient_heap_size);
+		return false;
+	}
+
+	// Sort used passes by level, declaration order within levels
+	for (u32 i = 0; i < fg->passes.size(); i++) {
+		if (!fg->passes[i].used) {
+			fg->stats.num_culled_passes += 1;
+			continue;
+		}
+		FgStep& step = fg->steps.add();
+		step.pass_idx = i;
+	}
+	const SfzArray<FgPass>& passes = fg->passes;
+	fg->steps.sort([&](const FgStep& lhs, const FgStep& rhs) {
+		const u32 lhs_level = passes[lhs.pass_idx].level;
+		const u32 rhs_level = passes[rhs.pass_idx].level;
+		if (lhs_level != rhs_level) return lhs_level < rhs_level;
+		return lhs.pass_idx < rhs.pass_idx;
+	});
+
+	// Barriers between levels. The transient heap might still be in use by work queued before the
+	// graph (e.g. the previous frame's transients), so it starts out as written, forcing a barrier
+	// before the first level that accesses transients.
+	for (u32 i = 1; i < fg->resources.size(); i++) {
+		fg->resources[i].rwtex_pending_read = false;
+		fg->resources[i].rwtex_pending_write = false;
+	}
+	fg->tmp_pending_reads.ranges.clear();
+	fg->tmp_pending_writes.ranges.clear();
+	fg->tmp_pending_writes.add(FgRange{ transient_heap, u64(transient_heap) + fg->stats.transient_size_bytes });
+	u32 level_begin = 0;
+	while (level_begin < fg->steps.size()) {
+		const u32 level = fg->passes[fg->steps[level_begin].pass_idx].level;
+		u32 level_end = level_begin + 1;
+		while (level_end < fg->steps.size() && fg->passes[fg->steps[level_end].pass_idx].level == level) {
+			level_end += 1;
+		}
+		computeLevelBarriers(fg, level_begin, level_end);
+		level_begin = level_end;
+	}
+
+	fg->compiled = true;
+	return true;
+}
+
+sfz_extern_c GpuFrameGraphStats gpuFrameGraphGetStats(const GpuFrameGraph* fg)
+{
+	return fg->stats;
+}
+
+sfz_extern_c GpuPtr gpuFgGetPtr(const GpuFrameGraph* fg, GpuFgRes res_handle)
+{
+	const FgResource* res = getResource(fg, res_handle);
+	if (res == nullptr || res->type == FG_RES_TYPE_IMPORTED_RWTEX) return GPU_NULLPTR;
+	return res->ptr;
+}
+
+sfz_extern_c GpuRWTex gpuFgGetRWTex(const GpuFrameGraph* fg, GpuFgRes res_handle)
+{
+	const FgResource* res = getResource(fg, res_handle);
+	if (res == nullptr || res->type != FG_RES_TYPE_IMPORTED_RWTEX) return GPU_NULL_RWTEX;
+	return res->tex;
+}
+
+sfz_extern_c void gpuFrameGraphExecute(GpuFrameGraph* fg, GpuLib* gpu)
+{
+	if (!fg->compiled) {
+		printf("[gpu_lib]: Frame graph must be compiled before it's executed.\n");
+		return;
+	}
+	for (const FgStep& step : fg->steps) {
+		if (step.heap_barrier) gpuQueueGpuHeapBarrier(gpu);
+		for (u32 i = 0; i < step.num_rwtex_barriers; i++) {
+			gpuQueueRWTexBarrier(gpu, fg->rwtex_barriers[step.rwtex_barriers_begin + i]);
+		}
+		const FgPass& pass = fg->passes[step.pass_idx];
+		pass.func(gpu, fg, pass.user_data);
+	}
+}
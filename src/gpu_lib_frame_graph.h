@@ -0,0 +1,102 @@
+#pragma once
+#ifndef GPU_LIB_FRAME_GRAPH_H
+#define GPU_LIB_FRAME_GRAPH_H
+
+#include <gpu_lib.h>
+
+// Frame graph
+// ------------------------------------------------------------------------------------------------
+
+// A frame graph on top of the command API. Every frame the passes are declared together with the
+// resources (GpuPtr ranges and RWTex) they read and write, then the graph is compiled and executed.
+// Compiling:
+//
+// * Culls passes whose results are never used. A pass is used if it has side effects, writes an
+//   imported resource or writes a resource read by a later used pass.
+// * Sorts the used passes topologically into levels. Passes in the same level don't depend on each
+//   other, so barriers are only needed between levels.
+// * Allocates transient buffers, memory is aliased between transients whose lifetimes (first to
+//   last level accessed) don't overlap.
+// * Computes the barriers needed between levels. A heap barrier is only inserted if a level
+//   accesses memory that overlaps with memory written (or read, if the level writes) since the
+//   last barrier, the same goes for RWTex barriers. The transient heap counts as written before
+//   the graph, so there is always a heap barrier before the first level accessing transients.
+//
+// Compiling is close to linear in the number of passes and resources, a graph with 1000 passes and
+// 1000 transients compiles in about 0.3 ms on a desktop CPU (see tests/gpu_lib_frame_graph_tests.cpp).
+//
+// Declaration order defines the meaning of the graph, a read depends on all writes to the resource
+// declared before it. Writes are not assumed to overwrite everything written before, so an earlier
+// write is never culled because of a later one. Imported resources should not overlap each other.
+//
+// Compiling only touches CPU memory, commands are recorded by gpuFrameGraphExecute() using the
+// normal command API. A frame graph is not thread-safe.
+
+struct GpuFrameGraph;
+
+// A resource in the frame graph, only valid until the next gpuFrameGraphReset().
+typedef u32 GpuFgRes;
+sfz_constant GpuFgRes GPU_NULL_FG_RES = 0;
+
+sfz_constant u32 GPU_FG_TRANSIENT_ALIGN = 256;
+
+// Called by gpuFrameGraphExecute() to queue the commands of a pass.
+typedef void GpuFgPassFunc(GpuLib* gpu, const GpuFrameGraph* fg, void* user_data);
+
+// A resource that is both read and written must be in both lists. The name is only used for error
+// messages and must be valid until the next gpuFrameGraphReset().
+sfz_struct(GpuFgPassDesc) {
+	const char* name;
+	const GpuFgRes* reads;
+	u32 num_reads;
+	const GpuFgRes* writes;
+	u32 num_writes;
+	bool side_effects; // Never culled, e.g. passes that only write to download buffers
+	GpuFgPassFunc* func;
+	void* user_data;
+};
+
+sfz_struct(GpuFrameGraphStats) {
+	u32 num_passes;
+	u32 num_culled_passes;
+	u32 num_levels;
+	u32 num_heap_barriers;
+	u32 num_rwtex_barriers;
+	u32 transient_size_bytes;
+	u32 transient_size_unaliased_bytes; // What the transients would need without aliasing
+};
+
+sfz_extern_c GpuFrameGraph* gpuFrameGraphInit(SfzAllocator* allocator);
+sfz_extern_c void gpuFrameGraphDestroy(GpuFrameGraph* fg);
+
+// Removes all passes and resources, call at the start of every frame. Doesn't deallocate memory.
+sfz_extern_c void gpuFrameGraphReset(GpuFrameGraph* fg);
+
+// Resources that live outside the frame graph. Importing the same RWTex twice returns the same
+// resource.
+sfz_extern_c GpuFgRes gpuFgImportPtr(GpuFrameGraph* fg, GpuPtr ptr, u32 num_bytes);
+sfz_extern_c GpuFgRes gpuFgImportRWTex(GpuFrameGraph* fg, GpuRWTex tex);
+
+// A buffer only used during this frame, allocated from the transient heap by
+// gpuFrameGraphCompile(). The contents are undefined before the first write.
+sfz_extern_c GpuFgRes gpuFgCreateTransient(GpuFrameGraph* fg, u32 num_bytes);
+
+sfz_extern_c void gpuFgAddPass(GpuFrameGraph* fg, const GpuFgPassDesc* desc);
+
+// Compiles the graph, see above. Transients are allocated from [transient_heap, transient_heap +
+// transient_heap_size), e.g. memory from gpuMalloc(). Returns false (and prints why) if the graph
+// is invalid or the transients don't fit, the required size is still available in the stats.
+sfz_extern_c bool gpuFrameGraphCompile(GpuFrameGraph* fg, GpuPtr transient_heap, u32 transient_heap_size);
+
+// Returns stats from the latest gpuFrameGraphCompile().
+sfz_extern_c GpuFrameGraphStats gpuFrameGraphGetStats(const GpuFrameGraph* fg);
+
+// Returns the memory or texture of a resource, transients are only valid after compiling. Typically
+// called from the pass functions.
+sfz_extern_c GpuPtr gpuFgGetPtr(const GpuFrameGraph* fg, GpuFgRes res);
+sfz_extern_c GpuRWTex gpuFgGetRWTex(const GpuFrameGraph* fg, GpuFgRes res);
+
+// Queues the used passes in compiled order, with the computed barriers between levels.
+sfz_extern_c void gpuFrameGraphExecute(GpuFrameGraph* fg, GpuLib* gpu);
+
+#endif // GPU_LIB_FRAME_GRAPH_H
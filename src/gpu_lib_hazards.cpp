@@ -0,0 +1,234 @@
+#include "gpu_lib_hazards.hpp"
+
+#include <stdio.h>
+
+// GpuPtrRangeSet
+// ------------------------------------------------------------------------------------------------
+
+void GpuPtrRangeSet::init(SfzAllocator* allocator, SfzDbgInfo alloc_dbg)
+{
+	ranges.init(GPU_HAZARD_MAX_NUM_TRACKED_RANGES + 1, allocator, alloc_dbg);
+}
+
+u32 GpuPtrRangeSet::lowerBound(u64 ptr) const
+{
+	u32 begin = 0;
+	u32 end = ranges.size();
+	while (begin < end) {
+		const u32 mid = begin + (end - begin) / 2;
+		if ((u64(ranges[mid].ptr) + ranges[mid].num_bytes) < ptr) begin = mid + 1;
+		else end = mid;
+	}
+	return begin;
+}
+
+bool GpuPtrRangeSet::overlaps(GpuPtrRange range) const
+{
+	if (range.num_bytes == 0) return false;
+	u32 idx = lowerBound(u64(range.ptr));
+	// lowerBound() includes a range ending exactly at ptr (for merging), it doesn't overlap
+	if (idx < ranges.size() && (u64(ranges[idx].ptr) + ranges[idx].num_bytes) == range.ptr) idx += 1;
+	return idx < ranges.size() && u64(ranges[idx].ptr) < (u64(range.ptr) + range.num_bytes);
+}
+
+bool GpuPtrRangeSet::overlaps(const GpuPtrRange* others, u32 num_others) const
+{
+	for (u32 i = 0; i < num_others; i++) {
+		if (overlaps(others[i])) return true;
+	}
+	return false;
+}
+
+void GpuPtrRangeSet::add(GpuPtrRange range)
+{
+	if (range.num_bytes == 0) return;
+	u64 begin = range.ptr;
+	u64 end = begin + range.num_bytes;
+	const u32 first = lowerBound(begin);
+	u32 last = first;
+	while (last < ranges.size() && u64(ranges[last].ptr) <= end) {
+		begin = u64_min(begin, ranges[last].ptr);
+		end = u64_max(end, u64(ranges[last].ptr) + ranges[last].num_bytes);
+		last += 1;
+	}
+	const GpuPtrRange merged = GpuPtrRange{ GpuPtr(begin), u32(end - begin) };
+	if (first == last) {
+		ranges.insert(first, merged);
+	}
+	else {
+		ranges[first] = merged;
+		if ((first + 1) < last) ranges.remove(first + 1, last - first - 1);
+	}
+
+	// Too many disjoint ranges, conservatively replace them with a single range covering all
+	if (GPU_HAZARD_MAX_NUM_TRACKED_RANGES < ranges.size()) {
+		const u64 all_begin = ranges.first().ptr;
+		const u64 all_end = u64(ranges.last().ptr) + ranges.last().num_bytes;
+		ranges.clear();
+		ranges.add(GpuPtrRange{ GpuPtr(all_begin), u32(all_end - all_begin) });
+	}
+}
+
+// GpuHeapHazardTracker
+// ------------------------------------------------------------------------------------------------
+
+void GpuHeapHazardTracker::init(SfzAllocator* allocator)
+{
+	reads.init(allocator, sfz_dbg("GpuHeapHazardTracker::reads"));
+	writes.init(allocator, sfz_dbg("GpuHeapHazardTracker::writes"));
+	unknown = false;
+}
+
+void GpuHeapHazardTracker::clear()
+{
+	reads.clear();
+	writes.clear();
+	unknown = false;
+}
+
+bool GpuHeapHazardTracker::hasHazard(const GpuDispatchAccess& access) const
+{
+	if (unknown) return true;
+	if (writes.overlaps(access.ptr_reads, access.num_ptr_reads)) return true; // RAW
+	if (writes.overlaps(access.ptr_writes, access.num_ptr_writes)) return true; // WAW
+	if (reads.overlaps(access.ptr_writes, access.num_ptr_writes)) return true; // WAR
+	return false;
+}
+
+void GpuHeapHazardTracker::add(const GpuDispatchAccess& access)
+{
+	for (u32 i = 0; i < access.num_ptr_reads; i++) reads.add(access.ptr_reads[i]);
+	for (u32 i = 0; i < access.num_ptr_writes; i++) writes.add(access.ptr_writes[i]);
+}
+
+// GpuRWTexHazardTracker
+// ------------------------------------------------------------------------------------------------
+
+void GpuRWTexHazardTracker::init(u32 max_num_textures, SfzAllocator* allocator)
+{
+	states.init(max_num_textures, allocator, sfz_dbg("GpuRWTexHazardTracker::states"));
+	states.add(GpuRWTexHazardState{}, max_num_textures);
+	tracked.init(max_num_textures, allocator, sfz_dbg("GpuRWTexHazardTracker::tracked"));
+	barriers.init(max_num_textures, allocator, sfz_dbg("GpuRWTexHazardTracker::barriers"));
+	all_dirty = false;
+}
+
+void GpuRWTexHazardTracker::setExists(GpuRWTex tex, bool exists)
+{
+	GpuRWTexHazardState& state = states[tex];
+	state.exists = exists;
+	state.pending_write = false;
+	state.pending_read = false;
+	// The tracked flag is kept, it refers to the entry in the tracked list. A new texture in the
+	// same slot must not be added to the list a second time.
+}
+
+void GpuRWTexHazardTracker::resolve(const GpuDispatchAccess* access)
+{
+	barriers.clear();
+	if (all_dirty) {
+		// Undeclared dispatches are synchronized by the user, including with each other
+		if (access != nullptr) barrierWritten();
+		return;
+	}
+
+	if (access == nullptr) {
+		// Barrier all textures with pending accesses, reads included
+		for (GpuRWTex tex : tracked) {
+			GpuRWTexHazardState& state = states[tex];
+			state.tracked = false;
+			if (!state.exists) continue; // Destroyed since it was accessed
+			if (state.pending_write || state.pending_read) barrier(tex);
+		}
+		tracked.clear();
+		return;
+	}
+
+	for (u32 i = 0; i < access->num_rwtex_reads; i++) {
+		const GpuRWTex tex = access->rwtex_reads[i];
+		const GpuRWTexHazardState* state = getDeclared(tex);
+		if (state == nullptr) continue;
+		if (state->pending_write) barrier(tex); // RAW
+	}
+	for (u32 i = 0; i < access->num_rwtex_writes; i++) {
+		const GpuRWTex tex = access->rwtex_writes[i];
+		const GpuRWTexHazardState* state = getDeclared(tex);
+		if (state == nullptr) continue;
+		if (state->pending_write || state->pending_read) barrier(tex); // WAW, WAR
+	}
+}
+
+void GpuRWTexHazardTracker::add(const GpuDispatchAccess* access)
+{
+	if (access == nullptr) {
+		all_dirty = true;
+		return;
+	}
+	if (all_dirty) return;
+	for (u32 i = 0; i < access->num_rwtex_reads; i++) track(access->rwtex_reads[i], false);
+	for (u32 i = 0; i < access->num_rwtex_writes; i++) track(access->rwtex_writes[i], true);
+}
+
+void GpuRWTexHazardTracker::barrierWritten()
+{
+	barriers.clear();
+	if (all_dirty) {
+		for (u32 idx = GPU_NULL_RWTEX + 1; idx < states.size(); idx++) {
+			GpuRWTexHazardState& state = states[idx];
+			state.tracked = false;
+			if (state.exists) barrier(GpuRWTex(idx));
+		}
+		tracked.clear();
+		all_dirty = false;
+		return;
+	}
+
+	u32 num_still_tracked = 0;
+	for (u32 i = 0; i < tracked.size(); i++) {
+		const GpuRWTex tex = tracked[i];
+		GpuRWTexHazardState& state = states[tex];
+		if (state.pending_write) barrier(tex);
+		if (state.exists && state.pending_read) {
+			tracked[num_still_tracked] = tex;
+			num_still_tracked += 1;
+		}
+		else {
+			state.tracked = false;
+		}
+	}
+	tracked.hackSetSize(num_still_tracked);
+}
+
+void GpuRWTexHazardTracker::onBarrier(GpuRWTex tex)
+{
+	if (u32(tex) >= states.size()) return;
+	states[tex].pending_write = false;
+	states[tex].pending_read = false;
+}
+
+GpuRWTexHazardState* GpuRWTexHazardTracker::getDeclared(GpuRWTex tex)
+{
+	if (u32(tex) >= states.size() || !states[tex].exists) {
+		printf("[gpu_lib]: Dispatch declares access to GpuRWTex %u, which doesn't exist.\n", u32(tex));
+		return nullptr;
+	}
+	return &states[tex];
+}
+
+void GpuRWTexHazardTracker::barrier(GpuRWTex tex)
+{
+	states[tex].pending_write = false;
+	states[tex].pending_read = false;
+	barriers.add(tex);
+}
+
+void GpuRWTexHazardTracker::track(GpuRWTex tex, bool write)
+{
+	GpuRWTexHazardState* state = getDeclared(tex);
+	if (state == nullptr) return;
+	if (write) state->pending_write = true;
+	else state->pending_read = true;
+	if (state->tracked) return;
+	state->tracked = true;
+	tracked.add(tex);
+}
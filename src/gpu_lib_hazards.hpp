@@ -0,0 +1,110 @@
+#pragma once
+#ifndef GPU_LIB_HAZARDS_HPP
+#define GPU_LIB_HAZARDS_HPP
+
+#include <gpu_lib.h>
+
+#include <sfz_cpp.hpp>
+#include <skipifzero_allocators.hpp>
+#include <skipifzero_arrays.hpp>
+
+// Hazard tracking
+// ------------------------------------------------------------------------------------------------
+
+// Bookkeeping used to infer barriers between dispatches with declared access (see
+// GpuDispatchAccess). Backend independent, the backend records a barrier when a query says there
+// is a hazard and the tracked accesses are cleared afterwards. Tested in tests/gpu_lib_hazards_tests.cpp.
+
+sfz_constant u32 GPU_HAZARD_MAX_NUM_TRACKED_RANGES = 256;
+
+// A set of gpu heap ranges, kept sorted by ptr with overlapping and adjacent ranges merged, so an
+// overlap query is a binary search. If more than GPU_HAZARD_MAX_NUM_TRACKED_RANGES disjoint ranges
+// are added they are conservatively replaced by a single range covering all of them.
+sfz_struct(GpuPtrRangeSet) {
+	SfzArray<GpuPtrRange> ranges;
+
+	void init(SfzAllocator* allocator, SfzDbgInfo alloc_dbg);
+	void clear() { ranges.clear(); }
+	bool isEmpty() const { return ranges.isEmpty(); }
+
+	// Index of the first range that ends at or after ptr.
+	u32 lowerBound(u64 ptr) const;
+
+	bool overlaps(GpuPtrRange range) const;
+	bool overlaps(const GpuPtrRange* others, u32 num_others) const;
+	void add(GpuPtrRange range);
+};
+
+// Keeps track of the gpu heap ranges accessed by dispatches since the last heap barrier.
+sfz_struct(GpuHeapHazardTracker) {
+	GpuPtrRangeSet reads;
+	GpuPtrRangeSet writes;
+
+	// Set if an undeclared dispatch has run, meaning anything could potentially have been written.
+	// Barriers between undeclared dispatches are the responsibility of the user, so this does not
+	// count as a declared access.
+	bool unknown;
+
+	void init(SfzAllocator* allocator);
+
+	// Called after a barrier (or transition) of the heap, everything before it is synchronized.
+	void clear();
+
+	bool hasDeclaredAccesses() const { return !reads.isEmpty() || !writes.isEmpty(); }
+
+	// Whether the access is a read-after-write, write-after-write or write-after-read of an earlier
+	// tracked access, i.e. whether a barrier is needed before it.
+	bool hasHazard(const GpuDispatchAccess& access) const;
+
+	void add(const GpuDispatchAccess& access);
+};
+
+// Hazard tracking state of a single GpuRWTex.
+sfz_struct(GpuRWTexHazardState) {
+	bool exists;
+	bool pending_write; // Written by a dispatch since the texture's last barrier
+	bool pending_read; // Read by a dispatch since the texture's last barrier
+	bool tracked; // In the tracked list
+};
+
+// Keeps track of which textures have been accessed by dispatches since their last barrier. Instead
+// of walking all textures, those with pending accesses are kept in a tracked list, so the cost of
+// the queries is proportional to the number of textures accessed. If an undeclared dispatch has run
+// all textures are assumed to be dirty until the next barrier of all of them.
+//
+// The queries output the textures that need a barrier in the barriers array, and consider them
+// synchronized from then on. The backend records a barrier for each of them.
+sfz_struct(GpuRWTexHazardTracker) {
+	SfzArray<GpuRWTexHazardState> states; // Indexed by GpuRWTex
+	SfzArray<GpuRWTex> tracked;
+	SfzArray<GpuRWTex> barriers;
+	bool all_dirty;
+
+	void init(u32 max_num_textures, SfzAllocator* allocator);
+
+	// Called when a texture is created or destroyed. Accesses to textures that don't exist are
+	// ignored (with an error message).
+	void setExists(GpuRWTex tex, bool exists);
+
+	// Barriers needed before a dispatch, read-after-write, write-after-write and write-after-read.
+	// An undeclared dispatch (access == nullptr) synchronizes against all declared accesses, barriers
+	// between undeclared dispatches are the responsibility of the user.
+	void resolve(const GpuDispatchAccess* access);
+
+	// Tracks the accesses of a dispatch, after resolve().
+	void add(const GpuDispatchAccess* access);
+
+	// Barriers all textures written since their last barrier (all of them if dirty). Textures that
+	// have only been read from stay tracked, to catch later write-after-reads.
+	void barrierWritten();
+
+	// Called after the user explicitly barriers a single texture.
+	void onBarrier(GpuRWTex tex);
+
+	// Internal helpers
+	GpuRWTexHazardState* getDeclared(GpuRWTex tex);
+	void barrier(GpuRWTex tex);
+	void track(GpuRWTex tex, bool write);
+};
+
+#endif
@@ -0,0 +1,36 @@
+#include "gpu_lib_hot_reload.hpp"
+
+// Kernel hot reload
+// ------------------------------------------------------------------------------------------------
+
+void watchedFilesInit(
+	SfzArray<GpuWatchedFile>& files,
+	const char* src_path,
+	const GpuKernelDep* deps,
+	u32 num_deps,
+	SfzAllocator* allocator)
+{
+	files.init(num_deps + 1, allocator, sfz_dbg("GpuKernelInfo::watched_files"));
+	GpuWatchedFile& src_file = files.add();
+	sfzStr320Appendf(&src_file.path, "%s", src_path);
+	src_file.last_write_time = fileLastWriteTime(src_path);
+	for (u32 i = 0; i < num_deps; i++) {
+		GpuWatchedFile& file = files.add();
+		file.path = deps[i].path;
+		file.last_write_time = fileLastWriteTime(deps[i].path.str);
+	}
+}
+
+bool watchedFilesChanged(SfzArray<GpuWatchedFile>& files)
+{
+	bool changed = false;
+	for (GpuWatchedFile& file : files) {
+		const u64 last_write_time = fileLastWriteTime(file.path.str);
+		if (last_write_time == 0) continue;
+		if (last_write_time != file.last_write_time) {
+			file.last_write_time = last_write_time;
+			changed = true;
+		}
+	}
+	return changed;
+}
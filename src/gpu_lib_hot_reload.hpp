@@ -0,0 +1,52 @@
+#pragma once
+#ifndef GPU_LIB_HOT_RELOAD_HPP
+#define GPU_LIB_HOT_RELOAD_HPP
+
+#include <gpu_lib.h>
+
+#include <sfz_cpp.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_strings.hpp>
+
+#include "gpu_lib_kernel_cache.hpp"
+
+// Kernel hot reload
+// ------------------------------------------------------------------------------------------------
+
+// Change detection for kernel hot reload. Each kernel watches its source file and the includes from
+// its last compile by polling their last write times, the backend rebuilds kernels whose files have
+// changed in the background. Tested in tests/gpu_lib_hot_reload_tests.cpp.
+
+// How often the watched files are polled, see hotReloadShouldPoll().
+sfz_constant f64 GPU_KERNEL_HOT_RELOAD_POLL_INTERVAL_MS = 250.0;
+
+// A file watched for changes when hot reloading kernels.
+sfz_struct(GpuWatchedFile) {
+	SfzStr320 path;
+	u64 last_write_time;
+};
+
+// Returns whether it's time to poll the watched files again (and if so records that it was done).
+// last_poll_ms and now_ms are from timeNowMs().
+inline bool hotReloadShouldPoll(f64* last_poll_ms, f64 now_ms)
+{
+	if (now_ms < *last_poll_ms + GPU_KERNEL_HOT_RELOAD_POLL_INTERVAL_MS) return false;
+	*last_poll_ms = now_ms;
+	return true;
+}
+
+// Starts watching a kernel's source file and its dependencies, replacing any previous files.
+void watchedFilesInit(
+	SfzArray<GpuWatchedFile>& files,
+	const char* src_path,
+	const GpuKernelDep* deps,
+	u32 num_deps,
+	SfzAllocator* allocator);
+
+// Returns whether any of the files has been written to since the last call (or init). Their times
+// are updated immediately, so a change is only reported once even if the rebuild fails. Files that
+// are currently missing are skipped until they reappear, editors often replace a file by deleting
+// and renaming.
+bool watchedFilesChanged(SfzArray<GpuWatchedFile>& files);
+
+#endif
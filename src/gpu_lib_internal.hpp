@@ -32,6 +32,19 @@
 // DXC compiler
 #include <dxc/dxcapi.h>
 
+#include "gpu_lib_cmd_stream.hpp"
+#include "gpu_lib_dispatch.hpp"
+#include "gpu_lib_hazards.hpp"
+#include "gpu_lib_hot_reload.hpp"
+#include "gpu_lib_jobs.hpp"
+#include "gpu_lib_kernel_cache.hpp"
+#include "gpu_lib_permutations.hpp"
+#include "gpu_lib_platform.hpp"
+#include "gpu_lib_prolog.hpp"
+#include "gpu_lib_ring.hpp"
+#include "gpu_lib_sync_ops.hpp"
+#include "gpu_lib_tex.hpp"
+
 using Microsoft::WRL::ComPtr;
 
 // gpu_lib
@@ -40,40 +53,145 @@ using Microsoft::WRL::ComPtr;
 sfz_constant u32 GPU_MALLOC_ALIGN = 64;
 sfz_constant u32 GPU_UPLOAD_HEAP_ALIGN = 256;
 sfz_constant u32 GPU_DOWNLOAD_HEAP_ALIGN = 256;
+sfz_constant u32 GPU_TEXTURE_PLACEMENT_ALIGN = D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT; // 512
+sfz_static_assert(GPU_TEXTURE_ROW_PITCH_ALIGN == D3D12_TEXTURE_DATA_PITCH_ALIGNMENT);
 
 sfz_constant u32 GPU_ROOT_PARAM_GLOBAL_HEAP_IDX = 0;
 sfz_constant u32 GPU_ROOT_PARAM_RW_TEX_ARRAY_IDX = 1;
 sfz_constant u32 GPU_ROOT_PARAM_LAUNCH_PARAMS_IDX = 2;
+sfz_constant u32 GPU_ROOT_PARAM_LARGE_LAUNCH_PARAMS_IDX = 3;
 
 sfz_constant u32 RWTEX_SWAPCHAIN_IDX = 1;
 
+// Size of the main queue's command stream, see GpuLib::cmd_stream. The commands recorded so far are
+// translated early if it fills up before the submit.
+sfz_constant u32 GPU_CMD_STREAM_MAX_NUM_CMDS = 16384; // 1 MiB
+
+// Objects registered in the command stream at the start of each submit, see cmdListResetStream()
+sfz_constant u32 GPU_CMD_STREAM_OBJ_GPU_HEAP = 0;
+sfz_constant u32 GPU_CMD_STREAM_OBJ_UPLOAD_HEAP = 1;
+sfz_constant u32 GPU_CMD_STREAM_OBJ_DOWNLOAD_HEAP = 2;
+sfz_constant u32 GPU_CMD_STREAM_OBJ_TIMESTAMP_QUERIES = 3;
+sfz_constant u32 GPU_CMD_STREAM_OBJ_INDIRECT_ARGS = 4;
+sfz_constant u32 GPU_CMD_STREAM_OBJ_DISPATCH_CMD_SIG = 5;
+sfz_constant u32 GPU_CMD_STREAM_OBJ_BATCH_CMD_SIG = 6;
+sfz_constant u32 GPU_CMD_STREAM_NUM_FIXED_OBJS = 7;
+
+// The command stream object of a texture or kernel in the current submit. Only valid if stamp is
+// the current submit's (curr_submit_idx + 1) and native is still the object's native object.
+sfz_struct(GpuCmdObjCache) {
+	u32 obj;
+	u64 stamp;
+	void* native;
+};
+
 sfz_struct(GpuCmdListInfo) {
-	ComPtr<ID3D12GraphicsCommandList> cmd_list;
+	ComPtr<ID3D12GraphicsCommandList> cmd_list; // Currently recording segment
 	ComPtr<ID3D12CommandAllocator> cmd_allocator;
-	u64 fence_value;
-	u64 submit_idx;
-	u64 upload_heap_offset;
-	u64 download_heap_offset;
+	GpuSubmitSlot slot;
+	GpuBoundState bound;
+
+	// The main thread's commands are split into segments by gpuQueueCmdContexts(), the contexts'
+	// command lists are executed in between. Segments share cmd_allocator, which is fine since only
+	// one of them is recording at a time. Segments are created on demand and reused by later
+	// submits, segments[0] is the command list created on init.
+	SfzArray<ComPtr<ID3D12GraphicsCommandList>> segments;
+	u32 num_segments_used;
+	SfzArray<ID3D12CommandList*> exec_lists; // To execute before the current segment, in order
+	SfzArray<GpuQueueSyncOp> sync_ops;
 };
 
+sfz_struct(GpuCmdContextInfo) {
+	ComPtr<ID3D12CommandAllocator> cmd_allocators[GPU_MAX_NUM_CONCURRENT_SUBMITS];
+	ComPtr<ID3D12GraphicsCommandList> cmd_list;
+	GpuQueue queue;
+	bool recording;
+	u64 begin_submit_idx; // Async submit idx for async compute contexts
+	GpuBoundState bound;
+
+	// Range of the upload heap reserved by gpuCmdContextBegin() for large launch params
+	u32 upload_heap_bytes;
+	u64 upload_begin_mapped;
+	u32 upload_num_reserved;
+	u32 upload_num_used;
+};
+
+
 sfz_struct(GpuRWTexInfo) {
 	ComPtr<ID3D12Resource> tex;
 	i32x2 tex_res;
 	GpuRWTexDesc desc;
 	SfzStr96 name;
+
+	GpuCmdObjCache cmd_obj;
 };
 
 sfz_struct(GpuPendingDownload) {
 	u32 heap_offset;
 	u32 num_bytes;
 	u64 submit_idx;
+
+	// Only used for texture downloads, row_pitch is 0 for linear memcpy downloads
+	u32 row_pitch;
+	u32 row_size;
+	u32 num_rows;
+};
+
+sfz_struct(GpuPendingRelease) {
+	ComPtr<IUnknown> object;
+	u64 submit_idx;
+	u64 async_fence_value; // Async work submitted before the object was retired
+};
+
+// A DXC compiler instance, none of the objects are thread-safe so each thread needs its own.
+sfz_struct(GpuDxc) {
+	ComPtr<IDxcUtils> utils;
+	ComPtr<IDxcCompiler3> compiler;
+};
+
+// The parameters a kernel was created with, copied from its GpuKernelDesc.
+sfz_struct(GpuKernelSource) {
+	SfzStr96 name;
+	SfzStr320 path;
+	u32 num_defines;
+	SfzStr96 defines[GPU_KERNEL_MAX_NUM_DEFINES];
 };
 
 sfz_struct(GpuKernelInfo) {
 	ComPtr<ID3D12PipelineState> pso;
-	ComPtr<ID3D12RootSignature> root_sig;
+	GpuHash dxil_hash; // Name of the pso in the pipeline library
 	i32x3 group_dims;
-	u32 launch_params_size;
+	GpuLaunchParamLayout param_layout;
+
+	GpuKernelSource source;
+	SfzArray<GpuKernelDep> deps;
+
+	// Hot reload, watched_files is only populated if enabled
+	SfzArray<GpuWatchedFile> watched_files;
+	bool reload_in_flight;
+
+	GpuCmdObjCache cmd_obj;
+};
+
+sfz_struct(GpuKernelPermutationsInfo) {
+	GpuKernelSource source; // Defines common to all permutations
+	u32 num_axes;
+	SfzStr96 axis_names[GPU_KERNEL_MAX_NUM_AXES];
+	u32 axis_num_values[GPU_KERNEL_MAX_NUM_AXES];
+	u32 num_permutations;
+	SfzArray<GpuKernel> kernels; // Indexed by key, GPU_NULL_KERNEL if not compiled
+	SfzArray<bool> failed; // Indexed by key, set if compilation failed so we don't retry every call
+};
+
+// A kernel being recompiled on a background thread, swapped in at the next submit.
+sfz_struct(GpuKernelReloadJob) {
+	GpuLib* gpu;
+	SfzHandle kernel;
+	GpuKernelSource source;
+	GpuKernelBinary binary;
+	ComPtr<ID3D12PipelineState> pso;
+	bool success;
+	HANDLE thread;
 };
 
 sfz_struct(GpuLib) {
@@ -84,6 +202,9 @@ sfz_struct(GpuLib) {
 	ComPtr<ID3D12Device3> device;
 	ComPtr<ID3D12InfoQueue> info_queue;
 
+	// Root signature shared by all kernels
+	ComPtr<ID3D12RootSignature> root_sig;
+
 	// Commands
 	u64 curr_submit_idx;
 	u64 known_completed_submit_idx;
@@ -91,56 +212,143 @@ sfz_struct(GpuLib) {
 	ComPtr<ID3D12Fence> cmd_queue_fence;
 	HANDLE cmd_queue_fence_event;
 	u64 cmd_queue_fence_value;
-	GpuCmdListInfo cmd_lists[GPU_NUM_CONCURRENT_SUBMITS];
-	GpuCmdListInfo& getPrevCmdList() { return cmd_lists[(curr_submit_idx > 0 ? curr_submit_idx - 1 : 0) % GPU_NUM_CONCURRENT_SUBMITS]; }
-	GpuCmdListInfo& getCurrCmdList() { return cmd_lists[curr_submit_idx % GPU_NUM_CONCURRENT_SUBMITS]; }
+	GpuCmdListInfo cmd_lists[GPU_MAX_NUM_CONCURRENT_SUBMITS]; // Only the first num_concurrent_submits are used
+	GpuCmdListInfo& getPrevCmdList() { return cmd_lists[submitSlotIdx(curr_submit_idx > 0 ? curr_submit_idx - 1 : 0, cfg.num_concurrent_submits)]; }
+	GpuCmdListInfo& getCurrCmdList() { return cmd_lists[submitSlotIdx(curr_submit_idx, cfg.num_concurrent_submits)]; }
+
+	// Async compute queue
+	//
+	// async_fence is signalled at the end of every async submit and by gpuQueueSignal(), the main
+	// queue has a separate fence for gpuQueueSignal() since its signals are executed at submit.
+	//
+	// Async work queued after a wait for a main queue signal that hasn't been submitted yet is held
+	// back (async_exec_lists and async_sync_ops) until gpuSubmitQueuedWork() submits the signal.
+	// Issuing the wait straight away would be valid on the GPU, but any CPU wait for the async
+	// queue before that submit would never return.
+	ComPtr<ID3D12CommandQueue> async_queue;
+	ComPtr<ID3D12Fence> async_fence;
+	HANDLE async_fence_event;
+	u64 async_fence_value; // Last value queued to be signalled
+	u64 async_fence_issued_value; // Last value whose signal has been issued to the async queue
+	u64 async_curr_submit_idx;
+	u64 async_submit_fence_values[GPU_MAX_NUM_CONCURRENT_SUBMITS]; // Last async submit to use each slot
+	SfzArray<ID3D12CommandList*> async_exec_lists; // Held back
+	SfzArray<GpuQueueSyncOp> async_sync_ops; // Held back
+	ComPtr<ID3D12Fence> main_sync_fence;
+	u64 main_sync_fence_value; // Last value queued to be signalled
+	u64 main_sync_fence_submitted_value; // Last value whose signal has been submitted
 
 	// Timestamps
 	ComPtr<ID3D12QueryHeap> timestamp_query_heap;
 
 	// GPU Heap
 	ComPtr<ID3D12Resource> gpu_heap;
-	D3D12_RESOURCE_STATES gpu_heap_state;
+	GpuResState gpu_heap_state;
 	u32 gpu_heap_next_free;
 
 	// Upload heap
 	ComPtr<ID3D12Resource> upload_heap;
 	u8* upload_heap_mapped_ptr;
-	u64 upload_heap_offset;
-	u64 upload_heap_safe_offset;
+	GpuHeapRing upload_heap_ring;
 	
 	// Download heap
 	ComPtr<ID3D12Resource> download_heap;
 	u8* download_heap_mapped_ptr;
-	u64 download_heap_offset;
-	u64 download_heap_safe_offset;
+	GpuHeapRing download_heap_ring;
 	sfz::Pool<GpuPendingDownload> downloads;
 
-	// RWTex descriptor heap
+	// Pending releases, objects that might still be in use by in-flight submits
+	SfzArray<GpuPendingRelease> pending_releases;
+
+	// RWTex descriptor heaps
+	//
+	// Descriptors are only ever written to the non shader-visible CPU heap. When a command list is
+	// submitted the CPU heap is copied to that submit's range in the shader-visible heap, meaning
+	// we never modify descriptors that are in use by in-flight submits. Async submits have their
+	// own ranges after the main queue's.
+	ComPtr<ID3D12DescriptorHeap> tex_descriptor_heap_cpu;
 	ComPtr<ID3D12DescriptorHeap> tex_descriptor_heap;
 	u32 num_tex_descriptors;
 	u32 tex_descriptor_size;
 	D3D12_CPU_DESCRIPTOR_HANDLE tex_descriptor_heap_start_cpu;
-	D3D12_GPU_DESCRIPTOR_HANDLE tex_descriptor_heap_start_gpu;
+	D3D12_CPU_DESCRIPTOR_HANDLE tex_descriptor_heap_visible_start_cpu;
+	D3D12_GPU_DESCRIPTOR_HANDLE tex_descriptor_heap_visible_start_gpu;
+	u64 getCurrTexDescriptorsOffset(GpuQueue queue = GPU_QUEUE_MAIN) const
+	{
+		const u32 n = cfg.num_concurrent_submits;
+		const u64 range_idx = queue == GPU_QUEUE_MAIN ? curr_submit_idx % n : n + async_curr_submit_idx % n;
+		return range_idx * num_tex_descriptors * tex_descriptor_size;
+	}
+	D3D12_GPU_DESCRIPTOR_HANDLE getCurrTexDescriptorsGpu(GpuQueue queue = GPU_QUEUE_MAIN) const { return { tex_descriptor_heap_visible_start_gpu.ptr + getCurrTexDescriptorsOffset(queue) }; }
 
 	// Textures
 	sfz::Pool<GpuRWTexInfo> rw_textures;
 
 	// DXC compiler
-	ComPtr<IDxcUtils> dxc_utils; // Not thread-safe
-	ComPtr<IDxcCompiler3> dxc_compiler; // Not thread-safe
-	ComPtr<IDxcIncludeHandler> dxc_include_handler; // Not thread-safe
+	GpuDxc dxc; // Not thread-safe
+	SfzArray<GpuDxc> dxc_workers; // One per worker thread, created on first use by gpuKernelInitBatch()
+
+	// On-disk compiled kernel cache, disabled if no directory was specified
+	GpuKernelCache kernel_cache;
+	GpuIncludeCache include_cache;
+	SRWLOCK kernel_cache_lock; // Protects stores, which may happen from several threads
+
+	// Pipeline library, PSOs are loaded from it when possible. Rebuilt from the live kernels and
+	// serialized to the kernel cache directory on destroy. The blob it was created from must outlive
+	// it and all its PSOs.
+	SfzArray<u8> pipeline_library_blob;
+	ComPtr<ID3D12PipelineLibrary> pipeline_library;
+	GpuPipelineLibraryKey pipeline_library_key;
+	u32 pipeline_library_num_in_file; // Number of PSOs in the file the library was created from
+	volatile LONG pipeline_library_num_stored;
 
 	// Kernels
 	sfz::Pool<GpuKernelInfo> kernels;
+	sfz::Pool<GpuKernelPermutationsInfo> kernel_permutations;
+	SfzArray<GpuKernelReloadJob*> kernel_reload_jobs;
+	f64 kernel_hot_reload_last_poll_ms;
+
+	// Command contexts
+	sfz::Pool<GpuCmdContextInfo> cmd_contexts;
 
 	// Swapchain
 	i32x2 swapchain_res;
+	i32x2 swapchain_fb_res; // Lags behind swapchain_res until the resolution has stabilized
+	u32 swapchain_num_stable_presents;
 	ComPtr<IDXGISwapChain4> swapchain;
 	ComPtr<ID3D12Resource> swapchain_rwtex;
 
-	// Tmp barriers
-	SfzArray<D3D12_RESOURCE_BARRIER> tmp_barriers;
+	// Hazard tracking for dispatches with declared access
+	//
+	// The heap tracker keeps the ranges accessed since the last heap barrier, the rwtex tracker the
+	// textures accessed since their last barrier. Both are in gpu_lib_hazards.hpp.
+	GpuHeapHazardTracker heap_hazards;
+	GpuRWTexHazardTracker rwtex_hazards;
+
+	// Command stream
+	//
+	// The main queue's commands are recorded into a backend independent command stream (see
+	// gpu_lib_cmd_stream.hpp) rather than straight into the command list. The stream is translated
+	// to the command list at submit, or earlier if it fills up. Before that, redundant barriers are
+	// merged and contiguous uploads coalesced by passes over it, and in debug mode it's validated.
+	// Resource states (gpu_heap_state, indirect_args_state) are tracked at record time. Command
+	// contexts still record straight into their own command lists.
+	GpuCmdStream cmd_stream;
+	SfzArray<D3D12_RESOURCE_BARRIER> tmp_barriers; // A run of barriers being translated
+
+	// Indirect dispatches
+	//
+	// The gpu heap can't be in the INDIRECT_ARGUMENT state while it's bound as a UAV, so arguments
+	// are copied from the heap to a separate buffer before each indirect dispatch. Each submit has
+	// its own range of the buffer, so ranges are never overwritten while in use. Buffers decay to
+	// COMMON after each submit, so the tracked state is reset when the command list is reset.
+	ComPtr<ID3D12Resource> indirect_args;
+	GpuResState indirect_args_state;
+	u32 indirect_args_num_used; // In the current submit's range
+	ComPtr<ID3D12CommandSignature> dispatch_cmd_sig; // Shared by all kernels, same root signature
+	ComPtr<ID3D12CommandSignature> batch_cmd_sig; // Root constants + dispatch, see GpuBatchDispatchArgs
+	GpuKernel count_to_groups_kernel;
+	u64 getCurrIndirectArgsOffset() const { return (u64(curr_submit_idx % cfg.num_concurrent_submits) * GPU_INDIRECT_ARGS_MAX_NUM_PER_SUBMIT + indirect_args_num_used) * sizeof(GpuDispatchArgs); }
 };
 
 // Texture helpers
@@ -173,65 +381,15 @@ inline DXGI_FORMAT formatToD3D12(GpuFormat fmt)
 	case GPU_FORMAT_RG_F32: return DXGI_FORMAT_R32G32_FLOAT;
 	case GPU_FORMAT_RGBA_F32: return DXGI_FORMAT_R32G32B32A32_FLOAT;
 
-	default: break;
-	}
-	sfz_assert(false);
-	return DXGI_FORMAT_UNKNOWN;
-}
-
-inline const char* formatToString(GpuFormat fmt)
-{
-	switch (fmt) {
-	case GPU_FORMAT_UNDEFINED: return "GPU_FORMAT_UNDEFINED";
-
-	case GPU_FORMAT_R_U8_UNORM: return "GPU_FORMAT_R_U8_UNORM";
-	case GPU_FORMAT_RG_U8_UNORM: return "GPU_FORMAT_RG_U8_UNORM";
-	case GPU_FORMAT_RGBA_U8_UNORM: return "GPU_FORMAT_RGBA_U8_UNORM";
-
-	case GPU_FORMAT_R_U8: return "GPU_FORMAT_R_U8";
-	case GPU_FORMAT_RG_U8: return "GPU_FORMAT_RG_U8";
-	case GPU_FORMAT_RGBA_U8: return "GPU_FORMAT_RGBA_U8";
-
-	case GPU_FORMAT_R_U16: return "GPU_FORMAT_R_U16";
-	case GPU_FORMAT_RG_U16: return "GPU_FORMAT_RG_U16";
-	case GPU_FORMAT_RGBA_U16: return "GPU_FORMAT_RGBA_U16";
-
-	case GPU_FORMAT_R_I32: return "GPU_FORMAT_R_I32";
-	case GPU_FORMAT_RG_I32: return "GPU_FORMAT_RG_I32";
-	case GPU_FORMAT_RGBA_I32: return "GPU_FORMAT_RGBA_I32";
-
-	case GPU_FORMAT_R_F16: return "GPU_FORMAT_R_F16";
-	case GPU_FORMAT_RG_F16: return "GPU_FORMAT_RG_F16";
-	case GPU_FORMAT_RGBA_F16: return "GPU_FORMAT_RGBA_F16";
-
-	case GPU_FORMAT_R_F32: return "GPU_FORMAT_R_F32";
-	case GPU_FORMAT_RG_F32: return "GPU_FORMAT_RG_F32";
-	case GPU_FORMAT_RGBA_F32: return "GPU_FORMAT_RGBA_F32";
+	case GPU_FORMAT_BC1_UNORM: return DXGI_FORMAT_BC1_UNORM;
+	case GPU_FORMAT_BC4_UNORM: return DXGI_FORMAT_BC4_UNORM;
+	case GPU_FORMAT_BC5_UNORM: return DXGI_FORMAT_BC5_UNORM;
+	case GPU_FORMAT_BC7_UNORM: return DXGI_FORMAT_BC7_UNORM;
 
 	default: break;
 	}
 	sfz_assert(false);
-	return "UNKNOWN";
-}
-
-inline i32x2 calcRWTexTargetRes(i32x2 swapchain_res, const GpuRWTexDesc* desc)
-{
-	if (!desc->swapchain_relative) return desc->fixed_res;
-	i32x2 res = i32x2_splat(0);
-	if (desc->relative_fixed_height != 0) {
-		sfz_assert(0 < desc->relative_fixed_height && desc->relative_fixed_height <= 16384);
-		const f32 aspect = f32(swapchain_res.x) / f32(swapchain_res.y);
-		res.y = desc->relative_fixed_height;
-		res.x = i32(roundf(aspect * f32(res.y)));
-	}
-	else {
-		sfz_assert(0.0f < desc->relative_scale && desc->relative_scale <= 8.0f);
-		res.x = i32(roundf(desc->relative_scale * f32(swapchain_res.x)));
-		res.y = i32(roundf(desc->relative_scale * f32(swapchain_res.y)));
-	}
-	res.x = i32_max(res.x, 1);
-	res.y = i32_max(res.y, 1);
-	return res;
+	return DXGI_FORMAT_UNKNOWN;
 }
 
 // Error handling
@@ -411,66 +569,41 @@ inline void fileUnmap(FileMapData map_data)
 	}
 }
 
-// Kernel prolog
+// Built-in kernels
 // ------------------------------------------------------------------------------------------------
 
-constexpr char GPU_KERNEL_PROLOG[] = R"(
-
-// Some macros that can be used to check if code is being compiled with GPU_LIB
-#define GPU_LIB
-#define GPU_HLSL
-
-// Other macros and constants
-#define static_assert(cond, msg) _Static_assert((cond), (msg))
-
-// Root signature
-RWByteAddressBuffer gpu_global_heap : register(u0);
-RWTexture2D<float4> gpu_rwtex_array[] : register(u1);
-
-// Textures
-typedef uint16_t GpuRWTex;
-static const GpuRWTex GPU_NULL_RWTEX = 0;
-static const GpuRWTex RWTEX_SWAPCHAIN_IDX = 1;
-
-RWTexture2D<float4> getSwapchainRWTex() { return gpu_rwtex_array[RWTEX_SWAPCHAIN_IDX]; }
-RWTexture2D<float4> getRWTex(GpuRWTex idx) { return gpu_rwtex_array[NonUniformResourceIndex(idx)]; }
-RWTexture2D<float4> getRWTex(GpuRWTex idx, out int2 tex_res)
-{
-	RWTexture2D<float4> tex = getRWTex(idx);
-	uint w = 0, h = 0;
-	tex.GetDimensions(w, h);
-	tex_res = int2(w, h);
-	return tex;
-}
-
-// Pointer type (matches GpuPtr on CPU)
-typedef uint GpuPtr;
-static const GpuPtr GPU_NULLPTR = 0;
+// Source of the kernel used by gpuQueueCountToGroups(), the prolog is prepended when compiling.
+// dispatchCountToGroups() is its CPU reference, tested in tests/gpu_lib_dispatch_tests.cpp.
+constexpr char GPU_COUNT_TO_GROUPS_KERNEL_SRC[] = R"(
+cbuffer LaunchParams : register(b0) {
+	GpuPtr count_ptr;
+	GpuPtr args_ptr;
+	uint elements_per_group;
+};
 
-uint ptrLoadByte(GpuPtr ptr)
+[numthreads(1, 1, 1)]
+void CSMain()
 {
-	const uint word_address = ptr & 0xFFFFFFFC;
-	const uint word = gpu_global_heap.Load<uint>(word_address);
-	const uint byte_address = ptr & 0x00000003;
-	const uint byte_shift = byte_address * 8;
-	const uint byte = (word >> byte_shift) & 0x000000FF;
-	return byte;
+	const uint count = ptrLoad<uint>(count_ptr);
+	const uint num_groups = min(count / elements_per_group + (count % elements_per_group != 0 ? 1 : 0), 65535);
+	ptrStore<uint3>(args_ptr, uint3(num_groups, 1, 1));
 }
-
-template<typename T>
-T ptrLoad(GpuPtr ptr) { return gpu_global_heap.Load<T>(ptr); }
-
-template<typename T>
-T ptrLoadArrayElem(GpuPtr ptr, uint idx) { return gpu_global_heap.Load<T>(ptr + idx * sizeof(T)); }
-
-template<typename T>
-void ptrStore(GpuPtr ptr, T val) { gpu_global_heap.Store<T>(ptr, val); }
-
-template<typename T>
-void ptrStoreArrayElem(GpuPtr ptr, T val, uint idx) { gpu_global_heap.Store<T>(ptr + idx * sizeof(T), val); }
-
 )";
 
-constexpr u32 GPU_KERNEL_PROLOG_SIZE = sizeof(GPU_KERNEL_PROLOG) - 1; // -1 because null-terminator
+// DXC arguments used for all kernels, defines are appended after these.
+constexpr LPCWSTR GPU_KERNEL_DXC_BASE_ARGS[] = {
+	L"-E",
+	L"CSMain",
+	L"-T",
+	L"cs_6_6",
+	L"-HV 2021",
+	L"-enable-16bit-types",
+	L"-O3",
+	L"-Zi",
+	L"-Qembed_debug",
+	DXC_ARG_PACK_MATRIX_ROW_MAJOR,
+	L"-DGPU_LIB_HLSL"
+};
+constexpr u32 GPU_KERNEL_DXC_NUM_BASE_ARGS = sizeof(GPU_KERNEL_DXC_BASE_ARGS) / sizeof(LPCWSTR);
 
 #endif // GPU_LIB_INTERNAL_HPP
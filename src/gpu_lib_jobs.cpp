@@ -0,0 +1,28 @@
+#include "gpu_lib_jobs.hpp"
+
+#include <omp.h>
+
+#include "gpu_lib_platform.hpp"
+
+// Batch jobs
+// ------------------------------------------------------------------------------------------------
+
+u32 jobsNumWorkers()
+{
+	return u32(omp_get_max_threads());
+}
+
+u32 jobsRunBatch(u32 num_items, GpuJobFunc* func, void* user, bool* successes_out, f32* times_ms_out)
+{
+	u32 num_failed = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:num_failed)
+	for (i32 i = 0; i < i32(num_items); i++) {
+		const f64 begin_ms = timeNowMs();
+		const bool success = func(user, u32(i), u32(omp_get_thread_num()));
+		const f64 end_ms = timeNowMs();
+		if (successes_out != nullptr) successes_out[i] = success;
+		if (times_ms_out != nullptr) times_ms_out[i] = f32(end_ms - begin_ms);
+		if (!success) num_failed += 1;
+	}
+	return num_failed;
+}
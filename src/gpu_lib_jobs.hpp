@@ -0,0 +1,29 @@
+#pragma once
+#ifndef GPU_LIB_JOBS_HPP
+#define GPU_LIB_JOBS_HPP
+
+#include <gpu_lib.h>
+
+#include <sfz_cpp.hpp>
+
+// Batch jobs
+// ------------------------------------------------------------------------------------------------
+
+// Runs a batch of independent items (e.g. kernel builds) on OpenMP worker threads and returns once
+// all have finished. Items are handed out one at a time since their cost varies a lot (a kernel
+// cache hit vs a full compile). Backend independent so the scheduling can be tested on Linux with a
+// stub job, see tests/gpu_lib_jobs_tests.cpp.
+
+// Runs one item. worker_idx is in [0, jobsNumWorkers()) and is never shared by two jobs running at
+// the same time, so it can index per worker state that isn't thread-safe (e.g. DXC instances).
+typedef bool GpuJobFunc(void* user, u32 item_idx, u32 worker_idx);
+
+// The max number of workers a batch runs on, per worker state must be created for this many.
+u32 jobsNumWorkers();
+
+// Runs func for every item in [0, num_items). The result and time (in ms) of each item are written
+// to successes_out and times_ms_out if they're not nullptr. Returns the number of failed items.
+// Batches sharing per worker state must not run at the same time, worker indices are per batch.
+u32 jobsRunBatch(u32 num_items, GpuJobFunc* func, void* user, bool* successes_out, f32* times_ms_out);
+
+#endif
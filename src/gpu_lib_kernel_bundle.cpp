@@ -0,0 +1,266 @@
+#include "gpu_lib_kernel_bundle.hpp"
+#include "gpu_lib_permutations.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static u32 alignUp(u32 value, u32 align)
+{
+	return (value + align - 1) & ~(align - 1);
+}
+
+static bool entryLess(u64 l_hash, u32 l_key, u64 r_hash, u32 r_key)
+{
+	if (l_hash != r_hash) return l_hash < r_hash;
+	return l_key < r_key;
+}
+
+static int compareEntries(const void* l_ptr, const void* r_ptr)
+{
+	const GpuKernelBundleEntry& l = *static_cast<const GpuKernelBundleEntry*>(l_ptr);
+	const GpuKernelBundleEntry& r = *static_cast<const GpuKernelBundleEntry*>(r_ptr);
+	if (entryLess(l.name_hash, l.permutation_key, r.name_hash, r.permutation_key)) return -1;
+	if (entryLess(r.name_hash, r.permutation_key, l.name_hash, l.permutation_key)) return 1;
+	return 0;
+}
+
+// Kernel bundle
+// ------------------------------------------------------------------------------------------------
+
+bool kernelBundleBuild(
+	const GpuKernelBundleInput* inputs, u32 num_inputs, SfzAllocator* allocator, SfzArray<u8>& bundle_out)
+{
+	// Calculate size of string table and offsets of param layouts and dxil blobs
+	const u32 entries_offset = sizeof(GpuKernelBundleHeader);
+	const u32 strings_offset = entries_offset + num_inputs * sizeof(GpuKernelBundleEntry);
+	u32 strings_size = 0;
+	for (u32 i = 0; i < num_inputs; i++) strings_size += u32(strlen(inputs[i].name)) + 1;
+	const u32 param_layouts_offset = alignUp(strings_offset + strings_size, GPU_KERNEL_BUNDLE_ALIGN);
+	const u32 dxils_offset =
+		alignUp(param_layouts_offset + num_inputs * sizeof(GpuLaunchParamLayout), GPU_KERNEL_BUNDLE_ALIGN);
+	u32 total_size = dxils_offset;
+	for (u32 i = 0; i < num_inputs; i++) total_size = alignUp(total_size + inputs[i].dxil_size, GPU_KERNEL_BUNDLE_ALIGN);
+
+	bundle_out.init(total_size, allocator, sfz_dbg("GpuKernelBundle"));
+	bundle_out.add(u8(0), total_size);
+	u8* bundle = bundle_out.data();
+
+	GpuKernelBundleHeader& header = *reinterpret_cast<GpuKernelBundleHeader*>(bundle);
+	header.magic = GPU_KERNEL_BUNDLE_MAGIC;
+	header.version = GPU_KERNEL_BUNDLE_VERSION;
+	header.num_entries = num_inputs;
+	header.strings_offset = strings_offset;
+	header.strings_size = strings_size;
+	header.total_size = total_size;
+
+	// Write entries, names and dxil
+	GpuKernelBundleEntry* entries = reinterpret_cast<GpuKernelBundleEntry*>(bundle + entries_offset);
+	u32 string_pos = strings_offset;
+	u32 dxil_pos = dxils_offset;
+	for (u32 i = 0; i < num_inputs; i++) {
+		const GpuKernelBundleInput& input = inputs[i];
+		GpuKernelBundleEntry& entry = entries[i];
+		entry.name_hash = kernelBundleNameHash(input.name);
+		entry.permutation_key = input.permutation_key;
+		entry.name_offset = string_pos;
+		entry.dxil_offset = dxil_pos;
+		entry.dxil_size = input.dxil_size;
+		entry.group_dims = input.group_dims;
+		entry.param_layout_offset = param_layouts_offset + i * sizeof(GpuLaunchParamLayout);
+		entry.dxil_hash = sha256(input.dxil, input.dxil_size);
+
+		const u32 name_len = u32(strlen(input.name));
+		memcpy(bundle + string_pos, input.name, name_len + 1);
+		string_pos += name_len + 1;
+		memcpy(bundle + entry.param_layout_offset, input.param_layout, sizeof(GpuLaunchParamLayout));
+		memcpy(bundle + dxil_pos, input.dxil, input.dxil_size);
+		dxil_pos = alignUp(dxil_pos + input.dxil_size, GPU_KERNEL_BUNDLE_ALIGN);
+	}
+
+	// Sort entries so they can be binary searched. Entries with the same hash and key are either
+	// duplicates or (very unlikely) hash collisions, neither can be looked up so both are errors.
+	qsort(entries, num_inputs, sizeof(GpuKernelBundleEntry), compareEntries);
+	for (u32 i = 1; i < num_inputs; i++) {
+		if (compareEntries(&entries[i - 1], &entries[i]) == 0) {
+			printf("[gpu_lib]: Kernel \"%s\" (permutation %u) is in bundle more than once.\n",
+				reinterpret_cast<const char*>(bundle + entries[i].name_offset), entries[i].permutation_key);
+			bundle_out.destroy();
+			return false;
+		}
+	}
+	return true;
+}
+
+const GpuKernelBundleEntry* kernelBundleFind(
+	const void* bundle_ptr, u64 bundle_size, const char* name, u32 permutation_key)
+{
+	const u8* bundle = static_cast<const u8*>(bundle_ptr);
+	if (bundle == nullptr || bundle_size < sizeof(GpuKernelBundleHeader)) return nullptr;
+	const GpuKernelBundleHeader& header = *reinterpret_cast<const GpuKernelBundleHeader*>(bundle);
+	if (header.magic != GPU_KERNEL_BUNDLE_MAGIC ||
+		header.version != GPU_KERNEL_BUNDLE_VERSION ||
+		header.total_size != bundle_size ||
+		u64(header.strings_offset) + header.strings_size > bundle_size ||
+		sizeof(GpuKernelBundleHeader) + u64(header.num_entries) * sizeof(GpuKernelBundleEntry) > header.strings_offset) {
+		return nullptr;
+	}
+
+	// Binary search for the first entry not less than (hash, key)
+	const GpuKernelBundleEntry* entries =
+		reinterpret_cast<const GpuKernelBundleEntry*>(bundle + sizeof(GpuKernelBundleHeader));
+	const u64 name_hash = kernelBundleNameHash(name);
+	u32 first = 0;
+	u32 count = header.num_entries;
+	while (count > 0) {
+		const u32 step = count / 2;
+		const GpuKernelBundleEntry& mid = entries[first + step];
+		if (entryLess(mid.name_hash, mid.permutation_key, name_hash, permutation_key)) {
+			first += step + 1;
+			count -= step + 1;
+		}
+		else {
+			count = step;
+		}
+	}
+	if (first >= header.num_entries) return nullptr;
+	const GpuKernelBundleEntry& entry = entries[first];
+	if (entry.name_hash != name_hash || entry.permutation_key != permutation_key) return nullptr;
+
+	// Validate the entry we found, including that the name actually matches
+	const u64 strings_end = u64(header.strings_offset) + header.strings_size;
+	if (entry.name_offset < header.strings_offset || entry.name_offset >= strings_end) return nullptr;
+	const char* entry_name = reinterpret_cast<const char*>(bundle + entry.name_offset);
+	const u64 max_name_len = strings_end - entry.name_offset;
+	if (strnlen(entry_name, size_t(max_name_len)) == max_name_len) return nullptr;
+	if (strcmp(entry_name, name) != 0) return nullptr;
+	if (u64(entry.dxil_offset) + entry.dxil_size > bundle_size) return nullptr;
+	if (u64(entry.param_layout_offset) + sizeof(GpuLaunchParamLayout) > bundle_size) return nullptr;
+	if ((entry.param_layout_offset % alignof(GpuLaunchParamLayout)) != 0) return nullptr;
+	return &entry;
+}
+
+sfz_extern_c bool gpuKernelBundleGetParamLayout(
+	const void* bundle, u64 bundle_size, const char* name, u32 permutation_key, GpuLaunchParamLayout* layout_out)
+{
+	const GpuKernelBundleEntry* entry = kernelBundleFind(bundle, bundle_size, name, permutation_key);
+	if (entry == nullptr) return false;
+	memcpy(layout_out, static_cast<const u8*>(bundle) + entry->param_layout_offset, sizeof(GpuLaunchParamLayout));
+	return true;
+}
+
+// Kernel manifest
+// ------------------------------------------------------------------------------------------------
+
+// Splits the line into whitespace separated tokens. Returns false if there are more than
+// max_num_tokens tokens.
+static bool tokenize(char* line, char** tokens_out, u32 max_num_tokens, u32* num_tokens_out)
+{
+	u32 num_tokens = 0;
+	char* token = strtok(line, " \t\r\n");
+	while (token != nullptr) {
+		if (num_tokens >= max_num_tokens) return false;
+		tokens_out[num_tokens] = token;
+		num_tokens += 1;
+		token = strtok(nullptr, " \t\r\n");
+	}
+	*num_tokens_out = num_tokens;
+	return true;
+}
+
+bool manifestParseLine(char* line, u32 line_idx, GpuManifestLine* out)
+{
+	*out = {};
+	char* tokens[3 + GPU_KERNEL_MAX_NUM_AXES + GPU_KERNEL_MAX_NUM_DEFINES] = {};
+	u32 num_tokens = 0;
+	if (!tokenize(line, tokens, sizeof(tokens) / sizeof(tokens[0]), &num_tokens)) {
+		// Comments can be arbitrarily long
+		if (tokens[0][0] == '#') return true;
+		printf("[gpu_lib_kernelc]: Line %u: Too many defines and axes.\n", line_idx);
+		return false;
+	}
+	if (num_tokens == 0 || tokens[0][0] == '#') return true;
+	if (num_tokens < 3) {
+		printf("[gpu_lib_kernelc]: Line %u: Expected \"<type> <name> <path>\".\n", line_idx);
+		return false;
+	}
+	out->type = sfzStr96InitFmt("%s", tokens[0]);
+	out->name = sfzStr96InitFmt("%s", tokens[1]);
+	out->path = sfzStr320InitFmt("%s", tokens[2]);
+	const bool is_permutations = strcmp(tokens[0], "permutations") == 0;
+	if (!is_permutations && strcmp(tokens[0], "kernel") != 0) {
+		printf("[gpu_lib_kernelc]: Line %u: Unknown type \"%s\".\n", line_idx, tokens[0]);
+		return false;
+	}
+
+	for (u32 i = 3; i < num_tokens; i++) {
+		char* colon = strchr(tokens[i], ':');
+		if (is_permutations && colon != nullptr) {
+			if (out->num_axes >= GPU_KERNEL_MAX_NUM_AXES) {
+				printf("[gpu_lib_kernelc]: Line %u: Too many axes.\n", line_idx);
+				return false;
+			}
+			*colon = '\0';
+			if (strlen(tokens[i]) > GPU_KERNEL_AXIS_NAME_MAX_LEN) {
+				printf("[gpu_lib_kernelc]: Line %u: Axis name \"%s\" is too long, max %u characters allowed.\n",
+					line_idx, tokens[i], GPU_KERNEL_AXIS_NAME_MAX_LEN);
+				return false;
+			}
+			out->axis_names[out->num_axes] = sfzStr96InitFmt("%s", tokens[i]);
+			out->axis_num_values[out->num_axes] = u32(strtoul(colon + 1, nullptr, 10));
+			// Same requirement as gpuKernelPermutationsInit(), a single value axis should be a define
+			if (out->axis_num_values[out->num_axes] < 2) {
+				printf("[gpu_lib_kernelc]: Line %u: Axis \"%s\" must have at least 2 values.\n", line_idx, tokens[i]);
+				return false;
+			}
+			out->num_axes += 1;
+		}
+		else {
+			if (out->num_defines >= GPU_KERNEL_MAX_NUM_DEFINES) {
+				printf("[gpu_lib_kernelc]: Line %u: Too many defines.\n", line_idx);
+				return false;
+			}
+			out->defines[out->num_defines] = sfzStr96InitFmt("%s", tokens[i]);
+			out->num_defines += 1;
+		}
+	}
+	if (out->num_defines + out->num_axes > GPU_KERNEL_MAX_NUM_DEFINES) {
+		printf("[gpu_lib_kernelc]: Line %u: Too many defines and axes.\n", line_idx);
+		return false;
+	}
+	return true;
+}
+
+bool manifestAddKernels(const GpuManifestLine& line, u32 line_idx, SfzArray<GpuManifestKernel>& kernels)
+{
+	const bool is_permutations = strcmp(line.type.str, "permutations") == 0;
+	u64 num_permutations = 1; // 64 bits so the product can't wrap before it's checked
+	for (u32 i = 0; i < line.num_axes; i++) {
+		num_permutations *= line.axis_num_values[i];
+		if (num_permutations > GPU_KERNEL_MAX_NUM_PERMUTATIONS) {
+			printf("[gpu_lib_kernelc]: Line %u: Too many permutations.\n", line_idx);
+			return false;
+		}
+	}
+
+	for (u32 key = 0; key < u32(num_permutations); key++) {
+		GpuManifestKernel& kernel = kernels.add();
+		kernel.name = line.name;
+		kernel.path = line.path;
+		for (u32 i = 0; i < line.num_defines; i++) kernel.defines[i] = line.defines[i];
+		kernel.num_defines = line.num_defines;
+		kernel.permutation_key = is_permutations ? key : GPU_KERNEL_BUNDLE_NO_PERMUTATION;
+
+		// Same keys as gpuKernelPermutationsGetKey()
+		u32 axis_values[GPU_KERNEL_MAX_NUM_AXES] = {};
+		permutationKeyUnpack(line.axis_num_values, line.num_axes, key, axis_values);
+		for (u32 i = 0; i < line.num_axes; i++) {
+			kernel.defines[kernel.num_defines] = sfzStr96InitFmt("%s=%u", line.axis_names[i].str, axis_values[i]);
+			kernel.num_defines += 1;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#ifndef GPU_LIB_KERNEL_BUNDLE_HPP
+#define GPU_LIB_KERNEL_BUNDLE_HPP
+
+#include <gpu_lib.h>
+
+#include <sfz_cpp.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_strings.hpp>
+
+#include "gpu_lib_kernel_cache.hpp"
+
+// Kernel bundle
+// ------------------------------------------------------------------------------------------------
+
+// A bundle is a single file containing precompiled kernels, written offline (gpu_lib_kernelc) and
+// memory mapped at runtime. Kernels are created straight from the mapped bytes, nothing is copied
+// or parsed up front.
+//
+// Layout (all offsets are from the start of the bundle):
+// * GpuKernelBundleHeader
+// * GpuKernelBundleEntry[num_entries], sorted by (name_hash, permutation_key)
+// * String table, null-terminated names
+// * GpuLaunchParamLayout[num_entries]
+// * DXIL blobs, each aligned to GPU_KERNEL_BUNDLE_ALIGN
+//
+// Looking up a kernel is a binary search over the entries. Only the header and the entries touched
+// by the search are validated, so looking up a few kernels in a large bundle is cheap.
+
+sfz_constant u32 GPU_KERNEL_BUNDLE_MAGIC = 0x30424B47; // "GKB0"
+sfz_constant u32 GPU_KERNEL_BUNDLE_VERSION = 2;
+sfz_constant u32 GPU_KERNEL_BUNDLE_ALIGN = 16;
+
+sfz_struct(GpuKernelBundleHeader) {
+	u32 magic;
+	u32 version;
+	u32 num_entries;
+	u32 strings_offset;
+	u32 strings_size;
+	u32 padding;
+	u64 total_size;
+};
+sfz_static_assert(sizeof(GpuKernelBundleHeader) == 32);
+
+sfz_struct(GpuKernelBundleEntry) {
+	u64 name_hash; // FNV-1a
+	u32 permutation_key; // GPU_KERNEL_BUNDLE_NO_PERMUTATION if not a permutation
+	u32 name_offset;
+	u32 dxil_offset;
+	u32 dxil_size;
+	i32x3 group_dims;
+	u32 param_layout_offset;
+	GpuHash dxil_hash; // Name in the pipeline library, precomputed so loading doesn't hash DXIL
+};
+sfz_static_assert(sizeof(GpuKernelBundleEntry) == 72);
+
+// A kernel to add to a bundle.
+sfz_struct(GpuKernelBundleInput) {
+	const char* name;
+	u32 permutation_key;
+	const u8* dxil;
+	u32 dxil_size;
+	i32x3 group_dims;
+	const GpuLaunchParamLayout* param_layout;
+};
+
+inline u64 kernelBundleNameHash(const char* name)
+{
+	u64 hash = 14695981039346656037ull;
+	for (const char* c = name; *c != '\0'; c++) {
+		hash ^= u64(u8(*c));
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Builds a bundle in memory. Returns false if two inputs have the same name and permutation key.
+bool kernelBundleBuild(
+	const GpuKernelBundleInput* inputs, u32 num_inputs, SfzAllocator* allocator, SfzArray<u8>& bundle_out);
+
+// Finds a kernel in a bundle, returns nullptr if it doesn't exist or the bundle is invalid. The
+// returned entry (and the DXIL and param layout it points to) is bounds checked against bundle_size.
+const GpuKernelBundleEntry* kernelBundleFind(
+	const void* bundle, u64 bundle_size, const char* name, u32 permutation_key);
+
+// Kernel manifest
+// ------------------------------------------------------------------------------------------------
+
+// Parsing of the manifests gpu_lib_kernelc builds bundles from, see tools/gpu_lib_kernelc.cpp for
+// the format. Errors are printed with the line index.
+
+// A parsed manifest line, type is empty for blank and comment lines.
+sfz_struct(GpuManifestLine) {
+	SfzStr96 type;
+	SfzStr96 name;
+	SfzStr320 path;
+	u32 num_defines;
+	SfzStr96 defines[GPU_KERNEL_MAX_NUM_DEFINES];
+	u32 num_axes;
+	SfzStr96 axis_names[GPU_KERNEL_MAX_NUM_AXES];
+	u32 axis_num_values[GPU_KERNEL_MAX_NUM_AXES];
+};
+
+// A kernel to compile, one per permutation of a "permutations" line.
+sfz_struct(GpuManifestKernel) {
+	SfzStr96 name;
+	SfzStr320 path;
+	u32 num_defines;
+	SfzStr96 defines[GPU_KERNEL_MAX_NUM_DEFINES];
+	const char* define_ptrs[GPU_KERNEL_MAX_NUM_DEFINES];
+	u32 permutation_key;
+};
+
+// Parses a line, modifying it in the process. Returns false if the line is invalid.
+bool manifestParseLine(char* line, u32 line_idx, GpuManifestLine* out);
+
+// Adds all kernels (one per permutation) described by a parsed line. Returns false if there are too
+// many permutations.
+bool manifestAddKernels(const GpuManifestLine& line, u32 line_idx, SfzArray<GpuManifestKernel>& kernels);
+
+#endif // GPU_LIB_KERNEL_BUNDLE_HPP
@@ -0,0 +1,313 @@
+#include "gpu_lib_kernel_cache.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+sfz_struct(GpuKernelCacheHeader) {
+	u32 magic;
+	u32 version;
+	GpuHash key;
+	i32x3 group_dims;
+	u32 padding;
+	u32 num_deps;
+	u32 dxil_size;
+	u64 total_size;
+	GpuLaunchParamLayout param_layout;
+};
+sfz_static_assert(sizeof(GpuKernelCacheHeader) == 72 + sizeof(GpuLaunchParamLayout));
+
+static SfzStr320 entryPath(const GpuKernelCache* cache, const GpuHash& key)
+{
+	SfzStr320 path = {};
+	sfzStr320Appendf(&path, "%s/%s.gkc", cache->dir.str, hashToString(key).str);
+	return path;
+}
+
+// Reads an entire cache file, optionally updating its last write time. The time is used to
+// determine the least recently used entries when evicting.
+static bool readCacheFile(const char* path, SfzAllocator* allocator, SfzArray<u8>& out, bool touch)
+{
+	if (!fileReadAll(path, allocator, out)) return false;
+	if (touch) fileSetLastWriteTime(path, fileTimeNow());
+	return true;
+}
+
+// Kernel cache
+// ------------------------------------------------------------------------------------------------
+
+bool kernelCacheInit(GpuKernelCache* cache, const char* dir, u64 max_size_bytes, SfzAllocator* allocator)
+{
+	*cache = {};
+	if (dir == nullptr || dir[0] == '\0') return false;
+
+	if (!dirCreate(dir)) {
+		printf("[gpu_lib]: Failed to create kernel cache directory \"%s\", reason: %s\n",
+			dir, platformLastErrorStr().str);
+		return false;
+	}
+
+	cache->enabled = true;
+	cache->allocator = allocator;
+	sfzStr320Appendf(&cache->dir, "%s", dir);
+	cache->max_size_bytes = max_size_bytes != 0 ? max_size_bytes : GPU_KERNEL_CACHE_DEFAULT_MAX_SIZE;
+	kernelCacheEvict(cache);
+	return true;
+}
+
+bool kernelCacheLoad(
+	GpuKernelCache* cache,
+	const GpuHash& key,
+	GpuIncludeCache* include_cache,
+	SfzAllocator* allocator,
+	GpuKernelBinary* out)
+{
+	if (!cache->enabled) return false;
+
+	const SfzStr320 path = entryPath(cache, key);
+	SfzArray<u8> file;
+	if (!readCacheFile(path.str, allocator, file, true)) return false;
+
+	// Validate header
+	if (file.size() < sizeof(GpuKernelCacheHeader)) return false;
+	GpuKernelCacheHeader header = {};
+	memcpy(&header, file.data(), sizeof(GpuKernelCacheHeader));
+	const u64 expected_size =
+		sizeof(GpuKernelCacheHeader) + u64(header.num_deps) * sizeof(GpuKernelDep) + header.dxil_size;
+	if (header.magic != GPU_KERNEL_CACHE_MAGIC ||
+		header.version != GPU_KERNEL_CACHE_VERSION ||
+		header.key != key ||
+		header.total_size != file.size() ||
+		expected_size != file.size()) {
+		printf("[gpu_lib]: Invalid kernel cache entry \"%s\", ignoring.\n", path.str);
+		return false;
+	}
+
+	// Check that dependencies (includes) haven't changed
+	const GpuKernelDep* deps =
+		reinterpret_cast<const GpuKernelDep*>(file.data() + sizeof(GpuKernelCacheHeader));
+	for (u32 i = 0; i < header.num_deps; i++) {
+		const GpuKernelDep& dep = deps[i];
+		const u8* dep_contents = nullptr;
+		u32 dep_size = 0;
+		GpuHash dep_hash = {};
+		if (!includeCacheGet(include_cache, dep.path.str, &dep_contents, &dep_size, &dep_hash)) return false;
+		if (dep_hash != dep.hash) return false;
+	}
+
+	// Cache hit, copy out data
+	const u8* dxil = file.data() + sizeof(GpuKernelCacheHeader) + header.num_deps * sizeof(GpuKernelDep);
+	out->dxil.init(header.dxil_size, allocator, sfz_dbg("GpuKernelBinary::dxil"));
+	out->dxil.add(dxil, header.dxil_size);
+	out->group_dims = header.group_dims;
+	out->param_layout = header.param_layout;
+	out->deps.init(header.num_deps, allocator, sfz_dbg("GpuKernelBinary::deps"));
+	out->deps.add(deps, header.num_deps);
+	return true;
+}
+
+void kernelCacheStore(GpuKernelCache* cache, const GpuHash& key, const GpuKernelBinary& binary)
+{
+	if (!cache->enabled) return;
+
+	GpuKernelCacheHeader header = {};
+	header.magic = GPU_KERNEL_CACHE_MAGIC;
+	header.version = GPU_KERNEL_CACHE_VERSION;
+	header.key = key;
+	header.group_dims = binary.group_dims;
+	header.param_layout = binary.param_layout;
+	header.num_deps = binary.deps.size();
+	header.dxil_size = binary.dxil.size();
+	header.total_size =
+		sizeof(GpuKernelCacheHeader) + u64(header.num_deps) * sizeof(GpuKernelDep) + header.dxil_size;
+
+	const SfzStr320 path = entryPath(cache, key);
+	const void* parts[3] = { &header, binary.deps.data(), binary.dxil.data() };
+	const u64 part_sizes[3] = {
+		sizeof(GpuKernelCacheHeader), u64(binary.deps.size()) * sizeof(GpuKernelDep), binary.dxil.size() };
+	if (!writeFileAtomic(path.str, parts, part_sizes, 3)) return;
+
+	cache->approx_size_bytes += header.total_size;
+	if (cache->approx_size_bytes > cache->max_size_bytes) kernelCacheEvict(cache);
+}
+
+static int compareLastWrite(const void* l_ptr, const void* r_ptr)
+{
+	const GpuFileInfo& l = *static_cast<const GpuFileInfo*>(l_ptr);
+	const GpuFileInfo& r = *static_cast<const GpuFileInfo*>(r_ptr);
+	if (l.last_write_time < r.last_write_time) return -1;
+	if (l.last_write_time > r.last_write_time) return 1;
+	return 0;
+}
+
+void kernelCacheEvict(GpuKernelCache* cache)
+{
+	if (!cache->enabled) return;
+
+	// List all entries in cache
+	SfzArray<GpuFileInfo> files;
+	files.init(256, cache->allocator, sfz_dbg("kernelCacheEvict"));
+	dirListFiles(cache->dir.str, ".gkc", files);
+	u64 total_size = 0;
+	for (const GpuFileInfo& info : files) total_size += info.size_bytes;
+
+	// The pipeline library counts against the size, but is never evicted. It's rebuilt from the
+	// kernels in use every time it's stored, so it doesn't grow with stale entries.
+	{
+		SfzStr320 library_path = {};
+		sfzStr320Appendf(&library_path, "%s/%s", cache->dir.str, GPU_PIPELINE_LIBRARY_FILE_NAME);
+		u64 library_size = 0;
+		if (fileSize(library_path.str, &library_size)) total_size += library_size;
+	}
+
+	// Evict least recently used entries until we are below the max size
+	if (total_size > cache->max_size_bytes) {
+		qsort(files.data(), files.size(), sizeof(GpuFileInfo), compareLastWrite);
+		for (u32 i = 0; i < files.size() && total_size > cache->max_size_bytes; i++) {
+			// Can fail if another process is currently reading the entry, that's fine.
+			if (fileDelete(files[i].path.str)) total_size -= files[i].size_bytes;
+		}
+	}
+	cache->approx_size_bytes = total_size;
+}
+
+// Pipeline library file
+// ------------------------------------------------------------------------------------------------
+
+sfz_struct(GpuPipelineLibraryHeader) {
+	u32 magic;
+	u32 version;
+	GpuPipelineLibraryKey key;
+	u64 blob_size;
+	GpuHash blob_hash;
+	u32 num_pipelines;
+	u32 padding;
+};
+sfz_static_assert(sizeof(GpuPipelineLibraryHeader) == 88);
+
+static SfzStr320 pipelineLibraryPath(const GpuKernelCache* cache)
+{
+	SfzStr320 path = {};
+	sfzStr320Appendf(&path, "%s/%s", cache->dir.str, GPU_PIPELINE_LIBRARY_FILE_NAME);
+	return path;
+}
+
+bool pipelineLibraryFileLoad(
+	const GpuKernelCache* cache,
+	const GpuPipelineLibraryKey& key,
+	SfzAllocator* allocator,
+	SfzArray<u8>& blob_out,
+	u32* num_pipelines_out)
+{
+	if (!cache->enabled) return false;
+
+	const SfzStr320 path = pipelineLibraryPath(cache);
+	SfzArray<u8> file;
+	if (!readCacheFile(path.str, allocator, file, false)) return false;
+
+	if (file.size() < sizeof(GpuPipelineLibraryHeader)) return false;
+	GpuPipelineLibraryHeader header = {};
+	memcpy(&header, file.data(), sizeof(GpuPipelineLibraryHeader));
+	if (header.magic != GPU_PIPELINE_LIBRARY_MAGIC ||
+		header.version != GPU_PIPELINE_LIBRARY_VERSION ||
+		header.blob_size != (file.size() - sizeof(GpuPipelineLibraryHeader))) {
+		printf("[gpu_lib]: Invalid pipeline library \"%s\", ignoring.\n", path.str);
+		return false;
+	}
+	if (header.key != key) {
+		printf("[gpu_lib]: Pipeline library \"%s\" is from a different adapter or driver, ignoring.\n", path.str);
+		return false;
+	}
+
+	const u8* blob = file.data() + sizeof(GpuPipelineLibraryHeader);
+	if (sha256(blob, header.blob_size) != header.blob_hash) {
+		printf("[gpu_lib]: Pipeline library \"%s\" is corrupt, ignoring.\n", path.str);
+		return false;
+	}
+
+	blob_out.init(u32(header.blob_size), allocator, sfz_dbg("pipelineLibraryFileLoad"));
+	blob_out.add(blob, u32(header.blob_size));
+	*num_pipelines_out = header.num_pipelines;
+	return true;
+}
+
+void pipelineLibraryFileStore(
+	GpuKernelCache* cache, const GpuPipelineLibraryKey& key, const void* blob, u64 blob_size, u32 num_pipelines)
+{
+	if (!cache->enabled) return;
+
+	const SfzStr320 path = pipelineLibraryPath(cache);
+	if (cache->max_size_bytes < (sizeof(GpuPipelineLibraryHeader) + blob_size)) {
+		printf("[gpu_lib]: Pipeline library (%.1f MiB) is larger than the kernel cache, not storing it.\n",
+			f64(sizeof(GpuPipelineLibraryHeader) + blob_size) / (1024.0 * 1024.0));
+		fileDelete(path.str);
+		return;
+	}
+
+	GpuPipelineLibraryHeader header = {};
+	header.magic = GPU_PIPELINE_LIBRARY_MAGIC;
+	header.version = GPU_PIPELINE_LIBRARY_VERSION;
+	header.key = key;
+	header.blob_size = blob_size;
+	header.blob_hash = sha256(blob, blob_size);
+	header.num_pipelines = num_pipelines;
+
+	const void* parts[2] = { &header, blob };
+	const u64 part_sizes[2] = { sizeof(GpuPipelineLibraryHeader), blob_size };
+	if (!writeFileAtomic(path.str, parts, part_sizes, 2)) return;
+	kernelCacheEvict(cache);
+}
+
+// Include cache
+// ------------------------------------------------------------------------------------------------
+
+void includeCacheInit(GpuIncludeCache* cache, SfzAllocator* allocator)
+{
+	cache->allocator = allocator;
+	rwLockInit(&cache->lock);
+	cache->files.init(64, allocator, sfz_dbg("GpuIncludeCache::files"));
+}
+
+bool includeCacheGet(
+	GpuIncludeCache* cache, const char* path, const u8** contents_out, u32* size_out, GpuHash* hash_out)
+{
+	// Read before the contents, if the file changes while we read it the next lookup sees a newer time
+	const u64 last_write_time = fileLastWriteTime(path);
+	if (last_write_time == 0) return false;
+
+	// Search backwards, the newest entry for a path is the only one that can be up to date
+	rwLockAcquireShared(&cache->lock);
+	bool hit = false;
+	for (u32 i = cache->files.size(); i > 0; i--) {
+		const GpuIncludeFile& file = cache->files[i - 1];
+		if (strcmp(file.path.str, path) != 0) continue;
+		if (file.last_write_time == last_write_time) {
+			*contents_out = file.contents.data();
+			*size_out = file.contents.size();
+			*hash_out = file.hash;
+			hit = true;
+		}
+		break;
+	}
+	rwLockReleaseShared(&cache->lock);
+	if (hit) return true;
+
+	// Read and hash the file outside the lock. Two threads might both miss on the same file, this
+	// only results in a redundant entry.
+	GpuIncludeFile file = {};
+	if (!fileReadAll(path, cache->allocator, file.contents)) return false;
+	sfzStr320Appendf(&file.path, "%s", path);
+	file.last_write_time = last_write_time;
+	file.hash = sha256(file.contents.data(), file.contents.size());
+	*contents_out = file.contents.data();
+	*size_out = file.contents.size();
+	*hash_out = file.hash;
+
+	// The contents buffer is owned by the entry from now on, moving it into the array doesn't move it
+	rwLockAcquireExclusive(&cache->lock);
+	cache->files.add(sfz_move(file));
+	rwLockReleaseExclusive(&cache->lock);
+	return true;
+}
@@ -0,0 +1,271 @@
+#pragma once
+#ifndef GPU_LIB_KERNEL_CACHE_HPP
+#define GPU_LIB_KERNEL_CACHE_HPP
+
+#include <gpu_lib.h>
+
+#include <string.h>
+
+#include <sfz_cpp.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_strings.hpp>
+
+#include "gpu_lib_platform.hpp"
+
+// SHA-256
+// ------------------------------------------------------------------------------------------------
+
+sfz_struct(GpuHash) {
+	u8 bytes[32];
+
+	bool operator== (const GpuHash& o) const { return memcmp(bytes, o.bytes, sizeof(bytes)) == 0; }
+	bool operator!= (const GpuHash& o) const { return !(*this == o); }
+};
+
+sfz_struct(GpuSha256) {
+	u32 state[8];
+	u64 num_bytes;
+	u8 block[64];
+};
+
+inline u32 sha256Rotr(u32 x, u32 n) { return (x >> n) | (x << (32 - n)); }
+
+inline void sha256ProcessBlock(u32 state[8], const u8 block[64])
+{
+	constexpr u32 K[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	u32 w[64];
+	for (u32 i = 0; i < 16; i++) {
+		w[i] = (u32(block[i * 4]) << 24) | (u32(block[i * 4 + 1]) << 16) |
+			(u32(block[i * 4 + 2]) << 8) | u32(block[i * 4 + 3]);
+	}
+	for (u32 i = 16; i < 64; i++) {
+		const u32 s0 = sha256Rotr(w[i - 15], 7) ^ sha256Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		const u32 s1 = sha256Rotr(w[i - 2], 17) ^ sha256Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	u32 a = state[0], b = state[1], c = state[2], d = state[3];
+	u32 e = state[4], f = state[5], g = state[6], h = state[7];
+	for (u32 i = 0; i < 64; i++) {
+		const u32 s1 = sha256Rotr(e, 6) ^ sha256Rotr(e, 11) ^ sha256Rotr(e, 25);
+		const u32 ch = (e & f) ^ (~e & g);
+		const u32 t1 = h + s1 + ch + K[i] + w[i];
+		const u32 s0 = sha256Rotr(a, 2) ^ sha256Rotr(a, 13) ^ sha256Rotr(a, 22);
+		const u32 maj = (a & b) ^ (a & c) ^ (b & c);
+		const u32 t2 = s0 + maj;
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+inline GpuSha256 sha256Init()
+{
+	GpuSha256 ctx = {};
+	ctx.state[0] = 0x6a09e667; ctx.state[1] = 0xbb67ae85; ctx.state[2] = 0x3c6ef372; ctx.state[3] = 0xa54ff53a;
+	ctx.state[4] = 0x510e527f; ctx.state[5] = 0x9b05688c; ctx.state[6] = 0x1f83d9ab; ctx.state[7] = 0x5be0cd19;
+	return ctx;
+}
+
+inline void sha256Update(GpuSha256* ctx, const void* data, u64 num_bytes)
+{
+	const u8* src = static_cast<const u8*>(data);
+	while (num_bytes > 0) {
+		const u32 block_offset = u32(ctx->num_bytes % 64);
+		const u32 num_to_copy = u32(u64_min(64 - block_offset, num_bytes));
+		memcpy(ctx->block + block_offset, src, num_to_copy);
+		ctx->num_bytes += num_to_copy;
+		src += num_to_copy;
+		num_bytes -= num_to_copy;
+		if ((ctx->num_bytes % 64) == 0) sha256ProcessBlock(ctx->state, ctx->block);
+	}
+}
+
+inline GpuHash sha256Final(GpuSha256* ctx)
+{
+	const u64 num_bits = ctx->num_bytes * 8;
+	const u8 pad_start = 0x80;
+	sha256Update(ctx, &pad_start, 1);
+	const u8 zero = 0;
+	while ((ctx->num_bytes % 64) != 56) sha256Update(ctx, &zero, 1);
+	u8 len_be[8];
+	for (u32 i = 0; i < 8; i++) len_be[i] = u8(num_bits >> (56 - i * 8));
+	sha256Update(ctx, len_be, 8);
+
+	GpuHash hash = {};
+	for (u32 i = 0; i < 8; i++) {
+		hash.bytes[i * 4 + 0] = u8(ctx->state[i] >> 24);
+		hash.bytes[i * 4 + 1] = u8(ctx->state[i] >> 16);
+		hash.bytes[i * 4 + 2] = u8(ctx->state[i] >> 8);
+		hash.bytes[i * 4 + 3] = u8(ctx->state[i]);
+	}
+	return hash;
+}
+
+inline GpuHash sha256(const void* data, u64 num_bytes)
+{
+	GpuSha256 ctx = sha256Init();
+	sha256Update(&ctx, data, num_bytes);
+	return sha256Final(&ctx);
+}
+
+inline SfzStr96 hashToString(const GpuHash& hash)
+{
+	SfzStr96 str = {};
+	for (u32 i = 0; i < 32; i++) sfzStr96Appendf(&str, "%02x", u32(hash.bytes[i]));
+	return str;
+}
+
+// Include cache
+// ------------------------------------------------------------------------------------------------
+
+// A file in the include cache.
+sfz_struct(GpuIncludeFile) {
+	SfzStr320 path;
+	u64 last_write_time;
+	GpuHash hash;
+	SfzArray<u8> contents;
+};
+
+// An in-memory cache of include files shared by all kernel compiles (and kernel cache lookups), so
+// that a header included by hundreds of kernels is only read and hashed once. Entries are checked
+// against the file's last write time on each lookup, a changed file is read again and gets a new
+// entry. Entries are never removed, so returned contents stay valid for the lifetime of the cache.
+sfz_struct(GpuIncludeCache) {
+	SfzAllocator* allocator;
+	GpuRWLock lock;
+	SfzArray<GpuIncludeFile> files;
+};
+
+void includeCacheInit(GpuIncludeCache* cache, SfzAllocator* allocator);
+
+// Returns the contents and hash of a file, reading it from disk if it's not cached or has changed.
+// Safe to call from multiple threads. Returns false if the file could not be read.
+bool includeCacheGet(
+	GpuIncludeCache* cache, const char* path, const u8** contents_out, u32* size_out, GpuHash* hash_out);
+
+// Kernel binary
+// ------------------------------------------------------------------------------------------------
+
+// A file (other than the main kernel source) that a kernel depends on, typically an include.
+sfz_struct(GpuKernelDep) {
+	SfzStr320 path;
+	GpuHash hash;
+};
+
+// The result of compiling a kernel, everything needed to create its pipeline state.
+sfz_struct(GpuKernelBinary) {
+	SfzArray<u8> dxil;
+	GpuHash dxil_hash; // Not stored in the cache, names the PSO in the pipeline library
+	i32x3 group_dims;
+	GpuLaunchParamLayout param_layout;
+	SfzArray<GpuKernelDep> deps;
+};
+
+// Kernel cache
+// ------------------------------------------------------------------------------------------------
+
+// Everything in this file is backend independent and tested in tests/gpu_lib_kernel_cache_tests.cpp,
+// including the SHA-256 above. A broken hash would silently serve stale binaries.
+//
+// An on-disk cache of compiled kernels, keyed by a hash of everything that goes into compiling
+// them (prolog, source, defines, compiler args and compiler version). Each entry is a single file
+// named after its key, written to a temporary file first and then atomically renamed into place.
+// This means several processes can safely share the same cache directory.
+//
+// Entries also contain the hashes of all includes used when compiling the kernel. An entry is
+// only considered a hit if all includes are unchanged.
+//
+// The cache is capped in size, the least recently used entries are evicted when it grows too big.
+// The pipeline library file (see below) counts against the size, but is never evicted.
+
+sfz_constant u32 GPU_KERNEL_CACHE_MAGIC = 0x30434B47; // "GKC0"
+sfz_constant u32 GPU_KERNEL_CACHE_VERSION = 2;
+
+sfz_struct(GpuKernelCache) {
+	bool enabled;
+	SfzAllocator* allocator;
+	SfzStr320 dir;
+	u64 max_size_bytes;
+	u64 approx_size_bytes;
+};
+
+// Initializes the cache, creating the directory if necessary. Returns false (and leaves cache
+// disabled) if the directory could not be created.
+bool kernelCacheInit(GpuKernelCache* cache, const char* dir, u64 max_size_bytes, SfzAllocator* allocator);
+
+// Tries to load an entry from the cache, returns false on cache miss. Includes are hashed through
+// the include cache, so each is only read once for all entries.
+bool kernelCacheLoad(
+	GpuKernelCache* cache,
+	const GpuHash& key,
+	GpuIncludeCache* include_cache,
+	SfzAllocator* allocator,
+	GpuKernelBinary* out);
+
+// Stores an entry in the cache, evicts old entries if the cache grows too large.
+void kernelCacheStore(GpuKernelCache* cache, const GpuHash& key, const GpuKernelBinary& binary);
+
+// Evicts the least recently used entries until the cache is below its max size.
+void kernelCacheEvict(GpuKernelCache* cache);
+
+// Pipeline library file
+// ------------------------------------------------------------------------------------------------
+
+// A serialized ID3D12PipelineLibrary stored in the kernel cache directory. Serialized libraries are
+// only valid for the adapter and driver they were created with, so these are stored in the header
+// and the file is ignored if they don't match. The blob is also hashed to detect corrupt files.
+// The number of pipelines in the library is stored so it can be rebuilt when some are no longer
+// used.
+
+sfz_constant u32 GPU_PIPELINE_LIBRARY_MAGIC = 0x304C5047; // "GPL0"
+sfz_constant u32 GPU_PIPELINE_LIBRARY_VERSION = 3;
+sfz_constant char GPU_PIPELINE_LIBRARY_FILE_NAME[] = "pipelines.gpl";
+
+sfz_struct(GpuPipelineLibraryKey) {
+	u32 vendor_id;
+	u32 device_id;
+	u32 subsys_id;
+	u32 revision;
+	u64 driver_version;
+	u32 d3d12_sdk_version;
+	u32 padding;
+
+	bool operator== (const GpuPipelineLibraryKey& o) const { return memcmp(this, &o, sizeof(GpuPipelineLibraryKey)) == 0; }
+	bool operator!= (const GpuPipelineLibraryKey& o) const { return !(*this == o); }
+};
+
+// Loads the pipeline library blob, returns false if it doesn't exist, is corrupt or was created
+// with a different key.
+bool pipelineLibraryFileLoad(
+	const GpuKernelCache* cache,
+	const GpuPipelineLibraryKey& key,
+	SfzAllocator* allocator,
+	SfzArray<u8>& blob_out,
+	u32* num_pipelines_out);
+
+// Whether the pipeline library file needs to be rewritten on shutdown. A new library is built from
+// the PSOs of the live kernels, num_live of them. Without newly stored PSOs all live PSOs were
+// loaded from the file, so it only differs if it has more (i.e. some are no longer used).
+inline bool pipelineLibraryNeedsStore(u32 num_stored, u32 num_live, u32 num_in_file)
+{
+	return num_stored != 0 || num_live != num_in_file;
+}
+
+// Stores the pipeline library blob, replacing any existing one. The blob is not stored if it alone
+// is larger than the max size of the cache, otherwise kernel cache entries are evicted to make room.
+void pipelineLibraryFileStore(
+	GpuKernelCache* cache, const GpuPipelineLibraryKey& key, const void* blob, u64 blob_size, u32 num_pipelines);
+
+#endif // GPU_LIB_KERNEL_CACHE_HPP
@@ -0,0 +1,91 @@
+#include <gpu_lib.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+// Appends to a string while keeping track of the total size, similar to chaining snprintf().
+sfz_struct(LayoutWriter) {
+	char* out;
+	u32 out_size;
+	u32 num_chars;
+};
+
+static void layoutWriterAppendf(LayoutWriter* w, const char* fmt, ...)
+{
+	char* dst = w->num_chars < w->out_size ? w->out + w->num_chars : nullptr;
+	const u32 dst_size = w->num_chars < w->out_size ? w->out_size - w->num_chars : 0;
+	va_list args;
+	va_start(args, fmt);
+	const i32 res = vsnprintf(dst, dst_size, fmt, args);
+	va_end(args);
+	if (res > 0) w->num_chars += u32(res);
+}
+
+static void layoutWriterAppendIdentifier(LayoutWriter* w, const char* name)
+{
+	if (name[0] >= '0' && name[0] <= '9') layoutWriterAppendf(w, "_");
+	for (const char* c = name; *c != '\0'; c++) {
+		const bool valid =
+			(*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '_';
+		layoutWriterAppendf(w, "%c", valid ? *c : '_');
+	}
+}
+
+// Param layout API
+// ------------------------------------------------------------------------------------------------
+
+sfz_extern_c const char* gpuParamTypeToString(GpuParamType type)
+{
+	switch (type) {
+	case GPU_PARAM_TYPE_UNKNOWN: return "UNKNOWN";
+	case GPU_PARAM_TYPE_BOOL: return "BOOL";
+	case GPU_PARAM_TYPE_I16: return "I16";
+	case GPU_PARAM_TYPE_U16: return "U16";
+	case GPU_PARAM_TYPE_F16: return "F16";
+	case GPU_PARAM_TYPE_I32: return "I32";
+	case GPU_PARAM_TYPE_U32: return "U32";
+	case GPU_PARAM_TYPE_F32: return "F32";
+	case GPU_PARAM_TYPE_I64: return "I64";
+	case GPU_PARAM_TYPE_U64: return "U64";
+	case GPU_PARAM_TYPE_F64: return "F64";
+	case GPU_PARAM_TYPE_STRUCT: return "STRUCT";
+	default: break;
+	}
+	return "UNKNOWN";
+}
+
+sfz_extern_c u32 gpuParamLayoutToCppHeader(
+	const GpuLaunchParamLayout* layout, const char* name, char* out, u32 out_size)
+{
+	LayoutWriter w = {};
+	w.out = out;
+	w.out_size = out_size;
+	if (out != nullptr && out_size > 0) out[0] = '\0';
+
+	layoutWriterAppendf(&w, "// Launch parameters of \"%s\"\nstruct GpuParamLayout_", name);
+	layoutWriterAppendIdentifier(&w, name);
+	layoutWriterAppendf(&w, " {\n");
+	layoutWriterAppendf(&w, "\tstatic constexpr u32 size = %u;\n", layout->size);
+	layoutWriterAppendf(&w, "\tstatic constexpr u32 used_size = %u;\n", layout->used_size);
+	layoutWriterAppendf(&w, "\tstatic constexpr bool is_large = %s;\n", layout->is_large ? "true" : "false");
+
+	// Members get their own scope so they can't clash with the constants above, and are suffixed
+	// instead of being nested structs since a nested struct can't have a member with its own name.
+	layoutWriterAppendf(&w, "\tstruct members {\n");
+	for (u32 i = 0; i < layout->num_members && i < GPU_LAUNCH_PARAMS_MAX_NUM_MEMBERS; i++) {
+		const GpuLaunchParamMember& member = layout->members[i];
+		layoutWriterAppendf(&w, "\t\tstatic constexpr u32 ");
+		layoutWriterAppendIdentifier(&w, member.name);
+		layoutWriterAppendf(&w, "_offset = %u, ", member.offset);
+		layoutWriterAppendIdentifier(&w, member.name);
+		layoutWriterAppendf(&w, "_size = %u; // %s x%u\n",
+			member.size, gpuParamTypeToString(member.type), member.num_components);
+	}
+	layoutWriterAppendf(&w, "\t};\n");
+	layoutWriterAppendf(&w, "};\n");
+	return w.num_chars;
+}
@@ -0,0 +1,63 @@
+#include "gpu_lib_permutations.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+// Kernel permutations
+// ------------------------------------------------------------------------------------------------
+
+u32 permutationKeyPack(const u32* axis_num_values, u32 num_axes, const u32* axis_values)
+{
+	u32 key = 0;
+	u32 stride = 1;
+	for (u32 i = 0; i < num_axes; i++) {
+		if (axis_values[i] >= axis_num_values[i]) return U32_MAX;
+		key += axis_values[i] * stride;
+		stride *= axis_num_values[i];
+	}
+	return key;
+}
+
+void permutationKeyUnpack(const u32* axis_num_values, u32 num_axes, u32 key, u32* axis_values_out)
+{
+	for (u32 i = 0; i < num_axes; i++) {
+		axis_values_out[i] = key % axis_num_values[i];
+		key /= axis_num_values[i];
+	}
+}
+
+bool permutationAxesValidate(
+	const GpuKernelAxis* axes, u32 num_axes, u32 num_defines, u32* num_permutations_out)
+{
+	if (num_axes > GPU_KERNEL_MAX_NUM_AXES) {
+		printf("[gpu_lib]: Too many permutation axes (%u), max %u allowed.\n", num_axes, GPU_KERNEL_MAX_NUM_AXES);
+		return false;
+	}
+	if ((num_defines + num_axes) > GPU_KERNEL_MAX_NUM_DEFINES) {
+		printf("[gpu_lib]: Too many defines + permutation axes (%u), max %u allowed.\n",
+			num_defines + num_axes, GPU_KERNEL_MAX_NUM_DEFINES);
+		return false;
+	}
+
+	u64 num_permutations = 1;
+	for (u32 i = 0; i < num_axes; i++) {
+		const GpuKernelAxis& axis = axes[i];
+		if (axis.num_values < 2) {
+			printf("[gpu_lib]: Permutation axis \"%s\" must have at least 2 values.\n", axis.name);
+			return false;
+		}
+		if (strlen(axis.name) > GPU_KERNEL_AXIS_NAME_MAX_LEN) {
+			printf("[gpu_lib]: Permutation axis name \"%s\" is too long, max %u characters allowed.\n",
+				axis.name, GPU_KERNEL_AXIS_NAME_MAX_LEN);
+			return false;
+		}
+		// Checked per axis so the product can't overflow
+		num_permutations *= axis.num_values;
+		if (num_permutations > GPU_KERNEL_MAX_NUM_PERMUTATIONS) {
+			printf("[gpu_lib]: Too many permutations, max %u allowed.\n", GPU_KERNEL_MAX_NUM_PERMUTATIONS);
+			return false;
+		}
+	}
+	*num_permutations_out = u32(num_permutations);
+	return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef GPU_LIB_PERMUTATIONS_HPP
+#define GPU_LIB_PERMUTATIONS_HPP
+
+#include <gpu_lib.h>
+
+// Kernel permutations
+// ------------------------------------------------------------------------------------------------
+
+// Backend independent parts of the kernel permutations API, shared with gpu_lib_kernelc. Tested in
+// tests/gpu_lib_permutations_tests.cpp.
+
+// Packs one value per axis into a key in mixed radix, first axis least significant. Returns U32_MAX
+// if any value is out of range.
+u32 permutationKeyPack(const u32* axis_num_values, u32 num_axes, const u32* axis_values);
+
+// Inverse of permutationKeyPack(), key must be less than the number of permutations.
+void permutationKeyUnpack(const u32* axis_num_values, u32 num_axes, u32 key, u32* axis_values_out);
+
+// Validates the axes of a GpuKernelPermutationsDesc with num_defines common defines, prints why and
+// returns false if they are invalid. Otherwise returns true and the number of permutations.
+bool permutationAxesValidate(
+	const GpuKernelAxis* axes, u32 num_axes, u32 num_defines, u32* num_permutations_out);
+
+#endif
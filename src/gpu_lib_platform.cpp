@@ -0,0 +1,386 @@
+#include "gpu_lib_platform.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sfz_defer.hpp>
+
+#ifdef _WIN32
+
+// Windows.h
+#pragma warning(push, 0)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#pragma warning(pop)
+
+#else
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#endif
+
+#ifdef _WIN32
+
+// Windows helpers
+// ------------------------------------------------------------------------------------------------
+
+sfz_struct(GpuWidePath) {
+	wchar_t str[320];
+};
+
+static GpuWidePath widen(const char* utf8)
+{
+	GpuWidePath wide = {};
+	MultiByteToWideChar(CP_UTF8, 0, utf8, -1, wide.str, 320);
+	return wide;
+}
+
+static u64 fromFileTime(FILETIME time)
+{
+	return (u64(time.dwHighDateTime) << 32) | u64(time.dwLowDateTime);
+}
+
+static FILETIME toFileTime(u64 time)
+{
+	FILETIME file_time = {};
+	file_time.dwLowDateTime = DWORD(time);
+	file_time.dwHighDateTime = DWORD(time >> 32);
+	return file_time;
+}
+
+static bool writeAll(HANDLE h_file, const void* data, u64 num_bytes)
+{
+	DWORD num_written = 0;
+	return WriteFile(h_file, data, DWORD(num_bytes), &num_written, nullptr) && num_written == num_bytes;
+}
+
+// Files
+// ------------------------------------------------------------------------------------------------
+
+bool fileReadAll(const char* path, SfzAllocator* allocator, SfzArray<u8>& out)
+{
+	const GpuWidePath path_w = widen(path);
+	const DWORD share_mode = FILE_SHARE_READ | FILE_SHARE_DELETE; // Allow others to delete while we read
+	HANDLE h_file = CreateFileW(
+		path_w.str, GENERIC_READ, share_mode, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (h_file == INVALID_HANDLE_VALUE) return false;
+	sfz_defer[=]() { CloseHandle(h_file); };
+
+	LARGE_INTEGER size = {};
+	if (!GetFileSizeEx(h_file, &size)) return false;
+	if (size.QuadPart > LONGLONG(U32_MAX)) return false;
+	const u32 num_bytes = u32(size.QuadPart);
+	out.init(num_bytes, allocator, sfz_dbg("fileReadAll"));
+	out.hackSetSize(num_bytes);
+	DWORD num_read = 0;
+	if (!ReadFile(h_file, out.data(), num_bytes, &num_read, nullptr) || num_read != num_bytes) {
+		out.destroy();
+		return false;
+	}
+	return true;
+}
+
+bool writeFileAtomic(const char* path, const void* const* parts, const u64* part_sizes, u32 num_parts)
+{
+	SfzStr320 tmp_path = {};
+	sfzStr320Appendf(&tmp_path, "%s.%u.%u.tmp", path, GetCurrentProcessId(), GetCurrentThreadId());
+	const GpuWidePath path_w = widen(path);
+	const GpuWidePath tmp_path_w = widen(tmp_path.str);
+	{
+		HANDLE h_file = CreateFileW(
+			tmp_path_w.str, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h_file == INVALID_HANDLE_VALUE) {
+			printf("[gpu_lib]: Failed to create file \"%s\", reason: %s\n", tmp_path.str, platformLastErrorStr().str);
+			return false;
+		}
+		bool success = true;
+		for (u32 i = 0; i < num_parts && success; i++) {
+			if (part_sizes[i] == 0) continue;
+			success = writeAll(h_file, parts[i], part_sizes[i]);
+		}
+		CloseHandle(h_file);
+		if (!success) {
+			printf("[gpu_lib]: Failed to write file \"%s\"\n", tmp_path.str);
+			DeleteFileW(tmp_path_w.str);
+			return false;
+		}
+	}
+	if (!MoveFileExW(tmp_path_w.str, path_w.str, MOVEFILE_REPLACE_EXISTING)) {
+		// Most likely another process is reading the same file. For cache entries this means it's
+		// already there.
+		DeleteFileW(tmp_path_w.str);
+		return false;
+	}
+	return true;
+}
+
+u64 fileLastWriteTime(const char* path)
+{
+	const GpuWidePath path_w = widen(path);
+	WIN32_FILE_ATTRIBUTE_DATA attribs = {};
+	if (!GetFileAttributesExW(path_w.str, GetFileExInfoStandard, &attribs)) return 0;
+	return fromFileTime(attribs.ftLastWriteTime);
+}
+
+bool fileSetLastWriteTime(const char* path, u64 time)
+{
+	const GpuWidePath path_w = widen(path);
+	const DWORD share_mode = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+	HANDLE h_file = CreateFileW(
+		path_w.str, FILE_WRITE_ATTRIBUTES, share_mode, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (h_file == INVALID_HANDLE_VALUE) return false;
+	const FILETIME file_time = toFileTime(time);
+	const bool success = SetFileTime(h_file, nullptr, nullptr, &file_time) != FALSE;
+	CloseHandle(h_file);
+	return success;
+}
+
+u64 fileTimeNow()
+{
+	FILETIME now = {};
+	GetSystemTimeAsFileTime(&now);
+	return fromFileTime(now);
+}
+
+bool fileSize(const char* path, u64* size_out)
+{
+	const GpuWidePath path_w = widen(path);
+	WIN32_FILE_ATTRIBUTE_DATA attribs = {};
+	if (!GetFileAttributesExW(path_w.str, GetFileExInfoStandard, &attribs)) return false;
+	*size_out = (u64(attribs.nFileSizeHigh) << 32) | u64(attribs.nFileSizeLow);
+	return true;
+}
+
+bool fileDelete(const char* path)
+{
+	const GpuWidePath path_w = widen(path);
+	return DeleteFileW(path_w.str) != FALSE;
+}
+
+bool dirCreate(const char* path)
+{
+	const GpuWidePath path_w = widen(path);
+	return CreateDirectoryW(path_w.str, nullptr) != FALSE || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+void dirListFiles(const char* dir, const char* extension, SfzArray<GpuFileInfo>& out)
+{
+	SfzStr320 pattern = {};
+	sfzStr320Appendf(&pattern, "%s/*%s", dir, extension);
+	const GpuWidePath pattern_w = widen(pattern.str);
+	WIN32_FIND_DATAW find_data = {};
+	HANDLE h_find = FindFirstFileW(pattern_w.str, &find_data);
+	if (h_find == INVALID_HANDLE_VALUE) return;
+	do {
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+		GpuFileInfo& info = out.add();
+		char name[MAX_PATH] = {};
+		WideCharToMultiByte(CP_UTF8, 0, find_data.cFileName, -1, name, MAX_PATH, nullptr, nullptr);
+		sfzStr320Appendf(&info.path, "%s/%s", dir, name);
+		info.size_bytes = (u64(find_data.nFileSizeHigh) << 32) | u64(find_data.nFileSizeLow);
+		info.last_write_time = fromFileTime(find_data.ftLastWriteTime);
+	} while (FindNextFileW(h_find, &find_data));
+	FindClose(h_find);
+}
+
+SfzStr320 platformLastErrorStr()
+{
+	wchar_t err_wide[320] = {};
+	FormatMessageW(
+		FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+		nullptr,
+		GetLastError(),
+		MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), err_wide, 320, nullptr);
+	SfzStr320 err = {};
+	WideCharToMultiByte(CP_UTF8, 0, err_wide, -1, err.str, sizeof(err.str), nullptr, nullptr);
+	return err;
+}
+
+// Time
+// ------------------------------------------------------------------------------------------------
+
+f64 timeNowMs()
+{
+	static const f64 ms_per_tick = []() {
+		LARGE_INTEGER freq = {};
+		QueryPerformanceFrequency(&freq);
+		return 1000.0 / f64(freq.QuadPart);
+	}();
+	LARGE_INTEGER now = {};
+	QueryPerformanceCounter(&now);
+	return f64(now.QuadPart) * ms_per_tick;
+}
+
+// Locks
+// ------------------------------------------------------------------------------------------------
+
+sfz_static_assert(sizeof(GpuRWLock) == sizeof(SRWLOCK));
+
+static SRWLOCK* srw(GpuRWLock* lock) { return reinterpret_cast<SRWLOCK*>(&lock->srw); }
+
+void rwLockInit(GpuRWLock* lock) { InitializeSRWLock(srw(lock)); }
+void rwLockAcquireShared(GpuRWLock* lock) { AcquireSRWLockShared(srw(lock)); }
+void rwLockReleaseShared(GpuRWLock* lock) { ReleaseSRWLockShared(srw(lock)); }
+void rwLockAcquireExclusive(GpuRWLock* lock) { AcquireSRWLockExclusive(srw(lock)); }
+void rwLockReleaseExclusive(GpuRWLock* lock) { ReleaseSRWLockExclusive(srw(lock)); }
+
+#else
+
+// POSIX helpers
+// ------------------------------------------------------------------------------------------------
+
+static u64 fromTimespec(timespec time)
+{
+	return u64(time.tv_sec) * 1000000000ull + u64(time.tv_nsec);
+}
+
+static bool writeAll(FILE* file, const void* data, u64 num_bytes)
+{
+	return fwrite(data, 1, num_bytes, file) == num_bytes;
+}
+
+// Files
+// ------------------------------------------------------------------------------------------------
+
+bool fileReadAll(const char* path, SfzAllocator* allocator, SfzArray<u8>& out)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr) return false;
+	sfz_defer[=]() { fclose(file); };
+
+	struct stat st = {};
+	if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+	if (u64(st.st_size) > u64(U32_MAX)) return false;
+	const u32 num_bytes = u32(st.st_size);
+	out.init(num_bytes, allocator, sfz_dbg("fileReadAll"));
+	out.hackSetSize(num_bytes);
+	if (num_bytes != 0 && fread(out.data(), 1, num_bytes, file) != num_bytes) {
+		out.destroy();
+		return false;
+	}
+	return true;
+}
+
+bool writeFileAtomic(const char* path, const void* const* parts, const u64* part_sizes, u32 num_parts)
+{
+	SfzStr320 tmp_path = {};
+	sfzStr320Appendf(&tmp_path, "%s.%u.%u.tmp", path, u32(getpid()), u32(u64(pthread_self())));
+	{
+		FILE* file = fopen(tmp_path.str, "wb");
+		if (file == nullptr) {
+			printf("[gpu_lib]: Failed to create file \"%s\", reason: %s\n", tmp_path.str, platformLastErrorStr().str);
+			return false;
+		}
+		bool success = true;
+		for (u32 i = 0; i < num_parts && success; i++) {
+			if (part_sizes[i] == 0) continue;
+			success = writeAll(file, parts[i], part_sizes[i]);
+		}
+		success = fclose(file) == 0 && success;
+		if (!success) {
+			printf("[gpu_lib]: Failed to write file \"%s\"\n", tmp_path.str);
+			unlink(tmp_path.str);
+			return false;
+		}
+	}
+	if (rename(tmp_path.str, path) != 0) {
+		unlink(tmp_path.str);
+		return false;
+	}
+	return true;
+}
+
+u64 fileLastWriteTime(const char* path)
+{
+	struct stat st = {};
+	if (stat(path, &st) != 0) return 0;
+	return fromTimespec(st.st_mtim);
+}
+
+bool fileSetLastWriteTime(const char* path, u64 time)
+{
+	timespec times[2] = {};
+	times[0].tv_nsec = UTIME_OMIT; // Access time
+	times[1].tv_sec = time_t(time / 1000000000ull);
+	times[1].tv_nsec = long(time % 1000000000ull);
+	return utimensat(AT_FDCWD, path, times, 0) == 0;
+}
+
+u64 fileTimeNow()
+{
+	timespec now = {};
+	clock_gettime(CLOCK_REALTIME, &now);
+	return fromTimespec(now);
+}
+
+bool fileSize(const char* path, u64* size_out)
+{
+	struct stat st = {};
+	if (stat(path, &st) != 0) return false;
+	*size_out = u64(st.st_size);
+	return true;
+}
+
+bool fileDelete(const char* path)
+{
+	return unlink(path) == 0;
+}
+
+bool dirCreate(const char* path)
+{
+	return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+void dirListFiles(const char* dir, const char* extension, SfzArray<GpuFileInfo>& out)
+{
+	DIR* d = opendir(dir);
+	if (d == nullptr) return;
+	const size_t extension_len = strlen(extension);
+	while (const dirent* entry = readdir(d)) {
+		const size_t name_len = strlen(entry->d_name);
+		if (name_len < extension_len) continue;
+		if (strcmp(entry->d_name + name_len - extension_len, extension) != 0) continue;
+		GpuFileInfo info = {};
+		sfzStr320Appendf(&info.path, "%s/%s", dir, entry->d_name);
+		struct stat st = {};
+		if (stat(info.path.str, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+		info.size_bytes = u64(st.st_size);
+		info.last_write_time = fromTimespec(st.st_mtim);
+		out.add(info);
+	}
+	closedir(d);
+}
+
+SfzStr320 platformLastErrorStr()
+{
+	SfzStr320 err = {};
+	sfzStr320Appendf(&err, "%s", strerror(errno));
+	return err;
+}
+
+// Time
+// ------------------------------------------------------------------------------------------------
+
+f64 timeNowMs()
+{
+	timespec now = {};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return f64(now.tv_sec) * 1000.0 + f64(now.tv_nsec) * 1e-6;
+}
+
+// Locks
+// ------------------------------------------------------------------------------------------------
+
+void rwLockInit(GpuRWLock* lock) { pthread_rwlock_init(&lock->rw, nullptr); }
+void rwLockAcquireShared(GpuRWLock* lock) { pthread_rwlock_rdlock(&lock->rw); }
+void rwLockReleaseShared(GpuRWLock* lock) { pthread_rwlock_unlock(&lock->rw); }
+void rwLockAcquireExclusive(GpuRWLock* lock) { pthread_rwlock_wrlock(&lock->rw); }
+void rwLockReleaseExclusive(GpuRWLock* lock) { pthread_rwlock_unlock(&lock->rw); }
+
+#endif
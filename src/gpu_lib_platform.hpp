@@ -0,0 +1,91 @@
+#pragma once
+#ifndef GPU_LIB_PLATFORM_HPP
+#define GPU_LIB_PLATFORM_HPP
+
+#include <gpu_lib.h>
+
+#include <sfz_cpp.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_strings.hpp>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+// Platform
+// ------------------------------------------------------------------------------------------------
+
+// The few OS services the backend independent parts of gpu_lib need (files, directories, time and
+// locks), implemented with Win32 on Windows and POSIX everywhere else. This is what lets the kernel
+// cache be built and tested on Linux. All paths are UTF-8.
+
+// Files
+// ------------------------------------------------------------------------------------------------
+
+// File times are in platform specific units (100ns on Windows, 1ns on POSIX) and should only be
+// compared with each other. 0 is never a valid time.
+
+sfz_struct(GpuFileInfo) {
+	SfzStr320 path;
+	u64 size_bytes;
+	u64 last_write_time;
+};
+
+// Reads an entire file without printing anything on failure, a missing file is often an expected
+// outcome. Other processes may delete the file while it's being read.
+bool fileReadAll(const char* path, SfzAllocator* allocator, SfzArray<u8>& out);
+
+// Writes the parts to a temporary file unique to this process and thread, then atomically renames
+// it. Other processes will either see the complete file or no file at all.
+bool writeFileAtomic(const char* path, const void* const* parts, const u64* part_sizes, u32 num_parts);
+
+// Returns the last write time of a file, 0 if it doesn't exist.
+u64 fileLastWriteTime(const char* path);
+
+// Sets the last write time of a file, returns false on failure.
+bool fileSetLastWriteTime(const char* path, u64 time);
+
+// The current time, in the same units as file times.
+u64 fileTimeNow();
+
+// Returns the size of a file, or false if it doesn't exist.
+bool fileSize(const char* path, u64* size_out);
+
+// Deletes a file, returns false on failure (e.g. another process has it open on Windows).
+bool fileDelete(const char* path);
+
+// Creates a directory, returns true if it was created or already exists.
+bool dirCreate(const char* path);
+
+// Lists the files (not directories) in a directory whose names end with the given extension,
+// e.g. ".gkc". Paths are "<dir>/<name>".
+void dirListFiles(const char* dir, const char* extension, SfzArray<GpuFileInfo>& out);
+
+// A description of the last error of the calling thread, for log messages.
+SfzStr320 platformLastErrorStr();
+
+// Time
+// ------------------------------------------------------------------------------------------------
+
+// A monotonic clock in milliseconds, for measuring durations. The epoch is unspecified.
+f64 timeNowMs();
+
+// Locks
+// ------------------------------------------------------------------------------------------------
+
+// A reader-writer lock, an SRWLOCK on Windows. Doesn't need to be destroyed.
+sfz_struct(GpuRWLock) {
+#ifdef _WIN32
+	void* srw; // SRWLOCK is a single pointer
+#else
+	pthread_rwlock_t rw;
+#endif
+};
+
+void rwLockInit(GpuRWLock* lock);
+void rwLockAcquireShared(GpuRWLock* lock);
+void rwLockReleaseShared(GpuRWLock* lock);
+void rwLockAcquireExclusive(GpuRWLock* lock);
+void rwLockReleaseExclusive(GpuRWLock* lock);
+
+#endif // GPU_LIB_PLATFORM_HPP
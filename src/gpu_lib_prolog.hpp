@@ -0,0 +1,171 @@
+#pragma once
+#ifndef GPU_LIB_PROLOG_HPP
+#define GPU_LIB_PROLOG_HPP
+
+#include <gpu_lib.h>
+
+// Kernel prolog
+// ------------------------------------------------------------------------------------------------
+
+// Number of typed views (register spaces) the rwtex array descriptor table is exposed as.
+constexpr u32 GPU_RWTEX_ARRAY_NUM_TYPED_VIEWS = 5;
+
+// Prepended to the source of every kernel. Backend independent text, so its declarations can be
+// checked on Linux. The ptr*() memory helpers have a CPU reference in tests/gpu_lib_prolog_ref.hpp,
+// both are tested in tests/gpu_lib_prolog_tests.cpp. Keep the two in sync when changing their
+// semantics.
+constexpr char GPU_KERNEL_PROLOG[] = R"(
+
+// Some macros that can be used to check if code is being compiled with GPU_LIB
+#define GPU_LIB
+#define GPU_HLSL
+
+// Other macros and constants
+#define static_assert(cond, msg) _Static_assert((cond), (msg))
+
+// Root signature
+RWByteAddressBuffer gpu_global_heap : register(u0);
+
+// Launch parameters are root constants at b0 (the default register of a kernel's single cbuffer).
+// Params larger than GPU_LAUNCH_PARAMS_MAX_SIZE are placed in the upload heap by gpuQueueDispatch()
+// and bound to b1. The compiler moves cbuffers declared without a register there automatically,
+// GPU_LARGE_LAUNCH_PARAMS can be used to do it explicitly. Large params declared with an explicit
+// register(b0) are a compile error.
+#define GPU_LARGE_LAUNCH_PARAMS register(b1)
+RWTexture2D<float4> gpu_rwtex_array[] : register(u1, space0);
+
+// Typed aliases of the rwtex array, they all point to the same descriptors as gpu_rwtex_array.
+//
+// Which view to use depends on the format of the texture:
+// * *_UNORM, *_F16, *_F32: float4 (getRWTex())
+// * R_U8, RG_U8, RGBA_U8, R_U16, RG_U16, RGBA_U16: uint4 (getRWTexU()) or uint (getRWTexU1())
+// * R_I32, RG_I32, RGBA_I32: int4 (getRWTexI()) or int (getRWTexI1())
+//
+// Atomics (InterlockedMin(), InterlockedMax(), etc) are only available on R_I32 textures through
+// the scalar int view, i.e. getRWTexI1().
+RWTexture2D<uint4> gpu_rwtex_array_u[] : register(u1, space1);
+RWTexture2D<int4> gpu_rwtex_array_i[] : register(u1, space2);
+RWTexture2D<uint> gpu_rwtex_array_u1[] : register(u1, space3);
+RWTexture2D<int> gpu_rwtex_array_i1[] : register(u1, space4);
+
+// Textures
+typedef uint16_t GpuRWTex;
+static const GpuRWTex GPU_NULL_RWTEX = 0;
+static const GpuRWTex RWTEX_SWAPCHAIN_IDX = 1;
+
+RWTexture2D<float4> getSwapchainRWTex() { return gpu_rwtex_array[RWTEX_SWAPCHAIN_IDX]; }
+RWTexture2D<float4> getRWTex(GpuRWTex idx) { return gpu_rwtex_array[NonUniformResourceIndex(idx)]; }
+RWTexture2D<float4> getRWTex(GpuRWTex idx, out int2 tex_res)
+{
+	RWTexture2D<float4> tex = getRWTex(idx);
+	uint w = 0, h = 0;
+	tex.GetDimensions(w, h);
+	tex_res = int2(w, h);
+	return tex;
+}
+
+RWTexture2D<uint4> getRWTexU(GpuRWTex idx) { return gpu_rwtex_array_u[NonUniformResourceIndex(idx)]; }
+RWTexture2D<int4> getRWTexI(GpuRWTex idx) { return gpu_rwtex_array_i[NonUniformResourceIndex(idx)]; }
+RWTexture2D<uint> getRWTexU1(GpuRWTex idx) { return gpu_rwtex_array_u1[NonUniformResourceIndex(idx)]; }
+RWTexture2D<int> getRWTexI1(GpuRWTex idx) { return gpu_rwtex_array_i1[NonUniformResourceIndex(idx)]; }
+
+// Pointer type (matches GpuPtr on CPU)
+typedef uint GpuPtr;
+static const GpuPtr GPU_NULLPTR = 0;
+
+uint ptrLoadByte(GpuPtr ptr)
+{
+	const uint word_address = ptr & 0xFFFFFFFC;
+	const uint word = gpu_global_heap.Load<uint>(word_address);
+	const uint byte_address = ptr & 0x00000003;
+	const uint byte_shift = byte_address * 8;
+	const uint byte = (word >> byte_shift) & 0x000000FF;
+	return byte;
+}
+
+template<typename T>
+T ptrLoad(GpuPtr ptr) { return gpu_global_heap.Load<T>(ptr); }
+
+template<typename T>
+T ptrLoadArrayElem(GpuPtr ptr, uint idx) { return gpu_global_heap.Load<T>(ptr + idx * sizeof(T)); }
+
+template<typename T>
+void ptrStore(GpuPtr ptr, T val) { gpu_global_heap.Store<T>(ptr, val); }
+
+template<typename T>
+void ptrStoreArrayElem(GpuPtr ptr, T val, uint idx) { gpu_global_heap.Store<T>(ptr + idx * sizeof(T), val); }
+
+// ptr must be 2 byte aligned
+uint ptrLoadU16(GpuPtr ptr)
+{
+	const uint word = gpu_global_heap.Load<uint>(ptr & 0xFFFFFFFC);
+	const uint half_shift = (ptr & 0x00000002) * 8;
+	return (word >> half_shift) & 0x0000FFFF;
+}
+
+// Vectorized 16 byte loads and stores, ptr must be 4 byte aligned (16 byte aligned is faster)
+uint4 ptrLoad4(GpuPtr ptr) { return gpu_global_heap.Load4(ptr); }
+void ptrStore4(GpuPtr ptr, uint4 val) { gpu_global_heap.Store4(ptr, val); }
+
+// Atomics
+//
+// All atomics return the value at ptr before the operation. ptr must be 4 byte aligned for 32-bit
+// atomics and 8 byte aligned for 64-bit atomics. Min and max are unsigned, use the *I() versions
+// for signed. Add wraps around the same way for both, so there is no signed version.
+uint ptrAtomicAdd(GpuPtr ptr, uint val) { uint orig; gpu_global_heap.InterlockedAdd(ptr, val, orig); return orig; }
+uint ptrAtomicMin(GpuPtr ptr, uint val) { uint orig; gpu_global_heap.InterlockedMin(ptr, val, orig); return orig; }
+int ptrAtomicMinI(GpuPtr ptr, int val) { int orig; gpu_global_heap.InterlockedMin(ptr, val, orig); return orig; }
+uint ptrAtomicMax(GpuPtr ptr, uint val) { uint orig; gpu_global_heap.InterlockedMax(ptr, val, orig); return orig; }
+int ptrAtomicMaxI(GpuPtr ptr, int val) { int orig; gpu_global_heap.InterlockedMax(ptr, val, orig); return orig; }
+uint ptrAtomicExchange(GpuPtr ptr, uint val) { uint orig; gpu_global_heap.InterlockedExchange(ptr, val, orig); return orig; }
+uint ptrAtomicCompareExchange(GpuPtr ptr, uint compare, uint val)
+{
+	uint orig;
+	gpu_global_heap.InterlockedCompareExchange(ptr, compare, val, orig);
+	return orig;
+}
+
+uint64_t ptrAtomicAdd64(GpuPtr ptr, uint64_t val) { uint64_t orig; gpu_global_heap.InterlockedAdd64(ptr, val, orig); return orig; }
+uint64_t ptrAtomicMin64(GpuPtr ptr, uint64_t val) { uint64_t orig; gpu_global_heap.InterlockedMin64(ptr, val, orig); return orig; }
+int64_t ptrAtomicMinI64(GpuPtr ptr, int64_t val) { int64_t orig; gpu_global_heap.InterlockedMin64(ptr, val, orig); return orig; }
+uint64_t ptrAtomicMax64(GpuPtr ptr, uint64_t val) { uint64_t orig; gpu_global_heap.InterlockedMax64(ptr, val, orig); return orig; }
+int64_t ptrAtomicMaxI64(GpuPtr ptr, int64_t val) { int64_t orig; gpu_global_heap.InterlockedMax64(ptr, val, orig); return orig; }
+uint64_t ptrAtomicExchange64(GpuPtr ptr, uint64_t val) { uint64_t orig; gpu_global_heap.InterlockedExchange64(ptr, val, orig); return orig; }
+uint64_t ptrAtomicCompareExchange64(GpuPtr ptr, uint64_t compare, uint64_t val)
+{
+	uint64_t orig;
+	gpu_global_heap.InterlockedCompareExchange64(ptr, compare, val, orig);
+	return orig;
+}
+
+// Wave-aggregated atomics, a single atomic per wave instead of one per lane. Only the active lanes
+// take part, lanes that shouldn't contribute must call with a value of 0 rather than branch around.
+//
+// Same result as if each active lane called ptrAtomicAdd() in lane order, i.e. each lane gets the
+// value at ptr before its own addition.
+uint ptrAtomicAddWave(GpuPtr ptr, uint val)
+{
+	const uint wave_sum = WaveActiveSum(val);
+	const uint lane_offset = WavePrefixSum(val);
+	uint wave_base = 0;
+	if (WaveIsFirstLane()) gpu_global_heap.InterlockedAdd(ptr, wave_sum, wave_base);
+	return WaveReadLaneFirst(wave_base) + lane_offset;
+}
+
+// Appends to an array, counter_ptr points to the u32 number of elements. Returns the index this lane
+// should write its element to, unique for each lane that appends. Lanes where append is false get
+// U32_MAX (0xFFFFFFFF). E.g.:
+//
+//     const uint idx = ptrAppendWave(count_ptr, visible);
+//     if (visible) ptrStoreArrayElem<uint>(array_ptr, tile_idx, idx);
+uint ptrAppendWave(GpuPtr counter_ptr, bool append)
+{
+	const uint idx = ptrAtomicAddWave(counter_ptr, append ? 1 : 0);
+	return append ? idx : 0xFFFFFFFF;
+}
+
+)";
+
+constexpr u32 GPU_KERNEL_PROLOG_SIZE = sizeof(GPU_KERNEL_PROLOG) - 1; // -1 because null-terminator
+
+#endif
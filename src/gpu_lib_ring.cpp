@@ -0,0 +1,36 @@
+#include "gpu_lib_ring.hpp"
+
+#include <stdio.h>
+
+// Heap ring
+// ------------------------------------------------------------------------------------------------
+
+bool heapRingAlloc(GpuHeapRing* ring, const char* name, u32 num_bytes, u32 align, u64* begin_mapped_out)
+{
+	if (ring->size < num_bytes) {
+		printf("[gpu_lib]: %s heap allocation of %u bytes is larger than the heap (%llu bytes)\n",
+			name, num_bytes, ring->size);
+		return false;
+	}
+
+	// Try to allocate a range
+	u64 begin = sfzRoundUpAlignedU64(ring->offset, align);
+	u64 begin_mapped = begin % ring->size;
+	if (ring->size < (begin_mapped + num_bytes)) {
+		// Wrap around, try in beginning of heap instead.
+		begin = sfzRoundUpAlignedU64(ring->offset, ring->size);
+		begin_mapped = 0;
+	}
+	const u64 end = begin + num_bytes;
+
+	// Check for heap overflow
+	if (ring->safe_offset < end) {
+		printf("[gpu_lib]: %s heap overflow by %llu bytes\n", name, end - ring->safe_offset);
+		return false;
+	}
+
+	// Commit change
+	ring->offset = end;
+	*begin_mapped_out = begin_mapped;
+	return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#ifndef GPU_LIB_RING_HPP
+#define GPU_LIB_RING_HPP
+
+#include <gpu_lib.h>
+
+#include <sfz_cpp.hpp>
+
+// Ring buffers
+// ------------------------------------------------------------------------------------------------
+
+// The upload and download heaps are ring buffers shared by the num_concurrent_submits submits that
+// can be in flight, each command list is used by every num_concurrent_submits:th submit. Backend
+// independent so the offset arithmetic can be tested on Linux against a simulated fence, see
+// tests/gpu_lib_ring_tests.cpp.
+
+// Heap ring
+// ------------------------------------------------------------------------------------------------
+
+// Offsets only ever grow, the offset into the mapped heap is offset % size. Everything allocated
+// before safe_offset - size belongs to completed submits, so allocations may end at safe_offset at
+// the latest. safe_offset starts at 0, nothing can be allocated until the first submit has begun.
+sfz_struct(GpuHeapRing) {
+	u64 size;
+	u64 offset; // End of the last allocation
+	u64 safe_offset;
+};
+
+inline GpuHeapRing heapRingInit(u64 size)
+{
+	GpuHeapRing ring = {};
+	ring.size = size;
+	return ring;
+}
+
+// Allocates num_bytes aligned to align, wrapping around to the beginning of the heap instead of
+// splitting the range. Returns false and prints an error (name is the heap's, e.g. "Upload") if the
+// allocation is larger than the heap or would overwrite memory in use by in-flight submits.
+bool heapRingAlloc(GpuHeapRing* ring, const char* name, u32 num_bytes, u32 align, u64* begin_mapped_out);
+
+// Frees everything allocated before submit_end_offset, the heap's offset at the end of a submit
+// that has completed.
+inline void heapRingRetire(GpuHeapRing* ring, u64 submit_end_offset)
+{
+	ring->safe_offset = u64_max(ring->safe_offset, submit_end_offset + ring->size);
+}
+
+// Submit ring
+// ------------------------------------------------------------------------------------------------
+
+// The submit using a command list, stored with it.
+sfz_struct(GpuSubmitSlot) {
+	u64 submit_idx;
+	u64 fence_value; // Signalled once the submit has completed
+	u64 upload_heap_offset; // Heap offsets at the end of the submit
+	u64 download_heap_offset;
+};
+
+inline u32 submitSlotIdx(u64 submit_idx, u32 num_concurrent_submits)
+{
+	return u32(submit_idx % num_concurrent_submits);
+}
+
+// Called when the slot's submit is submitted, fence_value is signalled once it has completed.
+inline void submitSlotEnd(GpuSubmitSlot* slot, u64 fence_value, const GpuHeapRing& upload, const GpuHeapRing& download)
+{
+	slot->fence_value = fence_value;
+	slot->upload_heap_offset = upload.offset;
+	slot->download_heap_offset = download.offset;
+}
+
+// Called once the slot's previous submit has completed (its fence value has been reached), before
+// submit_idx starts using the slot. Frees the heap ranges of the previous submit.
+inline void submitSlotBegin(GpuSubmitSlot* slot, u64 submit_idx, GpuHeapRing* upload, GpuHeapRing* download)
+{
+	heapRingRetire(upload, slot->upload_heap_offset);
+	heapRingRetire(download, slot->download_heap_offset);
+	slot->submit_idx = submit_idx;
+}
+
+// Whether starting the next submit in the slot would have to wait for the GPU.
+inline bool submitSlotInFlight(const GpuSubmitSlot& slot, u64 completed_fence_value)
+{
+	return completed_fence_value < slot.fence_value;
+}
+
+// Whether the (submitted) submit_idx is known to have completed without checking the fence: its
+// slot has been reused by a later submit, which only begins once the slot's previous submit is done.
+inline bool submitSlotReused(const GpuSubmitSlot& slot, u64 submit_idx)
+{
+	return slot.submit_idx != submit_idx;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#include "gpu_lib_sync_ops.hpp"
+
+// Queue sync ops
+// ------------------------------------------------------------------------------------------------
+
+static void issueExecute(u32 first_list, u32 end_list, GpuSyncStepFunc* func, void* user)
+{
+	if (end_list <= first_list) return;
+	GpuSyncStep step = {};
+	step.type = GPU_SYNC_STEP_EXECUTE;
+	step.first_list = first_list;
+	step.num_lists = end_list - first_list;
+	func(user, step);
+}
+
+GpuSyncOpsIssued syncOpsIssue(const GpuQueueSyncOp* ops, u32 num_ops, u32 num_lists, u64 max_wait_value,
+	GpuSyncStepFunc* func, void* user)
+{
+	GpuSyncOpsIssued issued = {};
+	for (u32 i = 0; i < num_ops; i++) {
+		const GpuQueueSyncOp& op = ops[i];
+		sfz_assert(issued.num_lists <= op.exec_list_idx && op.exec_list_idx <= num_lists);
+		issueExecute(issued.num_lists, op.exec_list_idx, func, user);
+		issued.num_lists = u32_max(issued.num_lists, op.exec_list_idx);
+		if (op.wait && max_wait_value < op.fence_value) break;
+
+		GpuSyncStep step = {};
+		step.type = op.wait ? GPU_SYNC_STEP_WAIT : GPU_SYNC_STEP_SIGNAL;
+		step.fence_value = op.fence_value;
+		func(user, step);
+		if (!op.wait) issued.last_signal_value = op.fence_value;
+		issued.num_ops += 1;
+	}
+
+	// Everything left after the last issued op can be executed unless it's behind a held wait
+	if (issued.num_ops == num_ops) {
+		issueExecute(issued.num_lists, num_lists, func, user);
+		issued.num_lists = num_lists;
+	}
+	return issued;
+}
+
+void syncOpsRemoveIssued(SfzArray<GpuQueueSyncOp>& ops, const GpuSyncOpsIssued& issued)
+{
+	if (issued.num_ops != 0) ops.remove(0, issued.num_ops);
+	for (GpuQueueSyncOp& op : ops) op.exec_list_idx -= issued.num_lists;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef GPU_LIB_SYNC_OPS_HPP
+#define GPU_LIB_SYNC_OPS_HPP
+
+#include <gpu_lib.h>
+
+#include <sfz_cpp.hpp>
+#include <skipifzero_arrays.hpp>
+
+// Queue sync ops
+// ------------------------------------------------------------------------------------------------
+
+// Work is queued to a command queue as an array of command lists and an array of cross-queue
+// signals and waits (sync ops) in between them, each op refers to the number of lists queued
+// before it. The backend issues them with syncOpsIssue(), which calls back with the native calls
+// in the order they have to be made. Backend independent so the issue order can be tested on Linux,
+// see tests/gpu_lib_sync_ops_tests.cpp.
+//
+// The main queue issues everything at submit. The async queue issues as soon as possible, but stops
+// at the first wait for a main queue signal that hasn't been submitted yet, the rest is held back
+// until a later call.
+
+// A cross-queue signal or wait, see gpuQueueSignal() and gpuQueueWait(). Executed after the first
+// exec_list_idx command lists queued before it.
+//
+// On the main queue: executed at submit. Waits for GpuLib::async_fence, otherwise signals
+// GpuLib::main_sync_fence. On the async queue: executed as soon as any waits for the main queue
+// before it can be, see asyncQueueIssue(). Waits for GpuLib::main_sync_fence, otherwise signals
+// GpuLib::async_fence.
+sfz_struct(GpuQueueSyncOp) {
+	u32 exec_list_idx;
+	bool wait;
+	u64 fence_value;
+};
+
+// Queues an op after the num_lists command lists queued so far.
+inline void syncOpsAdd(SfzArray<GpuQueueSyncOp>& ops, u32 num_lists, bool wait, u64 fence_value)
+{
+	GpuQueueSyncOp& op = ops.add();
+	op.exec_list_idx = num_lists;
+	op.wait = wait;
+	op.fence_value = fence_value;
+}
+
+enum GpuSyncStepType : u8 {
+	GPU_SYNC_STEP_EXECUTE = 0,
+	GPU_SYNC_STEP_WAIT,
+	GPU_SYNC_STEP_SIGNAL
+};
+
+// A native call to issue, ExecuteCommandLists(), Wait() or Signal().
+sfz_struct(GpuSyncStep) {
+	GpuSyncStepType type;
+	u32 first_list; // Execute, range of the queued command lists
+	u32 num_lists;
+	u64 fence_value; // Wait and signal
+};
+
+typedef void GpuSyncStepFunc(void* user, const GpuSyncStep& step);
+
+sfz_struct(GpuSyncOpsIssued) {
+	u32 num_lists;
+	u32 num_ops;
+	u64 last_signal_value; // 0 if no signal was issued
+};
+
+// Issues the queued lists and ops in order, up until the first wait for a value larger than
+// max_wait_value. The lists before that wait are still executed, the lists after the last op only
+// if every op was issued. Consecutive lists are executed with a single call, and ops with no lists
+// in between without empty ones.
+GpuSyncOpsIssued syncOpsIssue(const GpuQueueSyncOp* ops, u32 num_ops, u32 num_lists, u64 max_wait_value,
+	GpuSyncStepFunc* func, void* user);
+
+// Removes the issued ops, the remaining ops' list indices are made relative to the remaining lists.
+// The caller removes the issued lists from the front of its array.
+void syncOpsRemoveIssued(SfzArray<GpuQueueSyncOp>& ops, const GpuSyncOpsIssued& issued);
+
+#endif
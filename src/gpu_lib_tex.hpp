@@ -0,0 +1,113 @@
+#pragma once
+#ifndef GPU_LIB_TEX_HPP
+#define GPU_LIB_TEX_HPP
+
+#include <gpu_lib.h>
+
+#include <gpu_lib_bc.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <sfz_cpp.hpp>
+
+// Texture helpers
+// ------------------------------------------------------------------------------------------------
+
+// Backend independent parts of RWTex and swapchain management: the resolution of swapchain relative
+// textures, when the swapchain framebuffers are resized and the row layouts of texture copies.
+// Tested in tests/gpu_lib_tex_tests.cpp.
+
+// The number of presents the window resolution must stay unchanged before the actual swapchain
+// framebuffers are resized. Resizing them requires a flush, so we don't want to do it every frame
+// while the user is dragging the window.
+sfz_constant u32 GPU_SWAPCHAIN_RESIZE_NUM_STABLE_PRESENTS = 8;
+
+// Returns the resolution a RWTex should have given the current swapchain resolution.
+inline i32x2 calcRWTexTargetRes(i32x2 swapchain_res, const GpuRWTexDesc* desc)
+{
+	if (!desc->swapchain_relative) return desc->fixed_res;
+	i32x2 res = i32x2_splat(0);
+	if (desc->relative_fixed_height != 0) {
+		sfz_assert(0 < desc->relative_fixed_height && desc->relative_fixed_height <= 16384);
+		const f32 aspect = f32(swapchain_res.x) / f32(swapchain_res.y);
+		res.y = desc->relative_fixed_height;
+		res.x = i32(roundf(aspect * f32(res.y)));
+	}
+	else {
+		sfz_assert(0.0f < desc->relative_scale && desc->relative_scale <= 8.0f);
+		res.x = i32(roundf(desc->relative_scale * f32(swapchain_res.x)));
+		res.y = i32(roundf(desc->relative_scale * f32(swapchain_res.y)));
+	}
+	res.x = i32_max(res.x, 1);
+	res.y = i32_max(res.y, 1);
+	return res;
+}
+
+// Records the window resolution of a present. Returns true if it differs from the current swapchain
+// resolution (which is then updated), otherwise counts the present as stable.
+inline bool swapchainResUpdate(i32x2* swapchain_res, u32* num_stable_presents, i32x2 window_res)
+{
+	if (*swapchain_res != window_res) {
+		*swapchain_res = window_res;
+		*num_stable_presents = 0;
+		return true;
+	}
+	*num_stable_presents += 1;
+	return false;
+}
+
+// Whether the swapchain framebuffers should be resized to the swapchain resolution. Done once the
+// resolution has stabilized, or immediately the first time (fb_res is 0 before that).
+inline bool swapchainFbResizeDue(i32x2 fb_res, i32x2 swapchain_res, u32 num_stable_presents)
+{
+	if (fb_res == swapchain_res) return false;
+	const bool first_resize = fb_res == i32x2_splat(0);
+	const bool res_stable = num_stable_presents >= GPU_SWAPCHAIN_RESIZE_NUM_STABLE_PRESENTS;
+	return first_resize || res_stable;
+}
+
+// Texture rows
+// ------------------------------------------------------------------------------------------------
+
+// Rows of texture data in buffers (upload and download heaps) must start on this alignment.
+sfz_constant u32 GPU_TEXTURE_ROW_PITCH_ALIGN = 256;
+
+// The layout of a texture's rows when copied to or from a buffer. For block compressed formats a
+// row is a row of 4x4 blocks.
+sfz_struct(GpuTexRows) {
+	u32 row_size; // Bytes of data per row
+	u32 row_pitch; // Bytes between the start of each row in a buffer, row_size aligned
+	u32 num_rows;
+};
+
+inline GpuTexRows texRows(GpuFormat format, i32x2 res)
+{
+	sfz_assert(0 < res.x && 0 < res.y);
+	GpuTexRows rows = {};
+	if (gpuFormatIsBlockCompressed(format)) {
+		rows.row_size = u32((res.x + 3) / 4) * gpuBCBytesPerBlock(format);
+		rows.num_rows = u32((res.y + 3) / 4);
+	}
+	else {
+		rows.row_size = u32(res.x) * gpuFormatGetBytesPerPixel(format);
+		rows.num_rows = u32(res.y);
+	}
+	rows.row_pitch = sfzRoundUpAlignedU32(rows.row_size, GPU_TEXTURE_ROW_PITCH_ALIGN);
+	return rows;
+}
+
+// Copies rows between a tightly packed and a row pitched (e.g. for texture copies) layout.
+inline void copyRows(
+	u8* dst, u32 dst_pitch, const u8* src, u32 src_pitch, u32 row_size, u32 num_rows)
+{
+	if (dst_pitch == row_size && src_pitch == row_size) {
+		memcpy(dst, src, u64(row_size) * num_rows);
+		return;
+	}
+	for (u32 y = 0; y < num_rows; y++) {
+		memcpy(dst + u64(y) * dst_pitch, src + u64(y) * src_pitch, row_size);
+	}
+}
+
+#endif
@@ -48,7 +48,11 @@
 #define sfz_static_assert(cond)
 #endif
 
+#if defined(_MSC_VER)
 #define sfz_forceinline __forceinline
+#else
+#define sfz_forceinline inline __attribute__((always_inline))
+#endif
 
 #ifndef NULL
 #ifdef __cplusplus
@@ -258,6 +262,14 @@ sfz_extern_c SFZ_MATH_H_API float __cdecl floorf(float _X);
 sfz_extern_c SFZ_MATH_H_API float __cdecl ceilf(float _X);
 sfz_extern_c SFZ_MATH_H_API float __cdecl fmodf(float _X, float _Y);
 
+#elif defined(__GNUC__) || defined(__clang__)
+
+#include <math.h>
+
+#else
+#error "Not implemented for this compiler"
+#endif
+
 sfz_forceinline f32 sfz_sqrt(f32 x) { return sqrtf(x); }
 sfz_forceinline f32 sfz_cos(f32 x) { return cosf(x); }
 sfz_forceinline f32 sfz_sin(f32 x) { return sinf(x); }
@@ -266,10 +278,6 @@ sfz_forceinline f32 sfz_acos(f32 x) { return acosf(x); }
 sfz_forceinline f32 sfz_asin(f32 x) { return asinf(x); }
 sfz_forceinline f32 sfz_atan2(f32 y, f32 x) { return atan2f(y, x); }
 
-#else
-#error "Not implemented for this compiler
-#endif
-
 
 // Math functions
 // ------------------------------------------------------------------------------------------------
@@ -669,12 +677,22 @@ sfz_extern_c __declspec(dllimport) __declspec(noreturn) void __cdecl abort(void)
 sfz_extern_c __declspec(noreturn) void __cdecl abort(void);
 #endif
 sfz_extern_c void __cdecl __debugbreak(void);
+#define sfz_debugbreak() __debugbreak()
+
+#elif defined(__GNUC__) || defined(__clang__)
+
+#include <stdlib.h>
+#define sfz_debugbreak() __builtin_trap()
+
+#else
+#error "Not implemented for this compiler"
+#endif
 
 #ifndef NDEBUG
 #define sfz_assert(cond) \
 	do { \
 		if (!(cond)) { \
-			__debugbreak(); \
+			sfz_debugbreak(); \
 			volatile int assertDummyVal = 3; \
 			(void)assertDummyVal; \
 		} \
@@ -689,17 +707,13 @@ sfz_extern_c void __cdecl __debugbreak(void);
 #define sfz_assert_hard(cond) \
 	do { \
 		if (!(cond)) { \
-			__debugbreak(); \
+			sfz_debugbreak(); \
 			volatile int assertDummyVal = 3; \
 			(void)assertDummyVal; \
 			abort(); \
 		} \
 	} while(0)
 
-#else
-#error "Not implemented for this compiler"
-#endif
-
 
 // Forward declare memcpy(), memove() and memset()
 // ------------------------------------------------------------------------------------------------
@@ -710,6 +724,10 @@ sfz_extern_c void* __cdecl memcpy(void* _Dst, void const* _Src, u64 _Size);
 sfz_extern_c void* __cdecl memmove(void* _Dst, void const* _Src, u64 _Size);
 sfz_extern_c void* __cdecl memset(void* _Dst, i32 _Val, u64 _Size);
 
+#elif defined(__GNUC__) || defined(__clang__)
+
+#include <string.h>
+
 #else
 #error "Not implemented for this compiler"
 #endif
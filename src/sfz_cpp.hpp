@@ -58,8 +58,12 @@ inline void* operator new(u64, void* ptr) noexcept { return ptr; }
 inline void operator delete(void*, void*) noexcept { }
 #endif
 
+#elif defined(__GNUC__) || defined(__clang__)
+
+#include <new>
+
 #else
-#error "Not implemented for this compiler
+#error "Not implemented for this compiler"
 #endif
 
 // "new" and "delete" functions using sfz allocators
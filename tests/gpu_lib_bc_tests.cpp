@@ -0,0 +1,189 @@
+#include "gpu_lib_tests.hpp"
+
+#include <string.h>
+
+#include <skipifzero_allocators.hpp>
+#include <skipifzero_arrays.hpp>
+
+#include <gpu_lib_bc.h>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+static u32 lcgNext(u32& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+// A synthetic "natural" image: smooth gradients per channel, some noise and a few hard edges.
+static SfzArray<u8> createTestImage(i32x2 res, u32 seed)
+{
+	SfzArray<u8> img;
+	img.init(u32(res.x * res.y * 4), &g_allocator, sfz_dbg("img"));
+	u32 state = seed;
+	for (i32 y = 0; y < res.y; y++) {
+		for (i32 x = 0; x < res.x; x++) {
+			const f32 fx = f32(x) / f32(res.x);
+			const f32 fy = f32(y) / f32(res.y);
+			const bool edge = ((x / 37) + (y / 23)) % 5 == 0;
+			const i32 noise = i32(lcgNext(state) % 9) - 4;
+			const i32 r = i32(255.0f * fx) + noise + (edge ? 60 : 0);
+			const i32 g = i32(255.0f * fy) - noise;
+			const i32 b = i32(128.0f + 100.0f * sfz_sin(fx * 9.0f + fy * 5.0f)) + noise;
+			const i32 a = i32(255.0f * (1.0f - fx * fy)) + (edge ? -80 : 0);
+			img.add(u8(i32_clamp(r, 0, 255)));
+			img.add(u8(i32_clamp(g, 0, 255)));
+			img.add(u8(i32_clamp(b, 0, 255)));
+			img.add(u8(i32_clamp(a, 0, 255)));
+		}
+	}
+	return img;
+}
+
+static u32 numChannels(GpuFormat format)
+{
+	switch (format) {
+	case GPU_FORMAT_BC1_UNORM: return 3;
+	case GPU_FORMAT_BC4_UNORM: return 1;
+	case GPU_FORMAT_BC5_UNORM: return 2;
+	case GPU_FORMAT_BC7_UNORM: return 4;
+	default: break;
+	}
+	return 0;
+}
+
+static f32 encodeDecodePSNR(GpuFormat format, const u8* img, i32x2 res)
+{
+	SfzArray<u8> encoded;
+	encoded.init(gpuBCCalcSizeBytes(format, res), &g_allocator, sfz_dbg("encoded"));
+	encoded.add(u8(0), gpuBCCalcSizeBytes(format, res));
+	SfzArray<u8> decoded;
+	decoded.init(u32(res.x * res.y * 4), &g_allocator, sfz_dbg("decoded"));
+	decoded.add(u8(0), u32(res.x * res.y * 4));
+	TEST_CHECK(gpuBCEncode(format, img, res, encoded.data()));
+	TEST_CHECK(gpuBCDecode(format, encoded.data(), res, decoded.data()));
+	return gpuBCCalcPSNR(img, decoded.data(), res, numChannels(format));
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testSizes()
+{
+	TEST_CHECK(gpuFormatIsBlockCompressed(GPU_FORMAT_BC1_UNORM));
+	TEST_CHECK(gpuFormatIsBlockCompressed(GPU_FORMAT_BC7_UNORM));
+	TEST_CHECK(!gpuFormatIsBlockCompressed(GPU_FORMAT_RGBA_U8_UNORM));
+	TEST_CHECK(gpuBCCalcSizeBytes(GPU_FORMAT_BC1_UNORM, i32x2_init(4, 4)) == 8);
+	TEST_CHECK(gpuBCCalcSizeBytes(GPU_FORMAT_BC4_UNORM, i32x2_init(5, 5)) == 4 * 8);
+	TEST_CHECK(gpuBCCalcSizeBytes(GPU_FORMAT_BC5_UNORM, i32x2_init(8, 3)) == 2 * 16);
+	TEST_CHECK(gpuBCCalcSizeBytes(GPU_FORMAT_BC7_UNORM, i32x2_init(257, 131)) == 65 * 33 * 16);
+}
+
+static void testInvalidArgs()
+{
+	u8 pixels[16 * 4] = {};
+	u8 block[16] = {};
+	TEST_CHECK(!gpuBCEncode(GPU_FORMAT_RGBA_U8_UNORM, pixels, i32x2_init(4, 4), block));
+	TEST_CHECK(!gpuBCEncode(GPU_FORMAT_BC1_UNORM, pixels, i32x2_init(0, 4), block));
+	TEST_CHECK(!gpuBCEncodeBlockRows(GPU_FORMAT_BC1_UNORM, pixels, i32x2_init(4, 4), block, 0, 2));
+	TEST_CHECK(!gpuBCDecodeBlockRows(GPU_FORMAT_BC1_UNORM, block, i32x2_init(4, 4), pixels, 1, 0));
+}
+
+static void testSolidBlocksAreExact()
+{
+	// Colors exactly representable by each format, should round trip without loss
+	const u8 colors[3][4] = { { 0, 0, 0, 255 }, { 255, 255, 255, 255 }, { 132, 130, 66, 255 } };
+	for (u32 i = 0; i < 3; i++) {
+		u8 pixels[16 * 4];
+		for (u32 p = 0; p < 16; p++) memcpy(pixels + p * 4, colors[i], 4);
+		const i32x2 res = i32x2_init(4, 4);
+		TEST_CHECK(encodeDecodePSNR(GPU_FORMAT_BC1_UNORM, pixels, res) == F32_MAX);
+		TEST_CHECK(encodeDecodePSNR(GPU_FORMAT_BC4_UNORM, pixels, res) == F32_MAX);
+		TEST_CHECK(encodeDecodePSNR(GPU_FORMAT_BC5_UNORM, pixels, res) == F32_MAX);
+	}
+}
+
+static void testBC4Modes()
+{
+	// Two clusters, one at each end of the range, interpolating between min and max wastes most of
+	// the palette. The 6 value mode (with explicit 0 and 255) should represent this exactly.
+	u8 pixels[16 * 4] = {};
+	const u8 values[16] = { 0, 0, 255, 255, 100, 110, 120, 130, 0, 255, 105, 115, 125, 100, 130, 0 };
+	for (u32 p = 0; p < 16; p++) pixels[p * 4] = values[p];
+	const f32 psnr = encodeDecodePSNR(GPU_FORMAT_BC4_UNORM, pixels, i32x2_init(4, 4));
+	printf("    BC4 two cluster block: %.1f dB\n", psnr);
+	TEST_CHECK(psnr > 45.0f);
+}
+
+static void testQuality()
+{
+	const i32x2 res = i32x2_init(257, 131); // Not divisible by 4, tests edge padding
+	SfzArray<u8> img = createTestImage(res, 1337);
+	const f32 bc1 = encodeDecodePSNR(GPU_FORMAT_BC1_UNORM, img.data(), res);
+	const f32 bc4 = encodeDecodePSNR(GPU_FORMAT_BC4_UNORM, img.data(), res);
+	const f32 bc5 = encodeDecodePSNR(GPU_FORMAT_BC5_UNORM, img.data(), res);
+	const f32 bc7 = encodeDecodePSNR(GPU_FORMAT_BC7_UNORM, img.data(), res);
+	printf("    PSNR: BC1 %.1f dB, BC4 %.1f dB, BC5 %.1f dB, BC7 %.1f dB\n", bc1, bc4, bc5, bc7);
+	TEST_CHECK(bc1 > 36.0f);
+	TEST_CHECK(bc4 > 44.0f);
+	TEST_CHECK(bc5 > 44.0f);
+	TEST_CHECK(bc7 > 42.0f);
+}
+
+static void testBlockRowsMatchWholeImage()
+{
+	const i32x2 res = i32x2_init(64, 40);
+	SfzArray<u8> img = createTestImage(res, 42);
+	const GpuFormat formats[4] = { GPU_FORMAT_BC1_UNORM, GPU_FORMAT_BC4_UNORM, GPU_FORMAT_BC5_UNORM, GPU_FORMAT_BC7_UNORM };
+	for (GpuFormat format : formats) {
+		const u32 size = gpuBCCalcSizeBytes(format, res);
+		SfzArray<u8> whole;
+		whole.init(size, &g_allocator, sfz_dbg("whole"));
+		whole.add(u8(0), size);
+		SfzArray<u8> rows;
+		rows.init(size, &g_allocator, sfz_dbg("rows"));
+		rows.add(u8(0), size);
+		TEST_CHECK(gpuBCEncode(format, img.data(), res, whole.data()));
+		TEST_CHECK(gpuBCEncodeBlockRows(format, img.data(), res, rows.data(), 0, 3));
+		TEST_CHECK(gpuBCEncodeBlockRows(format, img.data(), res, rows.data(), 3, 10));
+		TEST_CHECK(memcmp(whole.data(), rows.data(), size) == 0);
+	}
+}
+
+static void benchThroughput()
+{
+	const i32x2 res = i32x2_init(1024, 1024);
+	SfzArray<u8> img = createTestImage(res, 7);
+	SfzArray<u8> encoded;
+	encoded.init(gpuBCCalcSizeBytes(GPU_FORMAT_BC7_UNORM, res), &g_allocator, sfz_dbg("encoded"));
+	encoded.add(u8(0), gpuBCCalcSizeBytes(GPU_FORMAT_BC7_UNORM, res));
+	const i32 num_block_rows = res.y / 4;
+	const f64 mpix = f64(res.x) * f64(res.y) / 1e6;
+
+	const GpuFormat formats[4] = { GPU_FORMAT_BC1_UNORM, GPU_FORMAT_BC4_UNORM, GPU_FORMAT_BC5_UNORM, GPU_FORMAT_BC7_UNORM };
+	for (GpuFormat format : formats) {
+		const f64 single_begin = testsTimeSecs();
+		TEST_CHECK(gpuBCEncodeBlockRows(format, img.data(), res, encoded.data(), 0, num_block_rows));
+		const f64 single_secs = testsTimeSecs() - single_begin;
+		const f64 multi_begin = testsTimeSecs();
+		TEST_CHECK(gpuBCEncode(format, img.data(), res, encoded.data()));
+		const f64 multi_secs = testsTimeSecs() - multi_begin;
+		printf("    %s: %.1f MPix/s single-threaded, %.1f MPix/s multi-threaded\n",
+			gpuFormatToString(format), mpix / single_secs, mpix / multi_secs);
+	}
+}
+
+i32 main()
+{
+	TEST_RUN(testSizes);
+	TEST_RUN(testInvalidArgs);
+	TEST_RUN(testSolidBlocksAreExact);
+	TEST_RUN(testBC4Modes);
+	TEST_RUN(testQuality);
+	TEST_RUN(testBlockRowsMatchWholeImage);
+	TEST_RUN(benchThroughput);
+	return testsResult();
+}
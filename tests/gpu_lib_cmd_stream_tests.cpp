@@ -0,0 +1,604 @@
+#include "gpu_lib_tests.hpp"
+
+#include <gpu_lib_cmd_stream.hpp>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+// The objects the D3D12 backend registers, the natives are never dereferenced.
+constexpr u32 HEAP = 0;
+constexpr u32 UPLOAD = 1;
+constexpr u32 DOWNLOAD = 2;
+constexpr u32 TEX0 = 3;
+constexpr u32 TEX1 = 4;
+constexpr u32 KERNEL = 5;
+constexpr u32 QUERIES = 6;
+constexpr u32 CMD_SIG = 7;
+constexpr u32 NUM_OBJS = 8;
+
+constexpr u64 HEAP_SIZE = 1u << 20;
+constexpr u64 UPLOAD_SIZE = 1u << 20;
+
+static void addTestObjs(GpuCmdStream* s)
+{
+	TEST_CHECK(cmdStreamAddObj(s, cmdObjBuffer((void*)1, HEAP_SIZE, GPU_RES_STATE_UNORDERED_ACCESS, true)) == HEAP);
+	TEST_CHECK(cmdStreamAddObj(s, cmdObjBuffer((void*)2, UPLOAD_SIZE, GPU_RES_STATE_GENERIC_READ, false)) == UPLOAD);
+	TEST_CHECK(cmdStreamAddObj(s, cmdObjBuffer((void*)3, UPLOAD_SIZE, GPU_RES_STATE_COPY_DEST, false)) == DOWNLOAD);
+	TEST_CHECK(cmdStreamAddObj(s, cmdObjTexture((void*)4, 64, 32, GPU_FORMAT_RGBA_U8_UNORM, GPU_RES_STATE_UNORDERED_ACCESS, true)) == TEX0);
+	TEST_CHECK(cmdStreamAddObj(s, cmdObjTexture((void*)5, 64, 32, GPU_FORMAT_RGBA_U8_UNORM, GPU_RES_STATE_UNORDERED_ACCESS, true)) == TEX1);
+	TEST_CHECK(cmdStreamAddObj(s, cmdObjKernel((void*)6)) == KERNEL);
+	TEST_CHECK(cmdStreamAddObj(s, cmdObjQueryHeap((void*)7, 1)) == QUERIES);
+	TEST_CHECK(cmdStreamAddObj(s, cmdObjCmdSig((void*)8, sizeof(GpuDispatchArgs), false)) == CMD_SIG);
+}
+
+struct TestStream final {
+	GpuCmdStream s;
+
+	TestStream(u32 max_num_cmds = 1024)
+	{
+		cmdStreamInit(&s, max_num_cmds, &g_allocator);
+		addTestObjs(&s);
+	}
+
+	void rec(const GpuCmd& cmd) { TEST_CHECK(cmdStreamRecord(&s, cmd)); }
+	const GpuCmd& operator[] (u32 idx) const { return s.cmds[idx]; }
+
+	// Validates without touching the object states
+	bool validateCopy()
+	{
+		GpuCmdObj states[NUM_OBJS];
+		memcpy(states, s.objs.data(), sizeof(states));
+		const bool valid = cmdStreamValidate(&s);
+		memcpy(s.objs.data(), states, sizeof(states));
+		s.validate_kernel_set = false;
+		return valid;
+	}
+};
+
+static bool isTransition(const GpuCmd& cmd, u32 obj, GpuResState before, GpuResState after)
+{
+	return cmd.type == GPU_CMD_BARRIER && !cmd.barrier.uav && cmd.barrier.obj == obj &&
+		cmd.barrier.before == before && cmd.barrier.after == after;
+}
+
+static bool isUav(const GpuCmd& cmd, u32 obj)
+{
+	return cmd.type == GPU_CMD_BARRIER && cmd.barrier.uav && cmd.barrier.obj == obj;
+}
+
+static u32 lcgNext(u32& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testRecordArena()
+{
+	TestStream t(4);
+	const GpuCmd* cmds = t.s.cmds;
+	for (u32 i = 0; i < 4; i++) t.rec(cmdDispatch(i + 1, 1, 1));
+	TEST_CHECK(!cmdStreamRecord(&t.s, cmdDispatch(5, 1, 1))); // Full
+	TEST_CHECK(t.s.num_cmds == 4);
+	for (u32 i = 0; i < 4; i++) TEST_CHECK(t[i].type == GPU_CMD_DISPATCH && t[i].dispatch.num_groups_x == i + 1);
+
+	// Clearing commands keeps the objects, and the commands start over at the same address
+	cmdStreamClearCmds(&t.s);
+	TEST_CHECK(t.s.num_cmds == 0);
+	TEST_CHECK(t.s.objs.size() == NUM_OBJS);
+	t.rec(cmdSetKernel(KERNEL));
+	TEST_CHECK(t.s.cmds == cmds && t[0].type == GPU_CMD_SET_KERNEL);
+
+	// Launch params are stored inline
+	const u32 params[3] = { 1, 2, 3 };
+	t.rec(cmdSetParams(params, sizeof(params)));
+	TEST_CHECK(t[1].set_params.size == 12 && t[1].set_params.params[2] == 3);
+
+	cmdStreamReset(&t.s);
+	TEST_CHECK(t.s.num_cmds == 0 && t.s.objs.size() == 0);
+}
+
+static void testMergeBarriers()
+{
+	TestStream t;
+
+	// A -> B, B -> C folds into A -> C, the UAV barrier after it is redundant
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST));
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COPY_SOURCE));
+	t.rec(cmdUavBarrier(TEX0));
+	t.rec(cmdUavBarrier(TEX0));
+	t.rec(cmdCopyBuffer(DOWNLOAD, 0, HEAP, 256, 64));
+
+	// Round trip back to UNORDERED_ACCESS becomes a UAV barrier, a transition replaces a UAV barrier
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_UNORDERED_ACCESS));
+	t.rec(cmdUavBarrier(TEX1));
+	t.rec(cmdTransition(TEX1, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE));
+	t.rec(cmdCopyTexToBuffer(DOWNLOAD, 0, 256, TEX1));
+	t.rec(cmdTransition(TEX1, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_UNORDERED_ACCESS));
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST));
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_UNORDERED_ACCESS));
+	t.rec(cmdSetKernel(KERNEL));
+
+	// Round trip to another state is kept, later barriers merge with the last one
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST));
+	t.rec(cmdSetKernel(KERNEL));
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COPY_SOURCE));
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_COPY_DEST));
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_UNORDERED_ACCESS));
+	t.rec(cmdDispatch(1, 1, 1));
+	TEST_CHECK(t.s.num_cmds == 19);
+	TEST_CHECK(t.validateCopy());
+
+	cmdStreamMergeBarriers(&t.s);
+	TEST_CHECK(t.s.num_cmds == 14);
+	TEST_CHECK(isTransition(t[0], HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE));
+	TEST_CHECK(isUav(t[1], TEX0));
+	TEST_CHECK(t[2].type == GPU_CMD_COPY_BUFFER);
+	TEST_CHECK(isTransition(t[3], HEAP, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_UNORDERED_ACCESS));
+	TEST_CHECK(isTransition(t[4], TEX1, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE));
+	TEST_CHECK(t[5].type == GPU_CMD_COPY_TEX_TO_BUFFER);
+	TEST_CHECK(isTransition(t[6], TEX1, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_UNORDERED_ACCESS));
+	TEST_CHECK(isUav(t[7], HEAP));
+	TEST_CHECK(t[8].type == GPU_CMD_SET_KERNEL);
+	TEST_CHECK(isTransition(t[9], HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST));
+	TEST_CHECK(t[10].type == GPU_CMD_SET_KERNEL);
+	TEST_CHECK(isTransition(t[11], HEAP, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COPY_SOURCE));
+	TEST_CHECK(isTransition(t[12], HEAP, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_UNORDERED_ACCESS));
+	TEST_CHECK(t[13].type == GPU_CMD_DISPATCH);
+	TEST_CHECK(t.validateCopy());
+}
+
+static void testMergeBarriersSkipsNops()
+{
+	TestStream t;
+	t.rec(cmdUavBarrier(HEAP));
+	t.rec(GpuCmd{});
+	t.rec(cmdUavBarrier(HEAP));
+	t.rec(GpuCmd{});
+	cmdStreamMergeBarriers(&t.s);
+	TEST_CHECK(t.s.num_cmds == 1);
+	TEST_CHECK(isUav(t[0], HEAP));
+
+	// The arena is rewound, recording continues right after the kept commands
+	t.rec(cmdDispatch(1, 1, 1));
+	TEST_CHECK(t.s.num_cmds == 2 && t[1].type == GPU_CMD_DISPATCH);
+}
+
+// Applies the barriers of a stream, returns false if a command other than a barrier sees a different
+// state or has a different set of resources barriered right before it than in the reference.
+sfz_struct(BarrierTrace) {
+	GpuResState states[NUM_OBJS];
+	u32 synced_mask; // Objects with a barrier since the last command that isn't a barrier
+};
+
+static u32 traceStream(const GpuCmdStream& s, BarrierTrace* traces_out)
+{
+	BarrierTrace trace = {};
+	for (u32 i = 0; i < NUM_OBJS; i++) trace.states[i] = s.objs[i].state;
+	u32 num_traces = 0;
+	for (u32 i = 0; i < s.num_cmds; i++) {
+		const GpuCmd& cmd = s.cmds[i];
+		if (cmd.type == GPU_CMD_NOP) continue;
+		if (cmd.type == GPU_CMD_BARRIER) {
+			if (!cmd.barrier.uav) trace.states[cmd.barrier.obj] = cmd.barrier.after;
+			trace.synced_mask |= 1u << cmd.barrier.obj;
+			continue;
+		}
+		traces_out[num_traces] = trace;
+		num_traces += 1;
+		trace.synced_mask = 0;
+	}
+	traces_out[num_traces] = trace;
+	return num_traces + 1;
+}
+
+static void testMergeBarriersRandom()
+{
+	// Random valid streams of barriers between copies, merging must not change the state any copy
+	// sees, or which resources are synchronized before it.
+	constexpr u32 NUM_STREAMS = 500;
+	constexpr u32 MAX_CMDS = 256;
+	const GpuResState states[] = {
+		GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COMMON };
+	const u32 objs[] = { HEAP, TEX0, TEX1 };
+	u32 rng = 1337;
+	u32 num_before = 0;
+	u32 num_after = 0;
+	for (u32 iter = 0; iter < NUM_STREAMS; iter++) {
+		TestStream t(MAX_CMDS);
+		GpuResState curr[NUM_OBJS];
+		for (u32 i = 0; i < NUM_OBJS; i++) curr[i] = t.s.objs[i].state;
+		while (t.s.num_cmds < MAX_CMDS) {
+			const u32 r = lcgNext(rng) % 8;
+			const u32 obj = objs[lcgNext(rng) % 3];
+			if (r < 4) {
+				const GpuResState after = states[lcgNext(rng) % 4];
+				if (after == curr[obj]) continue;
+				t.rec(cmdTransition(obj, curr[obj], after));
+				curr[obj] = after;
+			}
+			else if (r < 6) {
+				if (curr[obj] != GPU_RES_STATE_UNORDERED_ACCESS) continue;
+				t.rec(cmdUavBarrier(obj));
+			}
+			else if (r < 7) {
+				t.rec(GpuCmd{});
+			}
+			else {
+				t.rec(cmdSetKernel(KERNEL)); // Stands in for any command using resources
+			}
+		}
+		BarrierTrace ref[MAX_CMDS + 1];
+		BarrierTrace merged[MAX_CMDS + 1];
+		const u32 num_ref = traceStream(t.s, ref);
+		num_before += t.s.num_cmds;
+		cmdStreamMergeBarriers(&t.s);
+		num_after += t.s.num_cmds;
+		TEST_CHECK(traceStream(t.s, merged) == num_ref);
+		for (u32 i = 0; i < num_ref; i++) {
+			TEST_CHECK(memcmp(ref[i].states, merged[i].states, sizeof(ref[i].states)) == 0);
+			TEST_CHECK(ref[i].synced_mask == merged[i].synced_mask);
+		}
+		TEST_CHECK(t.validateCopy());
+	}
+	printf("    %u random commands merged to %u\n", num_before, num_after);
+}
+
+static void testCoalesceCopies()
+{
+	TestStream t;
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST));
+	t.rec(cmdCopyBuffer(HEAP, 1024, UPLOAD, 0, 256));
+	t.rec(cmdCopyBuffer(HEAP, 1280, UPLOAD, 256, 256));
+	t.rec(GpuCmd{});
+	t.rec(cmdCopyBuffer(HEAP, 1536, UPLOAD, 512, 100));
+	t.rec(cmdCopyBuffer(HEAP, 1636, UPLOAD, 768, 100)); // Source not contiguous
+	t.rec(cmdCopyBuffer(HEAP, 1736, UPLOAD, 868, 100));
+	t.rec(cmdCopyBuffer(HEAP, 0, UPLOAD, 968, 100)); // Destination not contiguous
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COPY_SOURCE));
+	t.rec(cmdCopyBuffer(DOWNLOAD, 0, HEAP, 100, 100)); // Other buffers
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_COPY_DEST));
+	t.rec(cmdCopyBuffer(HEAP, 200, UPLOAD, 1068, 100)); // Contiguous, but not back to back
+	TEST_CHECK(t.validateCopy());
+
+	cmdStreamCoalesceCopies(&t.s);
+	TEST_CHECK(t.s.num_cmds == 8);
+	TEST_CHECK(t[1].type == GPU_CMD_COPY_BUFFER && t[1].copy_buffer.dst_offset == 1024 &&
+		t[1].copy_buffer.src_offset == 0 && t[1].copy_buffer.num_bytes == 612);
+	TEST_CHECK(t[2].copy_buffer.dst_offset == 1636 && t[2].copy_buffer.num_bytes == 200);
+	TEST_CHECK(t[3].copy_buffer.dst_offset == 0 && t[3].copy_buffer.num_bytes == 100);
+	TEST_CHECK(t[5].copy_buffer.dst == DOWNLOAD && t[5].copy_buffer.num_bytes == 100);
+	TEST_CHECK(t[7].copy_buffer.dst_offset == 200 && t[7].copy_buffer.num_bytes == 100);
+	TEST_CHECK(t.validateCopy());
+}
+
+static void testValidateValid()
+{
+	TestStream t;
+	const u32 params[4] = {};
+
+	// Upload, dispatch, timestamp, indirect dispatch and texture download
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST));
+	t.rec(cmdCopyBuffer(HEAP, 1024, UPLOAD, 0, 256));
+	t.rec(cmdTimestamp(QUERIES, 0, HEAP, 2048));
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_UNORDERED_ACCESS));
+	t.rec(cmdSetKernel(KERNEL));
+	t.rec(cmdSetParams(params, sizeof(params)));
+	t.rec(cmdDispatch(GPU_CMD_DISPATCH_MAX_NUM_GROUPS, 1, 1));
+	t.rec(cmdSetLargeParams(UPLOAD, 512, 256));
+	t.rec(cmdDispatchIndirect(CMD_SIG, UPLOAD, 1024, 4));
+	t.rec(cmdTransition(TEX0, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE));
+	t.rec(cmdCopyTexToBuffer(DOWNLOAD, 512, 256, TEX0));
+	t.rec(cmdTransition(TEX1, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST));
+	t.rec(cmdCopyTex(TEX1, TEX0));
+	t.rec(cmdCopyTex(TEX1, TEX0, 16, 32));
+	t.rec(cmdTransition(TEX1, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_UNORDERED_ACCESS));
+	t.rec(cmdTransition(TEX0, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_UNORDERED_ACCESS));
+	t.rec(cmdSegmentEnd(0));
+	t.rec(cmdSetKernel(KERNEL));
+	t.rec(cmdDispatch(1, 2, 3));
+	TEST_CHECK(cmdStreamValidate(&t.s));
+
+	// States carry over to the next part of the stream
+	cmdStreamClearCmds(&t.s);
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE));
+	t.rec(cmdDispatch(1, 1, 1));
+	TEST_CHECK(!cmdStreamValidate(&t.s)); // Heap not in UNORDERED_ACCESS
+	TEST_CHECK(t.s.objs[HEAP].state == GPU_RES_STATE_COPY_SOURCE);
+}
+
+static void testValidateErrors()
+{
+	// Each stream has exactly one error
+	struct Case { const char* name; GpuCmd cmds[4]; u32 num_cmds; };
+	const u32 params[14] = {};
+	const Case cases[] = {
+		{ "missing object", { cmdUavBarrier(NUM_OBJS) }, 1 },
+		{ "wrong object type", { cmdSetKernel(HEAP) }, 1 },
+		{ "wrong before state", { cmdTransition(HEAP, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_COPY_SOURCE) }, 1 },
+		{ "transition to same state", { cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_UNORDERED_ACCESS) }, 1 },
+		{ "uav barrier outside UNORDERED_ACCESS", { cmdUavBarrier(DOWNLOAD) }, 1 },
+		{ "copy to heap in UNORDERED_ACCESS", { cmdCopyBuffer(HEAP, 0, UPLOAD, 0, 4) }, 1 },
+		{ "copy out of bounds", {
+			cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST),
+			cmdCopyBuffer(HEAP, HEAP_SIZE - 4, UPLOAD, 0, 8) }, 2 },
+		{ "copy of 0 bytes", {
+			cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST),
+			cmdCopyBuffer(HEAP, 0, UPLOAD, 0, 0) }, 2 },
+		{ "row pitch too small", {
+			cmdTransition(TEX0, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST),
+			cmdCopyBufferToTex(TEX0, UPLOAD, 0, 128) }, 2 },
+		{ "texture rows out of bounds", {
+			cmdTransition(TEX0, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST),
+			cmdCopyBufferToTex(TEX0, UPLOAD, UPLOAD_SIZE - 256 * 31, 256) }, 2 },
+		{ "texture copy region too large", {
+			cmdTransition(TEX0, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE),
+			cmdTransition(TEX1, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST),
+			cmdCopyTex(TEX1, TEX0, 65, 1) }, 3 },
+		{ "timestamp query out of bounds", {
+			cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST),
+			cmdTimestamp(QUERIES, 1, HEAP, 0) }, 2 },
+		{ "params too large", { cmdSetParams(params, sizeof(params)) }, 1 },
+		{ "unaligned large params", { cmdSetLargeParams(UPLOAD, 4, 64) }, 1 },
+		{ "dispatch without kernel", { cmdDispatch(1, 1, 1) }, 1 },
+		{ "dispatch of 0 groups", { cmdSetKernel(KERNEL), cmdDispatch(1, 0, 1) }, 2 },
+		{ "dispatch of too many groups", { cmdSetKernel(KERNEL), cmdDispatch(1, 1, GPU_CMD_DISPATCH_MAX_NUM_GROUPS + 1) }, 2 },
+		{ "dispatch with texture in COPY_SOURCE", {
+			cmdSetKernel(KERNEL),
+			cmdTransition(TEX1, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE),
+			cmdDispatch(1, 1, 1) }, 3 },
+		{ "kernel reset by segment end", { cmdSetKernel(KERNEL), cmdSegmentEnd(0), cmdDispatch(1, 1, 1) }, 3 },
+		{ "indirect args out of bounds", {
+			cmdSetKernel(KERNEL), cmdDispatchIndirect(CMD_SIG, UPLOAD, UPLOAD_SIZE - sizeof(GpuDispatchArgs), 2) }, 2 },
+		{ "indirect args in wrong state", { cmdSetKernel(KERNEL), cmdDispatchIndirect(CMD_SIG, DOWNLOAD, 0, 1) }, 2 },
+	};
+	for (const Case& c : cases) {
+		printf("    Expecting error, %s:\n", c.name);
+		TestStream t;
+		for (u32 i = 0; i < c.num_cmds; i++) t.rec(c.cmds[i]);
+		TEST_CHECK(!cmdStreamValidate(&t.s));
+
+		// Without the last command the stream is valid
+		cmdStreamClearCmds(&t.s);
+		cmdStreamReset(&t.s);
+		addTestObjs(&t.s);
+		for (u32 i = 0; i + 1 < c.num_cmds; i++) t.rec(c.cmds[i]);
+		TEST_CHECK(cmdStreamValidate(&t.s));
+	}
+}
+
+static void testBoundStateParams()
+{
+	GpuBoundState bound = {};
+	const u32 params[4] = { 1, 2, 3, 4 };
+	const u32 other[4] = { 1, 2, 5, 6 };
+	TEST_CHECK(!boundStateSetParams(&bound, params, 0));
+	TEST_CHECK(boundStateSetParams(&bound, params, 8));
+	TEST_CHECK(!boundStateSetParams(&bound, params, 8));
+	TEST_CHECK(!boundStateSetParams(&bound, params, 4));
+
+	// Larger than the bound params, the constants past the smaller size stay bound
+	TEST_CHECK(boundStateSetParams(&bound, params, 16));
+	TEST_CHECK(bound.params_size == 16);
+	TEST_CHECK(!boundStateSetParams(&bound, params, 12));
+	TEST_CHECK(boundStateSetParams(&bound, other, 12));
+	TEST_CHECK(bound.params_size == 16);
+	TEST_CHECK(bound.params[2] == 5 && bound.params[3] == 4);
+	TEST_CHECK(!boundStateSetParams(&bound, other, 8));
+
+	// Kernel changes keep the params
+	TEST_CHECK(boundStateSetKernel(&bound, (void*)1));
+	TEST_CHECK(!boundStateSetKernel(&bound, (void*)1));
+	TEST_CHECK(!boundStateSetParams(&bound, other, 12));
+
+	boundStateInvalidateParams(&bound);
+	TEST_CHECK(boundStateSetParams(&bound, other, 4));
+}
+
+// Benchmarks
+// ------------------------------------------------------------------------------------------------
+
+// Records a frame like the ones the backend records: batches of uploads, dispatches with declared
+// accesses and barriers in between, texture downloads and timestamps.
+static void recordFrame(TestStream& t, u32 num_batches)
+{
+	u64 upload_offset = 0;
+	u32 params[4] = {};
+	for (u32 b = 0; b < num_batches; b++) {
+		t.rec(cmdTimestamp(QUERIES, 0, HEAP, 8 * (b % 64)));
+		if (b == 0) {
+			t.s.cmds[t.s.num_cmds - 1] = cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST);
+			t.rec(cmdTimestamp(QUERIES, 0, HEAP, 0));
+		}
+		for (u32 i = 0; i < 8; i++) {
+			t.rec(cmdCopyBuffer(HEAP, 4096 + upload_offset % 65536, UPLOAD, upload_offset % 65536, 256));
+			upload_offset += 256;
+		}
+		t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_UNORDERED_ACCESS));
+		for (u32 i = 0; i < 8; i++) {
+			t.rec(cmdUavBarrier(HEAP));
+			t.rec(cmdUavBarrier(TEX0));
+			t.rec(cmdSetKernel(KERNEL));
+			params[0] = i;
+			t.rec(cmdSetParams(params, sizeof(params)));
+			t.rec(cmdDispatch(64, 1, 1));
+		}
+		t.rec(cmdTransition(TEX1, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_SOURCE));
+		t.rec(cmdCopyTexToBuffer(DOWNLOAD, 0, 256, TEX1));
+		t.rec(cmdTransition(TEX1, GPU_RES_STATE_COPY_SOURCE, GPU_RES_STATE_UNORDERED_ACCESS));
+		t.rec(cmdTransition(HEAP, GPU_RES_STATE_UNORDERED_ACCESS, GPU_RES_STATE_COPY_DEST));
+	}
+	t.rec(cmdTransition(HEAP, GPU_RES_STATE_COPY_DEST, GPU_RES_STATE_UNORDERED_ACCESS));
+}
+
+static void benchRecordAndPasses()
+{
+	constexpr u32 NUM_BATCHES = 2000;
+	constexpr u32 NUM_ITERS = 20;
+	TestStream t(1u << 17);
+	recordFrame(t, NUM_BATCHES);
+	const u32 num_recorded = t.s.num_cmds;
+	TEST_CHECK(t.validateCopy());
+
+	f64 record_ms = 0.0;
+	f64 passes_ms = 0.0;
+	f64 validate_ms = 0.0;
+	for (u32 iter = 0; iter < NUM_ITERS; iter++) {
+		cmdStreamClearCmds(&t.s);
+		const f64 begin = testsTimeSecs();
+		recordFrame(t, NUM_BATCHES);
+		const f64 recorded = testsTimeSecs();
+		cmdStreamMergeBarriers(&t.s);
+		cmdStreamCoalesceCopies(&t.s);
+		const f64 optimized = testsTimeSecs();
+		TEST_CHECK(t.validateCopy());
+		const f64 validated = testsTimeSecs();
+		record_ms += (recorded - begin) * 1000.0;
+		passes_ms += (optimized - recorded) * 1000.0;
+		validate_ms += (validated - optimized) * 1000.0;
+	}
+	printf("    %u commands recorded, %u after passes\n", num_recorded, t.s.num_cmds);
+	printf("    Record: %.3f ms, passes: %.3f ms, validate: %.3f ms (%.1f ns per recorded command)\n",
+		record_ms / NUM_ITERS, passes_ms / NUM_ITERS, validate_ms / NUM_ITERS,
+		(record_ms + passes_ms) * 1e6 / (f64(NUM_ITERS) * f64(num_recorded)));
+}
+
+// State binding calls made while translating a stream, counted by a stub backend.
+sfz_struct(BindCalls) {
+	u32 global; // Descriptor heaps, root signature, heap UAV and descriptor table
+	u32 pso;
+	u32 root_constants;
+	u32 dispatches;
+};
+
+// Counts the calls the backend makes for a stream translated into a single command list: global
+// state is bound once when the command list is reset, the pso and root constants only when they
+// change. With per_kernel_root_sig, counts them the way they were bound when each kernel had its
+// own root signature: root signature, heap UAV, descriptor table, pso and root constants for every
+// dispatch.
+static BindCalls countBindCalls(const GpuCmdStream& s, bool per_kernel_root_sig)
+{
+	BindCalls calls = {};
+	GpuBoundState bound = {};
+	calls.global = per_kernel_root_sig ? 1 : 4;
+	for (u32 i = 0; i < s.num_cmds; i++) {
+		const GpuCmd& cmd = s.cmds[i];
+		switch (cmd.type) {
+		case GPU_CMD_SET_KERNEL:
+			if (per_kernel_root_sig) {
+				calls.global += 3;
+				calls.pso += 1;
+			}
+			else if (boundStateSetKernel(&bound, s.objs[cmd.set_kernel.kernel].native)) {
+				calls.pso += 1;
+			}
+			break;
+		case GPU_CMD_SET_PARAMS:
+			if (per_kernel_root_sig) {
+				if (cmd.set_params.size != 0) calls.root_constants += 1;
+			}
+			else if (boundStateSetParams(&bound, cmd.set_params.params, cmd.set_params.size)) {
+				calls.root_constants += 1;
+			}
+			break;
+		case GPU_CMD_DISPATCH:
+			calls.dispatches += 1;
+			break;
+		case GPU_CMD_DISPATCH_INDIRECT:
+			calls.dispatches += 1;
+			if (s.objs[cmd.dispatch_indirect.cmd_sig].sets_params) boundStateInvalidateParams(&bound);
+			break;
+		default: break;
+		}
+	}
+	return calls;
+}
+
+static u32 numCalls(const BindCalls& calls)
+{
+	return calls.global + calls.pso + calls.root_constants + calls.dispatches;
+}
+
+static void printBindCalls(const char* name, const GpuCmdStream& s)
+{
+	const BindCalls before = countBindCalls(s, true);
+	const BindCalls after = countBindCalls(s, false);
+	TEST_CHECK(before.dispatches == after.dispatches);
+	printf("    %s: %u dispatches, %u calls with per kernel root signatures, %u shared (%u saved)\n",
+		name, after.dispatches, numCalls(before), numCalls(after), numCalls(before) - numCalls(after));
+	printf("      Root constants set %u times, %u without skipping bound params\n",
+		after.root_constants, before.root_constants);
+}
+
+// Counts the state binding calls for a few typical streams: a frame of batches of the same kernel,
+// a chain of post processing kernels sharing params, an iterative solver alternating between two
+// kernels where one takes a prefix of the other's params, and batched indirect dispatches.
+static void benchBindCalls()
+{
+	constexpr u32 NUM_DISPATCHES = 1024;
+	TestStream t(1u << 16);
+	const u32 kernels[4] = { KERNEL, cmdStreamAddObj(&t.s, cmdObjKernel((void*)9)),
+		cmdStreamAddObj(&t.s, cmdObjKernel((void*)10)), cmdStreamAddObj(&t.s, cmdObjKernel((void*)11)) };
+	const u32 params[4] = { 1920, 1080, 0, 0 };
+
+	recordFrame(t, NUM_DISPATCHES / 8);
+	const BindCalls frame = countBindCalls(t.s, false);
+	TEST_CHECK(frame.global == 4);
+	TEST_CHECK(frame.pso == 1);
+	TEST_CHECK(frame.root_constants == NUM_DISPATCHES);
+	TEST_CHECK(frame.dispatches == NUM_DISPATCHES);
+	TEST_CHECK(numCalls(countBindCalls(t.s, true)) == 1 + 6 * NUM_DISPATCHES);
+	printBindCalls("Frame", t.s);
+
+	cmdStreamClearCmds(&t.s);
+	for (u32 i = 0; i < NUM_DISPATCHES; i++) {
+		t.rec(cmdSetKernel(kernels[i % 4]));
+		t.rec(cmdSetParams(params, sizeof(params)));
+		t.rec(cmdDispatch(120, 68, 1));
+	}
+	TEST_CHECK(countBindCalls(t.s, false).pso == NUM_DISPATCHES);
+	TEST_CHECK(countBindCalls(t.s, false).root_constants == 1);
+	printBindCalls("Post processing chain", t.s);
+
+	cmdStreamClearCmds(&t.s);
+	for (u32 i = 0; i < NUM_DISPATCHES; i++) {
+		const u32 iter_params[2] = { 4096, i / 2 };
+		t.rec(cmdSetKernel(kernels[i % 2]));
+		t.rec(cmdSetParams(iter_params, (i % 2) == 0 ? 8 : 4));
+		t.rec(cmdDispatch(256, 1, 1));
+	}
+	TEST_CHECK(countBindCalls(t.s, false).root_constants == NUM_DISPATCHES / 2);
+	printBindCalls("Solver iterations", t.s);
+
+	// The command signature sets the params, the direct dispatch after each batch has to set them
+	const u32 batch_sig = cmdStreamAddObj(&t.s, cmdObjCmdSig((void*)12, 20, true));
+	cmdStreamClearCmds(&t.s);
+	for (u32 i = 0; i < NUM_DISPATCHES / 2; i++) {
+		t.rec(cmdSetKernel(kernels[0]));
+		t.rec(cmdDispatchIndirect(batch_sig, UPLOAD, 0, 1));
+		t.rec(cmdSetKernel(kernels[1]));
+		t.rec(cmdSetParams(params, sizeof(params)));
+		t.rec(cmdDispatch(120, 68, 1));
+	}
+	TEST_CHECK(countBindCalls(t.s, false).root_constants == NUM_DISPATCHES / 2);
+	printBindCalls("Batches", t.s);
+}
+
+i32 main()
+{
+	TEST_RUN(testRecordArena);
+	TEST_RUN(testMergeBarriers);
+	TEST_RUN(testMergeBarriersSkipsNops);
+	TEST_RUN(testMergeBarriersRandom);
+	TEST_RUN(testCoalesceCopies);
+	TEST_RUN(testValidateValid);
+	TEST_RUN(testValidateErrors);
+	TEST_RUN(testBoundStateParams);
+	TEST_RUN(benchRecordAndPasses);
+	TEST_RUN(benchBindCalls);
+	return testsResult();
+}
@@ -0,0 +1,280 @@
+#include "gpu_lib_tests.hpp"
+
+#include <string.h>
+
+#include <skipifzero_allocators.hpp>
+#include <skipifzero_arrays.hpp>
+
+#include <gpu_lib_cmd_stream.hpp>
+#include <gpu_lib_dispatch.hpp>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+static GpuLaunchParamLayout paramLayout(u32 size, u32 used_size)
+{
+	GpuLaunchParamLayout layout = {};
+	layout.size = size;
+	layout.used_size = used_size;
+	return layout;
+}
+
+static GpuDispatchBatchItem batchItem(u32 kernel, i32 num_groups_x, const void* params, u32 params_size)
+{
+	GpuDispatchBatchItem item = {};
+	item.kernel = GpuKernel{ kernel };
+	item.num_groups = i32x3_init(num_groups_x, 1, 1);
+	item.params = params;
+	item.params_size = params_size;
+	return item;
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testParamsSizeValid()
+{
+	const GpuLaunchParamLayout layout = paramLayout(16, 12);
+	TEST_CHECK(paramsSizeValid(layout, 12));
+	TEST_CHECK(paramsSizeValid(layout, 16));
+	TEST_CHECK(!paramsSizeValid(layout, 8)); // Smaller than the used part
+	TEST_CHECK(!paramsSizeValid(layout, 20)); // Larger than the struct
+	TEST_CHECK(!paramsSizeValid(layout, 14)); // Not a multiple of 4
+
+	// Kernels without params only accept none
+	const GpuLaunchParamLayout empty = paramLayout(0, 0);
+	TEST_CHECK(paramsSizeValid(empty, 0));
+	TEST_CHECK(!paramsSizeValid(empty, 4));
+}
+
+static void testCountToGroups()
+{
+	TEST_CHECK(dispatchCountToGroups(0, 64) == 0);
+	TEST_CHECK(dispatchCountToGroups(1, 64) == 1);
+	TEST_CHECK(dispatchCountToGroups(63, 64) == 1);
+	TEST_CHECK(dispatchCountToGroups(64, 64) == 1);
+	TEST_CHECK(dispatchCountToGroups(65, 64) == 2);
+	TEST_CHECK(dispatchCountToGroups(7, 1) == 7);
+	TEST_CHECK(dispatchCountToGroups(7, 3) == 3);
+
+	// Clamped to the max number of groups
+	TEST_CHECK(dispatchCountToGroups(65535 * 64, 64) == 65535);
+	TEST_CHECK(dispatchCountToGroups(65535 * 64 + 1, 64) == 65535);
+	TEST_CHECK(dispatchCountToGroups(65536, 1) == 65535);
+
+	// Counts close to U32_MAX don't overflow when rounding up
+	TEST_CHECK(dispatchCountToGroups(U32_MAX, U32_MAX) == 1);
+	TEST_CHECK(dispatchCountToGroups(U32_MAX - 1, U32_MAX) == 1);
+	TEST_CHECK(dispatchCountToGroups(U32_MAX, 1u << 31) == 2);
+	TEST_CHECK(dispatchCountToGroups(U32_MAX, 1u << 16) == 65535);
+
+	// Against a 64-bit ceil
+	u32 rng = 7;
+	bool all_match = true;
+	for (u32 i = 0; i < 100000; i++) {
+		rng = rng * 1664525u + 1013904223u;
+		const u32 count = rng >> (rng % 32);
+		const u32 elements_per_group = 1 + (rng >> 8) % 1024;
+		const u64 expected = u64_min((u64(count) + elements_per_group - 1) / elements_per_group, 65535);
+		all_match = all_match && dispatchCountToGroups(count, elements_per_group) == u32(expected);
+	}
+	TEST_CHECK(all_match);
+}
+
+static void testBatchRuns()
+{
+	const GpuDispatchBatchItem items[] = {
+		batchItem(1, 1, nullptr, 0), batchItem(1, 1, nullptr, 0),
+		batchItem(2, 1, nullptr, 0),
+		batchItem(1, 1, nullptr, 0), batchItem(1, 1, nullptr, 0), batchItem(1, 1, nullptr, 0),
+	};
+	TEST_CHECK(dispatchBatchRunEnd(items, 6, 0) == 2);
+	TEST_CHECK(dispatchBatchRunEnd(items, 6, 2) == 3);
+	TEST_CHECK(dispatchBatchRunEnd(items, 6, 3) == 6);
+	TEST_CHECK(dispatchBatchRunEnd(items, 6, 4) == 6);
+	TEST_CHECK(dispatchBatchRunEnd(items, 4, 3) == 4); // Stops at num_items
+
+	// Single dispatches and large params are dispatched directly
+	GpuLaunchParamLayout layout = paramLayout(16, 16);
+	TEST_CHECK(dispatchBatchRunIsDirect(1, layout));
+	TEST_CHECK(!dispatchBatchRunIsDirect(2, layout));
+	layout.is_large = 1;
+	TEST_CHECK(dispatchBatchRunIsDirect(2, layout));
+}
+
+static void testBatchPackArgs()
+{
+	const u32 params_a[3] = { 1, 2, 3 };
+	const u32 params_b[4] = { 4, 5, 6, 7 };
+	const GpuDispatchBatchItem items[] = {
+		batchItem(1, 10, params_a, 12),
+		batchItem(1, 20, params_b, 16),
+		batchItem(1, 30, params_b, 8), // Invalid, too small
+		batchItem(1, 40, params_a, 12),
+	};
+
+	// Every slot is overwritten, the padding of short params included
+	GpuBatchDispatchArgs args[4];
+	memset(args, 0xCD, sizeof(args));
+	const u32 num_args = dispatchBatchPackArgs(paramLayout(16, 12), items, 4, args);
+	TEST_CHECK(num_args == 3);
+	const u32 expected_params[3][GPU_LAUNCH_PARAMS_MAX_SIZE / 4] = { { 1, 2, 3 }, { 4, 5, 6, 7 }, { 1, 2, 3 } };
+	const u32 expected_groups[3] = { 10, 20, 40 };
+	for (u32 i = 0; i < 3; i++) {
+		TEST_CHECK(memcmp(args[i].params, expected_params[i], sizeof(args[i].params)) == 0);
+		TEST_CHECK(args[i].dispatch.num_groups_x == expected_groups[i]);
+		TEST_CHECK(args[i].dispatch.num_groups_y == 1 && args[i].dispatch.num_groups_z == 1);
+	}
+	TEST_CHECK(args[3].dispatch.num_groups_x == 0xCDCDCDCD); // Past the end is untouched
+
+	// All invalid
+	TEST_CHECK(dispatchBatchPackArgs(paramLayout(16, 16), items, 1, args) == 0);
+}
+
+// Compares recording the commands of many small dispatches one by one with batching them, both
+// into the command stream the backend records to. The batched path also packs the indirect args.
+static void benchmarkBatch()
+{
+	constexpr u32 NUM_ITEMS = 8192;
+	constexpr u32 NUM_ITERS = 64;
+	constexpr u32 NUM_KERNELS = 4;
+
+	u32 params[NUM_ITEMS][4];
+	SfzArray<GpuDispatchBatchItem> items;
+	items.init(NUM_ITEMS, &g_allocator, sfz_dbg(""));
+	for (u32 i = 0; i < NUM_ITEMS; i++) {
+		params[i][0] = i;
+		params[i][1] = i * 3;
+		params[i][2] = i * 7;
+		params[i][3] = 0;
+		items.add(batchItem(1 + (i / 64) % NUM_KERNELS, 1 + i % 16, params[i], 16));
+	}
+	const GpuLaunchParamLayout layout = paramLayout(16, 16);
+	SfzArray<GpuBatchDispatchArgs> args;
+	args.init(NUM_ITEMS, &g_allocator, sfz_dbg(""));
+	args.hackSetSize(NUM_ITEMS);
+
+	GpuCmdStream stream = {};
+	cmdStreamInit(&stream, NUM_ITEMS * 3, &g_allocator);
+	u32 kernel_objs[NUM_KERNELS + 1] = {};
+	for (u32 k = 1; k <= NUM_KERNELS; k++) kernel_objs[k] = cmdStreamAddObj(&stream, cmdObjKernel((void*)u64(k)));
+	const u32 cmd_sig = cmdStreamAddObj(&stream, cmdObjCmdSig((void*)u64(100), sizeof(GpuBatchDispatchArgs), true));
+	const u32 upload = cmdStreamAddObj(
+		&stream, cmdObjBuffer((void*)u64(101), NUM_ITEMS * sizeof(GpuBatchDispatchArgs), GPU_RES_STATE_GENERIC_READ, false));
+
+	f64 direct_ms = 0.0;
+	u32 direct_num_cmds = 0;
+	for (u32 iter = 0; iter < NUM_ITERS; iter++) {
+		cmdStreamClearCmds(&stream);
+		const f64 begin = testsTimeSecs();
+		for (const GpuDispatchBatchItem& item : items) {
+			if (!paramsSizeValid(layout, item.params_size)) continue;
+			cmdStreamRecord(&stream, cmdSetKernel(kernel_objs[item.kernel.handle]));
+			cmdStreamRecord(&stream, cmdSetParams(item.params, item.params_size));
+			cmdStreamRecord(&stream, cmdDispatch(u32(item.num_groups.x), u32(item.num_groups.y), u32(item.num_groups.z)));
+		}
+		direct_ms += (testsTimeSecs() - begin) * 1000.0;
+		direct_num_cmds = stream.num_cmds;
+	}
+
+	f64 batch_ms = 0.0;
+	u32 batch_num_cmds = 0;
+	u32 num_packed = 0;
+	for (u32 iter = 0; iter < NUM_ITERS; iter++) {
+		cmdStreamClearCmds(&stream);
+		num_packed = 0;
+		const f64 begin = testsTimeSecs();
+		for (u32 run_begin = 0, run_end = 0; run_begin < NUM_ITEMS; run_begin = run_end) {
+			run_end = dispatchBatchRunEnd(items.data(), NUM_ITEMS, run_begin);
+			const u32 num_args = dispatchBatchPackArgs(
+				layout, items.data() + run_begin, run_end - run_begin, args.data() + num_packed);
+			cmdStreamRecord(&stream, cmdSetKernel(kernel_objs[items[run_begin].kernel.handle]));
+			cmdStreamRecord(&stream, cmdDispatchIndirect(
+				cmd_sig, upload, u64(num_packed) * sizeof(GpuBatchDispatchArgs), num_args));
+			num_packed += num_args;
+		}
+		batch_ms += (testsTimeSecs() - begin) * 1000.0;
+		batch_num_cmds = stream.num_cmds;
+	}
+	TEST_CHECK(num_packed == NUM_ITEMS);
+	TEST_CHECK(batch_num_cmds == 2 * (NUM_ITEMS / 64));
+	TEST_CHECK(direct_num_cmds == 3 * NUM_ITEMS);
+
+	printf("    %u dispatches in runs of 64: direct %u commands, %.1f ns per dispatch\n",
+		NUM_ITEMS, direct_num_cmds, direct_ms * 1e6 / (f64(NUM_ITERS) * f64(NUM_ITEMS)));
+	printf("    Batched %u commands, %.1f ns per dispatch (grouping and packing args included)\n",
+		batch_num_cmds, batch_ms * 1e6 / (f64(NUM_ITERS) * f64(NUM_ITEMS)));
+}
+
+// Compares the CPU side of the two ways launch params reach a kernel: root constants copied into
+// the recorded command, and large params (the root CBV) written to the upload heap ring with only
+// their address recorded. The upload heap is mimicked by a plain buffer, allocations are aligned to
+// 256 bytes as required for constant buffers. The GPU side (an extra indirection through the root
+// CBV) can only be measured on a D3D12 device.
+static void benchmarkLargeParams()
+{
+	constexpr u32 NUM_DISPATCHES = 4096;
+	constexpr u32 NUM_ITERS = 64;
+	constexpr u32 CBUFFER_ALIGN = 256;
+
+	u32 params[GPU_LAUNCH_PARAMS_LARGE_MAX_SIZE / 4] = {};
+	for (u32 i = 0; i < GPU_LAUNCH_PARAMS_LARGE_MAX_SIZE / 4; i++) params[i] = i;
+
+	SfzArray<u8> heap;
+	heap.init(NUM_DISPATCHES * GPU_LAUNCH_PARAMS_LARGE_MAX_SIZE, &g_allocator, sfz_dbg(""));
+	heap.hackSetSize(heap.capacity());
+
+	GpuCmdStream stream = {};
+	cmdStreamInit(&stream, NUM_DISPATCHES * 2, &g_allocator);
+	const u32 upload = cmdStreamAddObj(
+		&stream, cmdObjBuffer((void*)u64(101), heap.size(), GPU_RES_STATE_GENERIC_READ, false));
+
+	f64 root_ms = 0.0;
+	for (u32 iter = 0; iter < NUM_ITERS; iter++) {
+		cmdStreamClearCmds(&stream);
+		const f64 begin = testsTimeSecs();
+		for (u32 i = 0; i < NUM_DISPATCHES; i++) {
+			params[0] = i;
+			cmdStreamRecord(&stream, cmdSetParams(params, GPU_LAUNCH_PARAMS_MAX_SIZE));
+			cmdStreamRecord(&stream, cmdDispatch(1, 1, 1));
+		}
+		root_ms += (testsTimeSecs() - begin) * 1000.0;
+	}
+	printf("    Root constants, %u bytes: %.1f ns per dispatch, 0 bytes of upload heap\n",
+		GPU_LAUNCH_PARAMS_MAX_SIZE, root_ms * 1e6 / (f64(NUM_ITERS) * f64(NUM_DISPATCHES)));
+
+	const u32 large_sizes[] = { GPU_LAUNCH_PARAMS_MAX_SIZE + 4, 256, 1024, GPU_LAUNCH_PARAMS_LARGE_MAX_SIZE };
+	for (u32 params_size : large_sizes) {
+		f64 large_ms = 0.0;
+		u64 offset = 0;
+		for (u32 iter = 0; iter < NUM_ITERS; iter++) {
+			cmdStreamClearCmds(&stream);
+			offset = 0;
+			const f64 begin = testsTimeSecs();
+			for (u32 i = 0; i < NUM_DISPATCHES; i++) {
+				params[0] = i;
+				memcpy(heap.data() + offset, params, params_size);
+				cmdStreamRecord(&stream, cmdSetLargeParams(upload, offset, params_size));
+				cmdStreamRecord(&stream, cmdDispatch(1, 1, 1));
+				offset += sfzRoundUpAlignedU32(params_size, CBUFFER_ALIGN);
+			}
+			large_ms += (testsTimeSecs() - begin) * 1000.0;
+		}
+		TEST_CHECK(stream.num_cmds == NUM_DISPATCHES * 2);
+		printf("    Root CBV, %u bytes: %.1f ns per dispatch, %u bytes of upload heap\n",
+			params_size, large_ms * 1e6 / (f64(NUM_ITERS) * f64(NUM_DISPATCHES)), u32(offset / NUM_DISPATCHES));
+	}
+}
+
+i32 main()
+{
+	TEST_RUN(testParamsSizeValid);
+	TEST_RUN(testCountToGroups);
+	TEST_RUN(testBatchRuns);
+	TEST_RUN(testBatchPackArgs);
+	TEST_RUN(benchmarkBatch);
+	TEST_RUN(benchmarkLargeParams);
+	return testsResult();
+}
@@ -0,0 +1,510 @@
+#include "gpu_lib_tests.hpp"
+
+#include <skipifzero_allocators.hpp>
+#include <skipifzero_arrays.hpp>
+
+#include <gpu_lib_frame_graph.h>
+
+// Command log
+// ------------------------------------------------------------------------------------------------
+
+// The frame graph only queues barriers and calls the pass functions, the command API is replaced by
+// stubs that log what would have been queued.
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+typedef enum {
+	CMD_HEAP_BARRIER = 0,
+	CMD_RWTEX_BARRIER,
+	CMD_PASS,
+} CmdType;
+
+sfz_struct(Cmd) {
+	CmdType type;
+	u32 idx; // RWTex or index of the pass in TestGraph::passes
+};
+
+static SfzArray<Cmd> g_cmds;
+
+sfz_extern_c void gpuQueueGpuHeapBarrier(GpuLib*) { g_cmds.add(Cmd{ CMD_HEAP_BARRIER, 0 }); }
+sfz_extern_c void gpuQueueRWTexBarrier(GpuLib*, GpuRWTex tex_idx) { g_cmds.add(Cmd{ CMD_RWTEX_BARRIER, tex_idx }); }
+
+static void logPass(GpuLib*, const GpuFrameGraph*, void* user_data)
+{
+	g_cmds.add(Cmd{ CMD_PASS, u32(u64(user_data)) });
+}
+
+// Test graphs
+// ------------------------------------------------------------------------------------------------
+
+constexpr u32 MAX_ACCESSES = 8;
+constexpr GpuPtr TRANSIENT_HEAP = 1 << 20;
+constexpr u32 TRANSIENT_HEAP_SIZE = 1 << 30;
+
+sfz_struct(TestPass) {
+	GpuFgRes reads[MAX_ACCESSES];
+	u32 num_reads;
+	GpuFgRes writes[MAX_ACCESSES];
+	u32 num_writes;
+	bool side_effects;
+};
+
+// Keeps the declared resources and passes, so the executed command log can be checked against them.
+sfz_struct(TestGraph) {
+	GpuFrameGraph* fg;
+	SfzArray<u32> res_sizes; // Indexed by GpuFgRes
+	SfzArray<TestPass> passes;
+
+	void init()
+	{
+		fg = gpuFrameGraphInit(&g_allocator);
+		res_sizes.init(1024, &g_allocator, sfz_dbg("TestGraph::res_sizes"));
+		passes.init(1024, &g_allocator, sfz_dbg("TestGraph::passes"));
+		reset();
+	}
+
+	void destroy() { gpuFrameGraphDestroy(fg); res_sizes.destroy(); passes.destroy(); }
+
+	void reset()
+	{
+		gpuFrameGraphReset(fg);
+		res_sizes.clear();
+		res_sizes.add(0); // Null resource
+		passes.clear();
+	}
+
+	GpuFgRes addRes(GpuFgRes res, u32 num_bytes)
+	{
+		if (res == res_sizes.size()) res_sizes.add(num_bytes);
+		return res;
+	}
+
+	GpuFgRes importPtr(GpuPtr ptr, u32 num_bytes) { return addRes(gpuFgImportPtr(fg, ptr, num_bytes), num_bytes); }
+	GpuFgRes importRWTex(GpuRWTex tex) { return addRes(gpuFgImportRWTex(fg, tex), 0); }
+	GpuFgRes createTransient(u32 num_bytes) { return addRes(gpuFgCreateTransient(fg, num_bytes), num_bytes); }
+
+	// Returns the index of the pass, the same as its index in executed CMD_PASS commands.
+	u32 addPass(
+		const GpuFgRes* reads, u32 num_reads, const GpuFgRes* writes, u32 num_writes, bool side_effects = false)
+	{
+		sfz_assert(num_reads <= MAX_ACCESSES && num_writes <= MAX_ACCESSES);
+		const u32 idx = passes.size();
+		TestPass& pass = passes.add();
+		pass = {};
+		for (u32 i = 0; i < num_reads; i++) pass.reads[i] = reads[i];
+		for (u32 i = 0; i < num_writes; i++) pass.writes[i] = writes[i];
+		pass.num_reads = num_reads;
+		pass.num_writes = num_writes;
+		pass.side_effects = side_effects;
+
+		GpuFgPassDesc desc = {};
+		desc.name = "test_pass";
+		desc.reads = reads;
+		desc.num_reads = num_reads;
+		desc.writes = writes;
+		desc.num_writes = num_writes;
+		desc.side_effects = side_effects;
+		desc.func = logPass;
+		desc.user_data = (void*)u64(idx);
+		gpuFgAddPass(fg, &desc);
+		return idx;
+	}
+
+	void execute()
+	{
+		g_cmds.clear();
+		gpuFrameGraphExecute(fg, nullptr);
+	}
+};
+
+static u32 numExecutedPasses()
+{
+	u32 num = 0;
+	for (const Cmd& cmd : g_cmds) num += cmd.type == CMD_PASS ? 1 : 0;
+	return num;
+}
+
+static u32 executedPos(u32 pass_idx)
+{
+	for (u32 i = 0; i < g_cmds.size(); i++) {
+		if (g_cmds[i].type == CMD_PASS && g_cmds[i].idx == pass_idx) return i;
+	}
+	return U32_MAX;
+}
+
+sfz_struct(SimRange) {
+	u64 begin;
+	u64 end;
+	bool write;
+};
+
+// Replays the command log and checks that no two heap accesses conflict (write-write, read-write)
+// without a heap barrier in between, and the same for RWTex. The contents of the transient heap are
+// treated as written before the graph, e.g. by the previous frame.
+static bool logIsHazardFree(const TestGraph& g)
+{
+	SfzArray<SimRange> pending;
+	pending.init(256, &g_allocator, sfz_dbg("pending"));
+	pending.add(SimRange{ TRANSIENT_HEAP, u64(TRANSIENT_HEAP) + TRANSIENT_HEAP_SIZE, true });
+	SfzArray<SimRange> pending_tex;
+	pending_tex.init(64, &g_allocator, sfz_dbg("pending_tex"));
+
+	auto checkAndAdd = [&](GpuFgRes res, bool write) {
+		const GpuRWTex tex = gpuFgGetRWTex(g.fg, res);
+		SimRange range = {};
+		range.write = write;
+		SfzArray<SimRange>* set = &pending;
+		if (tex != GPU_NULL_RWTEX) {
+			range.begin = tex;
+			range.end = u64(tex) + 1;
+			set = &pending_tex;
+		}
+		else {
+			range.begin = gpuFgGetPtr(g.fg, res);
+			range.end = range.begin + g.res_sizes[res];
+		}
+		for (const SimRange& other : *set) {
+			const bool overlap = range.begin < other.end && other.begin < range.end;
+			if (overlap && (write || other.write)) return false;
+		}
+		set->add(range);
+		return true;
+	};
+
+	for (u32 i = 0; i < g_cmds.size(); i++) {
+		const Cmd& cmd = g_cmds[i];
+		if (cmd.type == CMD_HEAP_BARRIER) {
+			pending.clear();
+			continue;
+		}
+		if (cmd.type == CMD_RWTEX_BARRIER) {
+			for (u32 j = 0; j < pending_tex.size();) {
+				if (pending_tex[j].begin == cmd.idx) pending_tex.remove(j);
+				else j += 1;
+			}
+			continue;
+		}
+
+		// All passes of a level are executed without barriers in between, so accesses of the
+		// whole run of passes are checked against each other
+		const TestPass& pass = g.passes[cmd.idx];
+		for (u32 j = 0; j < pass.num_writes; j++) {
+			if (!checkAndAdd(pass.writes[j], true)) return false;
+		}
+		for (u32 j = 0; j < pass.num_reads; j++) {
+			bool also_written = false;
+			for (u32 k = 0; k < pass.num_writes; k++) also_written |= pass.writes[k] == pass.reads[j];
+			if (!also_written && !checkAndAdd(pass.reads[j], false)) return false;
+		}
+	}
+	return true;
+}
+
+// Every used pass must run after all passes declared before it that write what it reads, which
+// must not be culled. Earlier writes of what it writes must run before it, unless culled.
+static bool logRespectsDependencies(const TestGraph& g)
+{
+	for (u32 p = 0; p < g.passes.size(); p++) {
+		const u32 pos = executedPos(p);
+		if (pos == U32_MAX) continue;
+		const TestPass& pass = g.passes[p];
+		for (u32 q = 0; q < p; q++) {
+			const TestPass& earlier = g.passes[q];
+			const u32 earlier_pos = executedPos(q);
+			for (u32 w = 0; w < earlier.num_writes; w++) {
+				bool read = false;
+				bool written = false;
+				for (u32 r = 0; r < pass.num_reads; r++) read |= pass.reads[r] == earlier.writes[w];
+				for (u32 r = 0; r < pass.num_writes; r++) written |= pass.writes[r] == earlier.writes[w];
+				if (read && earlier_pos == U32_MAX) return false;
+				if ((read || written) && earlier_pos != U32_MAX && pos < earlier_pos) return false;
+			}
+		}
+	}
+	return true;
+}
+
+static u32 lcgNext(u32& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testCulling()
+{
+	TestGraph g;
+	g.init();
+	const GpuFgRes imported = g.importPtr(64, 256);
+	const GpuFgRes unused = g.createTransient(1024);
+	const GpuFgRes used = g.createTransient(1024);
+	const u32 culled = g.addPass(nullptr, 0, &unused, 1);
+	const u32 producer = g.addPass(nullptr, 0, &used, 1);
+	const u32 consumer = g.addPass(&used, 1, &imported, 1);
+	const u32 side_effects = g.addPass(nullptr, 0, nullptr, 0, true);
+	TEST_CHECK(gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE));
+	const GpuFrameGraphStats stats = gpuFrameGraphGetStats(g.fg);
+	TEST_CHECK(stats.num_passes == 4);
+	TEST_CHECK(stats.num_culled_passes == 1);
+	TEST_CHECK(gpuFgGetPtr(g.fg, unused) == GPU_NULLPTR);
+	g.execute();
+	TEST_CHECK(executedPos(culled) == U32_MAX);
+	TEST_CHECK(executedPos(producer) < executedPos(consumer));
+	TEST_CHECK(executedPos(side_effects) != U32_MAX);
+	g.destroy();
+}
+
+static void testLevels()
+{
+	TestGraph g;
+	g.init();
+	const GpuFgRes a = g.importPtr(0, 256);
+	const GpuFgRes b = g.importPtr(256, 256);
+	const GpuFgRes c = g.importPtr(512, 256);
+	g.addPass(nullptr, 0, &a, 1); // Level 0
+	g.addPass(nullptr, 0, &b, 1); // Level 0
+	const GpuFgRes ab[2] = { a, b };
+	g.addPass(ab, 2, &c, 1); // Level 1
+	g.addPass(&a, 1, nullptr, 0, true); // Level 1
+	g.addPass(nullptr, 0, &a, 1); // Level 2, write after read
+	TEST_CHECK(gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE));
+	const GpuFrameGraphStats stats = gpuFrameGraphGetStats(g.fg);
+	TEST_CHECK(stats.num_levels == 3);
+	TEST_CHECK(stats.num_heap_barriers == 2);
+	g.execute();
+	TEST_CHECK(numExecutedPasses() == 5);
+	TEST_CHECK(logIsHazardFree(g));
+	TEST_CHECK(logRespectsDependencies(g));
+	g.destroy();
+}
+
+static void testRWTexBarriers()
+{
+	TestGraph g;
+	g.init();
+	const GpuFgRes tex = g.importRWTex(3);
+	TEST_CHECK(g.importRWTex(3) == tex);
+	const GpuFgRes other = g.importRWTex(4);
+	g.addPass(nullptr, 0, &tex, 1);
+	g.addPass(&tex, 1, &other, 1);
+	g.addPass(&tex, 1, nullptr, 0, true); // Same level, reads don't need a barrier
+	TEST_CHECK(gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE));
+	const GpuFrameGraphStats stats = gpuFrameGraphGetStats(g.fg);
+	TEST_CHECK(stats.num_rwtex_barriers == 1);
+	TEST_CHECK(stats.num_heap_barriers == 0);
+	g.execute();
+	TEST_CHECK(g_cmds.size() == 4);
+	TEST_CHECK(g_cmds[1].type == CMD_RWTEX_BARRIER && g_cmds[1].idx == 3);
+	TEST_CHECK(logIsHazardFree(g));
+	g.destroy();
+}
+
+static void testHeapBarrierBeforeFirstTransientAccess()
+{
+	TestGraph g;
+	g.init();
+
+	// Only imports, no barrier needed before the first level
+	const GpuFgRes imported = g.importPtr(0, 256);
+	g.addPass(nullptr, 0, &imported, 1);
+	TEST_CHECK(gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE));
+	g.execute();
+	TEST_CHECK(g_cmds.size() == 1 && g_cmds[0].type == CMD_PASS);
+
+	// The transient heap might still be in use by earlier work (e.g. the previous frame's graph)
+	g.reset();
+	const GpuFgRes transient = g.createTransient(256);
+	g.addPass(nullptr, 0, &transient, 1);
+	g.addPass(&transient, 1, nullptr, 0, true);
+	TEST_CHECK(gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE));
+	TEST_CHECK(gpuFrameGraphGetStats(g.fg).num_heap_barriers == 2);
+	g.execute();
+	TEST_CHECK(g_cmds.size() == 4);
+	TEST_CHECK(g_cmds[0].type == CMD_HEAP_BARRIER);
+	TEST_CHECK(logIsHazardFree(g));
+
+	// Transients first accessed in a later level, which only depends on the first through a RWTex.
+	// The heap barrier is inserted there.
+	g.reset();
+	const GpuFgRes tex = g.importRWTex(2);
+	const GpuFgRes transient2 = g.createTransient(256);
+	g.addPass(nullptr, 0, &tex, 1);
+	g.addPass(&tex, 1, &transient2, 1);
+	g.addPass(&transient2, 1, nullptr, 0, true);
+	TEST_CHECK(gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE));
+	g.execute();
+	TEST_CHECK(g_cmds.size() == 6);
+	TEST_CHECK(g_cmds[0].type == CMD_PASS);
+	TEST_CHECK(g_cmds[1].type == CMD_HEAP_BARRIER);
+	TEST_CHECK(g_cmds[2].type == CMD_RWTEX_BARRIER);
+	TEST_CHECK(logIsHazardFree(g));
+	g.destroy();
+}
+
+static void testTransientAliasing()
+{
+	TestGraph g;
+	g.init();
+
+	// Chain, each transient only lives for two levels, so every other one can share memory
+	const GpuFgRes imported = g.importPtr(0, 256);
+	GpuFgRes prev = GPU_NULL_FG_RES;
+	for (u32 i = 0; i < 8; i++) {
+		const GpuFgRes next = g.createTransient(1000);
+		g.addPass(&prev, prev != GPU_NULL_FG_RES ? 1 : 0, &next, 1);
+		prev = next;
+	}
+	g.addPass(&prev, 1, &imported, 1);
+	TEST_CHECK(gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE));
+	const GpuFrameGraphStats stats = gpuFrameGraphGetStats(g.fg);
+	TEST_CHECK(stats.transient_size_unaliased_bytes == 8 * 1024);
+	TEST_CHECK(stats.transient_size_bytes == 2 * 1024);
+	for (GpuFgRes res = 2; res < 10; res++) {
+		const GpuPtr ptr = gpuFgGetPtr(g.fg, res);
+		TEST_CHECK(ptr == TRANSIENT_HEAP || ptr == TRANSIENT_HEAP + 1024);
+		TEST_CHECK(ptr % GPU_FG_TRANSIENT_ALIGN == 0);
+	}
+	g.execute();
+	TEST_CHECK(logIsHazardFree(g));
+
+	// Doesn't fit, required size is still reported
+	TEST_CHECK(!gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, 2 * 1024 - 1));
+	TEST_CHECK(gpuFrameGraphGetStats(g.fg).transient_size_bytes == 2 * 1024);
+	g.destroy();
+}
+
+static void testTransientsNeverAliasWhileAlive()
+{
+	// Transients alive in the same level must not overlap, even if declared in a different order
+	TestGraph g;
+	g.init();
+	GpuFgRes wide[16];
+	for (u32 i = 0; i < 16; i++) {
+		wide[i] = g.createTransient(256 * (1 + i % 5));
+		g.addPass(nullptr, 0, &wide[i], 1);
+	}
+	for (u32 i = 0; i < 16; i += 4) g.addPass(&wide[i], 4, nullptr, 0, true);
+	TEST_CHECK(gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE));
+	const GpuFrameGraphStats stats = gpuFrameGraphGetStats(g.fg);
+	TEST_CHECK(stats.transient_size_bytes == stats.transient_size_unaliased_bytes);
+	g.execute();
+	TEST_CHECK(logIsHazardFree(g));
+	g.destroy();
+}
+
+static void testRandomGraphs()
+{
+	// Random DAGs over a mix of imports, RWTex and transients. The command log must respect all
+	// dependencies and be free of hazards, i.e. aliasing and barriers are correct.
+	TestGraph g;
+	g.init();
+	u32 state = 1337;
+	for (u32 iter = 0; iter < 200; iter++) {
+		g.reset();
+		GpuFgRes resources[48];
+		const u32 num_resources = 8 + lcgNext(state) % 40;
+		for (u32 i = 0; i < num_resources; i++) {
+			const u32 kind = lcgNext(state) % 8;
+			if (kind == 0) resources[i] = g.importRWTex(GpuRWTex(2 + i));
+			else if (kind == 1) resources[i] = g.importPtr(i * 4096, 4096);
+			else resources[i] = g.createTransient(1 + lcgNext(state) % 4000);
+		}
+		const u32 num_passes = 4 + lcgNext(state) % 60;
+		for (u32 p = 0; p < num_passes; p++) {
+			GpuFgRes reads[MAX_ACCESSES];
+			GpuFgRes writes[MAX_ACCESSES];
+			const u32 num_reads = lcgNext(state) % 4;
+			const u32 num_writes = 1 + lcgNext(state) % 3;
+			for (u32 i = 0; i < num_reads; i++) reads[i] = resources[lcgNext(state) % num_resources];
+			for (u32 i = 0; i < num_writes; i++) {
+				writes[i] = resources[lcgNext(state) % num_resources];
+				for (u32 j = 0; j < i; j++) {
+					if (writes[j] == writes[i]) writes[i] = GPU_NULL_FG_RES;
+				}
+			}
+			u32 num_unique_writes = 0;
+			for (u32 i = 0; i < num_writes; i++) {
+				if (writes[i] != GPU_NULL_FG_RES) writes[num_unique_writes++] = writes[i];
+			}
+			g.addPass(reads, num_reads, writes, num_unique_writes, lcgNext(state) % 10 == 0);
+		}
+		TEST_CHECK(gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE));
+		const GpuFrameGraphStats stats = gpuFrameGraphGetStats(g.fg);
+		TEST_CHECK(stats.transient_size_bytes <= stats.transient_size_unaliased_bytes);
+		g.execute();
+		TEST_CHECK(logIsHazardFree(g));
+		TEST_CHECK(logRespectsDependencies(g));
+	}
+	g.destroy();
+}
+
+// Benchmarks
+// ------------------------------------------------------------------------------------------------
+
+static f64 benchCompileMs(TestGraph& g, u32 num_iters)
+{
+	TEST_CHECK(gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE)); // Warm up
+	const f64 begin = testsTimeSecs();
+	for (u32 i = 0; i < num_iters; i++) {
+		gpuFrameGraphCompile(g.fg, TRANSIENT_HEAP, TRANSIENT_HEAP_SIZE);
+	}
+	return (testsTimeSecs() - begin) * 1000.0 / f64(num_iters);
+}
+
+static void benchCompile()
+{
+	constexpr u32 NUM_PASSES = 1000;
+	constexpr u32 NUM_ITERS = 20;
+	TestGraph g;
+	g.init();
+
+	// Chain of passes ping-ponging between two imported buffers
+	const GpuFgRes a = g.importPtr(0, 4096);
+	const GpuFgRes b = g.importPtr(4096, 4096);
+	for (u32 i = 0; i < NUM_PASSES; i++) {
+		const GpuFgRes read = i % 2 == 0 ? a : b;
+		const GpuFgRes write = i % 2 == 0 ? b : a;
+		g.addPass(&read, 1, &write, 1);
+	}
+	printf("    %u pass chain, imported buffers: %.3f ms\n", NUM_PASSES, benchCompileMs(g, NUM_ITERS));
+
+	// Chain of transients, each pass reads the previous pass's transient
+	g.reset();
+	GpuFgRes prev = GPU_NULL_FG_RES;
+	for (u32 i = 0; i < NUM_PASSES; i++) {
+		const GpuFgRes next = g.createTransient(1024 * (1 + i % 7));
+		g.addPass(&prev, prev != GPU_NULL_FG_RES ? 1 : 0, &next, 1);
+		prev = next;
+	}
+	g.addPass(&prev, 1, nullptr, 0, true);
+	printf("    %u pass chain, %u transients: %.3f ms\n", NUM_PASSES, NUM_PASSES, benchCompileMs(g, NUM_ITERS));
+
+	// Wide, 1000 independent passes each writing a transient, all read by groups of 8
+	g.reset();
+	GpuFgRes transients[NUM_PASSES];
+	for (u32 i = 0; i < NUM_PASSES; i++) {
+		transients[i] = g.createTransient(1024 * (1 + i % 7));
+		g.addPass(nullptr, 0, &transients[i], 1);
+	}
+	for (u32 i = 0; i < NUM_PASSES; i += 8) g.addPass(&transients[i], 8, nullptr, 0, true);
+	printf("    %u wide passes, %u transients: %.3f ms\n", NUM_PASSES, NUM_PASSES, benchCompileMs(g, NUM_ITERS));
+
+	g.destroy();
+}
+
+i32 main()
+{
+	g_cmds.init(4096, &g_allocator, sfz_dbg("g_cmds"));
+	TEST_RUN(testCulling);
+	TEST_RUN(testLevels);
+	TEST_RUN(testRWTexBarriers);
+	TEST_RUN(testHeapBarrierBeforeFirstTransientAccess);
+	TEST_RUN(testTransientAliasing);
+	TEST_RUN(testTransientsNeverAliasWhileAlive);
+	TEST_RUN(testRandomGraphs);
+	TEST_RUN(benchCompile);
+	g_cmds.destroy();
+	return testsResult();
+}
@@ -0,0 +1,365 @@
+#include "gpu_lib_tests.hpp"
+
+#include <gpu_lib_hazards.hpp>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+static GpuPtrRange range(u32 ptr, u32 num_bytes) { return GpuPtrRange{ GpuPtr(ptr), num_bytes }; }
+
+static bool rangesEqual(const GpuPtrRangeSet& set, const GpuPtrRange* expected, u32 num_expected)
+{
+	if (set.ranges.size() != num_expected) return false;
+	for (u32 i = 0; i < num_expected; i++) {
+		if (set.ranges[i].ptr != expected[i].ptr || set.ranges[i].num_bytes != expected[i].num_bytes) return false;
+	}
+	return true;
+}
+
+static GpuDispatchAccess accessReads(const GpuPtrRange* reads, u32 num_reads)
+{
+	GpuDispatchAccess access = {};
+	access.ptr_reads = reads;
+	access.num_ptr_reads = num_reads;
+	return access;
+}
+
+static GpuDispatchAccess accessWrites(const GpuPtrRange* writes, u32 num_writes)
+{
+	GpuDispatchAccess access = {};
+	access.ptr_writes = writes;
+	access.num_ptr_writes = num_writes;
+	return access;
+}
+
+static GpuDispatchAccess accessRWTex(const GpuRWTex* reads, u32 num_reads, const GpuRWTex* writes, u32 num_writes)
+{
+	GpuDispatchAccess access = {};
+	access.rwtex_reads = reads;
+	access.num_rwtex_reads = num_reads;
+	access.rwtex_writes = writes;
+	access.num_rwtex_writes = num_writes;
+	return access;
+}
+
+static bool barriersEqual(const GpuRWTexHazardTracker& tracker, const GpuRWTex* expected, u32 num_expected)
+{
+	if (tracker.barriers.size() != num_expected) return false;
+	for (u32 i = 0; i < num_expected; i++) {
+		if (tracker.barriers[i] != expected[i]) return false;
+	}
+	return true;
+}
+
+// Tracker with textures 1 to num_textures - 1 existing, like the backend's null slot 0
+static GpuRWTexHazardTracker rwtexTracker(u32 num_textures)
+{
+	GpuRWTexHazardTracker tracker = {};
+	tracker.init(16, &g_allocator);
+	for (u32 i = 0; i < num_textures; i++) tracker.setExists(GpuRWTex(i), true);
+	return tracker;
+}
+
+// Resolves and tracks a dispatch, like the backend does
+static void dispatch(GpuRWTexHazardTracker& tracker, const GpuDispatchAccess* access)
+{
+	tracker.resolve(access);
+	tracker.add(access);
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testRangeSetMerge()
+{
+	GpuPtrRangeSet set = {};
+	set.init(&g_allocator, sfz_dbg(""));
+	TEST_CHECK(set.isEmpty());
+
+	// Empty ranges are ignored, disjoint ranges are kept sorted
+	set.add(range(100, 0));
+	TEST_CHECK(set.isEmpty());
+	set.add(range(300, 10));
+	set.add(range(100, 10));
+	set.add(range(200, 10));
+	const GpuPtrRange sorted[] = { range(100, 10), range(200, 10), range(300, 10) };
+	TEST_CHECK(rangesEqual(set, sorted, 3));
+
+	// Adjacent ranges merge, on either side
+	set.add(range(110, 10));
+	set.add(range(190, 10));
+	const GpuPtrRange adjacent[] = { range(100, 20), range(190, 20), range(300, 10) };
+	TEST_CHECK(rangesEqual(set, adjacent, 3));
+
+	// Overlapping ranges merge, a range spanning several merges all of them
+	set.add(range(115, 10));
+	const GpuPtrRange overlap[] = { range(100, 25), range(190, 20), range(300, 10) };
+	TEST_CHECK(rangesEqual(set, overlap, 3));
+	set.add(range(120, 180));
+	const GpuPtrRange spanning[] = { range(100, 210) };
+	TEST_CHECK(rangesEqual(set, spanning, 1));
+
+	// A contained range changes nothing
+	set.add(range(150, 5));
+	TEST_CHECK(rangesEqual(set, spanning, 1));
+
+	set.clear();
+	TEST_CHECK(set.isEmpty());
+	set.ranges.destroy();
+}
+
+static void testRangeSetOverlaps()
+{
+	GpuPtrRangeSet set = {};
+	set.init(&g_allocator, sfz_dbg(""));
+	set.add(range(100, 10));
+	set.add(range(200, 10));
+
+	TEST_CHECK(set.overlaps(range(100, 1)));
+	TEST_CHECK(set.overlaps(range(109, 1)));
+	TEST_CHECK(set.overlaps(range(90, 11)));
+	TEST_CHECK(set.overlaps(range(105, 100))); // Covers the gap and the next range
+	TEST_CHECK(set.overlaps(range(0, 1000)));
+
+	// Touching ranges don't overlap, neither do empty ones
+	TEST_CHECK(!set.overlaps(range(110, 10)));
+	TEST_CHECK(!set.overlaps(range(90, 10)));
+	TEST_CHECK(!set.overlaps(range(110, 90)));
+	TEST_CHECK(!set.overlaps(range(210, 10)));
+	TEST_CHECK(!set.overlaps(range(105, 0)));
+
+	const GpuPtrRange others[] = { range(0, 10), range(150, 10), range(205, 1) };
+	TEST_CHECK(set.overlaps(others, 3));
+	TEST_CHECK(!set.overlaps(others, 2));
+	set.ranges.destroy();
+}
+
+static void testRangeSetCollapse()
+{
+	GpuPtrRangeSet set = {};
+	set.init(&g_allocator, sfz_dbg(""));
+
+	// Exactly the max number of disjoint ranges are kept as is
+	for (u32 i = 0; i < GPU_HAZARD_MAX_NUM_TRACKED_RANGES; i++) set.add(range(1000 + i * 16, 8));
+	TEST_CHECK(set.ranges.size() == GPU_HAZARD_MAX_NUM_TRACKED_RANGES);
+	TEST_CHECK(!set.overlaps(range(1008, 8)));
+
+	// One more collapses them into a single range covering all, gaps included
+	set.add(range(100, 4));
+	const u32 end = 1000 + (GPU_HAZARD_MAX_NUM_TRACKED_RANGES - 1) * 16 + 8;
+	const GpuPtrRange collapsed[] = { range(100, end - 100) };
+	TEST_CHECK(rangesEqual(set, collapsed, 1));
+	TEST_CHECK(set.overlaps(range(1008, 8)));
+	TEST_CHECK(set.overlaps(range(500, 4)));
+	TEST_CHECK(!set.overlaps(range(end, 4)));
+
+	// Merging a range into an existing one never collapses
+	set.clear();
+	for (u32 i = 0; i < GPU_HAZARD_MAX_NUM_TRACKED_RANGES; i++) set.add(range(1000 + i * 16, 8));
+	set.add(range(1004, 8));
+	TEST_CHECK(set.ranges.size() == GPU_HAZARD_MAX_NUM_TRACKED_RANGES);
+	set.ranges.destroy();
+}
+
+static void testHeapHazards()
+{
+	GpuHeapHazardTracker tracker = {};
+	tracker.init(&g_allocator);
+	TEST_CHECK(!tracker.hasDeclaredAccesses());
+
+	const GpuPtrRange a[] = { range(1000, 100) };
+	const GpuPtrRange b[] = { range(2000, 100) };
+	const GpuPtrRange a_part[] = { range(1050, 10) };
+
+	// Reads after reads never conflict
+	tracker.add(accessReads(a, 1));
+	TEST_CHECK(tracker.hasDeclaredAccesses());
+	TEST_CHECK(!tracker.hasHazard(accessReads(a, 1)));
+
+	// Write after read, only if the ranges overlap
+	TEST_CHECK(tracker.hasHazard(accessWrites(a_part, 1)));
+	TEST_CHECK(!tracker.hasHazard(accessWrites(b, 1)));
+
+	// Read after write and write after write
+	tracker.add(accessWrites(b, 1));
+	TEST_CHECK(tracker.hasHazard(accessReads(b, 1)));
+	TEST_CHECK(tracker.hasHazard(accessWrites(b, 1)));
+	TEST_CHECK(!tracker.hasHazard(accessReads(a_part, 1)));
+
+	// Access declaring both reads and writes
+	GpuDispatchAccess both = accessReads(b, 1);
+	both.ptr_writes = a_part;
+	both.num_ptr_writes = 1;
+	TEST_CHECK(tracker.hasHazard(both));
+
+	// Barrier resets everything
+	tracker.clear();
+	TEST_CHECK(!tracker.hasDeclaredAccesses());
+	TEST_CHECK(!tracker.hasHazard(accessReads(b, 1)));
+	TEST_CHECK(!tracker.hasHazard(accessWrites(a, 1)));
+
+	// After an undeclared dispatch everything is a hazard, but it's not a declared access
+	tracker.unknown = true;
+	TEST_CHECK(!tracker.hasDeclaredAccesses());
+	TEST_CHECK(tracker.hasHazard(accessReads(a, 1)));
+	TEST_CHECK(tracker.hasHazard(GpuDispatchAccess{}));
+	tracker.clear();
+	TEST_CHECK(!tracker.unknown);
+
+	tracker.reads.ranges.destroy();
+	tracker.writes.ranges.destroy();
+}
+
+static void testRWTexHazards()
+{
+	GpuRWTexHazardTracker tracker = rwtexTracker(8);
+	const GpuRWTex a[] = { 2 };
+	const GpuRWTex b[] = { 3 };
+	const GpuRWTex ab[] = { 2, 3 };
+
+	// Reads after reads never conflict
+	const GpuDispatchAccess read_a = accessRWTex(a, 1, nullptr, 0);
+	dispatch(tracker, &read_a);
+	tracker.resolve(&read_a);
+	TEST_CHECK(tracker.barriers.isEmpty());
+
+	// Write after read
+	const GpuDispatchAccess write_a = accessRWTex(nullptr, 0, a, 1);
+	const GpuDispatchAccess write_b = accessRWTex(nullptr, 0, b, 1);
+	tracker.resolve(&write_b);
+	TEST_CHECK(tracker.barriers.isEmpty());
+	dispatch(tracker, &write_a);
+	TEST_CHECK(barriersEqual(tracker, a, 1));
+
+	// Read after write, then the texture is synchronized
+	const GpuDispatchAccess read_ab = accessRWTex(ab, 2, nullptr, 0);
+	dispatch(tracker, &read_ab);
+	TEST_CHECK(barriersEqual(tracker, a, 1));
+	tracker.resolve(&read_ab);
+	TEST_CHECK(tracker.barriers.isEmpty());
+
+	// Write after write
+	dispatch(tracker, &write_b);
+	TEST_CHECK(barriersEqual(tracker, b, 1)); // WAR of the read above
+	tracker.resolve(&write_b);
+	TEST_CHECK(barriersEqual(tracker, b, 1));
+
+	// Explicit barrier of a single texture
+	tracker.add(&write_b);
+	tracker.onBarrier(b[0]);
+	tracker.resolve(&write_b);
+	TEST_CHECK(tracker.barriers.isEmpty());
+
+	// Nonexistent textures are ignored
+	const GpuRWTex missing[] = { 9, 200 };
+	const GpuDispatchAccess write_missing = accessRWTex(nullptr, 0, missing, 2);
+	dispatch(tracker, &write_missing);
+	tracker.resolve(&write_missing);
+	TEST_CHECK(tracker.barriers.isEmpty());
+}
+
+static void testRWTexBarrierWritten()
+{
+	GpuRWTexHazardTracker tracker = rwtexTracker(8);
+	const GpuRWTex reads[] = { 2, 3 };
+	const GpuRWTex writes[] = { 4, 5 };
+
+	// Nothing accessed, nothing to barrier
+	tracker.barrierWritten();
+	TEST_CHECK(tracker.barriers.isEmpty());
+
+	// Only written textures are barriered, the tracked list only holds accessed textures
+	const GpuDispatchAccess access = accessRWTex(reads, 2, writes, 2);
+	dispatch(tracker, &access);
+	dispatch(tracker, &access); // Tracked once
+	TEST_CHECK(tracker.tracked.size() == 4);
+	tracker.barrierWritten();
+	const GpuRWTex written[] = { 4, 5 };
+	TEST_CHECK(barriersEqual(tracker, written, 2));
+	tracker.barrierWritten();
+	TEST_CHECK(tracker.barriers.isEmpty());
+
+	// Read textures stay tracked, a later write after read needs a barrier
+	TEST_CHECK(tracker.tracked.size() == 2);
+	const GpuDispatchAccess write_read = accessRWTex(nullptr, 0, reads, 1);
+	dispatch(tracker, &write_read);
+	TEST_CHECK(barriersEqual(tracker, reads, 1));
+}
+
+static void testRWTexUndeclared()
+{
+	GpuRWTexHazardTracker tracker = rwtexTracker(4);
+	const GpuRWTex a[] = { 2 };
+	const GpuRWTex b[] = { 3 };
+
+	// An undeclared dispatch synchronizes against declared accesses, reads included
+	const GpuDispatchAccess read_a = accessRWTex(a, 1, nullptr, 0);
+	const GpuDispatchAccess write_b = accessRWTex(nullptr, 0, b, 1);
+	dispatch(tracker, &read_a);
+	dispatch(tracker, &write_b);
+	dispatch(tracker, nullptr);
+	const GpuRWTex both[] = { 2, 3 };
+	TEST_CHECK(barriersEqual(tracker, both, 2));
+	TEST_CHECK(tracker.all_dirty && tracker.tracked.isEmpty());
+
+	// Barriers between undeclared dispatches are the user's responsibility
+	dispatch(tracker, nullptr);
+	TEST_CHECK(tracker.barriers.isEmpty());
+
+	// After an undeclared dispatch everything is dirty, all textures but the null one are barriered
+	dispatch(tracker, &read_a);
+	const GpuRWTex all[] = { 1, 2, 3 };
+	TEST_CHECK(barriersEqual(tracker, all, 3));
+	TEST_CHECK(!tracker.all_dirty);
+
+	// Explicit barrier of all written textures after an undeclared dispatch
+	dispatch(tracker, nullptr);
+	TEST_CHECK(tracker.all_dirty);
+	tracker.barrierWritten();
+	TEST_CHECK(barriersEqual(tracker, all, 3));
+	TEST_CHECK(!tracker.all_dirty);
+	tracker.barrierWritten();
+	TEST_CHECK(tracker.barriers.isEmpty());
+}
+
+static void testRWTexDestroyed()
+{
+	GpuRWTexHazardTracker tracker = rwtexTracker(4);
+	const GpuRWTex a[] = { 2 };
+	const GpuDispatchAccess write_a = accessRWTex(nullptr, 0, a, 1);
+	const GpuDispatchAccess read_a = accessRWTex(a, 1, nullptr, 0);
+
+	// Destroyed with a pending write, no barrier is output
+	dispatch(tracker, &write_a);
+	tracker.setExists(a[0], false);
+	tracker.barrierWritten();
+	TEST_CHECK(tracker.barriers.isEmpty());
+	TEST_CHECK(tracker.tracked.isEmpty());
+
+	// A new texture in a slot that is still in the tracked list isn't added a second time
+	tracker.setExists(a[0], true);
+	dispatch(tracker, &read_a);
+	tracker.setExists(a[0], false);
+	tracker.setExists(a[0], true);
+	dispatch(tracker, &write_a);
+	TEST_CHECK(tracker.barriers.isEmpty()); // The read was of the destroyed texture
+	TEST_CHECK(tracker.tracked.size() == 1);
+	tracker.barrierWritten();
+	TEST_CHECK(barriersEqual(tracker, a, 1));
+	TEST_CHECK(tracker.tracked.isEmpty());
+}
+
+i32 main()
+{
+	TEST_RUN(testRangeSetMerge);
+	TEST_RUN(testRangeSetOverlaps);
+	TEST_RUN(testRangeSetCollapse);
+	TEST_RUN(testHeapHazards);
+	TEST_RUN(testRWTexHazards);
+	TEST_RUN(testRWTexBarrierWritten);
+	TEST_RUN(testRWTexUndeclared);
+	TEST_RUN(testRWTexDestroyed);
+	return testsResult();
+}
@@ -0,0 +1,150 @@
+#include "gpu_lib_tests.hpp"
+
+#include <string.h>
+
+#include <skipifzero_allocators.hpp>
+
+#include <gpu_lib_hot_reload.hpp>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+// Relative to the working directory, ctest runs tests in the build directory
+static const char TEST_DIR[] = "gpu_lib_hot_reload_tests_tmp";
+
+static void clearTestDir()
+{
+	dirCreate(TEST_DIR);
+	SfzArray<GpuFileInfo> files;
+	files.init(64, &g_allocator, sfz_dbg(""));
+	dirListFiles(TEST_DIR, "", files);
+	for (const GpuFileInfo& file : files) fileDelete(file.path.str);
+}
+
+static SfzStr320 testPath(const char* name)
+{
+	SfzStr320 path = {};
+	sfzStr320Appendf(&path, "%s/%s", TEST_DIR, name);
+	return path;
+}
+
+static bool writeTextFile(const char* path, const char* text)
+{
+	const void* parts[1] = { text };
+	const u64 part_sizes[1] = { strlen(text) };
+	return writeFileAtomic(path, parts, part_sizes, 1);
+}
+
+// Rewrites a file and moves its write time forward, so changes don't depend on the resolution of
+// file times.
+static u64 g_next_write_time = 0;
+static void touchFile(const char* path, const char* text)
+{
+	writeTextFile(path, text);
+	g_next_write_time += 1000000000ull;
+	fileSetLastWriteTime(path, g_next_write_time);
+}
+
+static GpuKernelDep testDep(const char* path)
+{
+	GpuKernelDep dep = {};
+	sfzStr320Appendf(&dep.path, "%s", path);
+	return dep;
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testPollInterval()
+{
+	f64 last_poll_ms = 0.0;
+	TEST_CHECK(hotReloadShouldPoll(&last_poll_ms, 1000.0));
+	TEST_CHECK(last_poll_ms == 1000.0);
+	TEST_CHECK(!hotReloadShouldPoll(&last_poll_ms, 1000.0));
+	TEST_CHECK(!hotReloadShouldPoll(&last_poll_ms, 1000.0 + GPU_KERNEL_HOT_RELOAD_POLL_INTERVAL_MS - 1.0));
+	TEST_CHECK(last_poll_ms == 1000.0);
+	TEST_CHECK(hotReloadShouldPoll(&last_poll_ms, 1000.0 + GPU_KERNEL_HOT_RELOAD_POLL_INTERVAL_MS));
+	TEST_CHECK(!hotReloadShouldPoll(&last_poll_ms, 1000.0 + GPU_KERNEL_HOT_RELOAD_POLL_INTERVAL_MS + 1.0));
+}
+
+static void testChanges()
+{
+	clearTestDir();
+	g_next_write_time = fileTimeNow();
+	const SfzStr320 src_path = testPath("kernel.hlsl");
+	const SfzStr320 inc_a_path = testPath("a.hlsli");
+	const SfzStr320 inc_b_path = testPath("b.hlsli");
+	touchFile(src_path.str, "src");
+	touchFile(inc_a_path.str, "a");
+	touchFile(inc_b_path.str, "b");
+
+	const GpuKernelDep deps[2] = { testDep(inc_a_path.str), testDep(inc_b_path.str) };
+	SfzArray<GpuWatchedFile> files;
+	watchedFilesInit(files, src_path.str, deps, 2, &g_allocator);
+	TEST_CHECK(files.size() == 3);
+	TEST_CHECK(strcmp(files[0].path.str, src_path.str) == 0);
+	TEST_CHECK(files[0].last_write_time == fileLastWriteTime(src_path.str));
+	TEST_CHECK(!watchedFilesChanged(files));
+
+	// The source and each include, reported once
+	touchFile(src_path.str, "src 2");
+	TEST_CHECK(watchedFilesChanged(files));
+	TEST_CHECK(!watchedFilesChanged(files));
+	touchFile(inc_b_path.str, "b 2");
+	TEST_CHECK(watchedFilesChanged(files));
+	TEST_CHECK(!watchedFilesChanged(files));
+
+	// Several files changed at once is a single change
+	touchFile(src_path.str, "src 3");
+	touchFile(inc_a_path.str, "a 3");
+	TEST_CHECK(watchedFilesChanged(files));
+	TEST_CHECK(!watchedFilesChanged(files));
+
+	// Older write times count too, e.g. a file reverted by version control
+	fileSetLastWriteTime(inc_a_path.str, files[1].last_write_time - 1000000000ull);
+	TEST_CHECK(watchedFilesChanged(files));
+
+	// Unrelated files are not watched
+	touchFile(testPath("c.hlsli").str, "c");
+	TEST_CHECK(!watchedFilesChanged(files));
+}
+
+static void testMissingFiles()
+{
+	clearTestDir();
+	g_next_write_time = fileTimeNow();
+	const SfzStr320 src_path = testPath("kernel.hlsl");
+	const SfzStr320 inc_path = testPath("a.hlsli");
+	touchFile(src_path.str, "src");
+	touchFile(inc_path.str, "a");
+	const GpuKernelDep deps[1] = { testDep(inc_path.str) };
+	SfzArray<GpuWatchedFile> files;
+	watchedFilesInit(files, src_path.str, deps, 1, &g_allocator);
+
+	// Deleted in the middle of being replaced, nothing to rebuild from yet
+	fileDelete(inc_path.str);
+	TEST_CHECK(!watchedFilesChanged(files));
+	TEST_CHECK(!watchedFilesChanged(files));
+	touchFile(inc_path.str, "a 2");
+	TEST_CHECK(watchedFilesChanged(files));
+	TEST_CHECK(!watchedFilesChanged(files));
+
+	// A file missing from the start is picked up once it's created
+	fileDelete(inc_path.str);
+	watchedFilesInit(files, src_path.str, deps, 1, &g_allocator);
+	TEST_CHECK(files[1].last_write_time == 0);
+	TEST_CHECK(!watchedFilesChanged(files));
+	touchFile(inc_path.str, "a 3");
+	TEST_CHECK(watchedFilesChanged(files));
+	clearTestDir();
+}
+
+i32 main()
+{
+	TEST_RUN(testPollInterval);
+	TEST_RUN(testChanges);
+	TEST_RUN(testMissingFiles);
+	return testsResult();
+}
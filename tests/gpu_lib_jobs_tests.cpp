@@ -0,0 +1,127 @@
+#include "gpu_lib_tests.hpp"
+
+#include <string.h>
+
+#include <gpu_lib_jobs.hpp>
+#include <gpu_lib_platform.hpp>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+// Stands in for a kernel compile, keeps the worker busy for the given time.
+static void spinMs(f64 ms)
+{
+	const f64 end_ms = timeNowMs() + ms;
+	while (timeNowMs() < end_ms) {}
+}
+
+constexpr u32 MAX_NUM_ITEMS = 1024;
+constexpr u32 MAX_NUM_WORKERS = 256;
+
+sfz_struct(TestBatch) {
+	u32 num_runs[MAX_NUM_ITEMS];
+	u32 worker_in_use[MAX_NUM_WORKERS];
+	u32 num_shared_workers;
+	u32 num_invalid_workers;
+	f64 item_ms[MAX_NUM_ITEMS];
+};
+
+static bool testJob(void* user, u32 item_idx, u32 worker_idx)
+{
+	TestBatch& batch = *static_cast<TestBatch*>(user);
+#pragma omp atomic
+	batch.num_runs[item_idx] += 1;
+	if (jobsNumWorkers() <= worker_idx || MAX_NUM_WORKERS <= worker_idx) {
+#pragma omp atomic
+		batch.num_invalid_workers += 1;
+		return false;
+	}
+
+	// Another job using the same worker index at the same time would see it in use
+	u32 in_use = 0;
+#pragma omp atomic capture
+	in_use = batch.worker_in_use[worker_idx]++;
+	if (in_use != 0) {
+#pragma omp atomic
+		batch.num_shared_workers += 1;
+	}
+	spinMs(batch.item_ms[item_idx]);
+#pragma omp atomic
+	batch.worker_in_use[worker_idx] -= 1;
+
+	return (item_idx % 3) != 0;
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testRunsEveryItemOnce()
+{
+	TestBatch* batch = new TestBatch{};
+	for (u32 i = 0; i < MAX_NUM_ITEMS; i++) batch->item_ms[i] = (i % 16) == 0 ? 0.1 : 0.0;
+	bool successes[MAX_NUM_ITEMS] = {};
+	const u32 num_failed = jobsRunBatch(MAX_NUM_ITEMS, testJob, batch, successes, nullptr);
+
+	u32 num_expected_failed = 0;
+	for (u32 i = 0; i < MAX_NUM_ITEMS; i++) {
+		TEST_CHECK(batch->num_runs[i] == 1);
+		TEST_CHECK(successes[i] == ((i % 3) != 0));
+		if ((i % 3) == 0) num_expected_failed += 1;
+	}
+	TEST_CHECK(num_failed == num_expected_failed);
+	TEST_CHECK(batch->num_invalid_workers == 0);
+	TEST_CHECK(batch->num_shared_workers == 0);
+	delete batch;
+}
+
+static void testTimes()
+{
+	TestBatch* batch = new TestBatch{};
+	const f64 item_ms[4] = { 0.0, 8.0, 0.0, 4.0 };
+	for (u32 i = 0; i < 4; i++) batch->item_ms[i] = item_ms[i];
+	f32 times_ms[4] = {};
+	jobsRunBatch(4, testJob, batch, nullptr, times_ms);
+	TEST_CHECK(times_ms[0] < 4.0f);
+	TEST_CHECK(8.0f <= times_ms[1]);
+	TEST_CHECK(times_ms[2] < 4.0f);
+	TEST_CHECK(4.0f <= times_ms[3]);
+	delete batch;
+}
+
+static void testEmpty()
+{
+	TestBatch* batch = new TestBatch{};
+	TEST_CHECK(jobsRunBatch(0, testJob, batch, nullptr, nullptr) == 0);
+	TEST_CHECK(batch->num_runs[0] == 0);
+	delete batch;
+}
+
+// A batch of stub compiles with a mix of costs, like a few full compiles among kernel cache hits.
+// Prints the wall time of the batch against the sum of the item times.
+static void benchmarkBatch()
+{
+	constexpr u32 NUM_ITEMS = 64;
+	TestBatch* batch = new TestBatch{};
+	for (u32 i = 0; i < NUM_ITEMS; i++) batch->item_ms[i] = (i % 8) == 0 ? 8.0 : 0.5;
+	f32 times_ms[NUM_ITEMS] = {};
+
+	const f64 begin_ms = timeNowMs();
+	jobsRunBatch(NUM_ITEMS, testJob, batch, nullptr, times_ms);
+	const f64 batch_ms = timeNowMs() - begin_ms;
+
+	f64 sum_ms = 0.0;
+	for (u32 i = 0; i < NUM_ITEMS; i++) sum_ms += f64(times_ms[i]);
+	TEST_CHECK(batch->num_shared_workers == 0);
+	printf("    %u stub compiles, %u workers: %.1f ms, %.1f ms of work (%.1fx)\n",
+		NUM_ITEMS, jobsNumWorkers(), batch_ms, sum_ms, sum_ms / batch_ms);
+	delete batch;
+}
+
+i32 main()
+{
+	TEST_RUN(testRunsEveryItemOnce);
+	TEST_RUN(testTimes);
+	TEST_RUN(testEmpty);
+	TEST_RUN(benchmarkBatch);
+	return testsResult();
+}
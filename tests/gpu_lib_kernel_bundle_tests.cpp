@@ -0,0 +1,365 @@
+#include "gpu_lib_tests.hpp"
+
+#include <string.h>
+
+#include <gpu_lib_kernel_bundle.hpp>
+#include <gpu_lib_permutations.hpp>
+#include <skipifzero_allocators.hpp>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+constexpr u32 NUM_TEST_INPUTS = 4;
+
+// A few kernels with fake DXIL, two of them are permutations of the same kernel.
+struct TestInputs final {
+	u8 dxils[NUM_TEST_INPUTS][100];
+	GpuLaunchParamLayout layouts[NUM_TEST_INPUTS];
+	GpuKernelBundleInput inputs[NUM_TEST_INPUTS];
+
+	TestInputs()
+	{
+		const char* names[NUM_TEST_INPUTS] = { "blur", "tonemap", "tonemap", "last-kernel" };
+		const u32 keys[NUM_TEST_INPUTS] = { GPU_KERNEL_BUNDLE_NO_PERMUTATION, 0, 1, GPU_KERNEL_BUNDLE_NO_PERMUTATION };
+		for (u32 i = 0; i < NUM_TEST_INPUTS; i++) {
+			for (u32 j = 0; j < sizeof(dxils[i]); j++) dxils[i][j] = u8(i * 31 + j);
+			layouts[i] = {};
+			layouts[i].size = 16 * (i + 1);
+			layouts[i].used_size = 4 * (i + 1);
+			inputs[i] = {};
+			inputs[i].name = names[i];
+			inputs[i].permutation_key = keys[i];
+			inputs[i].dxil = dxils[i];
+			inputs[i].dxil_size = 37 + i * 20; // Not a multiple of the alignment
+			inputs[i].group_dims = i32x3_init(8 * (i + 1), 1, 1);
+			inputs[i].param_layout = &layouts[i];
+		}
+	}
+};
+
+static bool entryMatches(const SfzArray<u8>& bundle, const GpuKernelBundleEntry* entry, const GpuKernelBundleInput& input)
+{
+	if (entry == nullptr) return false;
+	return entry->permutation_key == input.permutation_key &&
+		entry->dxil_size == input.dxil_size &&
+		memcmp(bundle.data() + entry->dxil_offset, input.dxil, input.dxil_size) == 0 &&
+		(entry->dxil_offset % GPU_KERNEL_BUNDLE_ALIGN) == 0 &&
+		entry->group_dims == input.group_dims &&
+		memcmp(bundle.data() + entry->param_layout_offset, input.param_layout, sizeof(GpuLaunchParamLayout)) == 0 &&
+		entry->dxil_hash == sha256(input.dxil, input.dxil_size);
+}
+
+static GpuKernelBundleHeader& header(SfzArray<u8>& bundle)
+{
+	return *reinterpret_cast<GpuKernelBundleHeader*>(bundle.data());
+}
+
+static GpuKernelBundleEntry* entries(SfzArray<u8>& bundle)
+{
+	return reinterpret_cast<GpuKernelBundleEntry*>(bundle.data() + sizeof(GpuKernelBundleHeader));
+}
+
+// Builds the test bundle, corrupts a copy of it and checks that the kernel can't be found.
+static bool findInCorrupted(const char* name, u32 key, void(*corrupt)(SfzArray<u8>& bundle))
+{
+	TestInputs t;
+	SfzArray<u8> bundle;
+	if (!kernelBundleBuild(t.inputs, NUM_TEST_INPUTS, &g_allocator, bundle)) return true;
+	corrupt(bundle);
+	const bool found = kernelBundleFind(bundle.data(), bundle.size(), name, key) != nullptr;
+	bundle.destroy();
+	return found;
+}
+
+static char* copyLine(char* buffer, u32 buffer_size, const char* line)
+{
+	snprintf(buffer, buffer_size, "%s", line);
+	return buffer;
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testBuildAndFind()
+{
+	TestInputs t;
+	SfzArray<u8> bundle;
+	TEST_CHECK(kernelBundleBuild(t.inputs, NUM_TEST_INPUTS, &g_allocator, bundle));
+	TEST_CHECK(header(bundle).magic == GPU_KERNEL_BUNDLE_MAGIC);
+	TEST_CHECK(header(bundle).total_size == bundle.size());
+	TEST_CHECK(header(bundle).num_entries == NUM_TEST_INPUTS);
+
+	for (u32 i = 0; i < NUM_TEST_INPUTS; i++) {
+		const GpuKernelBundleInput& input = t.inputs[i];
+		const GpuKernelBundleEntry* entry =
+			kernelBundleFind(bundle.data(), bundle.size(), input.name, input.permutation_key);
+		TEST_CHECK(entryMatches(bundle, entry, input));
+	}
+
+	// Entries are sorted by (name hash, key)
+	const GpuKernelBundleEntry* sorted = entries(bundle);
+	for (u32 i = 1; i < NUM_TEST_INPUTS; i++) {
+		TEST_CHECK(sorted[i - 1].name_hash < sorted[i].name_hash ||
+			(sorted[i - 1].name_hash == sorted[i].name_hash && sorted[i - 1].permutation_key < sorted[i].permutation_key));
+	}
+
+	// Unknown names and keys
+	TEST_CHECK(kernelBundleFind(bundle.data(), bundle.size(), "missing", GPU_KERNEL_BUNDLE_NO_PERMUTATION) == nullptr);
+	TEST_CHECK(kernelBundleFind(bundle.data(), bundle.size(), "tonemap", 2) == nullptr);
+	TEST_CHECK(kernelBundleFind(bundle.data(), bundle.size(), "tonemap", GPU_KERNEL_BUNDLE_NO_PERMUTATION) == nullptr);
+	TEST_CHECK(kernelBundleFind(bundle.data(), bundle.size(), "blur", 0) == nullptr);
+
+	// Param layouts through the public API
+	GpuLaunchParamLayout layout = {};
+	TEST_CHECK(gpuKernelBundleGetParamLayout(bundle.data(), bundle.size(), "tonemap", 1, &layout));
+	TEST_CHECK(layout.size == t.layouts[2].size && layout.used_size == t.layouts[2].used_size);
+	TEST_CHECK(!gpuKernelBundleGetParamLayout(bundle.data(), bundle.size(), "tonemap", 5, &layout));
+	bundle.destroy();
+
+	// Empty bundle
+	TEST_CHECK(kernelBundleBuild(nullptr, 0, &g_allocator, bundle));
+	TEST_CHECK(kernelBundleFind(bundle.data(), bundle.size(), "blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION) == nullptr);
+	bundle.destroy();
+}
+
+static void testBuildRejectsDuplicates()
+{
+	TestInputs t;
+	SfzArray<u8> bundle;
+	t.inputs[2].permutation_key = 0; // Same name and key as inputs[1]
+	TEST_CHECK(!kernelBundleBuild(t.inputs, NUM_TEST_INPUTS, &g_allocator, bundle));
+	TEST_CHECK(bundle.data() == nullptr);
+
+	// Same name as another kernel's permutation, but not a permutation itself is fine
+	TestInputs t2;
+	t2.inputs[2].permutation_key = GPU_KERNEL_BUNDLE_NO_PERMUTATION;
+	TEST_CHECK(kernelBundleBuild(t2.inputs, NUM_TEST_INPUTS, &g_allocator, bundle));
+	bundle.destroy();
+}
+
+static void testFindInvalidBundles()
+{
+	// Sanity check of the helper, the uncorrupted bundle is found
+	TEST_CHECK(findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>&) {}));
+
+	// Null, empty or too small for the header
+	TestInputs t;
+	SfzArray<u8> bundle;
+	TEST_CHECK(kernelBundleBuild(t.inputs, NUM_TEST_INPUTS, &g_allocator, bundle));
+	TEST_CHECK(kernelBundleFind(nullptr, bundle.size(), "blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION) == nullptr);
+	TEST_CHECK(kernelBundleFind(bundle.data(), 0, "blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION) == nullptr);
+	TEST_CHECK(kernelBundleFind(bundle.data(), sizeof(GpuKernelBundleHeader) - 1, "blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION) == nullptr);
+
+	// Truncated, e.g. a partially written file
+	TEST_CHECK(kernelBundleFind(bundle.data(), bundle.size() - 1, "blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION) == nullptr);
+	TEST_CHECK(kernelBundleFind(bundle.data(), bundle.size() / 2, "blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION) == nullptr);
+	bundle.destroy();
+
+	// Bad magic and version
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		header(b).magic = 0x12345678;
+	}));
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		header(b).version = GPU_KERNEL_BUNDLE_VERSION + 1;
+	}));
+
+	// Truncated, but with a header claiming the truncated size
+	TEST_CHECK(!findInCorrupted("last-kernel", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		const u32 new_size = b.size() - 2 * GPU_KERNEL_BUNDLE_ALIGN;
+		header(b).total_size = new_size;
+		b.hackSetSize(new_size);
+	}));
+
+	// Header tables out of bounds
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		header(b).num_entries = U32_MAX;
+	}));
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		header(b).strings_size = U32_MAX;
+	}));
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		header(b).strings_offset = sizeof(GpuKernelBundleHeader); // Overlaps the entries
+	}));
+
+	// Entries pointing out of bounds or outside the string table
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		for (u32 i = 0; i < header(b).num_entries; i++) entries(b)[i].dxil_offset = U32_MAX;
+	}));
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		for (u32 i = 0; i < header(b).num_entries; i++) entries(b)[i].dxil_size = u32(b.size());
+	}));
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		for (u32 i = 0; i < header(b).num_entries; i++) entries(b)[i].param_layout_offset = u32(b.size()) - 4;
+	}));
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		for (u32 i = 0; i < header(b).num_entries; i++) entries(b)[i].param_layout_offset += 1;
+	}));
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		for (u32 i = 0; i < header(b).num_entries; i++) entries(b)[i].name_offset = 0; // Before the strings
+	}));
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		for (u32 i = 0; i < header(b).num_entries; i++) entries(b)[i].name_offset = u32(b.size()); // After
+	}));
+
+	// Name hash matches but the name doesn't, e.g. a hash collision
+	TEST_CHECK(!findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		u8* strings = b.data() + header(b).strings_offset;
+		for (u32 i = 0; i < header(b).strings_size; i++) {
+			if (strings[i] == 'b') strings[i] = 'B';
+		}
+	}));
+}
+
+static void testFindNameNotTerminated()
+{
+	// The last name in the string table loses its null-terminator, it must not be read past the
+	// end of the string table (which is followed by the param layouts).
+	TEST_CHECK(!findInCorrupted("last-kernel", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		GpuKernelBundleHeader& h = header(b);
+		b.data()[h.strings_offset + h.strings_size - 1] = 'x';
+	}));
+
+	// Even if the bytes after the table would happen to complete the name
+	TEST_CHECK(!findInCorrupted("last-kernel", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		GpuKernelBundleHeader& h = header(b);
+		h.strings_size -= 1;
+	}));
+
+	// Other names are unaffected
+	TEST_CHECK(findInCorrupted("blur", GPU_KERNEL_BUNDLE_NO_PERMUTATION, [](SfzArray<u8>& b) {
+		GpuKernelBundleHeader& h = header(b);
+		b.data()[h.strings_offset + h.strings_size - 1] = 'x';
+	}));
+}
+
+static void testManifestParse()
+{
+	char buffer[2048];
+	GpuManifestLine line = {};
+
+	// Blank lines and comments, comments may have any number of tokens
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), "  \t\n"), 1, &line));
+	TEST_CHECK(line.type.str[0] == '\0');
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), "# a comment"), 1, &line));
+	TEST_CHECK(line.type.str[0] == '\0');
+	char long_comment[512] = "#";
+	for (u32 i = 0; i < 40; i++) strcat(long_comment, " word");
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), long_comment), 1, &line));
+	TEST_CHECK(line.type.str[0] == '\0');
+
+	// Kernel with defines, colons are only axes on permutation lines
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), "kernel blur shaders/blur.hlsl A=1 B:2\r\n"), 1, &line));
+	TEST_CHECK(strcmp(line.type.str, "kernel") == 0);
+	TEST_CHECK(strcmp(line.name.str, "blur") == 0);
+	TEST_CHECK(strcmp(line.path.str, "shaders/blur.hlsl") == 0);
+	TEST_CHECK(line.num_defines == 2 && line.num_axes == 0);
+	TEST_CHECK(strcmp(line.defines[1].str, "B:2") == 0);
+
+	// Permutations, axes and defines can be mixed
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), "permutations tm tm.hlsl FAST:2 X=3 MODE:3"), 1, &line));
+	TEST_CHECK(line.num_axes == 2 && line.num_defines == 1);
+	TEST_CHECK(strcmp(line.axis_names[1].str, "MODE") == 0 && line.axis_num_values[1] == 3);
+
+	// Invalid lines
+	TEST_CHECK(!manifestParseLine(copyLine(buffer, sizeof(buffer), "kernel blur"), 1, &line));
+	TEST_CHECK(!manifestParseLine(copyLine(buffer, sizeof(buffer), "shader blur blur.hlsl"), 1, &line));
+}
+
+static void testManifestRules()
+{
+	char buffer[2048];
+	GpuManifestLine line = {};
+
+	// Single value axes should be defines
+	TEST_CHECK(!manifestParseLine(copyLine(buffer, sizeof(buffer), "permutations tm tm.hlsl A:2 B:1"), 1, &line));
+	TEST_CHECK(!manifestParseLine(copyLine(buffer, sizeof(buffer), "permutations tm tm.hlsl A:0"), 1, &line));
+	TEST_CHECK(!manifestParseLine(copyLine(buffer, sizeof(buffer), "permutations tm tm.hlsl A:x"), 1, &line));
+
+	// Token limit: type, name, path and at most GPU_KERNEL_MAX_NUM_AXES + GPU_KERNEL_MAX_NUM_DEFINES
+	// more. Lines with more tokens are rejected rather than silently truncated.
+	const u32 max_num_tokens = 3 + GPU_KERNEL_MAX_NUM_AXES + GPU_KERNEL_MAX_NUM_DEFINES;
+	char many[1024] = "kernel k k.hlsl";
+	for (u32 i = 3; i < max_num_tokens; i++) strcat(many, " D");
+	TEST_CHECK(!manifestParseLine(copyLine(buffer, sizeof(buffer), many), 1, &line)); // Too many defines
+	strcat(many, " D");
+	TEST_CHECK(!manifestParseLine(copyLine(buffer, sizeof(buffer), many), 1, &line)); // Too many tokens
+
+	// Define limit, and defines + axes share it
+	char defines[512] = "kernel k k.hlsl";
+	for (u32 i = 0; i < GPU_KERNEL_MAX_NUM_DEFINES; i++) strcat(defines, " D");
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), defines), 1, &line));
+	TEST_CHECK(line.num_defines == GPU_KERNEL_MAX_NUM_DEFINES);
+	char shared[512] = "permutations k k.hlsl A:2";
+	for (u32 i = 1; i < GPU_KERNEL_MAX_NUM_DEFINES; i++) strcat(shared, " D");
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), shared), 1, &line));
+	strcat(shared, " D");
+	TEST_CHECK(!manifestParseLine(copyLine(buffer, sizeof(buffer), shared), 1, &line));
+
+	// Axis limit
+	char axes[512] = "permutations k k.hlsl";
+	for (u32 i = 0; i < GPU_KERNEL_MAX_NUM_AXES; i++) strcat(axes, " A:2");
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), axes), 1, &line));
+	strcat(axes, " A:2");
+	TEST_CHECK(!manifestParseLine(copyLine(buffer, sizeof(buffer), axes), 1, &line));
+
+	// Axis name length
+	char long_axis[256] = "permutations k k.hlsl ";
+	const u32 prefix_len = u32(strlen(long_axis));
+	memset(long_axis + prefix_len, 'N', GPU_KERNEL_AXIS_NAME_MAX_LEN);
+	strcat(long_axis, ":2");
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), long_axis), 1, &line));
+	memcpy(long_axis + prefix_len + GPU_KERNEL_AXIS_NAME_MAX_LEN, "N:2", 4);
+	TEST_CHECK(!manifestParseLine(copyLine(buffer, sizeof(buffer), long_axis), 1, &line));
+}
+
+static void testManifestAddKernels()
+{
+	SfzArray<GpuManifestKernel> kernels;
+	kernels.init(64, &g_allocator, sfz_dbg(""));
+	char buffer[2048];
+	GpuManifestLine line = {};
+
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), "kernel blur blur.hlsl R=4"), 1, &line));
+	TEST_CHECK(manifestAddKernels(line, 1, kernels));
+	TEST_CHECK(kernels.size() == 1);
+	TEST_CHECK(kernels[0].permutation_key == GPU_KERNEL_BUNDLE_NO_PERMUTATION);
+	TEST_CHECK(kernels[0].num_defines == 1 && strcmp(kernels[0].defines[0].str, "R=4") == 0);
+
+	// One kernel per permutation, with keys matching permutationKeyPack()
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), "permutations tm tm.hlsl FAST:2 X=1 MODE:3"), 2, &line));
+	TEST_CHECK(manifestAddKernels(line, 2, kernels));
+	TEST_CHECK(kernels.size() == 7);
+	const u32 num_values[] = { 2, 3 };
+	for (u32 i = 1; i < kernels.size(); i++) {
+		const GpuManifestKernel& kernel = kernels[i];
+		TEST_CHECK(kernel.permutation_key == i - 1);
+		TEST_CHECK(kernel.num_defines == 3 && strcmp(kernel.defines[0].str, "X=1") == 0);
+		u32 values[2] = {};
+		TEST_CHECK(sscanf(kernel.defines[1].str, "FAST=%u", &values[0]) == 1);
+		TEST_CHECK(sscanf(kernel.defines[2].str, "MODE=%u", &values[1]) == 1);
+		TEST_CHECK(permutationKeyPack(num_values, 2, values) == kernel.permutation_key);
+	}
+
+	// Too many permutations, including products that wrap around in 32 bits
+	kernels.clear();
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), "permutations k k.hlsl A:64 B:65"), 3, &line));
+	TEST_CHECK(!manifestAddKernels(line, 3, kernels));
+	TEST_CHECK(manifestParseLine(copyLine(buffer, sizeof(buffer), "permutations k k.hlsl A:2 B:2147483648"), 3, &line));
+	TEST_CHECK(!manifestAddKernels(line, 3, kernels));
+	TEST_CHECK(kernels.size() == 0);
+	kernels.destroy();
+}
+
+i32 main()
+{
+	TEST_RUN(testBuildAndFind);
+	TEST_RUN(testBuildRejectsDuplicates);
+	TEST_RUN(testFindInvalidBundles);
+	TEST_RUN(testFindNameNotTerminated);
+	TEST_RUN(testManifestParse);
+	TEST_RUN(testManifestRules);
+	TEST_RUN(testManifestAddKernels);
+	return testsResult();
+}
@@ -0,0 +1,621 @@
+#include "gpu_lib_tests.hpp"
+
+#include <string.h>
+
+#include <skipifzero_allocators.hpp>
+
+#include <gpu_lib_kernel_cache.hpp>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+// Relative to the working directory, ctest runs tests in the build directory
+static const char TEST_DIR[] = "gpu_lib_kernel_cache_tests_tmp";
+
+static void clearTestDir()
+{
+	dirCreate(TEST_DIR);
+	SfzArray<GpuFileInfo> files;
+	files.init(64, &g_allocator, sfz_dbg(""));
+	dirListFiles(TEST_DIR, "", files);
+	for (const GpuFileInfo& file : files) fileDelete(file.path.str);
+}
+
+static SfzStr320 testPath(const char* name)
+{
+	SfzStr320 path = {};
+	sfzStr320Appendf(&path, "%s/%s", TEST_DIR, name);
+	return path;
+}
+
+static bool writeTextFile(const char* path, const char* text)
+{
+	const void* parts[1] = { text };
+	const u64 part_sizes[1] = { strlen(text) };
+	return writeFileAtomic(path, parts, part_sizes, 1);
+}
+
+static GpuHash hashString(const char* str) { return sha256(str, strlen(str)); }
+
+static bool hashEquals(const GpuHash& hash, const char* hex) { return strcmp(hashToString(hash).str, hex) == 0; }
+
+static SfzStr320 entryPath(const GpuHash& key)
+{
+	SfzStr320 path = {};
+	sfzStr320Appendf(&path, "%s/%s.gkc", TEST_DIR, hashToString(key).str);
+	return path;
+}
+
+static GpuKernelBinary testBinary(u32 dxil_size, const char* dep_path)
+{
+	GpuKernelBinary binary = {};
+	binary.dxil.init(dxil_size, &g_allocator, sfz_dbg(""));
+	for (u32 i = 0; i < dxil_size; i++) binary.dxil.add(u8(i * 7));
+	binary.group_dims = i32x3_init(8, 4, 2);
+	binary.param_layout.size = 48;
+	binary.param_layout.used_size = 44;
+	binary.deps.init(1, &g_allocator, sfz_dbg(""));
+	if (dep_path != nullptr) {
+		GpuKernelDep& dep = binary.deps.add();
+		sfzStr320Appendf(&dep.path, "%s", dep_path);
+		SfzArray<u8> contents;
+		fileReadAll(dep_path, &g_allocator, contents);
+		dep.hash = sha256(contents.data(), contents.size());
+	}
+	return binary;
+}
+
+static bool binariesEqual(const GpuKernelBinary& a, const GpuKernelBinary& b)
+{
+	if (a.dxil.size() != b.dxil.size() || memcmp(a.dxil.data(), b.dxil.data(), a.dxil.size()) != 0) return false;
+	if (a.group_dims != b.group_dims) return false;
+	if (memcmp(&a.param_layout, &b.param_layout, sizeof(GpuLaunchParamLayout)) != 0) return false;
+	if (a.deps.size() != b.deps.size()) return false;
+	for (u32 i = 0; i < a.deps.size(); i++) {
+		if (strcmp(a.deps[i].path.str, b.deps[i].path.str) != 0 || a.deps[i].hash != b.deps[i].hash) return false;
+	}
+	return true;
+}
+
+static bool cacheLoad(GpuKernelCache* cache, const GpuHash& key, GpuKernelBinary* out)
+{
+	GpuIncludeCache include_cache = {};
+	includeCacheInit(&include_cache, &g_allocator);
+	*out = {};
+	return kernelCacheLoad(cache, key, &include_cache, &g_allocator, out);
+}
+
+static GpuPipelineLibraryKey testLibraryKey()
+{
+	GpuPipelineLibraryKey key = {};
+	key.vendor_id = 0x10DE;
+	key.device_id = 0x2684;
+	key.subsys_id = 0x16F31458;
+	key.revision = 0xA1;
+	key.driver_version = 0x0020000E0C9B1234ull;
+	key.d3d12_sdk_version = 614;
+	return key;
+}
+
+static SfzArray<u8> testBlob(u32 num_bytes)
+{
+	SfzArray<u8> blob;
+	blob.init(num_bytes, &g_allocator, sfz_dbg(""));
+	for (u32 i = 0; i < num_bytes; i++) blob.add(u8(i * 13 + 5));
+	return blob;
+}
+
+static bool libraryLoad(const GpuKernelCache* cache, const GpuPipelineLibraryKey& key, u32* num_pipelines_out)
+{
+	SfzArray<u8> blob;
+	return pipelineLibraryFileLoad(cache, key, &g_allocator, blob, num_pipelines_out);
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testSha256KnownAnswers()
+{
+	// FIPS 180-2 examples, the 56 byte message needs a second block for the padding and the 112
+	// byte one spans two blocks before padding
+	TEST_CHECK(hashEquals(hashString(""),
+		"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+	TEST_CHECK(hashEquals(hashString("abc"),
+		"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+	TEST_CHECK(hashEquals(hashString("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+		"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+	TEST_CHECK(hashEquals(hashString(
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"),
+		"cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"));
+
+	// One million 'a', fed in uneven pieces
+	u8 a_chunk[1000];
+	memset(a_chunk, 'a', sizeof(a_chunk));
+	GpuSha256 ctx = sha256Init();
+	u32 num_left = 1000000;
+	for (u32 i = 0; num_left > 0; i++) {
+		const u32 num_bytes = u32_min(num_left, 1 + (i * 37) % 1000);
+		sha256Update(&ctx, a_chunk, num_bytes);
+		num_left -= num_bytes;
+	}
+	TEST_CHECK(hashEquals(sha256Final(&ctx),
+		"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"));
+}
+
+static void testSha256BlockBoundaries()
+{
+	// Messages of bytes i % 251 around the padding and block boundaries, reference from Python's
+	// hashlib
+	struct { u32 num_bytes; const char* hex; } const known[] = {
+		{ 55, "463eb28e72f82e0a96c0a4cc53690c571281131f672aa229e0d45ae59b598b59" },
+		{ 56, "da2ae4d6b36748f2a318f23e7ab1dfdf45acdc9d049bd80e59de82a60895f562" },
+		{ 63, "29af2686fd53374a36b0846694cc342177e428d1647515f078784d69cdb9e488" },
+		{ 64, "fdeab9acf3710362bd2658cdc9a29e8f9c757fcf9811603a8c447cd1d9151108" },
+		{ 65, "4bfd2c8b6f1eec7a2afeb48b934ee4b2694182027e6d0fc075074f2fabb31781" },
+		{ 119, "da18797ed7c3a777f0847f429724a2d8cd5138e6ed2895c3fa1a6d39d18f7ec6" },
+		{ 120, "f52b23db1fbb6ded89ef42a23ce0c8922c45f25c50b568a93bf1c075420bbb7c" },
+		{ 128, "471fb943aa23c511f6f72f8d1652d9c880cfa392ad80503120547703e56a2be5" },
+	};
+	u8 data[128];
+	for (u32 i = 0; i < 128; i++) data[i] = u8(i % 251);
+
+	for (const auto& k : known) {
+		TEST_CHECK(hashEquals(sha256(data, k.num_bytes), k.hex));
+
+		// Split at every position, the result must not depend on how the data is fed
+		bool all_splits_equal = true;
+		for (u32 split = 0; split <= k.num_bytes; split++) {
+			GpuSha256 ctx = sha256Init();
+			sha256Update(&ctx, data, split);
+			sha256Update(&ctx, data + split, k.num_bytes - split);
+			all_splits_equal = all_splits_equal && hashEquals(sha256Final(&ctx), k.hex);
+		}
+		TEST_CHECK(all_splits_equal);
+	}
+}
+
+static void testWriteFileAtomic()
+{
+	clearTestDir();
+	const SfzStr320 path = testPath("atomic.bin");
+
+	// Parts are concatenated, empty parts skipped
+	const char* parts[3] = { "hello ", "", "world" };
+	const u64 part_sizes[3] = { 6, 0, 5 };
+	TEST_CHECK(writeFileAtomic(path.str, (const void* const*)parts, part_sizes, 3));
+	SfzArray<u8> contents;
+	TEST_CHECK(fileReadAll(path.str, &g_allocator, contents));
+	TEST_CHECK(contents.size() == 11 && memcmp(contents.data(), "hello world", 11) == 0);
+
+	// Replaces an existing file, no temporary files left behind
+	TEST_CHECK(writeTextFile(path.str, "bye"));
+	TEST_CHECK(fileReadAll(path.str, &g_allocator, contents));
+	TEST_CHECK(contents.size() == 3 && memcmp(contents.data(), "bye", 3) == 0);
+	SfzArray<GpuFileInfo> tmp_files;
+	tmp_files.init(8, &g_allocator, sfz_dbg(""));
+	dirListFiles(TEST_DIR, ".tmp", tmp_files);
+	TEST_CHECK(tmp_files.size() == 0);
+
+	// Missing files
+	TEST_CHECK(!fileReadAll(testPath("missing.bin").str, &g_allocator, contents));
+	TEST_CHECK(fileLastWriteTime(testPath("missing.bin").str) == 0);
+	TEST_CHECK(!writeTextFile(testPath("missing_dir/file.bin").str, "x"));
+}
+
+static void testCacheStoreLoad()
+{
+	clearTestDir();
+	GpuKernelCache cache = {};
+	TEST_CHECK(kernelCacheInit(&cache, TEST_DIR, 0, &g_allocator));
+	TEST_CHECK(cache.enabled && cache.max_size_bytes == GPU_KERNEL_CACHE_DEFAULT_MAX_SIZE);
+	TEST_CHECK(cache.approx_size_bytes == 0);
+
+	const SfzStr320 inc_path = testPath("common.hlsli");
+	TEST_CHECK(writeTextFile(inc_path.str, "#define COMMON 1\n"));
+	const GpuKernelBinary binary = testBinary(1000, inc_path.str);
+	const GpuHash key = hashString("kernel a");
+	kernelCacheStore(&cache, key, binary);
+
+	u64 entry_size = 0;
+	TEST_CHECK(fileSize(entryPath(key).str, &entry_size));
+	TEST_CHECK(cache.approx_size_bytes == entry_size);
+
+	// Hit returns exactly what was stored
+	GpuKernelBinary loaded = {};
+	TEST_CHECK(cacheLoad(&cache, key, &loaded));
+	TEST_CHECK(binariesEqual(binary, loaded));
+
+	// Other keys miss, as does everything when the cache is disabled
+	TEST_CHECK(!cacheLoad(&cache, hashString("kernel b"), &loaded));
+	GpuKernelCache disabled = {};
+	TEST_CHECK(!kernelCacheInit(&disabled, "", 0, &g_allocator));
+	TEST_CHECK(!cacheLoad(&disabled, key, &loaded));
+
+	// A new cache on the same directory picks up the size and the entry
+	GpuKernelCache reopened = {};
+	TEST_CHECK(kernelCacheInit(&reopened, TEST_DIR, 0, &g_allocator));
+	TEST_CHECK(reopened.approx_size_bytes == entry_size);
+	TEST_CHECK(cacheLoad(&reopened, key, &loaded));
+}
+
+static void testCacheDependencyChanged()
+{
+	clearTestDir();
+	GpuKernelCache cache = {};
+	kernelCacheInit(&cache, TEST_DIR, 0, &g_allocator);
+	const SfzStr320 inc_path = testPath("common.hlsli");
+	TEST_CHECK(writeTextFile(inc_path.str, "#define COMMON 1\n"));
+	const GpuHash key = hashString("kernel a");
+	kernelCacheStore(&cache, key, testBinary(100, inc_path.str));
+	GpuKernelBinary loaded = {};
+	TEST_CHECK(cacheLoad(&cache, key, &loaded));
+
+	// Changed include misses
+	TEST_CHECK(writeTextFile(inc_path.str, "#define COMMON 2\n"));
+	TEST_CHECK(!cacheLoad(&cache, key, &loaded));
+
+	// Changing it back hits again, only the contents matter
+	TEST_CHECK(writeTextFile(inc_path.str, "#define COMMON 1\n"));
+	TEST_CHECK(cacheLoad(&cache, key, &loaded));
+
+	// Deleted include misses
+	TEST_CHECK(fileDelete(inc_path.str));
+	TEST_CHECK(!cacheLoad(&cache, key, &loaded));
+}
+
+static void testCacheInvalidEntries()
+{
+	clearTestDir();
+	GpuKernelCache cache = {};
+	kernelCacheInit(&cache, TEST_DIR, 0, &g_allocator);
+	const GpuHash key = hashString("kernel a");
+	kernelCacheStore(&cache, key, testBinary(100, nullptr));
+	SfzArray<u8> valid;
+	TEST_CHECK(fileReadAll(entryPath(key).str, &g_allocator, valid));
+	GpuKernelBinary loaded = {};
+	TEST_CHECK(cacheLoad(&cache, key, &loaded));
+
+	auto storeCorrupted = [&](auto corrupt) {
+		SfzArray<u8> copy;
+		copy.init(valid.size(), &g_allocator, sfz_dbg(""));
+		copy.add(valid.data(), valid.size());
+		corrupt(copy);
+		const void* parts[1] = { copy.data() };
+		const u64 part_sizes[1] = { copy.size() };
+		writeFileAtomic(entryPath(key).str, parts, part_sizes, 1);
+	};
+
+	// Truncated, in the header and in the dxil
+	storeCorrupted([](SfzArray<u8>& file) { file.hackSetSize(40); });
+	TEST_CHECK(!cacheLoad(&cache, key, &loaded));
+	storeCorrupted([](SfzArray<u8>& file) { file.hackSetSize(file.size() - 1); });
+	TEST_CHECK(!cacheLoad(&cache, key, &loaded));
+
+	// Bad magic and version
+	storeCorrupted([](SfzArray<u8>& file) { file[0] ^= 0xFF; });
+	TEST_CHECK(!cacheLoad(&cache, key, &loaded));
+	storeCorrupted([](SfzArray<u8>& file) { file[4] ^= 0xFF; });
+	TEST_CHECK(!cacheLoad(&cache, key, &loaded));
+
+	// Entry stored under the wrong name
+	storeCorrupted([](SfzArray<u8>& file) { file[8] ^= 0xFF; });
+	TEST_CHECK(!cacheLoad(&cache, key, &loaded));
+
+	// Trailing garbage
+	storeCorrupted([](SfzArray<u8>& file) { file.add(u8(0)); });
+	TEST_CHECK(!cacheLoad(&cache, key, &loaded));
+
+	storeCorrupted([](SfzArray<u8>&) {});
+	TEST_CHECK(cacheLoad(&cache, key, &loaded));
+}
+
+static void testCacheEvict()
+{
+	clearTestDir();
+	GpuKernelCache cache = {};
+	kernelCacheInit(&cache, TEST_DIR, 0, &g_allocator);
+
+	// Four entries, oldest first
+	GpuHash keys[4];
+	const u64 now = fileTimeNow();
+	for (u32 i = 0; i < 4; i++) {
+		keys[i] = hashString(sfzStr96InitFmt("kernel %u", i).str);
+		kernelCacheStore(&cache, keys[i], testBinary(1000, nullptr));
+		fileSetLastWriteTime(entryPath(keys[i]).str, now - (4 - i) * 10000000ull);
+	}
+	u64 entry_size = 0;
+	fileSize(entryPath(keys[0]).str, &entry_size);
+	TEST_CHECK(cache.approx_size_bytes == 4 * entry_size);
+
+	// Loading touches the entry, so the oldest entry is now the second
+	GpuKernelBinary loaded = {};
+	TEST_CHECK(cacheLoad(&cache, keys[0], &loaded));
+
+	// Evicts least recently used until below the max size
+	cache.max_size_bytes = 3 * entry_size - 1;
+	kernelCacheEvict(&cache);
+	TEST_CHECK(cache.approx_size_bytes == 2 * entry_size);
+	TEST_CHECK(cacheLoad(&cache, keys[0], &loaded));
+	TEST_CHECK(!cacheLoad(&cache, keys[1], &loaded));
+	TEST_CHECK(!cacheLoad(&cache, keys[2], &loaded));
+	TEST_CHECK(cacheLoad(&cache, keys[3], &loaded));
+
+	// Storing beyond the max size evicts immediately
+	cache.max_size_bytes = 2 * entry_size;
+	kernelCacheStore(&cache, keys[1], testBinary(1000, nullptr));
+	TEST_CHECK(cache.approx_size_bytes <= cache.max_size_bytes);
+	TEST_CHECK(cacheLoad(&cache, keys[1], &loaded));
+
+	// Other files in the directory are left alone
+	const SfzStr320 other_path = testPath("other.txt");
+	writeTextFile(other_path.str, "not a cache entry");
+	cache.max_size_bytes = 1;
+	kernelCacheEvict(&cache);
+	TEST_CHECK(cache.approx_size_bytes == 0);
+	TEST_CHECK(fileLastWriteTime(other_path.str) != 0);
+	clearTestDir();
+}
+
+static void testIncludeCacheHit()
+{
+	clearTestDir();
+	const SfzStr320 path = testPath("common.hlsli");
+	const char text[] = "#define COMMON 1\n";
+	TEST_CHECK(writeTextFile(path.str, text));
+	GpuIncludeCache cache = {};
+	includeCacheInit(&cache, &g_allocator);
+
+	// First lookup reads and hashes the file
+	const u8* contents = nullptr;
+	u32 size = 0;
+	GpuHash hash = {};
+	TEST_CHECK(includeCacheGet(&cache, path.str, &contents, &size, &hash));
+	TEST_CHECK(size == strlen(text) && memcmp(contents, text, size) == 0);
+	TEST_CHECK(hash == hashString(text));
+	TEST_CHECK(cache.files.size() == 1);
+
+	// Following lookups of the unchanged file return the same entry without reading it again
+	const u8* hit_contents = nullptr;
+	u32 hit_size = 0;
+	GpuHash hit_hash = {};
+	TEST_CHECK(includeCacheGet(&cache, path.str, &hit_contents, &hit_size, &hit_hash));
+	TEST_CHECK(hit_contents == contents && hit_size == size && hit_hash == hash);
+	TEST_CHECK(cache.files.size() == 1);
+
+	// Missing files fail without adding an entry
+	TEST_CHECK(!includeCacheGet(&cache, testPath("missing.hlsli").str, &hit_contents, &hit_size, &hit_hash));
+	TEST_CHECK(cache.files.size() == 1);
+}
+
+static void testIncludeCacheInvalidate()
+{
+	clearTestDir();
+	const SfzStr320 path = testPath("common.hlsli");
+	const SfzStr320 other_path = testPath("other.hlsli");
+	TEST_CHECK(writeTextFile(path.str, "#define COMMON 1\n"));
+	TEST_CHECK(writeTextFile(other_path.str, "#define OTHER 1\n"));
+	const u64 time = fileTimeNow() - 100000000ull;
+	fileSetLastWriteTime(path.str, time);
+	GpuIncludeCache cache = {};
+	includeCacheInit(&cache, &g_allocator);
+
+	const u8* old_contents = nullptr;
+	u32 old_size = 0;
+	GpuHash old_hash = {};
+	TEST_CHECK(includeCacheGet(&cache, path.str, &old_contents, &old_size, &old_hash));
+	const u8* contents = nullptr;
+	u32 size = 0;
+	GpuHash hash = {};
+	TEST_CHECK(includeCacheGet(&cache, other_path.str, &contents, &size, &hash));
+
+	// A changed write time reads the file again into a new entry, the old contents stay valid
+	TEST_CHECK(writeTextFile(path.str, "#define COMMON 22\n"));
+	fileSetLastWriteTime(path.str, time + 1000);
+	TEST_CHECK(includeCacheGet(&cache, path.str, &contents, &size, &hash));
+	TEST_CHECK(hash == hashString("#define COMMON 22\n") && hash != old_hash);
+	TEST_CHECK(contents != old_contents && size == old_size + 1);
+	TEST_CHECK(memcmp(old_contents, "#define COMMON 1\n", old_size) == 0);
+	TEST_CHECK(cache.files.size() == 3);
+
+	// The newest entry is the one that hits from now on
+	TEST_CHECK(includeCacheGet(&cache, path.str, &contents, &size, &hash));
+	TEST_CHECK(hash == hashString("#define COMMON 22\n"));
+	TEST_CHECK(cache.files.size() == 3);
+
+	// Going back to an older write time (e.g. a reverted file) is also a change
+	TEST_CHECK(writeTextFile(path.str, "#define COMMON 1\n"));
+	fileSetLastWriteTime(path.str, time);
+	TEST_CHECK(includeCacheGet(&cache, path.str, &contents, &size, &hash));
+	TEST_CHECK(hash == old_hash);
+	TEST_CHECK(cache.files.size() == 4);
+
+	// Deleted file fails, even though it has entries
+	TEST_CHECK(fileDelete(path.str));
+	TEST_CHECK(!includeCacheGet(&cache, path.str, &contents, &size, &hash));
+}
+
+static void testIncludeCacheThreads()
+{
+	clearTestDir();
+	constexpr u32 NUM_FILES = 8;
+	for (u32 i = 0; i < NUM_FILES; i++) {
+		const SfzStr320 path = testPath(sfzStr96InitFmt("inc_%u.hlsli", i).str);
+		TEST_CHECK(writeTextFile(path.str, sfzStr96InitFmt("#define INC %u\n", i).str));
+	}
+	GpuIncludeCache cache = {};
+	includeCacheInit(&cache, &g_allocator);
+
+	// Concurrent lookups all see the right file, threads racing on a miss may add redundant entries
+	i32 num_wrong = 0;
+	#pragma omp parallel for schedule(dynamic) reduction(+:num_wrong)
+	for (i32 i = 0; i < 4000; i++) {
+		const u32 file_idx = u32(i) % NUM_FILES;
+		const u8* contents = nullptr;
+		u32 size = 0;
+		GpuHash hash = {};
+		const SfzStr320 path = testPath(sfzStr96InitFmt("inc_%u.hlsli", file_idx).str);
+		const SfzStr96 text = sfzStr96InitFmt("#define INC %u\n", file_idx);
+		const bool found = includeCacheGet(&cache, path.str, &contents, &size, &hash);
+		if (!found || size != strlen(text.str) || memcmp(contents, text.str, size) != 0 || hash != hashString(text.str)) {
+			num_wrong += 1;
+		}
+	}
+	TEST_CHECK(num_wrong == 0);
+	TEST_CHECK(cache.files.size() >= NUM_FILES);
+	clearTestDir();
+}
+
+static void testPipelineLibraryFile()
+{
+	clearTestDir();
+	GpuKernelCache cache = {};
+	kernelCacheInit(&cache, TEST_DIR, 0, &g_allocator);
+	const GpuPipelineLibraryKey key = testLibraryKey();
+	u32 num_pipelines = 0;
+	TEST_CHECK(!libraryLoad(&cache, key, &num_pipelines));
+
+	// Round trip
+	const SfzArray<u8> blob = testBlob(5000);
+	pipelineLibraryFileStore(&cache, key, blob.data(), blob.size(), 17);
+	SfzArray<u8> loaded;
+	TEST_CHECK(pipelineLibraryFileLoad(&cache, key, &g_allocator, loaded, &num_pipelines));
+	TEST_CHECK(num_pipelines == 17);
+	TEST_CHECK(loaded.size() == blob.size() && memcmp(loaded.data(), blob.data(), blob.size()) == 0);
+
+	// Any difference in adapter, driver or SDK version rejects the file
+	GpuPipelineLibraryKey other[6] = {};
+	for (GpuPipelineLibraryKey& k : other) k = key;
+	other[0].vendor_id += 1;
+	other[1].device_id += 1;
+	other[2].subsys_id += 1;
+	other[3].revision += 1;
+	other[4].driver_version += 1;
+	other[5].d3d12_sdk_version += 1;
+	for (const GpuPipelineLibraryKey& k : other) {
+		TEST_CHECK(k != key);
+		TEST_CHECK(!libraryLoad(&cache, k, &num_pipelines));
+	}
+	TEST_CHECK(libraryLoad(&cache, key, &num_pipelines));
+
+	// Corrupted files are rejected, the blob is hashed
+	const SfzStr320 path = testPath(GPU_PIPELINE_LIBRARY_FILE_NAME);
+	SfzArray<u8> valid;
+	TEST_CHECK(fileReadAll(path.str, &g_allocator, valid));
+	auto storeCorrupted = [&](auto corrupt) {
+		SfzArray<u8> copy;
+		copy.init(valid.size(), &g_allocator, sfz_dbg(""));
+		copy.add(valid.data(), valid.size());
+		corrupt(copy);
+		const void* parts[1] = { copy.data() };
+		const u64 part_sizes[1] = { copy.size() };
+		writeFileAtomic(path.str, parts, part_sizes, 1);
+	};
+	storeCorrupted([](SfzArray<u8>& file) { file.last() ^= 0x01; });
+	TEST_CHECK(!libraryLoad(&cache, key, &num_pipelines));
+	storeCorrupted([](SfzArray<u8>& file) { file.hackSetSize(file.size() - 1); });
+	TEST_CHECK(!libraryLoad(&cache, key, &num_pipelines));
+	storeCorrupted([](SfzArray<u8>& file) { file.hackSetSize(20); });
+	TEST_CHECK(!libraryLoad(&cache, key, &num_pipelines));
+	storeCorrupted([](SfzArray<u8>& file) { file[4] ^= 0xFF; });
+	TEST_CHECK(!libraryLoad(&cache, key, &num_pipelines));
+	storeCorrupted([](SfzArray<u8>&) {});
+	TEST_CHECK(libraryLoad(&cache, key, &num_pipelines));
+
+	// Disabled cache neither loads nor stores
+	GpuKernelCache disabled = {};
+	TEST_CHECK(!libraryLoad(&disabled, key, &num_pipelines));
+	pipelineLibraryFileStore(&disabled, key, blob.data(), blob.size(), 1);
+}
+
+static void testPipelineLibraryNeedsStore()
+{
+	// Nothing new and the file has exactly the live PSOs
+	TEST_CHECK(!pipelineLibraryNeedsStore(0, 10, 10));
+	TEST_CHECK(!pipelineLibraryNeedsStore(0, 0, 0));
+
+	// Some PSOs in the file are no longer used, prune them
+	TEST_CHECK(pipelineLibraryNeedsStore(0, 8, 10));
+	TEST_CHECK(pipelineLibraryNeedsStore(0, 0, 10));
+
+	// New PSOs, even if the count happens to match (one added, one dropped)
+	TEST_CHECK(pipelineLibraryNeedsStore(1, 10, 10));
+	TEST_CHECK(pipelineLibraryNeedsStore(3, 3, 0));
+}
+
+static void testPipelineLibrarySizeBudget()
+{
+	clearTestDir();
+	GpuKernelCache cache = {};
+	kernelCacheInit(&cache, TEST_DIR, 0, &g_allocator);
+	const GpuPipelineLibraryKey key = testLibraryKey();
+	const SfzStr320 library_path = testPath(GPU_PIPELINE_LIBRARY_FILE_NAME);
+
+	// Three kernel entries, oldest first, then the library
+	GpuHash keys[3];
+	const u64 now = fileTimeNow();
+	for (u32 i = 0; i < 3; i++) {
+		keys[i] = hashString(sfzStr96InitFmt("kernel %u", i).str);
+		kernelCacheStore(&cache, keys[i], testBinary(1000, nullptr));
+		fileSetLastWriteTime(entryPath(keys[i]).str, now - (3 - i) * 10000000ull);
+	}
+	u64 entry_size = 0;
+	fileSize(entryPath(keys[0]).str, &entry_size);
+	const SfzArray<u8> blob = testBlob(2000);
+	pipelineLibraryFileStore(&cache, key, blob.data(), blob.size(), 2);
+	u64 library_size = 0;
+	TEST_CHECK(fileSize(library_path.str, &library_size));
+	TEST_CHECK(cache.approx_size_bytes == 3 * entry_size + library_size);
+
+	// The library counts against the size but is never evicted, kernel entries make room for it
+	cache.max_size_bytes = library_size + entry_size;
+	kernelCacheEvict(&cache);
+	TEST_CHECK(cache.approx_size_bytes == library_size + entry_size);
+	u32 num_pipelines = 0;
+	TEST_CHECK(libraryLoad(&cache, key, &num_pipelines));
+	GpuKernelBinary loaded = {};
+	TEST_CHECK(!cacheLoad(&cache, keys[0], &loaded));
+	TEST_CHECK(!cacheLoad(&cache, keys[1], &loaded));
+	TEST_CHECK(cacheLoad(&cache, keys[2], &loaded));
+
+	// Even when it's all that fits
+	cache.max_size_bytes = library_size;
+	kernelCacheEvict(&cache);
+	TEST_CHECK(cache.approx_size_bytes == library_size);
+	TEST_CHECK(libraryLoad(&cache, key, &num_pipelines));
+
+	// Storing a bigger library evicts kernel entries to make room
+	cache.max_size_bytes = library_size + 100;
+	kernelCacheStore(&cache, keys[0], testBinary(1000, nullptr));
+	const SfzArray<u8> bigger_blob = testBlob(2100);
+	pipelineLibraryFileStore(&cache, key, bigger_blob.data(), bigger_blob.size(), 3);
+	TEST_CHECK(libraryLoad(&cache, key, &num_pipelines) && num_pipelines == 3);
+	TEST_CHECK(!cacheLoad(&cache, keys[0], &loaded));
+	TEST_CHECK(cache.approx_size_bytes <= cache.max_size_bytes);
+
+	// A library larger than the whole cache isn't stored, and the old one is removed since it's stale
+	const SfzArray<u8> huge_blob = testBlob(4000);
+	pipelineLibraryFileStore(&cache, key, huge_blob.data(), huge_blob.size(), 4);
+	TEST_CHECK(!libraryLoad(&cache, key, &num_pipelines));
+	TEST_CHECK(fileLastWriteTime(library_path.str) == 0);
+	clearTestDir();
+}
+
+i32 main()
+{
+	TEST_RUN(testSha256KnownAnswers);
+	TEST_RUN(testSha256BlockBoundaries);
+	TEST_RUN(testWriteFileAtomic);
+	TEST_RUN(testCacheStoreLoad);
+	TEST_RUN(testCacheDependencyChanged);
+	TEST_RUN(testCacheInvalidEntries);
+	TEST_RUN(testCacheEvict);
+	TEST_RUN(testIncludeCacheHit);
+	TEST_RUN(testIncludeCacheInvalidate);
+	TEST_RUN(testIncludeCacheThreads);
+	TEST_RUN(testPipelineLibraryFile);
+	TEST_RUN(testPipelineLibraryNeedsStore);
+	TEST_RUN(testPipelineLibrarySizeBudget);
+	return testsResult();
+}
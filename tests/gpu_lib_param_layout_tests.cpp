@@ -0,0 +1,113 @@
+#include "gpu_lib_tests.hpp"
+
+#include <string.h>
+
+#include <gpu_lib.h>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static GpuLaunchParamMember createMember(const char* name, u32 offset, u32 size, GpuParamType type, u32 num_components)
+{
+	GpuLaunchParamMember member = {};
+	strncpy(member.name, name, GPU_LAUNCH_PARAM_NAME_MAX_LEN - 1);
+	member.offset = offset;
+	member.size = size;
+	member.type = type;
+	member.num_components = num_components;
+	return member;
+}
+
+// Members named like the generated constants, these used to break the generated header.
+static GpuLaunchParamLayout createClashingLayout()
+{
+	GpuLaunchParamLayout layout = {};
+	layout.size = 32;
+	layout.used_size = 20;
+	layout.is_large = 0;
+	layout.members[0] = createMember("size", 0, 4, GPU_PARAM_TYPE_U32, 1);
+	layout.members[1] = createMember("offset", 4, 4, GPU_PARAM_TYPE_U32, 1);
+	layout.members[2] = createMember("used_size", 8, 4, GPU_PARAM_TYPE_F32, 1);
+	layout.members[3] = createMember("is_large", 12, 4, GPU_PARAM_TYPE_BOOL, 1);
+	layout.members[4] = createMember("members", 16, 4, GPU_PARAM_TYPE_I32, 1);
+	layout.num_members = 5;
+	return layout;
+}
+
+// Expected output of gpuParamLayoutToCppHeader() for createClashingLayout(), also compiled below
+// to make sure the generated header is valid C++ and works with the static assert macros.
+static const char CLASHING_HEADER[] =
+	"// Launch parameters of \"clash-kernel\"\n"
+	"struct GpuParamLayout_clash_kernel {\n"
+	"\tstatic constexpr u32 size = 32;\n"
+	"\tstatic constexpr u32 used_size = 20;\n"
+	"\tstatic constexpr bool is_large = false;\n"
+	"\tstruct members {\n"
+	"\t\tstatic constexpr u32 size_offset = 0, size_size = 4; // U32 x1\n"
+	"\t\tstatic constexpr u32 offset_offset = 4, offset_size = 4; // U32 x1\n"
+	"\t\tstatic constexpr u32 used_size_offset = 8, used_size_size = 4; // F32 x1\n"
+	"\t\tstatic constexpr u32 is_large_offset = 12, is_large_size = 4; // BOOL x1\n"
+	"\t\tstatic constexpr u32 members_offset = 16, members_size = 4; // I32 x1\n"
+	"\t};\n"
+	"};\n";
+
+// Launch parameters of "clash-kernel"
+struct GpuParamLayout_clash_kernel {
+	static constexpr u32 size = 32;
+	static constexpr u32 used_size = 20;
+	static constexpr bool is_large = false;
+	struct members {
+		static constexpr u32 size_offset = 0, size_size = 4; // U32 x1
+		static constexpr u32 offset_offset = 4, offset_size = 4; // U32 x1
+		static constexpr u32 used_size_offset = 8, used_size_size = 4; // F32 x1
+		static constexpr u32 is_large_offset = 12, is_large_size = 4; // BOOL x1
+		static constexpr u32 members_offset = 16, members_size = 4; // I32 x1
+	};
+};
+
+struct ClashParams {
+	u32 size;
+	u32 offset;
+	f32 used_size;
+	u32 is_large;
+	i32 members;
+};
+GPU_PARAMS_STATIC_ASSERT_SIZE(ClashParams, GpuParamLayout_clash_kernel);
+GPU_PARAMS_STATIC_ASSERT_MEMBER(ClashParams, GpuParamLayout_clash_kernel, size);
+GPU_PARAMS_STATIC_ASSERT_MEMBER(ClashParams, GpuParamLayout_clash_kernel, offset);
+GPU_PARAMS_STATIC_ASSERT_MEMBER(ClashParams, GpuParamLayout_clash_kernel, used_size);
+GPU_PARAMS_STATIC_ASSERT_MEMBER(ClashParams, GpuParamLayout_clash_kernel, is_large);
+GPU_PARAMS_STATIC_ASSERT_MEMBER(ClashParams, GpuParamLayout_clash_kernel, members);
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testClashingMemberNames()
+{
+	const GpuLaunchParamLayout layout = createClashingLayout();
+	char header[2048] = {};
+	const u32 num_chars = gpuParamLayoutToCppHeader(&layout, "clash-kernel", header, sizeof(header));
+	TEST_CHECK(num_chars == strlen(CLASHING_HEADER));
+	TEST_CHECK(strcmp(header, CLASHING_HEADER) == 0);
+	if (strcmp(header, CLASHING_HEADER) != 0) printf("%s", header);
+}
+
+static void testTruncation()
+{
+	const GpuLaunchParamLayout layout = createClashingLayout();
+	const u32 required = gpuParamLayoutToCppHeader(&layout, "clash-kernel", nullptr, 0);
+	TEST_CHECK(required == strlen(CLASHING_HEADER));
+
+	char small[16];
+	memset(small, 'x', sizeof(small));
+	TEST_CHECK(gpuParamLayoutToCppHeader(&layout, "clash-kernel", small, sizeof(small)) == required);
+	TEST_CHECK(small[sizeof(small) - 1] == '\0');
+	TEST_CHECK(strncmp(small, CLASHING_HEADER, sizeof(small) - 1) == 0);
+}
+
+i32 main()
+{
+	TEST_RUN(testClashingMemberNames);
+	TEST_RUN(testTruncation);
+	return testsResult();
+}
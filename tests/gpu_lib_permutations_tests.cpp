@@ -0,0 +1,117 @@
+#include "gpu_lib_tests.hpp"
+
+#include <string.h>
+
+#include <gpu_lib_permutations.hpp>
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testKeyRoundTrip()
+{
+	const u32 num_values[] = { 2, 3, 5, 7 };
+	const u32 num_permutations = 2 * 3 * 5 * 7;
+
+	// Every key unpacks to in range values and packs back to itself
+	bool all_round_trip = true;
+	for (u32 key = 0; key < num_permutations; key++) {
+		u32 values[4] = {};
+		permutationKeyUnpack(num_values, 4, key, values);
+		for (u32 i = 0; i < 4; i++) all_round_trip = all_round_trip && values[i] < num_values[i];
+		all_round_trip = all_round_trip && permutationKeyPack(num_values, 4, values) == key;
+	}
+	TEST_CHECK(all_round_trip);
+
+	// First axis least significant
+	const u32 first[] = { 1, 0, 0, 0 };
+	const u32 second[] = { 0, 1, 0, 0 };
+	const u32 last[] = { 1, 2, 4, 6 };
+	TEST_CHECK(permutationKeyPack(num_values, 4, first) == 1);
+	TEST_CHECK(permutationKeyPack(num_values, 4, second) == 2);
+	TEST_CHECK(permutationKeyPack(num_values, 4, last) == num_permutations - 1);
+}
+
+static void testKeyBoundaries()
+{
+	const u32 num_values[] = { 2, 3 };
+
+	// Out of range values on any axis give U32_MAX
+	const u32 bad_first[] = { 2, 0 };
+	const u32 bad_last[] = { 0, 3 };
+	const u32 huge[] = { U32_MAX, 0 };
+	TEST_CHECK(permutationKeyPack(num_values, 2, bad_first) == U32_MAX);
+	TEST_CHECK(permutationKeyPack(num_values, 2, bad_last) == U32_MAX);
+	TEST_CHECK(permutationKeyPack(num_values, 2, huge) == U32_MAX);
+
+	// No axes, a single permutation
+	TEST_CHECK(permutationKeyPack(num_values, 0, nullptr) == 0);
+
+	// The max number of permutations, 8 axes with 2 values each is 256
+	u32 max_values[GPU_KERNEL_MAX_NUM_AXES];
+	u32 ones[GPU_KERNEL_MAX_NUM_AXES];
+	for (u32 i = 0; i < GPU_KERNEL_MAX_NUM_AXES; i++) {
+		max_values[i] = i == 0 ? GPU_KERNEL_MAX_NUM_PERMUTATIONS >> (GPU_KERNEL_MAX_NUM_AXES - 1) : 2;
+		ones[i] = max_values[i] - 1;
+	}
+	TEST_CHECK(permutationKeyPack(max_values, GPU_KERNEL_MAX_NUM_AXES, ones) == GPU_KERNEL_MAX_NUM_PERMUTATIONS - 1);
+	u32 unpacked[GPU_KERNEL_MAX_NUM_AXES] = {};
+	permutationKeyUnpack(max_values, GPU_KERNEL_MAX_NUM_AXES, GPU_KERNEL_MAX_NUM_PERMUTATIONS - 1, unpacked);
+	TEST_CHECK(memcmp(unpacked, ones, sizeof(ones)) == 0);
+}
+
+static void testAxesValidate()
+{
+	u32 num_permutations = 0;
+	const GpuKernelAxis axes[] = { { "A", 2 }, { "B", 3 } };
+	TEST_CHECK(permutationAxesValidate(axes, 2, 0, &num_permutations));
+	TEST_CHECK(num_permutations == 6);
+	TEST_CHECK(permutationAxesValidate(nullptr, 0, 0, &num_permutations));
+	TEST_CHECK(num_permutations == 1);
+
+	// Single value axes should be defines
+	const GpuKernelAxis single[] = { { "A", 2 }, { "B", 1 } };
+	TEST_CHECK(!permutationAxesValidate(single, 2, 0, &num_permutations));
+
+	// Axes and defines share the define slots
+	TEST_CHECK(permutationAxesValidate(axes, 2, GPU_KERNEL_MAX_NUM_DEFINES - 2, &num_permutations));
+	TEST_CHECK(!permutationAxesValidate(axes, 2, GPU_KERNEL_MAX_NUM_DEFINES - 1, &num_permutations));
+	GpuKernelAxis many[GPU_KERNEL_MAX_NUM_AXES + 1];
+	for (GpuKernelAxis& axis : many) axis = { "A", 2 };
+	TEST_CHECK(permutationAxesValidate(many, GPU_KERNEL_MAX_NUM_AXES, 0, &num_permutations));
+	TEST_CHECK(!permutationAxesValidate(many, GPU_KERNEL_MAX_NUM_AXES + 1, 0, &num_permutations));
+
+	// Too many permutations, including products that would overflow 32 bits
+	const GpuKernelAxis max[] = { { "A", 2 }, { "B", GPU_KERNEL_MAX_NUM_PERMUTATIONS / 2 } };
+	const GpuKernelAxis too_many[] = { { "A", 2 }, { "B", GPU_KERNEL_MAX_NUM_PERMUTATIONS / 2 + 1 } };
+	const GpuKernelAxis overflow[] = { { "A", 1u << 16 }, { "B", 1u << 16 }, { "C", 2 } };
+	TEST_CHECK(permutationAxesValidate(max, 2, 0, &num_permutations));
+	TEST_CHECK(num_permutations == GPU_KERNEL_MAX_NUM_PERMUTATIONS);
+	TEST_CHECK(!permutationAxesValidate(too_many, 2, 0, &num_permutations));
+	TEST_CHECK(!permutationAxesValidate(overflow, 3, 0, &num_permutations));
+}
+
+static void testAxisNameMaxLen()
+{
+	// The longest allowed name with the largest value still fits in a define
+	char name[GPU_KERNEL_AXIS_NAME_MAX_LEN + 2] = {};
+	memset(name, 'N', GPU_KERNEL_AXIS_NAME_MAX_LEN);
+	char define[64 + GPU_KERNEL_DEFINE_MAX_LEN] = {};
+	snprintf(define, sizeof(define), "%s=%u", name, GPU_KERNEL_MAX_NUM_PERMUTATIONS - 1);
+	TEST_CHECK(strlen(define) + 1 == GPU_KERNEL_DEFINE_MAX_LEN);
+
+	u32 num_permutations = 0;
+	const GpuKernelAxis longest[] = { { name, 2 } };
+	TEST_CHECK(permutationAxesValidate(longest, 1, 0, &num_permutations));
+	name[GPU_KERNEL_AXIS_NAME_MAX_LEN] = 'N';
+	const GpuKernelAxis too_long[] = { { name, 2 } };
+	TEST_CHECK(!permutationAxesValidate(too_long, 1, 0, &num_permutations));
+}
+
+i32 main()
+{
+	TEST_RUN(testKeyRoundTrip);
+	TEST_RUN(testKeyBoundaries);
+	TEST_RUN(testAxesValidate);
+	TEST_RUN(testAxisNameMaxLen);
+	return testsResult();
+}
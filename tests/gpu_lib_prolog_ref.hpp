@@ -0,0 +1,133 @@
+#pragma once
+
+#include <string.h>
+
+#include <sfz.h>
+
+// CPU reference of the kernel prolog helpers
+// ------------------------------------------------------------------------------------------------
+
+// CPU versions of the memory helpers in GPU_KERNEL_PROLOG (gpu_lib_prolog.hpp), written to follow
+// the HLSL line by line. They pin down the semantics the kernels rely on (return values, signed vs
+// unsigned min/max, wave aggregation order), so any change to the prolog must also be made here.
+//
+// The global heap is a little-endian byte array, same as a ByteAddressBuffer. Waves are simulated
+// by calling a helper once for the whole wave, with per-lane inputs and an active lane mask.
+
+constexpr u32 REF_WAVE_MAX_LANES = 64;
+
+struct RefHeap final {
+	u8* bytes = nullptr;
+	u32 size = 0;
+
+	u32 load(u32 ptr) const { sfz_assert((ptr & 3) == 0 && (ptr + 4) <= size); u32 v; memcpy(&v, bytes + ptr, 4); return v; }
+	void store(u32 ptr, u32 v) { sfz_assert((ptr & 3) == 0 && (ptr + 4) <= size); memcpy(bytes + ptr, &v, 4); }
+	u64 load64(u32 ptr) const { sfz_assert((ptr & 7) == 0 && (ptr + 8) <= size); u64 v; memcpy(&v, bytes + ptr, 8); return v; }
+	void store64(u32 ptr, u64 v) { sfz_assert((ptr & 7) == 0 && (ptr + 8) <= size); memcpy(bytes + ptr, &v, 8); }
+};
+
+struct RefUint4 final { u32 x, y, z, w; };
+
+// Loads and stores
+// ------------------------------------------------------------------------------------------------
+
+inline u32 refPtrLoadU16(const RefHeap& heap, u32 ptr)
+{
+	const u32 word = heap.load(ptr & 0xFFFFFFFC);
+	const u32 half_shift = (ptr & 0x00000002) * 8;
+	return (word >> half_shift) & 0x0000FFFF;
+}
+
+inline RefUint4 refPtrLoad4(const RefHeap& heap, u32 ptr)
+{
+	return RefUint4{ heap.load(ptr), heap.load(ptr + 4), heap.load(ptr + 8), heap.load(ptr + 12) };
+}
+
+inline void refPtrStore4(RefHeap& heap, u32 ptr, RefUint4 val)
+{
+	heap.store(ptr, val.x);
+	heap.store(ptr + 4, val.y);
+	heap.store(ptr + 8, val.z);
+	heap.store(ptr + 12, val.w);
+}
+
+// Atomics
+// ------------------------------------------------------------------------------------------------
+
+// All return the value before the operation, same as the "original_value" out parameter of the
+// HLSL Interlocked*() functions. Single threaded, so atomicity is trivial.
+
+inline u32 refPtrAtomicAdd(RefHeap& heap, u32 ptr, u32 val) { const u32 orig = heap.load(ptr); heap.store(ptr, orig + val); return orig; }
+inline u32 refPtrAtomicMin(RefHeap& heap, u32 ptr, u32 val) { const u32 orig = heap.load(ptr); heap.store(ptr, u32_min(orig, val)); return orig; }
+inline i32 refPtrAtomicMinI(RefHeap& heap, u32 ptr, i32 val) { const i32 orig = i32(heap.load(ptr)); heap.store(ptr, u32(i32_min(orig, val))); return orig; }
+inline u32 refPtrAtomicMax(RefHeap& heap, u32 ptr, u32 val) { const u32 orig = heap.load(ptr); heap.store(ptr, u32_max(orig, val)); return orig; }
+inline i32 refPtrAtomicMaxI(RefHeap& heap, u32 ptr, i32 val) { const i32 orig = i32(heap.load(ptr)); heap.store(ptr, u32(i32_max(orig, val))); return orig; }
+inline u32 refPtrAtomicExchange(RefHeap& heap, u32 ptr, u32 val) { const u32 orig = heap.load(ptr); heap.store(ptr, val); return orig; }
+inline u32 refPtrAtomicCompareExchange(RefHeap& heap, u32 ptr, u32 compare, u32 val)
+{
+	const u32 orig = heap.load(ptr);
+	if (orig == compare) heap.store(ptr, val);
+	return orig;
+}
+
+inline u64 refPtrAtomicAdd64(RefHeap& heap, u32 ptr, u64 val) { const u64 orig = heap.load64(ptr); heap.store64(ptr, orig + val); return orig; }
+inline u64 refPtrAtomicMin64(RefHeap& heap, u32 ptr, u64 val) { const u64 orig = heap.load64(ptr); heap.store64(ptr, orig < val ? orig : val); return orig; }
+inline i64 refPtrAtomicMinI64(RefHeap& heap, u32 ptr, i64 val) { const i64 orig = i64(heap.load64(ptr)); heap.store64(ptr, u64(orig < val ? orig : val)); return orig; }
+inline u64 refPtrAtomicMax64(RefHeap& heap, u32 ptr, u64 val) { const u64 orig = heap.load64(ptr); heap.store64(ptr, orig > val ? orig : val); return orig; }
+inline i64 refPtrAtomicMaxI64(RefHeap& heap, u32 ptr, i64 val) { const i64 orig = i64(heap.load64(ptr)); heap.store64(ptr, u64(orig > val ? orig : val)); return orig; }
+inline u64 refPtrAtomicExchange64(RefHeap& heap, u32 ptr, u64 val) { const u64 orig = heap.load64(ptr); heap.store64(ptr, val); return orig; }
+inline u64 refPtrAtomicCompareExchange64(RefHeap& heap, u32 ptr, u64 compare, u64 val)
+{
+	const u64 orig = heap.load64(ptr);
+	if (orig == compare) heap.store64(ptr, val);
+	return orig;
+}
+
+// Wave intrinsics
+// ------------------------------------------------------------------------------------------------
+
+// Bit i of active_mask is set if lane i is active. Inactive lanes don't take part in the wave ops
+// and their outputs are left untouched.
+
+inline u32 refWaveActiveSum(const u32* vals, u64 active_mask)
+{
+	u32 sum = 0;
+	for (u32 i = 0; i < REF_WAVE_MAX_LANES; i++) {
+		if ((active_mask >> i) & 1) sum += vals[i];
+	}
+	return sum;
+}
+
+inline u32 refWavePrefixSum(const u32* vals, u64 active_mask, u32 lane)
+{
+	u32 sum = 0;
+	for (u32 i = 0; i < lane; i++) {
+		if ((active_mask >> i) & 1) sum += vals[i];
+	}
+	return sum;
+}
+
+// Wave-aggregated atomics
+// ------------------------------------------------------------------------------------------------
+
+inline void refPtrAtomicAddWave(RefHeap& heap, u32 ptr, const u32* vals, u64 active_mask, u32* results_out)
+{
+	if (active_mask == 0) return;
+	const u32 wave_sum = refWaveActiveSum(vals, active_mask);
+	const u32 wave_base = refPtrAtomicAdd(heap, ptr, wave_sum); // Only the first lane
+	for (u32 i = 0; i < REF_WAVE_MAX_LANES; i++) {
+		if (!((active_mask >> i) & 1)) continue;
+		const u32 lane_offset = refWavePrefixSum(vals, active_mask, i);
+		results_out[i] = wave_base + lane_offset;
+	}
+}
+
+inline void refPtrAppendWave(RefHeap& heap, u32 counter_ptr, const bool* append, u64 active_mask, u32* idxs_out)
+{
+	u32 vals[REF_WAVE_MAX_LANES] = {};
+	for (u32 i = 0; i < REF_WAVE_MAX_LANES; i++) vals[i] = append[i] ? 1 : 0;
+	refPtrAtomicAddWave(heap, counter_ptr, vals, active_mask, idxs_out);
+	for (u32 i = 0; i < REF_WAVE_MAX_LANES; i++) {
+		if ((active_mask >> i) & 1) idxs_out[i] = append[i] ? idxs_out[i] : 0xFFFFFFFF;
+	}
+}
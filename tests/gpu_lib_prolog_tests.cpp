@@ -0,0 +1,279 @@
+#include "gpu_lib_tests.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gpu_lib_prolog.hpp>
+
+#include "gpu_lib_prolog_ref.hpp"
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+constexpr u32 HEAP_SIZE = 256;
+
+struct TestHeap final {
+	u8 bytes[HEAP_SIZE] = {};
+	RefHeap heap = { bytes, HEAP_SIZE };
+};
+
+// Runs the lanes in active_mask one at a time in lane order, each calling ptrAtomicAdd().
+static void sequentialAtomicAdd(RefHeap& heap, u32 ptr, const u32* vals, u64 active_mask, u32* results_out)
+{
+	for (u32 i = 0; i < REF_WAVE_MAX_LANES; i++) {
+		if ((active_mask >> i) & 1) results_out[i] = refPtrAtomicAdd(heap, ptr, vals[i]);
+	}
+}
+
+// Copies the last line of the prolog containing str to line_out, returns the number of lines
+// containing it.
+static u32 findPrologLines(const char* str, char* line_out, u32 line_size)
+{
+	u32 num_found = 0;
+	const char* match = GPU_KERNEL_PROLOG;
+	while ((match = strstr(match, str)) != nullptr) {
+		const char* begin = match;
+		while (begin != GPU_KERNEL_PROLOG && begin[-1] != '\n') begin -= 1;
+		const char* end = strchr(match, '\n');
+		snprintf(line_out, line_size, "%.*s", i32(end - begin), begin);
+		num_found += 1;
+		match = end;
+	}
+	return num_found;
+}
+
+static u32 lcgNext(u32& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testLoadU16()
+{
+	TestHeap t;
+	t.heap.store(8, 0xBEEFCAFE);
+	TEST_CHECK(refPtrLoadU16(t.heap, 8) == 0xCAFE);
+	TEST_CHECK(refPtrLoadU16(t.heap, 10) == 0xBEEF);
+	TEST_CHECK(refPtrLoadU16(t.heap, 12) == 0);
+}
+
+static void testLoadStore4()
+{
+	TestHeap t;
+	for (u32 i = 0; i < HEAP_SIZE; i++) t.bytes[i] = 0xAB;
+
+	// 4 byte aligned but not 16 byte aligned is allowed
+	refPtrStore4(t.heap, 20, RefUint4{ 1, 2, 3, 0xFFFFFFFF });
+	const RefUint4 v = refPtrLoad4(t.heap, 20);
+	TEST_CHECK(v.x == 1 && v.y == 2 && v.z == 3 && v.w == 0xFFFFFFFF);
+	TEST_CHECK(t.heap.load(20) == 1);
+	TEST_CHECK(t.heap.load(32) == 0xFFFFFFFF);
+
+	// Neighbours untouched
+	TEST_CHECK(t.heap.load(16) == 0xABABABAB);
+	TEST_CHECK(t.heap.load(36) == 0xABABABAB);
+}
+
+static void testAtomics32()
+{
+	TestHeap t;
+
+	// Add returns the value before and wraps around
+	t.heap.store(0, 0xFFFFFFFE);
+	TEST_CHECK(refPtrAtomicAdd(t.heap, 0, 3) == 0xFFFFFFFE);
+	TEST_CHECK(t.heap.load(0) == 1);
+
+	// -1 is the largest unsigned and smallest signed value, distinguishes the two versions
+	t.heap.store(0, u32(-1));
+	TEST_CHECK(refPtrAtomicMin(t.heap, 0, 5) == 0xFFFFFFFF);
+	TEST_CHECK(t.heap.load(0) == 5);
+	t.heap.store(0, u32(-1));
+	TEST_CHECK(refPtrAtomicMinI(t.heap, 0, 5) == -1);
+	TEST_CHECK(t.heap.load(0) == u32(-1));
+
+	t.heap.store(0, u32(-1));
+	TEST_CHECK(refPtrAtomicMax(t.heap, 0, 5) == 0xFFFFFFFF);
+	TEST_CHECK(t.heap.load(0) == 0xFFFFFFFF);
+	t.heap.store(0, u32(-1));
+	TEST_CHECK(refPtrAtomicMaxI(t.heap, 0, 5) == -1);
+	TEST_CHECK(t.heap.load(0) == 5);
+
+	TEST_CHECK(refPtrAtomicExchange(t.heap, 0, 42) == 5);
+	TEST_CHECK(t.heap.load(0) == 42);
+
+	// Compare exchange only writes on match, but always returns the value before
+	TEST_CHECK(refPtrAtomicCompareExchange(t.heap, 0, 41, 7) == 42);
+	TEST_CHECK(t.heap.load(0) == 42);
+	TEST_CHECK(refPtrAtomicCompareExchange(t.heap, 0, 42, 7) == 42);
+	TEST_CHECK(t.heap.load(0) == 7);
+}
+
+static void testAtomics64()
+{
+	TestHeap t;
+
+	// Carries into the upper word
+	t.heap.store64(8, 0x00000000FFFFFFFF);
+	TEST_CHECK(refPtrAtomicAdd64(t.heap, 8, 1) == 0x00000000FFFFFFFF);
+	TEST_CHECK(t.heap.load64(8) == 0x0000000100000000);
+	TEST_CHECK(t.heap.load(8) == 0 && t.heap.load(12) == 1);
+
+	t.heap.store64(8, u64(-1));
+	TEST_CHECK(refPtrAtomicMin64(t.heap, 8, 5) == ~0ull);
+	TEST_CHECK(t.heap.load64(8) == 5);
+	t.heap.store64(8, u64(-1));
+	TEST_CHECK(refPtrAtomicMinI64(t.heap, 8, 5) == -1);
+	TEST_CHECK(t.heap.load64(8) == ~0ull);
+
+	t.heap.store64(8, u64(-1));
+	TEST_CHECK(refPtrAtomicMax64(t.heap, 8, 5) == ~0ull);
+	TEST_CHECK(t.heap.load64(8) == ~0ull);
+	t.heap.store64(8, u64(-1));
+	TEST_CHECK(refPtrAtomicMaxI64(t.heap, 8, 5) == -1);
+	TEST_CHECK(t.heap.load64(8) == 5);
+
+	TEST_CHECK(refPtrAtomicExchange64(t.heap, 8, 0x123456789ull) == 5);
+	TEST_CHECK(refPtrAtomicCompareExchange64(t.heap, 8, 0x123456788ull, 1) == 0x123456789ull);
+	TEST_CHECK(t.heap.load64(8) == 0x123456789ull);
+	TEST_CHECK(refPtrAtomicCompareExchange64(t.heap, 8, 0x123456789ull, 1) == 0x123456789ull);
+	TEST_CHECK(t.heap.load64(8) == 1);
+}
+
+static void testAtomicAddWaveMatchesLaneOrder()
+{
+	// Random values and active masks, the wave version must give each lane exactly what it would
+	// have gotten if the lanes had called ptrAtomicAdd() one at a time in lane order.
+	u32 state = 1337;
+	for (u32 iter = 0; iter < 1000; iter++) {
+		u32 vals[REF_WAVE_MAX_LANES] = {};
+		for (u32 i = 0; i < REF_WAVE_MAX_LANES; i++) vals[i] = lcgNext(state) % 5;
+		u64 active_mask = (u64(lcgNext(state)) << 40) ^ (u64(lcgNext(state)) << 20) ^ u64(lcgNext(state));
+		if (iter % 4 == 0) active_mask &= 0xFFFFFFFF; // Wave32
+		if (active_mask == 0) active_mask = 1;
+		const u32 base = lcgNext(state);
+
+		TestHeap wave;
+		TestHeap seq;
+		wave.heap.store(4, base);
+		seq.heap.store(4, base);
+		u32 wave_results[REF_WAVE_MAX_LANES] = {};
+		u32 seq_results[REF_WAVE_MAX_LANES] = {};
+		refPtrAtomicAddWave(wave.heap, 4, vals, active_mask, wave_results);
+		sequentialAtomicAdd(seq.heap, 4, vals, active_mask, seq_results);
+
+		TEST_CHECK(wave.heap.load(4) == seq.heap.load(4));
+		for (u32 i = 0; i < REF_WAVE_MAX_LANES; i++) {
+			TEST_CHECK(wave_results[i] == seq_results[i]);
+		}
+	}
+}
+
+static void testAppendWave()
+{
+	TestHeap t;
+	t.heap.store(0, 10);
+
+	// Lanes 0-7 active, lanes 1, 2, 5 and 6 append, lane 8 is inactive but would append
+	bool append[REF_WAVE_MAX_LANES] = {};
+	append[1] = true;
+	append[2] = true;
+	append[5] = true;
+	append[6] = true;
+	append[8] = true;
+	u32 idxs[REF_WAVE_MAX_LANES];
+	for (u32 i = 0; i < REF_WAVE_MAX_LANES; i++) idxs[i] = 1234;
+	refPtrAppendWave(t.heap, 0, append, 0xFF, idxs);
+
+	// Indices are consecutive in lane order, non-appending lanes get U32_MAX
+	TEST_CHECK(idxs[0] == 0xFFFFFFFF);
+	TEST_CHECK(idxs[1] == 10);
+	TEST_CHECK(idxs[2] == 11);
+	TEST_CHECK(idxs[3] == 0xFFFFFFFF);
+	TEST_CHECK(idxs[4] == 0xFFFFFFFF);
+	TEST_CHECK(idxs[5] == 12);
+	TEST_CHECK(idxs[6] == 13);
+	TEST_CHECK(idxs[7] == 0xFFFFFFFF);
+	TEST_CHECK(idxs[8] == 1234);
+	TEST_CHECK(t.heap.load(0) == 14);
+
+	// No lane appends, counter unchanged
+	bool none[REF_WAVE_MAX_LANES] = {};
+	refPtrAppendWave(t.heap, 0, none, ~0ull, idxs);
+	TEST_CHECK(t.heap.load(0) == 14);
+	TEST_CHECK(idxs[1] == 0xFFFFFFFF && idxs[63] == 0xFFFFFFFF);
+}
+
+static void testAppendWaveMultipleWaves()
+{
+	// Several waves appending to the same array in some order, every appending lane must get a
+	// unique index and together they must cover [0, count) without gaps.
+	TestHeap t;
+	u32 state = 42;
+	u32 num_appended = 0;
+	bool seen[32 * REF_WAVE_MAX_LANES] = {};
+	for (u32 wave = 0; wave < 32; wave++) {
+		bool append[REF_WAVE_MAX_LANES] = {};
+		for (u32 i = 0; i < REF_WAVE_MAX_LANES; i++) append[i] = (lcgNext(state) % 3) == 0;
+		const u64 active_mask = (u64(lcgNext(state)) << 32) | u64(lcgNext(state)) | 1;
+		u32 idxs[REF_WAVE_MAX_LANES] = {};
+		refPtrAppendWave(t.heap, 0, append, active_mask, idxs);
+		for (u32 i = 0; i < REF_WAVE_MAX_LANES; i++) {
+			if (!((active_mask >> i) & 1) || !append[i]) continue;
+			TEST_CHECK(idxs[i] < 32 * REF_WAVE_MAX_LANES);
+			TEST_CHECK(!seen[idxs[i]]);
+			seen[idxs[i]] = true;
+			num_appended += 1;
+		}
+	}
+	TEST_CHECK(t.heap.load(0) == num_appended);
+	for (u32 i = 0; i < num_appended; i++) TEST_CHECK(seen[i]);
+}
+
+// The typed views of the rwtex array must match the root signature's descriptor ranges: one per
+// register space, all at u1, in this order. Each needs a getter indexing it non-uniformly.
+static void testTypedViewDeclarations()
+{
+	struct ExpectedView { const char* type; const char* getter; };
+	const ExpectedView views[GPU_RWTEX_ARRAY_NUM_TYPED_VIEWS] = {
+		{ "float4", "getRWTex" },
+		{ "uint4", "getRWTexU" },
+		{ "int4", "getRWTexI" },
+		{ "uint", "getRWTexU1" },
+		{ "int", "getRWTexI1" },
+	};
+	char str[256] = {};
+	char line[256] = {};
+	for (u32 i = 0; i < GPU_RWTEX_ARRAY_NUM_TYPED_VIEWS; i++) {
+		snprintf(str, sizeof(str), "register(u1, space%u);", i);
+		TEST_CHECK(findPrologLines(str, line, sizeof(line)) == 1);
+		char type[16] = {};
+		char name[64] = {};
+		u32 space = ~0u;
+		TEST_CHECK(sscanf(line, "RWTexture2D<%15[^>]> %63[^[][] : register(u1, space%u);", type, name, &space) == 3);
+		TEST_CHECK(space == i);
+		TEST_CHECK(strcmp(type, views[i].type) == 0);
+
+		snprintf(str, sizeof(str), "RWTexture2D<%s> %s(GpuRWTex idx) { return %s[NonUniformResourceIndex(idx)]; }",
+			views[i].type, views[i].getter, name);
+		TEST_CHECK(findPrologLines(str, line, sizeof(line)) == 1);
+	}
+
+	// No other declarations at u1, which would alias the views
+	TEST_CHECK(findPrologLines("register(u1", line, sizeof(line)) == GPU_RWTEX_ARRAY_NUM_TYPED_VIEWS);
+}
+
+i32 main()
+{
+	TEST_RUN(testLoadU16);
+	TEST_RUN(testLoadStore4);
+	TEST_RUN(testAtomics32);
+	TEST_RUN(testAtomics64);
+	TEST_RUN(testAtomicAddWaveMatchesLaneOrder);
+	TEST_RUN(testAppendWave);
+	TEST_RUN(testAppendWaveMultipleWaves);
+	TEST_RUN(testTypedViewDeclarations);
+	return testsResult();
+}
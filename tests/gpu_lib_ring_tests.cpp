@@ -0,0 +1,235 @@
+#include "gpu_lib_tests.hpp"
+
+#include <skipifzero_allocators.hpp>
+#include <skipifzero_arrays.hpp>
+
+#include <gpu_lib_ring.hpp>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+static u32 lcgNext(u32& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+// An allocation in the mapped heap, in use until its submit has completed
+sfz_struct(TestRange) {
+	u64 submit_idx;
+	u64 begin_mapped;
+	u64 size;
+};
+
+// The submit ring the way gpuSubmitQueuedWork() drives it, against a simulated fence that the GPU
+// advances whenever it wants to (and when the CPU waits for it).
+struct TestRing final {
+	u32 num_slots = 0;
+	GpuSubmitSlot slots[GPU_MAX_NUM_CONCURRENT_SUBMITS] = {};
+	GpuHeapRing upload = {};
+	GpuHeapRing download = {};
+	u64 curr_submit_idx = 0;
+	u64 fence_value = 0; // Next value to signal
+	u64 completed_fence_value = 0;
+	u64 num_waits = 0;
+	SfzArray<u64> submit_fence_values; // Per submit
+	SfzArray<TestRange> upload_ranges; // Of submits that might not have completed
+	SfzArray<TestRange> download_ranges;
+
+	TestRing(u32 num_slots_in, u64 heap_size)
+	{
+		num_slots = num_slots_in;
+		upload = heapRingInit(heap_size);
+		download = heapRingInit(heap_size);
+		submit_fence_values.init(4096, &g_allocator, sfz_dbg(""));
+		upload_ranges.init(4096, &g_allocator, sfz_dbg(""));
+		download_ranges.init(4096, &g_allocator, sfz_dbg(""));
+	}
+
+	GpuSubmitSlot& currSlot() { return slots[submitSlotIdx(curr_submit_idx, num_slots)]; }
+
+	void submit()
+	{
+		submitSlotEnd(&currSlot(), fence_value, upload, download);
+		submit_fence_values.add(fence_value);
+		fence_value += 1;
+		curr_submit_idx += 1;
+
+		// Wait until the next command list is done
+		GpuSubmitSlot& slot = currSlot();
+		if (submitSlotInFlight(slot, completed_fence_value)) {
+			completed_fence_value = slot.fence_value;
+			num_waits += 1;
+		}
+		submitSlotBegin(&slot, curr_submit_idx, &upload, &download);
+	}
+
+	bool submitted(u64 submit_idx) const { return submit_idx < curr_submit_idx; }
+	bool completed(u64 submit_idx) const
+	{
+		return submitted(submit_idx) && submit_fence_values[u32(submit_idx)] <= completed_fence_value;
+	}
+
+	// Allocates and checks that the range doesn't overlap any range that might still be in use
+	bool alloc(GpuHeapRing* ring, SfzArray<TestRange>& ranges, u32 num_bytes, u32 align, bool* overlap_out)
+	{
+		u64 begin_mapped = 0;
+		if (!heapRingAlloc(ring, "Test", num_bytes, align, &begin_mapped)) return false;
+		for (u32 i = 0; i < ranges.size();) {
+			if (completed(ranges[i].submit_idx)) {
+				ranges.removeQuickSwap(i);
+				continue;
+			}
+			const TestRange& r = ranges[i];
+			if (begin_mapped < r.begin_mapped + r.size && r.begin_mapped < begin_mapped + num_bytes) *overlap_out = true;
+			i += 1;
+		}
+		*overlap_out = *overlap_out || ring->size < begin_mapped + num_bytes || begin_mapped % align != 0;
+		ranges.add({ curr_submit_idx, begin_mapped, num_bytes });
+		return true;
+	}
+};
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testHeapRingAlloc()
+{
+	GpuHeapRing ring = heapRingInit(1024);
+	u64 begin_mapped = 0;
+
+	// Nothing can be allocated before the first submit has begun
+	TEST_CHECK(!heapRingAlloc(&ring, "Test", 256, 256, &begin_mapped));
+	heapRingRetire(&ring, 0);
+	TEST_CHECK(ring.safe_offset == 1024);
+
+	// The whole heap fits exactly
+	TEST_CHECK(heapRingAlloc(&ring, "Test", 1024, 256, &begin_mapped));
+	TEST_CHECK(begin_mapped == 0 && ring.offset == 1024);
+	TEST_CHECK(!heapRingAlloc(&ring, "Test", 256, 256, &begin_mapped));
+	TEST_CHECK(ring.offset == 1024);
+
+	// Larger than the heap, no matter how much is free
+	heapRingRetire(&ring, 1024);
+	TEST_CHECK(!heapRingAlloc(&ring, "Test", 1025, 256, &begin_mapped));
+	TEST_CHECK(ring.offset == 1024);
+
+	// Retiring an older offset never moves the safe offset back
+	heapRingRetire(&ring, 0);
+	TEST_CHECK(ring.safe_offset == 2048);
+}
+
+static void testHeapRingWrap()
+{
+	GpuHeapRing ring = heapRingInit(1024);
+	heapRingRetire(&ring, 0);
+	u64 begin_mapped = 0;
+
+	// Alignment of the beginning
+	TEST_CHECK(heapRingAlloc(&ring, "Test", 100, 4, &begin_mapped));
+	TEST_CHECK(begin_mapped == 0 && ring.offset == 100);
+	TEST_CHECK(heapRingAlloc(&ring, "Test", 256, 256, &begin_mapped));
+	TEST_CHECK(begin_mapped == 256 && ring.offset == 512);
+	TEST_CHECK(heapRingAlloc(&ring, "Test", 256, 256, &begin_mapped));
+	TEST_CHECK(begin_mapped == 512 && ring.offset == 768);
+
+	// Doesn't fit at the end, wraps around instead of splitting the range, but the beginning is
+	// still in use
+	TEST_CHECK(!heapRingAlloc(&ring, "Test", 512, 256, &begin_mapped));
+	TEST_CHECK(ring.offset == 768);
+
+	// Once the submit of the first allocation has completed
+	heapRingRetire(&ring, 512);
+	TEST_CHECK(ring.safe_offset == 1536);
+	TEST_CHECK(heapRingAlloc(&ring, "Test", 512, 256, &begin_mapped));
+	TEST_CHECK(begin_mapped == 0 && ring.offset == 1536);
+	TEST_CHECK(!heapRingAlloc(&ring, "Test", 256, 256, &begin_mapped));
+}
+
+static void testSubmitSlots()
+{
+	// 3 slots, the GPU doesn't complete anything on its own
+	TestRing t(3, 4096);
+	t.submit(); // Like gpuLibInit()
+	TEST_CHECK(t.upload.safe_offset == 4096 && t.download.safe_offset == 4096);
+	for (u32 i = 0; i < 2; i++) t.submit();
+	TEST_CHECK(t.num_waits == 0);
+
+	// The next slot holds submit 1, which hasn't completed
+	TEST_CHECK(submitSlotInFlight(t.slots[submitSlotIdx(t.curr_submit_idx + 1, 3)], t.completed_fence_value));
+	t.submit();
+	TEST_CHECK(t.num_waits == 1);
+	TEST_CHECK(t.curr_submit_idx == 4);
+
+	// Submit 1 is known to be done from its reused slot, submits 2 and 3 aren't
+	TEST_CHECK(submitSlotReused(t.slots[submitSlotIdx(1, 3)], 1));
+	TEST_CHECK(t.completed(1));
+	TEST_CHECK(!submitSlotReused(t.slots[submitSlotIdx(2, 3)], 2));
+	TEST_CHECK(!t.completed(2));
+	TEST_CHECK(!submitSlotReused(t.slots[submitSlotIdx(3, 3)], 3));
+}
+
+// Random uploads and downloads over many submits with random GPU progress. Checks that no range is
+// handed out while a submit that might still be running uses it, that everything is freed once the
+// slots have been reused, and that gpuWaitForSubmit()'s reuse check only reports completed submits.
+static void testSubmitRingRandom()
+{
+	constexpr u32 NUM_SUBMITS = 2000;
+	constexpr u64 HEAP_SIZE = 1u << 16;
+	u32 rng = 3;
+	for (u32 num_slots = 2; num_slots <= GPU_MAX_NUM_CONCURRENT_SUBMITS; num_slots++) {
+		TestRing t(num_slots, HEAP_SIZE);
+		t.submit();
+		bool overlap = false;
+		bool reuse_ok = true;
+		u32 num_failed = 0;
+		for (u32 s = 0; s < NUM_SUBMITS; s++) {
+			const u32 num_allocs = lcgNext(rng) % 8;
+			for (u32 i = 0; i < num_allocs; i++) {
+				const u32 num_bytes = 256 * (1 + lcgNext(rng) % 16);
+				const u32 align = (lcgNext(rng) % 2) == 0 ? 256 : 4096;
+				const bool download = (lcgNext(rng) % 4) == 0;
+				GpuHeapRing* ring = download ? &t.download : &t.upload;
+				SfzArray<TestRange>& ranges = download ? t.download_ranges : t.upload_ranges;
+
+				if (!t.alloc(ring, ranges, num_bytes, align, &overlap)) num_failed += 1;
+			}
+
+			// The GPU catches up by a random amount
+			const u64 max_completed = t.fence_value - 1;
+			if ((lcgNext(rng) % 2) == 0 && t.completed_fence_value < max_completed) {
+				t.completed_fence_value += 1 + lcgNext(rng) % (max_completed - t.completed_fence_value);
+			}
+			t.submit();
+
+			// Wait for a random earlier submit, done straight away if its slot has been reused
+			const u64 wait_idx = lcgNext(rng) % t.curr_submit_idx;
+			if (submitSlotReused(t.slots[submitSlotIdx(wait_idx, num_slots)], wait_idx)) {
+				reuse_ok = reuse_ok && t.completed(wait_idx);
+			}
+		}
+
+		// Everything is freed once every slot has been reused, half the heap fits wherever the
+		// offset is
+		for (u32 i = 0; i < num_slots; i++) t.submit();
+		TEST_CHECK(t.alloc(&t.upload, t.upload_ranges, HEAP_SIZE / 2, 256, &overlap));
+		TEST_CHECK(t.alloc(&t.download, t.download_ranges, HEAP_SIZE / 2, 256, &overlap));
+
+		TEST_CHECK(!overlap);
+		TEST_CHECK(reuse_ok);
+		TEST_CHECK(num_failed < NUM_SUBMITS);
+		printf("    %u slots: %llu waits, %u of ~%u allocations rejected\n",
+			num_slots, t.num_waits, num_failed, NUM_SUBMITS * 7 / 2);
+	}
+}
+
+i32 main()
+{
+	TEST_RUN(testHeapRingAlloc);
+	TEST_RUN(testHeapRingWrap);
+	TEST_RUN(testSubmitSlots);
+	TEST_RUN(testSubmitRingRandom);
+	return testsResult();
+}
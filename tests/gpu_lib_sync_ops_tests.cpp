@@ -0,0 +1,277 @@
+#include "gpu_lib_tests.hpp"
+
+#include <skipifzero_allocators.hpp>
+
+#include <gpu_lib_sync_ops.hpp>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+constexpr u32 MAX_NUM_STEPS = 256;
+
+sfz_struct(StepLog) {
+	GpuSyncStep steps[MAX_NUM_STEPS];
+	u32 num_steps;
+};
+
+static void logStep(void* user, const GpuSyncStep& step)
+{
+	StepLog& log = *static_cast<StepLog*>(user);
+	TEST_CHECK(log.num_steps < MAX_NUM_STEPS);
+	if (log.num_steps < MAX_NUM_STEPS) log.steps[log.num_steps++] = step;
+}
+
+static bool isExecute(const GpuSyncStep& step, u32 first_list, u32 num_lists)
+{
+	return step.type == GPU_SYNC_STEP_EXECUTE && step.first_list == first_list && step.num_lists == num_lists;
+}
+
+static bool isWait(const GpuSyncStep& step, u64 fence_value)
+{
+	return step.type == GPU_SYNC_STEP_WAIT && step.fence_value == fence_value;
+}
+
+static bool isSignal(const GpuSyncStep& step, u64 fence_value)
+{
+	return step.type == GPU_SYNC_STEP_SIGNAL && step.fence_value == fence_value;
+}
+
+static GpuSyncOpsIssued issue(const SfzArray<GpuQueueSyncOp>& ops, u32 num_lists, u64 max_wait_value, StepLog& log)
+{
+	log.num_steps = 0;
+	return syncOpsIssue(ops.data(), ops.size(), num_lists, max_wait_value, logStep, &log);
+}
+
+static u32 lcgNext(u32& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testIssueAll()
+{
+	// L0 L1 S1 L2 W5 W6 L3 L4 S2 L5, like the main queue's segments and contexts at submit
+	SfzArray<GpuQueueSyncOp> ops;
+	ops.init(16, &g_allocator, sfz_dbg(""));
+	syncOpsAdd(ops, 2, false, 1);
+	syncOpsAdd(ops, 3, true, 5);
+	syncOpsAdd(ops, 3, true, 6);
+	syncOpsAdd(ops, 5, false, 2);
+
+	StepLog log = {};
+	const GpuSyncOpsIssued issued = issue(ops, 6, U64_MAX, log);
+	TEST_CHECK(log.num_steps == 8);
+	TEST_CHECK(isExecute(log.steps[0], 0, 2));
+	TEST_CHECK(isSignal(log.steps[1], 1));
+	TEST_CHECK(isExecute(log.steps[2], 2, 1));
+	TEST_CHECK(isWait(log.steps[3], 5));
+	TEST_CHECK(isWait(log.steps[4], 6));
+	TEST_CHECK(isExecute(log.steps[5], 3, 2));
+	TEST_CHECK(isSignal(log.steps[6], 2));
+	TEST_CHECK(isExecute(log.steps[7], 5, 1));
+	TEST_CHECK(issued.num_lists == 6);
+	TEST_CHECK(issued.num_ops == 4);
+	TEST_CHECK(issued.last_signal_value == 2);
+
+	syncOpsRemoveIssued(ops, issued);
+	TEST_CHECK(ops.isEmpty());
+}
+
+static void testNoLists()
+{
+	SfzArray<GpuQueueSyncOp> ops;
+	ops.init(16, &g_allocator, sfz_dbg(""));
+	StepLog log = {};
+	GpuSyncOpsIssued issued = issue(ops, 0, U64_MAX, log);
+	TEST_CHECK(log.num_steps == 0);
+	TEST_CHECK(issued.num_lists == 0 && issued.num_ops == 0 && issued.last_signal_value == 0);
+
+	// Only ops, e.g. an async signal right after a submit
+	syncOpsAdd(ops, 0, true, 3);
+	syncOpsAdd(ops, 0, false, 4);
+	issued = issue(ops, 0, 3, log);
+	TEST_CHECK(log.num_steps == 2);
+	TEST_CHECK(isWait(log.steps[0], 3));
+	TEST_CHECK(isSignal(log.steps[1], 4));
+	TEST_CHECK(issued.num_lists == 0 && issued.num_ops == 2 && issued.last_signal_value == 4);
+
+	// Only lists
+	ops.clear();
+	issued = issue(ops, 3, 0, log);
+	TEST_CHECK(log.num_steps == 1);
+	TEST_CHECK(isExecute(log.steps[0], 0, 3));
+	TEST_CHECK(issued.num_lists == 3 && issued.num_ops == 0);
+}
+
+static void testHeldWait()
+{
+	// L0 S1 L1 W7 L2 S2 L3, where the main queue has only submitted up to 6
+	SfzArray<GpuQueueSyncOp> ops;
+	ops.init(16, &g_allocator, sfz_dbg(""));
+	syncOpsAdd(ops, 1, false, 1);
+	syncOpsAdd(ops, 2, true, 7);
+	syncOpsAdd(ops, 3, false, 2);
+
+	StepLog log = {};
+	GpuSyncOpsIssued issued = issue(ops, 4, 6, log);
+	TEST_CHECK(log.num_steps == 3);
+	TEST_CHECK(isExecute(log.steps[0], 0, 1));
+	TEST_CHECK(isSignal(log.steps[1], 1));
+	TEST_CHECK(isExecute(log.steps[2], 1, 1));
+	TEST_CHECK(issued.num_lists == 2);
+	TEST_CHECK(issued.num_ops == 1);
+	TEST_CHECK(issued.last_signal_value == 1);
+
+	// The rest is relative to the remaining lists (L2 and L3)
+	syncOpsRemoveIssued(ops, issued);
+	TEST_CHECK(ops.size() == 2);
+	TEST_CHECK(ops[0].wait && ops[0].exec_list_idx == 0 && ops[0].fence_value == 7);
+	TEST_CHECK(!ops[1].wait && ops[1].exec_list_idx == 1 && ops[1].fence_value == 2);
+
+	// Still held, trailing lists aren't executed either
+	issued = issue(ops, 2, 6, log);
+	TEST_CHECK(log.num_steps == 0);
+	TEST_CHECK(issued.num_lists == 0 && issued.num_ops == 0 && issued.last_signal_value == 0);
+	syncOpsRemoveIssued(ops, issued);
+	TEST_CHECK(ops.size() == 2 && ops[1].exec_list_idx == 1);
+
+	// More work queued behind the held wait, then the main queue submits up to 7
+	syncOpsAdd(ops, 3, false, 3);
+	issued = issue(ops, 3, 7, log);
+	TEST_CHECK(log.num_steps == 5);
+	TEST_CHECK(isWait(log.steps[0], 7));
+	TEST_CHECK(isExecute(log.steps[1], 0, 1));
+	TEST_CHECK(isSignal(log.steps[2], 2));
+	TEST_CHECK(isExecute(log.steps[3], 1, 2));
+	TEST_CHECK(isSignal(log.steps[4], 3));
+	TEST_CHECK(issued.num_lists == 3 && issued.num_ops == 3 && issued.last_signal_value == 3);
+	syncOpsRemoveIssued(ops, issued);
+	TEST_CHECK(ops.isEmpty());
+}
+
+// A main queue submit as gpuSubmitQueuedWork() issues it. gpuQueueCmdContexts() ends the current
+// segment and queues the contexts after it, gpuQueueSignal() and gpuQueueWait() end the segment and
+// queue the op after it. The last segment is queued at submit.
+static void testSegmentsAndContexts()
+{
+	// Seg0 CtxA CtxB Seg1 S1 Seg2 CtxC W4 Seg3, the contexts are lists 1, 2 and 5
+	constexpr u32 SEG0 = 0, SEG1 = 3, SEG2 = 4, CTX_C = 5, SEG3 = 6;
+	SfzArray<GpuQueueSyncOp> ops;
+	ops.init(16, &g_allocator, sfz_dbg(""));
+	syncOpsAdd(ops, SEG2, false, 1);
+	syncOpsAdd(ops, SEG3, true, 4);
+
+	StepLog log = {};
+	const GpuSyncOpsIssued issued = issue(ops, SEG3 + 1, U64_MAX, log);
+
+	// Contexts are executed together with the segments around them, ops split the calls
+	TEST_CHECK(log.num_steps == 5);
+	TEST_CHECK(isExecute(log.steps[0], SEG0, SEG1 - SEG0 + 1));
+	TEST_CHECK(isSignal(log.steps[1], 1));
+	TEST_CHECK(isExecute(log.steps[2], SEG2, CTX_C - SEG2 + 1));
+	TEST_CHECK(isWait(log.steps[3], 4));
+	TEST_CHECK(isExecute(log.steps[4], SEG3, 1));
+	TEST_CHECK(issued.num_lists == SEG3 + 1 && issued.num_ops == 2 && issued.last_signal_value == 1);
+}
+
+// Lists and ops queued to a queue, each tagged with its position in the order they were queued.
+// Issued items are checked against that order.
+struct TestQueue final {
+	SfzArray<u32> lists;
+	SfzArray<GpuQueueSyncOp> ops;
+	SfzArray<u32> op_items;
+	u32 num_queued = 0;
+	u32 num_issued = 0;
+	bool order_ok = true;
+	bool waits_ok = true;
+
+	TestQueue(u32 capacity)
+	{
+		lists.init(capacity, &g_allocator, sfz_dbg(""));
+		ops.init(capacity, &g_allocator, sfz_dbg(""));
+		op_items.init(capacity, &g_allocator, sfz_dbg(""));
+	}
+
+	void addList() { lists.add(num_queued++); }
+
+	void addOp(bool wait, u64 fence_value)
+	{
+		syncOpsAdd(ops, lists.size(), wait, fence_value);
+		op_items.add(num_queued++);
+	}
+
+	GpuSyncOpsIssued issueAndCheck(u64 max_wait_value)
+	{
+		StepLog log = {};
+		const GpuSyncOpsIssued issued = issue(ops, lists.size(), max_wait_value, log);
+		u32 op_idx = 0;
+		for (u32 s = 0; s < log.num_steps; s++) {
+			const GpuSyncStep& step = log.steps[s];
+			if (step.type == GPU_SYNC_STEP_EXECUTE) {
+				for (u32 l = 0; l < step.num_lists; l++) {
+					order_ok = order_ok && lists[step.first_list + l] == num_issued;
+					num_issued += 1;
+				}
+				continue;
+			}
+			order_ok = order_ok && op_idx < ops.size() && op_items[op_idx] == num_issued &&
+				ops[op_idx].fence_value == step.fence_value;
+			if (step.type == GPU_SYNC_STEP_WAIT) waits_ok = waits_ok && step.fence_value <= max_wait_value;
+			op_idx += 1;
+			num_issued += 1;
+		}
+		order_ok = order_ok && op_idx == issued.num_ops;
+
+		if (issued.num_lists != 0) lists.remove(0, issued.num_lists);
+		if (issued.num_ops != 0) op_items.remove(0, issued.num_ops);
+		syncOpsRemoveIssued(ops, issued);
+		return issued;
+	}
+};
+
+// Queues random lists, signals and waits the way the async queue does, issuing after each and
+// advancing the submitted main queue value now and then. Checks that everything is issued exactly
+// once in the order it was queued, and that no wait is issued before its value has been submitted.
+static void testIssueOrderRandom()
+{
+	constexpr u32 NUM_ITERS = 200;
+	constexpr u32 MAX_NUM_ITEMS = 64;
+	u32 rng = 1;
+	for (u32 iter = 0; iter < NUM_ITERS; iter++) {
+		TestQueue q(MAX_NUM_ITEMS);
+		u64 main_submitted = 0;
+		u64 main_queued = 0;
+		u64 async_signalled = 0;
+		const u32 num_items = 1 + lcgNext(rng) % MAX_NUM_ITEMS;
+		for (u32 i = 0; i < num_items; i++) {
+			const u32 kind = lcgNext(rng) % 8;
+			if (kind < 4) q.addList();
+			else if (kind < 6) q.addOp(false, ++async_signalled);
+			else if (kind < 7) q.addOp(true, ++main_queued); // May not have been submitted yet
+			else main_submitted = main_queued;
+			q.issueAndCheck(main_submitted);
+		}
+
+		// Everything is issued once the main queue has submitted all of its signals
+		q.issueAndCheck(main_queued);
+		TEST_CHECK(q.lists.isEmpty() && q.ops.isEmpty());
+		TEST_CHECK(q.num_issued == q.num_queued);
+		TEST_CHECK(q.order_ok);
+		TEST_CHECK(q.waits_ok);
+	}
+}
+
+i32 main()
+{
+	TEST_RUN(testIssueAll);
+	TEST_RUN(testNoLists);
+	TEST_RUN(testHeldWait);
+	TEST_RUN(testSegmentsAndContexts);
+	TEST_RUN(testIssueOrderRandom);
+	return testsResult();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdio.h>
+#include <time.h>
+
+#include <sfz.h>
+
+// Test helpers
+// ------------------------------------------------------------------------------------------------
+
+// Minimal test framework, each test executable registers its tests with TEST_RUN() from main() and
+// returns testsResult(). A failed check prints where it failed and continues with the test.
+
+inline u32 g_tests_num_failed_checks = 0;
+inline u32 g_tests_num_failed = 0;
+
+#define TEST_CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("    %s:%i: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+			g_tests_num_failed_checks += 1; \
+		} \
+	} while(0)
+
+#define TEST_RUN(test_func) testsRun(#test_func, test_func)
+
+inline void testsRun(const char* name, void(*test_func)())
+{
+	const u32 num_failed_before = g_tests_num_failed_checks;
+	printf("[ RUN  ] %s\n", name);
+	test_func();
+	const bool passed = num_failed_before == g_tests_num_failed_checks;
+	if (!passed) g_tests_num_failed += 1;
+	printf("[ %s ] %s\n", passed ? " OK " : "FAIL", name);
+}
+
+inline int testsResult()
+{
+	if (g_tests_num_failed != 0) {
+		printf("%u test(s) failed.\n", g_tests_num_failed);
+		return 1;
+	}
+	printf("All tests passed.\n");
+	return 0;
+}
+
+// Wall clock time in seconds, for benchmarks.
+inline f64 testsTimeSecs()
+{
+	timespec ts = {};
+	timespec_get(&ts, TIME_UTC);
+	return f64(ts.tv_sec) + f64(ts.tv_nsec) * 1e-9;
+}
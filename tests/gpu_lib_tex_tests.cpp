@@ -0,0 +1,272 @@
+#include "gpu_lib_tests.hpp"
+
+#include <string.h>
+
+#include <skipifzero_allocators.hpp>
+#include <skipifzero_arrays.hpp>
+
+#include <gpu_lib_tex.hpp>
+
+// Helpers
+// ------------------------------------------------------------------------------------------------
+
+static SfzAllocator g_allocator = sfz::createStandardAllocator();
+
+static const GpuFormat ALL_FORMATS[] = {
+	GPU_FORMAT_R_U8_UNORM, GPU_FORMAT_RG_U8_UNORM, GPU_FORMAT_RGBA_U8_UNORM,
+	GPU_FORMAT_R_U8, GPU_FORMAT_RG_U8, GPU_FORMAT_RGBA_U8,
+	GPU_FORMAT_R_U16, GPU_FORMAT_RG_U16, GPU_FORMAT_RGBA_U16,
+	GPU_FORMAT_R_I32, GPU_FORMAT_RG_I32, GPU_FORMAT_RGBA_I32,
+	GPU_FORMAT_R_F16, GPU_FORMAT_RG_F16, GPU_FORMAT_RGBA_F16,
+	GPU_FORMAT_R_F32, GPU_FORMAT_RG_F32, GPU_FORMAT_RGBA_F32,
+	GPU_FORMAT_BC1_UNORM, GPU_FORMAT_BC4_UNORM, GPU_FORMAT_BC5_UNORM, GPU_FORMAT_BC7_UNORM,
+};
+
+static GpuRWTexDesc relativeScaleDesc(f32 scale)
+{
+	GpuRWTexDesc desc = {};
+	desc.format = GPU_FORMAT_RGBA_U8_UNORM;
+	desc.swapchain_relative = true;
+	desc.relative_scale = scale;
+	return desc;
+}
+
+static GpuRWTexDesc relativeHeightDesc(i32 height)
+{
+	GpuRWTexDesc desc = {};
+	desc.format = GPU_FORMAT_RGBA_U8_UNORM;
+	desc.swapchain_relative = true;
+	desc.relative_fixed_height = height;
+	return desc;
+}
+
+static bool resEquals(i32x2 res, i32 x, i32 y) { return res.x == x && res.y == y; }
+
+// The swapchain state kept by gpuSwapchainPresent(), counts framebuffer resizes.
+sfz_struct(TestSwapchain) {
+	i32x2 res;
+	i32x2 fb_res;
+	u32 num_stable_presents;
+	u32 num_fb_resizes;
+};
+
+// Does what gpuSwapchainPresent() does with the window resolution, returns whether the swapchain
+// resolution (and thus swapchain relative textures) changed.
+static bool present(TestSwapchain* s, i32x2 window_res)
+{
+	const bool res_changed = swapchainResUpdate(&s->res, &s->num_stable_presents, window_res);
+	if (swapchainFbResizeDue(s->fb_res, s->res, s->num_stable_presents)) {
+		s->fb_res = s->res;
+		s->num_fb_resizes += 1;
+	}
+	return res_changed;
+}
+
+// Tests
+// ------------------------------------------------------------------------------------------------
+
+static void testFixedRes()
+{
+	GpuRWTexDesc desc = {};
+	desc.fixed_res = i32x2_init(123, 45);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(1920, 1080), &desc), 123, 45));
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(7, 3), &desc), 123, 45));
+}
+
+static void testRelativeScale()
+{
+	const i32x2 swapchain_res = i32x2_init(1920, 1080);
+	GpuRWTexDesc desc = relativeScaleDesc(1.0f);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(swapchain_res, &desc), 1920, 1080));
+	desc = relativeScaleDesc(0.5f);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(swapchain_res, &desc), 960, 540));
+	desc = relativeScaleDesc(2.0f);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(swapchain_res, &desc), 3840, 2160));
+
+	// Rounded to nearest, not truncated
+	desc = relativeScaleDesc(0.5f);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(1281, 721), &desc), 641, 361)); // 640.5, 360.5
+	desc = relativeScaleDesc(1.0f / 3.0f);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(1000, 500), &desc), 333, 167)); // 333.3, 166.7
+	desc = relativeScaleDesc(0.75f);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(1366, 767), &desc), 1025, 575)); // 1024.5, 575.25
+
+	// Never smaller than 1x1
+	desc = relativeScaleDesc(0.25f);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(1, 1), &desc), 1, 1));
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(800, 1), &desc), 200, 1));
+}
+
+static void testRelativeFixedHeight()
+{
+	GpuRWTexDesc desc = relativeHeightDesc(720);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(1920, 1080), &desc), 1280, 720));
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(1080, 1920), &desc), 405, 720));
+
+	// Width follows the aspect ratio, rounded to nearest
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(2560, 1080), &desc), 1707, 720)); // 1706.67
+	desc = relativeHeightDesc(100);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(1366, 768), &desc), 178, 100)); // 177.86
+
+	// Very tall windows still get a width of at least 1
+	desc = relativeHeightDesc(4);
+	TEST_CHECK(resEquals(calcRWTexTargetRes(i32x2_init(1, 1000), &desc), 1, 4));
+}
+
+static void testSwapchainFirstResize()
+{
+	TestSwapchain s = {};
+	TEST_CHECK(present(&s, i32x2_init(1280, 720)));
+	TEST_CHECK(resEquals(s.res, 1280, 720));
+	TEST_CHECK(resEquals(s.fb_res, 1280, 720)); // Resized immediately the first time
+	TEST_CHECK(s.num_fb_resizes == 1);
+	TEST_CHECK(!present(&s, i32x2_init(1280, 720)));
+	TEST_CHECK(s.num_fb_resizes == 1);
+}
+
+static void testSwapchainStablePresents()
+{
+	TestSwapchain s = {};
+	present(&s, i32x2_init(1280, 720));
+
+	// Dragging the window, the swapchain resolution follows but the framebuffers don't
+	for (i32 i = 1; i <= 20; i++) {
+		TEST_CHECK(present(&s, i32x2_init(1280 + i, 720)));
+		TEST_CHECK(resEquals(s.res, 1280 + i, 720));
+		TEST_CHECK(resEquals(s.fb_res, 1280, 720));
+	}
+	TEST_CHECK(s.num_fb_resizes == 1);
+
+	// Resized on the present the resolution has been unchanged for enough presents
+	for (u32 i = 0; i < GPU_SWAPCHAIN_RESIZE_NUM_STABLE_PRESENTS - 1; i++) {
+		TEST_CHECK(!present(&s, i32x2_init(1300, 720)));
+		TEST_CHECK(s.num_fb_resizes == 1);
+	}
+	TEST_CHECK(!present(&s, i32x2_init(1300, 720)));
+	TEST_CHECK(s.num_fb_resizes == 2);
+	TEST_CHECK(resEquals(s.fb_res, 1300, 720));
+
+	// Only once
+	for (u32 i = 0; i < 2 * GPU_SWAPCHAIN_RESIZE_NUM_STABLE_PRESENTS; i++) present(&s, i32x2_init(1300, 720));
+	TEST_CHECK(s.num_fb_resizes == 2);
+
+	// A change resets the count
+	for (u32 i = 0; i < GPU_SWAPCHAIN_RESIZE_NUM_STABLE_PRESENTS - 1; i++) present(&s, i32x2_init(800, 600));
+	present(&s, i32x2_init(801, 600));
+	for (u32 i = 0; i < GPU_SWAPCHAIN_RESIZE_NUM_STABLE_PRESENTS - 1; i++) present(&s, i32x2_init(801, 600));
+	TEST_CHECK(s.num_fb_resizes == 2);
+	present(&s, i32x2_init(801, 600));
+	TEST_CHECK(s.num_fb_resizes == 3);
+	TEST_CHECK(resEquals(s.fb_res, 801, 600));
+
+	// Going back to the framebuffer resolution before it's stable doesn't resize
+	present(&s, i32x2_init(900, 600));
+	present(&s, i32x2_init(801, 600));
+	for (u32 i = 0; i < 2 * GPU_SWAPCHAIN_RESIZE_NUM_STABLE_PRESENTS; i++) present(&s, i32x2_init(801, 600));
+	TEST_CHECK(s.num_fb_resizes == 3);
+}
+
+static void testTexRows()
+{
+	// Odd sizes, rows are padded to the pitch alignment
+	GpuTexRows rows = texRows(GPU_FORMAT_RGBA_U8_UNORM, i32x2_init(13, 7));
+	TEST_CHECK(rows.row_size == 52 && rows.row_pitch == 256 && rows.num_rows == 7);
+	rows = texRows(GPU_FORMAT_RGBA_F32, i32x2_init(17, 1));
+	TEST_CHECK(rows.row_size == 272 && rows.row_pitch == 512 && rows.num_rows == 1);
+	rows = texRows(GPU_FORMAT_R_U8, i32x2_init(1, 3));
+	TEST_CHECK(rows.row_size == 1 && rows.row_pitch == 256 && rows.num_rows == 3);
+
+	// Already aligned rows have no padding
+	rows = texRows(GPU_FORMAT_RGBA_U8, i32x2_init(64, 2));
+	TEST_CHECK(rows.row_size == 256 && rows.row_pitch == 256 && rows.num_rows == 2);
+
+	// Block compressed rows are rows of 4x4 blocks, partial blocks round up
+	rows = texRows(GPU_FORMAT_BC1_UNORM, i32x2_init(13, 7));
+	TEST_CHECK(rows.row_size == 4 * 8 && rows.row_pitch == 256 && rows.num_rows == 2);
+	rows = texRows(GPU_FORMAT_BC7_UNORM, i32x2_init(13, 7));
+	TEST_CHECK(rows.row_size == 4 * 16 && rows.row_pitch == 256 && rows.num_rows == 2);
+	rows = texRows(GPU_FORMAT_BC4_UNORM, i32x2_init(1, 1));
+	TEST_CHECK(rows.row_size == 8 && rows.row_pitch == 256 && rows.num_rows == 1);
+	rows = texRows(GPU_FORMAT_BC5_UNORM, i32x2_init(128, 8));
+	TEST_CHECK(rows.row_size == 512 && rows.row_pitch == 512 && rows.num_rows == 2);
+
+	// Same total size as the block compression encoder produces
+	for (GpuFormat format : ALL_FORMATS) {
+		if (!gpuFormatIsBlockCompressed(format)) continue;
+		rows = texRows(format, i32x2_init(37, 11));
+		TEST_CHECK(rows.row_size * rows.num_rows == gpuBCCalcSizeBytes(format, i32x2_init(37, 11)));
+	}
+}
+
+// Packs tightly packed rows to a pitched buffer (as uploads do) and back (as downloads do), for
+// every format and a few odd resolutions.
+static void testCopyRows()
+{
+	const i32x2 resolutions[] = {
+		i32x2_init(1, 1), i32x2_init(3, 5), i32x2_init(13, 7), i32x2_init(64, 4), i32x2_init(65, 3) };
+	SfzArray<u8> packed, pitched, unpacked;
+	packed.init(4096, &g_allocator, sfz_dbg(""));
+	pitched.init(4096, &g_allocator, sfz_dbg(""));
+	unpacked.init(4096, &g_allocator, sfz_dbg(""));
+	for (GpuFormat format : ALL_FORMATS) {
+		for (i32x2 res : resolutions) {
+			const GpuTexRows rows = texRows(format, res);
+			const u32 packed_size = rows.row_size * rows.num_rows;
+			packed.clear();
+			for (u32 i = 0; i < packed_size; i++) packed.add(u8(i * 31 + 7));
+			pitched.clear();
+			pitched.add(u8(0xAB), rows.row_pitch * rows.num_rows);
+			unpacked.clear();
+			unpacked.add(u8(0), packed_size);
+
+			copyRows(pitched.data(), rows.row_pitch, packed.data(), rows.row_size, rows.row_size, rows.num_rows);
+			bool rows_correct = true;
+			bool padding_untouched = true;
+			for (u32 y = 0; y < rows.num_rows; y++) {
+				const u8* row = pitched.data() + y * rows.row_pitch;
+				if (memcmp(row, packed.data() + y * rows.row_size, rows.row_size) != 0) rows_correct = false;
+				for (u32 x = rows.row_size; x < rows.row_pitch; x++) {
+					if (row[x] != 0xAB) padding_untouched = false;
+				}
+			}
+			TEST_CHECK(rows_correct);
+			TEST_CHECK(padding_untouched);
+
+			copyRows(unpacked.data(), rows.row_size, pitched.data(), rows.row_pitch, rows.row_size, rows.num_rows);
+			TEST_CHECK(memcmp(unpacked.data(), packed.data(), packed_size) == 0);
+		}
+	}
+}
+
+static void testCopyRowsPitches()
+{
+	// Both sides pitched, with a pitch that isn't a power of two
+	u8 src[3 * 300];
+	for (u32 i = 0; i < sizeof(src); i++) src[i] = u8(i);
+	u8 dst[3 * 260];
+	memset(dst, 0xCD, sizeof(dst));
+	copyRows(dst, 260, src, 300, 255, 3);
+	for (u32 y = 0; y < 3; y++) {
+		TEST_CHECK(memcmp(dst + y * 260, src + y * 300, 255) == 0);
+		TEST_CHECK(dst[y * 260 + 255] == 0xCD && dst[y * 260 + 259] == 0xCD);
+	}
+
+	// No rows and empty rows do nothing
+	memset(dst, 0xCD, sizeof(dst));
+	copyRows(dst, 260, src, 300, 255, 0);
+	copyRows(dst, 0, src, 0, 0, 3);
+	TEST_CHECK(dst[0] == 0xCD);
+}
+
+i32 main()
+{
+	TEST_RUN(testFixedRes);
+	TEST_RUN(testRelativeScale);
+	TEST_RUN(testRelativeFixedHeight);
+	TEST_RUN(testSwapchainFirstResize);
+	TEST_RUN(testSwapchainStablePresents);
+	TEST_RUN(testTexRows);
+	TEST_RUN(testCopyRows);
+	TEST_RUN(testCopyRowsPitches);
+	return testsResult();
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sfz.h>
+#include <sfz_defer.hpp>
+#include <skipifzero_allocators.hpp>
+#include <skipifzero_arrays.hpp>
+#include <skipifzero_strings.hpp>
+
+#include <gpu_lib.h>
+#include <gpu_lib_kernel_bundle.hpp>
+
+// gpu_lib_kernelc
+// ------------------------------------------------------------------------------------------------
+
+// Compiles all kernels listed in a manifest into a kernel bundle, see gpuKernelBundleWrite().
+//
+// Usage: gpu_lib_kernelc <manifest> <output bundle> [output header]
+//
+// If an output header is specified, the launch parameter layouts of all kernels are written to it
+// as C++ structs (see gpuParamLayoutToCppHeader()), to be validated against the C++ launch params
+// structs using GPU_PARAMS_STATIC_ASSERT_SIZE() and GPU_PARAMS_STATIC_ASSERT_MEMBER(). All
+// permutations of a kernel must have the same layout.
+//
+// The manifest has one kernel per line, paths are relative to the working directory:
+//
+//     # Comment
+//     kernel <name> <path> [DEFINE ...]
+//     permutations <name> <path> [AXIS:num_values ...] [DEFINE ...]
+//
+// A "permutations" line adds every permutation, each axis is set as "-DAXIS=<value>" and must have
+// at least 2 values and a name of at most GPU_KERNEL_AXIS_NAME_MAX_LEN characters. Their keys are packed in the same way as gpuKernelPermutationsGetKey(), as
+// long as the axes are listed in the same order as in the GpuKernelPermutationsDesc.
+
+// Reads back the bundle and writes the launch parameter layouts of all kernels to a C++ header.
+static bool writeHeader(
+	const char* header_path,
+	const char* manifest_path,
+	const char* bundle_path,
+	const SfzArray<GpuManifestKernel>& kernels,
+	SfzAllocator* allocator)
+{
+	FILE* bundle_file = fopen(bundle_path, "rb");
+	if (bundle_file == nullptr) return false;
+	fseek(bundle_file, 0, SEEK_END);
+	const u64 bundle_size = u64(ftell(bundle_file));
+	fseek(bundle_file, 0, SEEK_SET);
+	SfzArray<u8> bundle;
+	bundle.init(u32(bundle_size), allocator, sfz_dbg("bundle"));
+	bundle.add(u8(0), u32(bundle_size));
+	const u64 num_read = fread(bundle.data(), 1, bundle_size, bundle_file);
+	fclose(bundle_file);
+	if (num_read != bundle_size) return false;
+
+	FILE* header = fopen(header_path, "w");
+	if (header == nullptr) return false;
+	sfz_defer[=]() { fclose(header); };
+	fprintf(header, "// Generated by gpu_lib_kernelc from \"%s\", do not edit.\n\n", manifest_path);
+	fprintf(header, "#pragma once\n\n#include <gpu_lib.h>\n");
+
+	SfzArray<char> text;
+	text.init(4096, allocator, sfz_dbg("text"));
+	for (u32 i = 0; i < kernels.size(); i++) {
+		const GpuManifestKernel& kernel = kernels[i];
+		if (i > 0 && strcmp(kernels[i - 1].name.str, kernel.name.str) == 0) continue;
+
+		GpuLaunchParamLayout layout = {};
+		if (!gpuKernelBundleGetParamLayout(
+			bundle.data(), bundle_size, kernel.name.str, kernel.permutation_key, &layout)) {
+			return false;
+		}
+
+		// Permutations of the same kernel follow each other, they must all match the first one
+		for (u32 j = i + 1; j < kernels.size() && strcmp(kernels[j].name.str, kernel.name.str) == 0; j++) {
+			GpuLaunchParamLayout other = {};
+			gpuKernelBundleGetParamLayout(bundle.data(), bundle_size, kernel.name.str, kernels[j].permutation_key, &other);
+			if (memcmp(&layout, &other, sizeof(GpuLaunchParamLayout)) != 0) {
+				printf("[gpu_lib_kernelc]: Permutation %u of \"%s\" has a different launch parameter layout.\n",
+					kernels[j].permutation_key, kernel.name.str);
+				return false;
+			}
+		}
+
+		const u32 num_chars = gpuParamLayoutToCppHeader(&layout, kernel.name.str, nullptr, 0);
+		text.clear();
+		text.add('\0', num_chars + 1);
+		gpuParamLayoutToCppHeader(&layout, kernel.name.str, text.data(), text.size());
+		fprintf(header, "\n%s", text.data());
+	}
+	return true;
+}
+
+i32 main(i32 argc, char* argv[])
+{
+	if (argc != 3 && argc != 4) {
+		printf("Usage: gpu_lib_kernelc <manifest> <output bundle> [output header]\n");
+		return 1;
+	}
+	const char* manifest_path = argv[1];
+	const char* bundle_path = argv[2];
+	const char* header_path = argc == 4 ? argv[3] : nullptr;
+
+	SfzAllocator allocator = sfz::createStandardAllocator();
+
+	// Parse manifest
+	FILE* manifest = fopen(manifest_path, "r");
+	if (manifest == nullptr) {
+		printf("[gpu_lib_kernelc]: Failed to open manifest \"%s\".\n", manifest_path);
+		return 1;
+	}
+	SfzArray<GpuManifestKernel> kernels;
+	kernels.init(256, &allocator, sfz_dbg("kernels"));
+	{
+		sfz_defer[=]() { fclose(manifest); };
+		char line_buffer[2048] = {};
+		u32 line_idx = 1;
+		while (fgets(line_buffer, sizeof(line_buffer), manifest) != nullptr) {
+			GpuManifestLine line = {};
+			if (!manifestParseLine(line_buffer, line_idx, &line)) return 1;
+			if (line.type.str[0] != '\0' && !manifestAddKernels(line, line_idx, kernels)) return 1;
+			line_idx += 1;
+		}
+	}
+
+	// Descs point into the kernels array, which is not modified from here on
+	SfzArray<GpuKernelDesc> descs;
+	descs.init(kernels.size(), &allocator, sfz_dbg("descs"));
+	SfzArray<u32> permutation_keys;
+	permutation_keys.init(kernels.size(), &allocator, sfz_dbg("permutation_keys"));
+	for (GpuManifestKernel& kernel : kernels) {
+		for (u32 i = 0; i < kernel.num_defines; i++) kernel.define_ptrs[i] = kernel.defines[i].str;
+		GpuKernelDesc& desc = descs.add();
+		desc.name = kernel.name.str;
+		desc.path = kernel.path.str;
+		desc.num_defines = kernel.num_defines;
+		desc.defines = kernel.define_ptrs;
+		permutation_keys.add(kernel.permutation_key);
+	}
+
+	printf("[gpu_lib_kernelc]: Compiling %u kernels from \"%s\"...\n", descs.size(), manifest_path);
+	if (!gpuKernelBundleWrite(bundle_path, descs.data(), permutation_keys.data(), descs.size(), &allocator)) {
+		printf("[gpu_lib_kernelc]: Failed to write bundle \"%s\".\n", bundle_path);
+		return 1;
+	}
+	printf("[gpu_lib_kernelc]: Wrote bundle \"%s\".\n", bundle_path);
+
+	if (header_path != nullptr) {
+		if (!writeHeader(header_path, manifest_path, bundle_path, kernels, &allocator)) {
+			printf("[gpu_lib_kernelc]: Failed to write header \"%s\".\n", header_path);
+			return 1;
+		}
+		printf("[gpu_lib_kernelc]: Wrote header \"%s\".\n", header_path);
+	}
+	return 0;
+}